@@ -42,6 +42,7 @@ import com.generalrobotix.ui.view.vsensor.Camera_impl;
 
 import jp.go.aist.hrp.simulator.*;
 import jp.go.aist.hrp.simulator.ModelLoaderPackage.AABBdataType;
+import jp.go.aist.hrp.simulator.ModelLoaderPackage.AABBTreeLayout;
 import jp.go.aist.hrp.simulator.ModelLoaderPackage.ModelLoadOption;
 import jp.go.aist.hrp.simulator.ModelLoaderPackage.ModelLoaderException;
 
@@ -1558,6 +1559,7 @@ public class GrxModelItem extends GrxBaseItem implements Manipulatable {
             option.readImage = false;
             option.AABBtype = AABBdataType.AABB_NUM;
             option.AABBdata = depth;
+            option.AABBtreeLayout = AABBTreeLayout.AABB_TREE_NORMAL;
 
             return mloader.getBodyInfoEx(getURL(false), option);
     	}catch(Exception e){
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2008, AIST, the University of Tokyo and General Robotix Inc.
+ * All rights reserved. This program is made available under the terms of the
+ * Eclipse Public License v1.0 which accompanies this distribution, and is
+ * available at http://www.eclipse.org/legal/epl-v10.html
+ * Contributors:
+ * National Institute of Advanced Industrial Science and Technology (AIST)
+ */
+
+#ifndef OPENHRP_AABB_TREE_ACCESSOR_H_INCLUDED
+#define OPENHRP_AABB_TREE_ACCESSOR_H_INCLUDED
+
+#include "Opcode/Opcode.h"
+
+namespace hrp {
+
+    /**
+       A node of an optimized tree of OPCODE.
+       A primitive which is a child of a node of a no-leaf tree does not have
+       a node of its own. It is referred by the null node and its index.
+    */
+    struct TreeNodeRef
+    {
+        const void* node;
+        udword primitive;
+    };
+
+    /**
+       @if jp
+       OPCODE の四種類の木 (通常、リーフなし、量子化、量子化かつリーフなし) を
+       同じ方法で辿るためのアクセサ。
+       @else
+       Gives uniform access to the nodes of the four layouts of the optimized
+       trees of OPCODE so that a traversal can be written once for all of them
+       and for the pairs of trees of different layouts.
+       The boxes of a quantized tree are dequantized and the boxes of the
+       primitives of a no-leaf tree are computed from their triangles.
+       @endif
+    */
+    class AABBTreeAccessor
+    {
+      public:
+
+        explicit AABBTreeAccessor(const Opcode::Model& model)
+            : mesh(model.GetMeshInterface()) {
+
+            const Opcode::AABBOptimizedTree* tree = model.GetTree();
+            if(model.HasLeafNodes()){
+                if(model.IsQuantized()){
+                    layout = QUANTIZED;
+                    const Opcode::AABBQuantizedTree* t = static_cast<const Opcode::AABBQuantizedTree*>(tree);
+                    rootNode = t->GetNodes();
+                    centerCoeff = t->mCenterCoeff;
+                    extentsCoeff = t->mExtentsCoeff;
+                } else {
+                    layout = NORMAL;
+                    rootNode = static_cast<const Opcode::AABBCollisionTree*>(tree)->GetNodes();
+                }
+            } else {
+                if(model.IsQuantized()){
+                    layout = QUANTIZED_NO_LEAF;
+                    const Opcode::AABBQuantizedNoLeafTree* t = static_cast<const Opcode::AABBQuantizedNoLeafTree*>(tree);
+                    rootNode = t->GetNodes();
+                    centerCoeff = t->mCenterCoeff;
+                    extentsCoeff = t->mExtentsCoeff;
+                } else {
+                    layout = NO_LEAF;
+                    rootNode = static_cast<const Opcode::AABBNoLeafTree*>(tree)->GetNodes();
+                }
+            }
+        }
+
+        TreeNodeRef root() const {
+            TreeNodeRef ref;
+            ref.node = rootNode;
+            ref.primitive = 0;
+            return ref;
+        }
+
+        /**
+           @return true if the node is a leaf or a primitive of a no-leaf tree
+        */
+        bool isPrimitive(const TreeNodeRef& ref) const {
+            switch(layout){
+            case NORMAL:
+                return static_cast<const Opcode::AABBCollisionNode*>(ref.node)->IsLeaf();
+            case QUANTIZED:
+                return static_cast<const Opcode::AABBQuantizedNode*>(ref.node)->IsLeaf();
+            default:
+                return ref.node == 0;
+            }
+        }
+
+        udword getPrimitive(const TreeNodeRef& ref) const {
+            switch(layout){
+            case NORMAL:
+                return static_cast<const Opcode::AABBCollisionNode*>(ref.node)->GetPrimitive();
+            case QUANTIZED:
+                return static_cast<const Opcode::AABBQuantizedNode*>(ref.node)->GetPrimitive();
+            default:
+                return ref.primitive;
+            }
+        }
+
+        TreeNodeRef getPos(const TreeNodeRef& ref) const {
+            TreeNodeRef child;
+            child.primitive = 0;
+            switch(layout){
+            case NORMAL:
+                child.node = static_cast<const Opcode::AABBCollisionNode*>(ref.node)->GetPos();
+                break;
+            case QUANTIZED:
+                child.node = static_cast<const Opcode::AABBQuantizedNode*>(ref.node)->GetPos();
+                break;
+            case NO_LEAF:
+                setNoLeafChild(child, static_cast<const Opcode::AABBNoLeafNode*>(ref.node)->mPosData);
+                break;
+            case QUANTIZED_NO_LEAF:
+                setNoLeafChild(child, static_cast<const Opcode::AABBQuantizedNoLeafNode*>(ref.node)->mPosData);
+                break;
+            }
+            return child;
+        }
+
+        TreeNodeRef getNeg(const TreeNodeRef& ref) const {
+            TreeNodeRef child;
+            child.primitive = 0;
+            switch(layout){
+            case NORMAL:
+                child.node = static_cast<const Opcode::AABBCollisionNode*>(ref.node)->GetNeg();
+                break;
+            case QUANTIZED:
+                child.node = static_cast<const Opcode::AABBQuantizedNode*>(ref.node)->GetNeg();
+                break;
+            case NO_LEAF:
+                setNoLeafChild(child, static_cast<const Opcode::AABBNoLeafNode*>(ref.node)->mNegData);
+                break;
+            case QUANTIZED_NO_LEAF:
+                setNoLeafChild(child, static_cast<const Opcode::AABBQuantizedNoLeafNode*>(ref.node)->mNegData);
+                break;
+            }
+            return child;
+        }
+
+        /**
+           gets the box of a node in the local coordinate of the model
+        */
+        void getBox(const TreeNodeRef& ref, IceMaths::Point& out_center, IceMaths::Point& out_extents) const {
+            if(!ref.node){
+                getPrimitiveBox(ref.primitive, out_center, out_extents);
+                return;
+            }
+            switch(layout){
+            case NORMAL:
+                out_center = static_cast<const Opcode::AABBCollisionNode*>(ref.node)->mAABB.mCenter;
+                out_extents = static_cast<const Opcode::AABBCollisionNode*>(ref.node)->mAABB.mExtents;
+                break;
+            case NO_LEAF:
+                out_center = static_cast<const Opcode::AABBNoLeafNode*>(ref.node)->mAABB.mCenter;
+                out_extents = static_cast<const Opcode::AABBNoLeafNode*>(ref.node)->mAABB.mExtents;
+                break;
+            case QUANTIZED:
+                dequantize(static_cast<const Opcode::AABBQuantizedNode*>(ref.node)->mAABB, out_center, out_extents);
+                break;
+            case QUANTIZED_NO_LEAF:
+                dequantize(static_cast<const Opcode::AABBQuantizedNoLeafNode*>(ref.node)->mAABB, out_center, out_extents);
+                break;
+            }
+        }
+
+      private:
+
+        enum Layout { NORMAL, NO_LEAF, QUANTIZED, QUANTIZED_NO_LEAF };
+
+        Layout layout;
+        const void* rootNode;
+        const Opcode::MeshInterface* mesh;
+        IceMaths::Point centerCoeff;
+        IceMaths::Point extentsCoeff;
+
+        static void setNoLeafChild(TreeNodeRef& child, EXWORD data) {
+            if(data & 1){
+                child.node = 0;
+                child.primitive = udword(data >> 1);
+            } else {
+                child.node = reinterpret_cast<const void*>(data);
+            }
+        }
+
+        void dequantize(const Opcode::QuantizedAABB& box, IceMaths::Point& out_center, IceMaths::Point& out_extents) const {
+            out_center.Set(float(box.mCenter[0]) * centerCoeff.x,
+                           float(box.mCenter[1]) * centerCoeff.y,
+                           float(box.mCenter[2]) * centerCoeff.z);
+            out_extents.Set(float(box.mExtents[0]) * extentsCoeff.x,
+                            float(box.mExtents[1]) * extentsCoeff.y,
+                            float(box.mExtents[2]) * extentsCoeff.z);
+        }
+
+        void getPrimitiveBox(udword primitive, IceMaths::Point& out_center, IceMaths::Point& out_extents) const {
+            Opcode::VertexPointers vp;
+            mesh->GetTriangle(vp, primitive);
+            IceMaths::Point min = *vp.Vertex[0];
+            IceMaths::Point max = *vp.Vertex[0];
+            min.Min(*vp.Vertex[1]);
+            max.Max(*vp.Vertex[1]);
+            min.Min(*vp.Vertex[2]);
+            max.Max(*vp.Vertex[2]);
+            out_center = (max + min) * 0.5f;
+            out_extents = (max - min) * 0.5f;
+        }
+    };
+}
+
+#endif
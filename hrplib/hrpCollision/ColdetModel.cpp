@@ -13,6 +13,10 @@
 #include <iostream>
 #include "ColdetModel.h"
 #include "ColdetModelSharedDataSet.h"
+#include "ColdetModelCache.h"
+#include "ColdetModelSharedDataSetRegistry.h"
+#include "ColdetPointCloud.h"
+#include "AABBTreeAccessor.h"
 
 #include "Opcode/Opcode.h"
 
@@ -26,8 +30,6 @@ ColdetModel::ColdetModel()
     dataSet = new ColdetModelSharedDataSet();
     isValid_ = false;
     initialize();
-    dataSet->neighbor.clear();
-    vertex2TriangleMap.clear();
 }
 
 
@@ -37,12 +39,16 @@ ColdetModel::ColdetModel(const ColdetModel& org)
 {
     dataSet = org.dataSet;
     initialize();
+    // a copy is placed at the same position, and the primitive offset
+    // from the link is a part of the shape
+    *transform = *org.transform;
+    *pTransform = *org.pTransform;
 }
 
 
 void ColdetModel::initialize()
 {
-    dataSet->refCounter++;
+    ColdetModelSharedDataSetRegistry::instance().ref(dataSet);
 
     transform = new IceMaths::Matrix4x4();
     transform->Identity();
@@ -55,16 +61,17 @@ void ColdetModel::initialize()
 ColdetModelSharedDataSet::ColdetModelSharedDataSet()
 {
     refCounter = 0;
+    isRegistered = false;
+    contentHash = 0;
     pType = ColdetModel::SP_MESH;
+    treeLayout = ColdetModel::AABB_TREE_NORMAL;
     AABBTreeMaxDepth=0;
 }    
 
 
 ColdetModel::~ColdetModel()
 {
-    if(--dataSet->refCounter <= 0){
-        delete dataSet;
-    }
+    ColdetModelSharedDataSetRegistry::instance().unref(dataSet);
     delete pTransform;
     delete transform;
 }
@@ -72,6 +79,7 @@ ColdetModel::~ColdetModel()
 
 void ColdetModel::setNumVertices(int n)
 {
+    detachDataSet();
     dataSet->vertices.resize(n);
 }
 
@@ -84,8 +92,8 @@ int ColdetModel::getNumVertices() const
 
 void ColdetModel::setNumTriangles(int n)
 {
+    detachDataSet();
     dataSet->triangles.resize(n);
-    initNeighbor(n);
 }
 
 
@@ -97,12 +105,14 @@ int ColdetModel::getNumTriangles() const
         
 void ColdetModel::setVertex(int index, float x, float y, float z)
 {
+    detachDataSet();
     dataSet->vertices[index].Set(x, y, z);
 }
 
 
 void ColdetModel::addVertex(float x, float y, float z)
 {
+    detachDataSet();
     dataSet->vertices.push_back(IceMaths::Point(x, y, z));
 }
 
@@ -118,11 +128,11 @@ void ColdetModel::getVertex(int index, float& x, float& y, float& z) const
         
 void ColdetModel::setTriangle(int index, int v1, int v2, int v3)
 {
+    detachDataSet();
     udword* mVRef = dataSet->triangles[index].mVRef;
     mVRef[0] = v1;
     mVRef[1] = v2;
     mVRef[2] = v3;
-    setNeighborTriangle(index, v1, v2, v3);
 }
 
 void ColdetModel::getTriangle(int index, int& v1, int& v2, int& v3) const
@@ -136,13 +146,75 @@ void ColdetModel::getTriangle(int index, int& v1, int& v2, int& v3) const
 
 void ColdetModel::addTriangle(int v1, int v2, int v3)
 {
+    detachDataSet();
     dataSet->triangles.push_back(IceMaths::IndexedTriangle(v1, v2, v3));
 }
 
 
+/**
+   @if jp
+   共有レジストリに登録済みのデータセットは変更できないので、
+   形状を変更する前に自分専用の複製に置き換える。
+   @endif
+*/
+void ColdetModel::detachDataSet()
+{
+    if(!dataSet->isRegistered){
+        return;
+    }
+    ColdetModelSharedDataSetRegistry& registry = ColdetModelSharedDataSetRegistry::instance();
+    ColdetModelSharedDataSet* org = dataSet;
+    dataSet = new ColdetModelSharedDataSet();
+    dataSet->vertices = org->vertices;
+    dataSet->triangles = org->triangles;
+    dataSet->pType = org->pType;
+    dataSet->pParams = org->pParams;
+    dataSet->treeLayout = org->treeLayout;
+    registry.ref(dataSet);
+    registry.unref(org);
+    isValid_ = false;
+}
+
+
+void ColdetModel::setAABBTreeLayout(AABBTreeLayout layout)
+{
+    if(layout == dataSet->treeLayout){
+        return;
+    }
+    detachDataSet();
+    dataSet->treeLayout = layout;
+    isValid_ = false;
+}
+
+
+ColdetModel::AABBTreeLayout ColdetModel::getAABBTreeLayout() const
+{
+    return dataSet->treeLayout;
+}
+
+
 void ColdetModel::build()
 {
+    if(dataSet->isRegistered){
+        isValid_ = true;
+        return;
+    }
+
+    ColdetModelSharedDataSetRegistry& registry = ColdetModelSharedDataSetRegistry::instance();
+
+    // a model of the same shape which has already been built is shared
+    ColdetModelSharedDataSet* shared = registry.find(dataSet);
+    if(shared){
+        registry.unref(dataSet);
+        dataSet = shared;
+        isValid_ = true;
+        return;
+    }
+
     isValid_ = dataSet->build();
+    if(isValid_){
+        dataSet = registry.add(dataSet);
+    }
     /*
     unsigned int maxDepth = dataSet->getAABBTreeDepth();
     for(unsigned int i=0; i<maxDepth; i++){
@@ -170,16 +242,29 @@ bool ColdetModelSharedDataSet::build()
         
         OPCC.mIMesh = &iMesh;
         
-        OPCC.mNoLeaf = false;
-        OPCC.mQuantized = false;
+        // a no-leaf tree of a single triangle would have no node
+        OPCC.mNoLeaf = ((treeLayout == ColdetModel::AABB_TREE_NO_LEAF ||
+                         treeLayout == ColdetModel::AABB_TREE_QUANTIZED_NO_LEAF) &&
+                        triangles.size() > 1);
+        OPCC.mQuantized = (treeLayout == ColdetModel::AABB_TREE_QUANTIZED ||
+                           treeLayout == ColdetModel::AABB_TREE_QUANTIZED_NO_LEAF);
         OPCC.mKeepOriginal = false;
-        
-        model.Build(OPCC);
-        if(model.GetTree()){
-            AABBTreeMaxDepth = computeDepth(((Opcode::AABBCollisionTree*)model.GetTree())->GetNodes(), 0, -1) + 1;
-            for(int i=0; i<AABBTreeMaxDepth; i++)
-                for(int j=0; j<i; j++)
-                    numBBMap.at(i) += numLeafMap.at(j);
+
+        ColdetModelCache& cache = ColdetModelCache::instance();
+        if(!cache.load(this, OPCC)){
+            computeNeighbors();
+            AABBTreeMaxDepth = 0;
+            numBBMap.clear();
+            numLeafMap.clear();
+            model.Build(OPCC);
+            if(model.GetTree()){
+                AABBTreeAccessor tree(model);
+                AABBTreeMaxDepth = computeDepth(tree, tree.root(), 0, -1) + 1;
+                for(int i=0; i<AABBTreeMaxDepth; i++)
+                    for(int j=0; j<i; j++)
+                        numBBMap.at(i) += numLeafMap.at(j);
+                cache.save(this);
+            }
         }
         result = true;
     }
@@ -203,31 +288,40 @@ int ColdetModel::getAABBmaxNum(){
 }
 
 
+/**
+   @if jp
+   木の配置によらず、リーフなしの木の三角形はリーフノードと同じ深さの箱として扱う。
+   @endif
+*/
 static void getBoundingBoxDataSub
-(const Opcode::AABBCollisionNode* node, unsigned int currentDepth, unsigned int depth, std::vector<Vector3>& out_data){
-    if(currentDepth == depth || node->IsLeaf() ){
-        const IceMaths::Point& p = node->mAABB.mCenter;
+(const AABBTreeAccessor& tree, const TreeNodeRef& node, unsigned int currentDepth, unsigned int depth, std::vector<Vector3>& out_data){
+    bool isLeaf = tree.isPrimitive(node);
+    if(currentDepth == depth || isLeaf ){
+        IceMaths::Point p, q;
+        tree.getBox(node, p, q);
         out_data.push_back(Vector3(p.x, p.y, p.z));
-        const IceMaths::Point& q = node->mAABB.mExtents;
         out_data.push_back(Vector3(q.x, q.y, q.z));
     }
     currentDepth++;
     if(currentDepth > depth) return;
-    if(!node->IsLeaf()){
-        getBoundingBoxDataSub(node->GetPos(), currentDepth, depth, out_data);
-        getBoundingBoxDataSub(node->GetNeg(), currentDepth, depth, out_data);
+    if(!isLeaf){
+        getBoundingBoxDataSub(tree, tree.getPos(node), currentDepth, depth, out_data);
+        getBoundingBoxDataSub(tree, tree.getNeg(node), currentDepth, depth, out_data);
     }
 }
 
 
 void ColdetModel::getBoundingBoxData(const int depth, std::vector<Vector3>& out_data){
-    const Opcode::AABBCollisionNode* rootNode=((Opcode::AABBCollisionTree*)dataSet->model.GetTree())->GetNodes();
     out_data.clear();
-    getBoundingBoxDataSub(rootNode, 0, depth, out_data);
+    if(!dataSet->model.GetTree()){
+        return;
+    }
+    AABBTreeAccessor tree(dataSet->model);
+    getBoundingBoxDataSub(tree, tree.root(), 0, depth, out_data);
 }
 
 
-int ColdetModelSharedDataSet::computeDepth(const Opcode::AABBCollisionNode* node, int currentDepth, int max )
+int ColdetModelSharedDataSet::computeDepth(const AABBTreeAccessor& tree, const TreeNodeRef& node, int currentDepth, int max )
 {
     /*
 	cout << "depth= " << currentDepth << " ";
@@ -245,10 +339,10 @@ int ColdetModelSharedDataSet::computeDepth(const Opcode::AABBCollisionNode* node
     }
     numBBMap.at(currentDepth)++;
 
-    if(!node->IsLeaf()){
+    if(!tree.isPrimitive(node)){
         currentDepth++;
-        max = computeDepth(node->GetPos(), currentDepth, max);
-        max = computeDepth(node->GetNeg(), currentDepth, max);
+        max = computeDepth(tree, tree.getPos(node), currentDepth, max);
+        max = computeDepth(tree, tree.getNeg(node), currentDepth, max);
     }else
         numLeafMap.at(currentDepth)++;
 
@@ -274,6 +368,7 @@ void ColdetModel::setPosition(const double* R, const double* p)
 
 void ColdetModel::setPrimitiveType(PrimitiveType ptype)
 {
+    detachDataSet();
     dataSet->pType = ptype;
 }
 
@@ -284,6 +379,7 @@ ColdetModel::PrimitiveType ColdetModel::getPrimitiveType() const
 
 void ColdetModel::setNumPrimitiveParams(unsigned int nparam)
 {
+    detachDataSet();
     dataSet->pParams.resize(nparam);
 }
 
@@ -291,6 +387,8 @@ bool ColdetModel::setPrimitiveParam(unsigned int index, float value)
 {
     if (index >= dataSet->pParams.size()) return false;
 
+    detachDataSet();
+
     dataSet->pParams[index] = value;
     return true;
 }
@@ -311,6 +409,25 @@ void ColdetModel::setPrimitivePosition(const double* R, const double* p)
                     (float)p[0], (float)p[1], (float)p[2], 1.0f);
 }
 
+void ColdetModel::getPrimitivePosition(double* R, double* p) const
+{
+    for (int i=0; i<3; i++){
+        for (int j=0; j<3; j++){
+            R[i*3+j] = pTransform->m[j][i];
+        }
+        p[i] = pTransform->m[3][i];
+    }
+}
+
+boost::uint64_t ColdetModel::getShapeHash() const
+{
+    // the hash of a registered data set has been calculated when it was looked up
+    if(dataSet->isRegistered){
+        return dataSet->contentHash;
+    }
+    return ColdetModelSharedDataSetRegistry::calcContentHash(dataSet);
+}
+
 double ColdetModel::computeDistanceWithRay(const double *point, 
                                            const double *dir)
 {
@@ -348,13 +465,167 @@ bool ColdetModel::checkCollisionWithPointCloud(const std::vector<Vector3> &i_clo
     return false;
 }
 
-void ColdetModel::setNeighborTriangle(int triangle, int vertex0, int vertex1, int vertex2){
-    setNeighborTriangleSub(triangle, vertex0, vertex1);
-    setNeighborTriangleSub(triangle, vertex1, vertex2);
-    setNeighborTriangleSub(triangle, vertex2, vertex0);
+
+namespace {
+
+    /**
+       Ericson, Real-Time Collision Detection, 5.1.5
+    */
+    double squaredDistanceToTriangle(const Vector3& p, const Vector3& a, const Vector3& b, const Vector3& c)
+    {
+        const Vector3 ab(b - a);
+        const Vector3 ac(c - a);
+        const Vector3 ap(p - a);
+        double d1 = ab.dot(ap);
+        double d2 = ac.dot(ap);
+        if(d1 <= 0.0 && d2 <= 0.0){
+            return ap.squaredNorm();
+        }
+        const Vector3 bp(p - b);
+        double d3 = ab.dot(bp);
+        double d4 = ac.dot(bp);
+        if(d3 >= 0.0 && d4 <= d3){
+            return bp.squaredNorm();
+        }
+        double vc = d1 * d4 - d3 * d2;
+        if(vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0){
+            return (ap - (d1 / (d1 - d3)) * ab).squaredNorm();
+        }
+        const Vector3 cp(p - c);
+        double d5 = ab.dot(cp);
+        double d6 = ac.dot(cp);
+        if(d6 >= 0.0 && d5 <= d6){
+            return cp.squaredNorm();
+        }
+        double vb = d5 * d2 - d1 * d6;
+        if(vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0){
+            return (ap - (d2 / (d2 - d6)) * ac).squaredNorm();
+        }
+        double va = d3 * d6 - d5 * d4;
+        if(va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0){
+            return (bp - ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b)).squaredNorm();
+        }
+        double denom = 1.0 / (va + vb + vc);
+        return (ap - (vb * denom) * ab - (vc * denom) * ac).squaredNorm();
+    }
+
+    /**
+       @if jp
+       メッシュの木とポイントクラウドの木を同時に辿り、重なる葉どうしで三角形と球を調べる。
+       判定はメッシュの局所座標で行う。
+       @endif
+    */
+    class PointCloudCollider
+    {
+      public:
+        PointCloudCollider(const Opcode::Model& model, const IceMaths::Matrix4x4& transform, const ColdetPointCloud& cloud)
+            : tree(model), mesh(model.GetMeshInterface()), cloud(cloud), nodes(cloud.nodes()) {
+            for(int i=0; i < 3; ++i){
+                for(int j=0; j < 3; ++j){
+                    Rt(i, j) = transform.m[i][j];
+                }
+                p[i] = transform.m[3][i];
+            }
+            absRt = Rt.cwiseAbs();
+            squaredRadius = cloud.radius() * cloud.radius();
+        }
+
+        bool collide() {
+            return collide(tree.root(), 0);
+        }
+
+      private:
+        AABBTreeAccessor tree;
+        const Opcode::MeshInterface* mesh;
+        const ColdetPointCloud& cloud;
+        const std::vector<ColdetPointCloud::Node>& nodes;
+        Matrix33 Rt; // rotation from the world frame to the mesh frame
+        Matrix33 absRt;
+        Vector3 p;
+        double squaredRadius;
+
+        bool collide(const TreeNodeRef& meshNode, int cloudNodeIndex) {
+
+            const ColdetPointCloud::Node& cloudNode = nodes[cloudNodeIndex];
+
+            IceMaths::Point center, extents;
+            tree.getBox(meshNode, center, extents);
+            const Vector3 c(center.x, center.y, center.z);
+            const Vector3 e(extents.x, extents.y, extents.z);
+
+            const Vector3 d(Rt * (cloudNode.center - p) - c);
+            const Vector3 cloudExtents(absRt * cloudNode.extents);
+            for(int i=0; i < 3; ++i){
+                if(fabs(d[i]) > e[i] + cloudExtents[i]){
+                    return false;
+                }
+            }
+
+            bool isMeshLeaf = tree.isPrimitive(meshNode);
+            bool isCloudLeaf = (cloudNode.child < 0);
+
+            if(isMeshLeaf && isCloudLeaf){
+                return collideTrianglePoints(tree.getPrimitive(meshNode), cloudNode);
+            }
+            if(isCloudLeaf || (!isMeshLeaf && e.maxCoeff() > cloudNode.extents.maxCoeff())){
+                return (collide(tree.getPos(meshNode), cloudNodeIndex) ||
+                        collide(tree.getNeg(meshNode), cloudNodeIndex));
+            }
+            return (collide(meshNode, cloudNode.child) ||
+                    collide(meshNode, cloudNode.child + 1));
+        }
+
+        bool collideTrianglePoints(udword triangle, const ColdetPointCloud::Node& cloudNode) {
+            Opcode::VertexPointers vp;
+            mesh->GetTriangle(vp, triangle);
+            Vector3 v[3];
+            for(int i=0; i < 3; ++i){
+                v[i] << vp.Vertex[i]->x, vp.Vertex[i]->y, vp.Vertex[i]->z;
+            }
+            const std::vector<Vector3>& points = cloud.points();
+            for(int i=cloudNode.begin; i < cloudNode.end; ++i){
+                const Vector3 q(Rt * (points[i] - p));
+                if(squaredDistanceToTriangle(q, v[0], v[1], v[2]) <= squaredRadius){
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+}
+
+
+bool ColdetModel::checkCollisionWithPointCloud(const ColdetPointCloud& cloud)
+{
+    if(cloud.empty() || !dataSet->model.GetTree()){
+        return false;
+    }
+    PointCloudCollider collider(dataSet->model, *transform, cloud);
+    return collider.collide();
+}
+
+/**
+   @if jp
+   辺を共有する三角形を求めて隣接三角形表 neighbor を作る。
+   @endif
+*/
+void ColdetModelSharedDataSet::computeNeighbors()
+{
+    triangle3 init;
+    init.triangles[0] = init.triangles[1] = init.triangles[2] = -1;
+    neighbor.assign(triangles.size(), init);
+
+    std::map<VertexIndexPair, int> vertex2TriangleMap;
+    for(size_t i=0; i < triangles.size(); ++i){
+        const udword* mVRef = triangles[i].mVRef;
+        setNeighborTriangleSub(vertex2TriangleMap, i, mVRef[0], mVRef[1]);
+        setNeighborTriangleSub(vertex2TriangleMap, i, mVRef[1], mVRef[2]);
+        setNeighborTriangleSub(vertex2TriangleMap, i, mVRef[2], mVRef[0]);
+    }
 }
 
-void ColdetModel::setNeighborTriangleSub(int triangle, int vertex0, int vertex1){
+void ColdetModelSharedDataSet::setNeighborTriangleSub
+(std::map<VertexIndexPair, int>& vertex2TriangleMap, int triangle, int vertex0, int vertex1){
     VertexIndexPair indexPair(vertex1, vertex0);
     std::map<VertexIndexPair, int>::iterator it = vertex2TriangleMap.find(indexPair);
     if(it==vertex2TriangleMap.end()){
@@ -368,23 +639,15 @@ void ColdetModel::setNeighborTriangleSub(int triangle, int vertex0, int vertex1)
     setNeighbor(triangle, it->second);
 }
 
-void ColdetModel::initNeighbor(int n){
-    for(int i=0; i<n; i++){
-        triangle3 init;
-        init.triangles[0] = init.triangles[1] = init.triangles[2] = -1;
-        dataSet->neighbor.push_back(init);
-    }
-}
-
-void ColdetModel::setNeighbor(int triangle0, int triangle1 ){
-    triangle3* t0 = &(dataSet->neighbor.at(triangle0));
+void ColdetModelSharedDataSet::setNeighbor(int triangle0, int triangle1 ){
+    triangle3* t0 = &(neighbor.at(triangle0));
     for(int i=0; i<3; i++){
         if(t0->triangles[i] == -1){
             t0->triangles[i] = triangle1;
             break;
         }
     }
-    t0 = &(dataSet->neighbor.at(triangle1));
+    t0 = &(neighbor.at(triangle1));
     for(int i=0; i<3; i++){
         if(t0->triangles[i] == -1){
             t0->triangles[i] = triangle0;
@@ -392,4 +655,3 @@ void ColdetModel::setNeighbor(int triangle0, int triangle1 ){
         }
     }
 }
-
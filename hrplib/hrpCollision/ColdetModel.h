@@ -19,6 +19,7 @@
 #include <hrpUtil/Referenced.h>
 #include <vector>
 #include <map>
+#include <boost/cstdint.hpp>
 
 
 namespace IceMaths {
@@ -28,6 +29,7 @@ namespace IceMaths {
 namespace hrp {
 
     class ColdetModelSharedDataSet;
+    class ColdetPointCloud;
     class VertexIndexPair
     {
     public :
@@ -56,6 +58,15 @@ namespace hrp {
       public:
         enum PrimitiveType { SP_MESH, SP_BOX, SP_CYLINDER, SP_CONE, SP_SPHERE, SP_PLANE };
 
+        /**
+           Node layouts of the tree of bounding boxes.
+           A no-leaf tree stores the triangles in their parent nodes and has
+           about half the nodes of a normal tree. A quantized tree stores the
+           boxes with 16 bit integers. They save memory at the cost of looser
+           boxes and slower queries, and suit large static meshes.
+        */
+        enum AABBTreeLayout { AABB_TREE_NORMAL, AABB_TREE_NO_LEAF, AABB_TREE_QUANTIZED, AABB_TREE_QUANTIZED_NO_LEAF };
+
         /**
          * @brief constructor
          */
@@ -64,7 +75,8 @@ namespace hrp {
         /**
          * @brief copy constructor
          *
-         * Shape information stored in dataSet is shared with org
+         * Shape information stored in dataSet is shared with org.
+         * The position and the primitive offset are copied.
          */
         ColdetModel(const ColdetModel& org);
 
@@ -144,10 +156,26 @@ namespace hrp {
 
         void getTriangle(int index, int& out_v1, int& out_v2, int& out_v3) const;
 
+        /**
+         * @brief set the node layout of the tree of bounding boxes
+         *
+         * The layout takes effect when build() is called next time.
+         * @param layout node layout. AABB_TREE_NORMAL is the default.
+         */
+        void setAABBTreeLayout(AABBTreeLayout layout);
+
+        /**
+         * @brief get the node layout of the tree of bounding boxes
+         * @return node layout
+         */
+        AABBTreeLayout getAABBTreeLayout() const;
+
         /**
          * @brief build tree of bounding boxes to accelerate collision check
          *
-         * This method must be called before doing collision check
+         * This method must be called before doing collision check.
+         * If a model of the same shape has already been built in this process,
+         * its tree is shared instead of building a new one.
          */
         void build();
 
@@ -211,6 +239,20 @@ namespace hrp {
          * @param p position relative to link (length = 3)
          */
         void setPrimitivePosition(const double* R, const double* p);
+
+        /**
+         * @brief get position and orientation of primitive
+         * @param R orientation relative to link (length = 9)
+         * @param p position relative to link (length = 3)
+         */
+        void getPrimitivePosition(double* R, double* p) const;
+
+        /**
+         * @brief get a hash of the shape
+         * @return 64 bit hash of the vertices, triangles, primitive type and
+         * primitive parameters, which is equal for the models of the same shape
+         */
+        boost::uint64_t getShapeHash() const;
         
         /**
          * @brief compute distance between a point and this mesh along ray
@@ -229,6 +271,16 @@ namespace hrp {
         bool checkCollisionWithPointCloud(const std::vector<Vector3> &i_cloud,
                                           double i_radius);
 
+        /**
+         * @brief check collision between this triangle mesh and an indexed point cloud
+         *
+         * The tree of this mesh and the tree of the cloud are traversed
+         * together, and only the points near the triangles are tested.
+         * @param cloud point cloud with the radius of spheres assigned to the points
+         * @return true if colliding, false otherwise
+         */
+        bool checkCollisionWithPointCloud(const ColdetPointCloud& cloud);
+
         void getBoundingBoxData(const int depth, std::vector<Vector3>& out_boxes);
         
         int getAABBTreeDepth();
@@ -241,8 +293,7 @@ namespace hrp {
          * @brief common part of constuctors
          */
         void initialize();
-        void setNeighborTriangle(int triangle, int vertex0, int vertex1, int vertex2);
-        void initNeighbor(int n);
+        void detachDataSet();
 
         
         ColdetModelSharedDataSet* dataSet;
@@ -250,10 +301,6 @@ namespace hrp {
         IceMaths::Matrix4x4* pTransform; ///< transform of primitive
         std::string name_;
         bool isValid_;
-        std::map<VertexIndexPair, int> vertex2TriangleMap;
-
-        void setNeighborTriangleSub(int triangle, int vertex0, int vertex1);
-        void setNeighbor(int triangle0, int triangle1);
 
         friend class ColdetModelPair;
     };
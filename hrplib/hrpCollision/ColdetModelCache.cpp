@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2008, AIST, the University of Tokyo and General Robotix Inc.
+ * All rights reserved. This program is made available under the terms of the
+ * Eclipse Public License v1.0 which accompanies this distribution, and is
+ * available at http://www.eclipse.org/legal/epl-v10.html
+ * Contributors:
+ * National Institute of Advanced Industrial Science and Technology (AIST)
+ */
+
+#include "ColdetModelSharedDataSet.h"
+#include "ColdetModelCache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#include <boost/format.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <hrpUtil/Fnv1aHash.h>
+
+using namespace std;
+using namespace boost;
+using namespace hrp;
+
+namespace {
+
+    const char cacheMagic[8] = { 'H', 'R', 'P', 'C', 'M', 'C', '\0', '\0' };
+    const udword cacheVersion = 1;
+
+    /**
+       Building the tree of a mesh smaller than this is faster than reading a file
+    */
+    const size_t minNumTrianglesToCache = 256;
+
+    /**
+       The node records, the neighbor table and the two depth maps follow
+       this header in this order.
+    */
+    struct CacheHeader
+    {
+        char magic[8];
+        udword version;
+        udword nodeRecordSize;
+        udword numVertices;
+        udword numTriangles;
+        udword numNodes;
+        udword maxDepth;
+    };
+
+    /**
+       A node of Opcode::AABBCollisionTree whose pointers are replaced with indices.
+       data is (index of the positive child) << 1 for an internal node and
+       (primitive index << 1) | 1 for a leaf as well as AABBCollisionNode::mData.
+    */
+    struct NodeRecord
+    {
+        Opcode::CollisionAABB aabb;
+        udword data;
+        udword parent;
+    };
+}
+
+
+ColdetModelCache& ColdetModelCache::instance()
+{
+    static ColdetModelCache cache;
+    return cache;
+}
+
+
+ColdetModelCache::ColdetModelCache()
+{
+    const char* dir = getenv("OPENHRP_MODEL_CACHE_DIR");
+    if(dir){
+        setDirectory(dir);
+    }
+}
+
+
+void ColdetModelCache::setDirectory(const std::string& directory)
+{
+    directory_ = directory;
+    if(!directory_.empty()){
+        char last = directory_[directory_.size() - 1];
+        if(last != '/' && last != '\\'){
+            directory_ += '/';
+        }
+    }
+}
+
+
+bool ColdetModelCache::isCacheable(ColdetModelSharedDataSet* dataSet) const
+{
+    return isEnabled() && dataSet->triangles.size() >= minNumTrianglesToCache;
+}
+
+
+/**
+   @if jp
+   頂点と三角形の内容の 64bit FNV-1a ハッシュ値からキャッシュファイルのパスを決める。
+   @endif
+*/
+std::string ColdetModelCache::cacheFilePath(ColdetModelSharedDataSet* dataSet) const
+{
+    Fnv1aHash hash;
+    udword numVertices = dataSet->vertices.size();
+    udword numTriangles = dataSet->triangles.size();
+    hash.add(&numVertices, sizeof(numVertices));
+    hash.add(&numTriangles, sizeof(numTriangles));
+    if(numVertices > 0){
+        hash.add(&dataSet->vertices[0], numVertices * sizeof(IceMaths::Point));
+    }
+    if(numTriangles > 0){
+        hash.add(&dataSet->triangles[0], numTriangles * sizeof(IceMaths::IndexedTriangle));
+    }
+
+    return str(format("%1%%2$016x.cmc") % directory_ % hash.value());
+}
+
+
+/**
+   @if jp
+   キャッシュが有効であれば dataSet の木と隣接三角形表、深さの情報を復元して true を返す。
+   @else
+   Restores the tree, the neighbor table and the depth maps of dataSet
+   from the cache entry of its mesh.
+   @return false if there is no valid entry.
+   @endif
+*/
+bool ColdetModelCache::load(ColdetModelSharedDataSet* dataSet, const Opcode::OPCODECREATE& create)
+{
+    using namespace boost::interprocess;
+
+    if(!isCacheable(dataSet) || create.mNoLeaf || create.mQuantized){
+        return false;
+    }
+
+    string path(cacheFilePath(dataSet));
+
+    struct stat statbuff;
+    if( stat( path.c_str(), &statbuff ) != 0 || statbuff.st_size <= (off_t)sizeof(CacheHeader) ){
+        return false;
+    }
+
+    const udword numTriangles = dataSet->triangles.size();
+    Opcode::AABBCollisionNode* nodes = 0;
+    udword numNodes = 0;
+
+    try {
+        file_mapping file(path.c_str(), read_only);
+        mapped_region region(file, read_only);
+        const char* data = static_cast<const char*>(region.get_address());
+        size_t size = region.get_size();
+
+        const CacheHeader* header = reinterpret_cast<const CacheHeader*>(data);
+        if(memcmp(header->magic, cacheMagic, sizeof(cacheMagic)) != 0 ||
+           header->version != cacheVersion ||
+           header->nodeRecordSize != sizeof(NodeRecord) ||
+           header->numVertices != dataSet->vertices.size() ||
+           header->numTriangles != numTriangles ||
+           header->numNodes != numTriangles * 2 - 1){
+            return false;
+        }
+        numNodes = header->numNodes;
+        const udword maxDepth = header->maxDepth;
+
+        size_t expectedSize =
+            sizeof(CacheHeader) + numNodes * sizeof(NodeRecord) +
+            numTriangles * sizeof(triangle3) + maxDepth * sizeof(int) * 2;
+        if(size != expectedSize){
+            return false;
+        }
+
+        const NodeRecord* records = reinterpret_cast<const NodeRecord*>(data + sizeof(CacheHeader));
+        const triangle3* neighbor = reinterpret_cast<const triangle3*>(records + numNodes);
+        const int* numBB = reinterpret_cast<const int*>(neighbor + numTriangles);
+        const int* numLeaf = numBB + maxDepth;
+
+        // a broken file must not produce pointers out of the node array
+        for(udword i=0; i < numNodes; ++i){
+            const NodeRecord& record = records[i];
+            if(record.parent >= numNodes){
+                return false;
+            }
+            if(record.data & 1){
+                if((record.data >> 1) >= numTriangles){
+                    return false;
+                }
+            } else if((record.data >> 1) + 1 >= numNodes){
+                return false;
+            }
+        }
+
+        nodes = new Opcode::AABBCollisionNode[numNodes];
+        for(udword i=0; i < numNodes; ++i){
+            const NodeRecord& record = records[i];
+            Opcode::AABBCollisionNode& node = nodes[i];
+            node.mAABB = record.aabb;
+            if(record.data & 1){
+                node.mData = record.data;
+            } else {
+                node.mData = (EXWORD)&nodes[record.data >> 1];
+            }
+            node.mB = &nodes[record.parent];
+        }
+
+        dataSet->neighbor.assign(neighbor, neighbor + numTriangles);
+        dataSet->AABBTreeMaxDepth = maxDepth;
+        dataSet->numBBMap.assign(numBB, numBB + maxDepth);
+        dataSet->numLeafMap.assign(numLeaf, numLeaf + maxDepth);
+    }
+    catch(const interprocess_exception& ex){
+        delete [] nodes;
+        return false;
+    }
+
+    Opcode::AABBCollisionTree* tree = new Opcode::AABBCollisionTree;
+    tree->SetNodes(nodes, numNodes);
+
+    return dataSet->model.Build(create, tree);
+}
+
+
+/**
+   @if jp
+   構築し終えた dataSet の木と隣接三角形表、深さの情報をキャッシュファイルに書き出す。
+   @endif
+*/
+bool ColdetModelCache::save(ColdetModelSharedDataSet* dataSet)
+{
+    if(!isCacheable(dataSet) || !dataSet->model.HasLeafNodes() || dataSet->model.IsQuantized()){
+        return false;
+    }
+
+    const Opcode::AABBCollisionTree* tree =
+        static_cast<const Opcode::AABBCollisionTree*>(dataSet->model.GetTree());
+    if(!tree || !tree->GetNodes()){
+        return false;
+    }
+
+    const Opcode::AABBCollisionNode* nodes = tree->GetNodes();
+    const udword numNodes = tree->GetNbNodes();
+    const udword numTriangles = dataSet->triangles.size();
+
+    if(dataSet->neighbor.size() != numTriangles ||
+       dataSet->numBBMap.size() != (size_t)dataSet->AABBTreeMaxDepth ||
+       dataSet->numLeafMap.size() != (size_t)dataSet->AABBTreeMaxDepth){
+        return false;
+    }
+
+    vector<NodeRecord> records(numNodes);
+    for(udword i=0; i < numNodes; ++i){
+        const Opcode::AABBCollisionNode& node = nodes[i];
+        NodeRecord& record = records[i];
+        record.aabb = node.mAABB;
+        if(node.IsLeaf()){
+            record.data = node.mData;
+        } else {
+            record.data = (node.GetPos() - nodes) << 1;
+        }
+        record.parent = node.GetB() - nodes;
+    }
+
+    CacheHeader header;
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.nodeRecordSize = sizeof(NodeRecord);
+    header.numVertices = dataSet->vertices.size();
+    header.numTriangles = numTriangles;
+    header.numNodes = numNodes;
+    header.maxDepth = dataSet->AABBTreeMaxDepth;
+
+    string path(cacheFilePath(dataSet));
+    // the address distinguishes the data sets saved concurrently by the threads of a process
+#ifdef _WIN32
+    string tmpPath(str(format("%1%.%2%.%3%.tmp") % path % _getpid() % (void*)dataSet));
+#else
+    string tmpPath(str(format("%1%.%2%.%3%.tmp") % path % getpid() % (void*)dataSet));
+#endif
+    {
+        ofstream ofs(tmpPath.c_str(), ios::out | ios::binary | ios::trunc);
+        if(!ofs){
+            cout << "cannot write the collision model cache " << tmpPath << endl;
+            return false;
+        }
+        ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        ofs.write(reinterpret_cast<const char*>(&records[0]), numNodes * sizeof(NodeRecord));
+        ofs.write(reinterpret_cast<const char*>(&dataSet->neighbor[0]), numTriangles * sizeof(triangle3));
+        if(header.maxDepth > 0){
+            ofs.write(reinterpret_cast<const char*>(&dataSet->numBBMap[0]), header.maxDepth * sizeof(int));
+            ofs.write(reinterpret_cast<const char*>(&dataSet->numLeafMap[0]), header.maxDepth * sizeof(int));
+        }
+        if(!ofs){
+            ofs.close();
+            remove(tmpPath.c_str());
+            return false;
+        }
+    }
+
+    if(rename(tmpPath.c_str(), path.c_str()) != 0){
+        remove(path.c_str());
+        if(rename(tmpPath.c_str(), path.c_str()) != 0){
+            remove(tmpPath.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
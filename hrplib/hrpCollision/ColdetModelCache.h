@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2008, AIST, the University of Tokyo and General Robotix Inc.
+ * All rights reserved. This program is made available under the terms of the
+ * Eclipse Public License v1.0 which accompanies this distribution, and is
+ * available at http://www.eclipse.org/legal/epl-v10.html
+ * Contributors:
+ * National Institute of Advanced Industrial Science and Technology (AIST)
+ */
+
+#ifndef OPENHRP_COLDET_MODEL_CACHE_H_INCLUDED
+#define OPENHRP_COLDET_MODEL_CACHE_H_INCLUDED
+
+#include <string>
+#include <boost/cstdint.hpp>
+#include "ColdetModel.h"
+#include "Opcode/Opcode.h"
+
+namespace hrp {
+
+    class ColdetModelSharedDataSet;
+
+    /**
+       @if jp
+       構築済みの OPCODE の木と隣接三角形表、深さごとのバウンディングボックス数を
+       ディスクに保存し、同じメッシュの次回以降の build() で再利用するためのキャッシュ。
+       @else
+       On-disk cache of the data built by ColdetModelSharedDataSet::build().
+
+       A cache entry stores the nodes of the AABB collision tree, the neighbor
+       triangle table and the per-depth bounding box counts of a mesh. It is
+       keyed by a hash of the vertices and triangles, and it is memory-mapped
+       when it is read. Small meshes are always built from scratch because
+       building them is cheaper than opening a file.
+
+       The cache is enabled by setting the directory to a non-empty path.
+       The initial directory is taken from the OPENHRP_MODEL_CACHE_DIR
+       environment variable, which is shared with the cache of the model loader.
+       @endif
+    */
+    class ColdetModelCache
+    {
+      public:
+
+        static ColdetModelCache& instance();
+
+        void setDirectory(const std::string& directory);
+        const std::string& directory() const { return directory_; }
+        bool isEnabled() const { return !directory_.empty(); }
+
+        bool load(ColdetModelSharedDataSet* dataSet, const Opcode::OPCODECREATE& create);
+        bool save(ColdetModelSharedDataSet* dataSet);
+
+      private:
+
+        ColdetModelCache();
+
+        std::string directory_;
+
+        bool isCacheable(ColdetModelSharedDataSet* dataSet) const;
+        std::string cacheFilePath(ColdetModelSharedDataSet* dataSet) const;
+    };
+}
+
+#endif
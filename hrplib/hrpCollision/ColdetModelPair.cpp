@@ -15,12 +15,36 @@
 #include <math.h>
 #include "ColdetModelPair.h"
 #include "ColdetModelSharedDataSet.h"
+#include "AABBTreeAccessor.h"
 #include "CollisionPairInserter.h"
 #include "Opcode/Opcode.h"
 #include "SSVTreeCollider.h"
+#include "ConvexCollider.h"
 
 using namespace hrp;
 
+namespace {
+
+    bool isConvexPrimitiveType(int primitiveType)
+    {
+        return (primitiveType == ColdetModel::SP_BOX ||
+                primitiveType == ColdetModel::SP_CYLINDER ||
+                primitiveType == ColdetModel::SP_CONE);
+    }
+
+    void getWorldBoundingBox(const Opcode::Model& model, const IceMaths::Matrix4x4& transform,
+                             IceMaths::Point& out_center, IceMaths::Point& out_extents)
+    {
+        AABBTreeAccessor tree(model);
+        IceMaths::Point center, extents;
+        tree.getBox(tree.root(), center, extents);
+        TransformPoint4x3(out_center, center, transform);
+        out_extents.x = fabsf(transform.m[0][0]) * extents.x + fabsf(transform.m[1][0]) * extents.y + fabsf(transform.m[2][0]) * extents.z;
+        out_extents.y = fabsf(transform.m[0][1]) * extents.x + fabsf(transform.m[1][1]) * extents.y + fabsf(transform.m[2][1]) * extents.z;
+        out_extents.z = fabsf(transform.m[0][2]) * extents.x + fabsf(transform.m[1][2]) * extents.y + fabsf(transform.m[2][2]) * extents.z;
+    }
+}
+
 
 ColdetModelPair::ColdetModelPair()
 {
@@ -85,6 +109,12 @@ std::vector<collision_data>& ColdetModelPair::detectCollisionsSub(bool detectAll
     else if (pt0 == ColdetModel::SP_SPHERE || pt1 == ColdetModel::SP_SPHERE) {
         detected = detectSphereMeshCollisions(detectAllContacts);
     }
+    else if (isConvexPrimitiveType(pt0) && isConvexPrimitiveType(pt1)) {
+        detected = detectConvexPrimitiveCollisions(detectAllContacts);
+    }
+    else if (pt0 == ColdetModel::SP_BOX || pt1 == ColdetModel::SP_BOX) {
+        detected = detectBoxMeshCollisions(detectAllContacts);
+    }
     else {
         detected = detectMeshMeshCollisions(detectAllContacts);
     }
@@ -167,7 +197,8 @@ bool ColdetModelPair::detectMeshMeshCollisions(bool detectAllContacts)
         if(colCache.Model0->HasSingleNode() || colCache.Model1->HasSingleNode())
             return result;
 
-        Opcode::AABBTreeCollider collider;
+        // the trees may have different layouts
+        SSVTreeCollider collider;
         collider.setCollisionPairInserter(collisionPairInserter);
         
         if(!detectAllContacts){
@@ -177,7 +208,7 @@ bool ColdetModelPair::detectMeshMeshCollisions(bool detectAllContacts)
         bool isOk = collider.Collide(colCache, models[1]->transform, models[0]->transform);
 		
 		if (!isOk)
-			std::cerr << "AABBTreeCollider::Collide() failed" << std::endl;
+			std::cerr << "SSVTreeCollider::Collide() failed" << std::endl;
 		
 		result = collider.GetContactStatus();
         
@@ -566,6 +597,171 @@ bool ColdetModelPair::detectPlaneCylinderCollisions(bool detectAllContacts) {
 }
 
 
+/**
+   @if jp
+   モデル index のプリミティブをワールド座標の凸形状として取得する。
+   パラメータが足りない場合や、面の一部が無い円柱・円錐の場合は false を返す。
+   @else
+   Gets the primitive of the model as a convex primitive in the world frame.
+   The scale of the primitive transform is applied to its size.
+   @return false if the parameters are missing or the primitive is not a
+   solid, e.g. a cylinder without caps.
+   @endif
+*/
+bool ColdetModelPair::getConvexPrimitive(int index, ConvexPrimitive& out_primitive)
+{
+    ColdetModel* model = models[index].get();
+    IceMaths::Matrix4x4 T = (*(model->pTransform)) * (*(model->transform));
+
+    Vector3 p(T[3][0], T[3][1], T[3][2]);
+    Matrix33 R;
+    Vector3 scale;
+    for(int i=0; i < 3; ++i){
+        Vector3 axis(T[i][0], T[i][1], T[i][2]);
+        scale[i] = axis.norm();
+        if(scale[i] <= 0.0){
+            return false;
+        }
+        R.col(i) = axis / scale[i];
+    }
+
+    float param[5] = { 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+
+    switch(model->getPrimitiveType()){
+
+    case ColdetModel::SP_BOX:
+        for(int i=0; i < 3; ++i){
+            if(!model->getPrimitiveParam(i, param[i])){
+                return false;
+            }
+        }
+        out_primitive.setBox(p, R, Vector3(param[0] * scale[0], param[1] * scale[1], param[2] * scale[2]) / 2.0);
+        return true;
+
+    case ColdetModel::SP_CYLINDER:
+        // radius, height, top, bottom and side
+        if(!model->getPrimitiveParam(0, param[0]) || !model->getPrimitiveParam(1, param[1])){
+            return false;
+        }
+        for(int i=2; i < 5; ++i){
+            model->getPrimitiveParam(i, param[i]);
+            if(param[i] == 0.0f){
+                return false;
+            }
+        }
+        out_primitive.setCylinder(p, R, param[0] * scale[0], param[1] * scale[1] / 2.0);
+        return true;
+
+    case ColdetModel::SP_CONE:
+        // bottom radius, height, bottom and side
+        if(!model->getPrimitiveParam(0, param[0]) || !model->getPrimitiveParam(1, param[1])){
+            return false;
+        }
+        for(int i=2; i < 4; ++i){
+            model->getPrimitiveParam(i, param[i]);
+            if(param[i] == 0.0f){
+                return false;
+            }
+        }
+        out_primitive.setCone(p, R, param[0] * scale[0], param[1] * scale[1] / 2.0);
+        return true;
+
+    default:
+        break;
+    }
+
+    return false;
+}
+
+
+/**
+   @if jp
+   直方体、円柱、円錐どうしの接触を、三角形メッシュを使わずに解析的に求める。
+   @endif
+*/
+bool ColdetModelPair::detectConvexPrimitiveCollisions(bool detectAllContacts)
+{
+    if(!models[0]->isValid() || !models[1]->isValid()){
+        return false;
+    }
+
+    ConvexPrimitive primitive0, primitive1;
+    if(!getConvexPrimitive(0, primitive0) || !getConvexPrimitive(1, primitive1)){
+        return detectMeshMeshCollisions(detectAllContacts);
+    }
+
+    return collideConvexPrimitives(primitive0, primitive1, collisionPairInserter->collisions());
+}
+
+
+/**
+   @if jp
+   直方体の外接球に触れる三角形を SphereCollider で集め、
+   それぞれの三角形と直方体の接触を解析的に求める。
+   @endif
+*/
+bool ColdetModelPair::detectBoxMeshCollisions(bool detectAllContacts)
+{
+    if(!models[0]->isValid() || !models[1]->isValid()){
+        return false;
+    }
+
+    int boxIndex = (models[0]->getPrimitiveType() == ColdetModel::SP_BOX) ? 0 : 1;
+    ColdetModelPtr mesh = models[1 - boxIndex];
+
+    ConvexPrimitive box;
+    if(!getConvexPrimitive(boxIndex, box)){
+        return detectMeshMeshCollisions(detectAllContacts);
+    }
+
+    const Vector3& c = box.center();
+    IceMaths::Sphere boundingSphere(IceMaths::Point(c[0], c[1], c[2]), box.boundingRadius());
+
+    Opcode::SphereCache colCache;
+    Opcode::SphereCollider collider;
+
+    if(!collider.Collide(colCache, boundingSphere, mesh->dataSet->model, 0, mesh->transform)){
+        std::cerr << "SphereCollider::Collide() failed" << std::endl;
+        return false;
+    }
+    if(!collider.GetContactStatus()){
+        return false;
+    }
+
+    int numTouchedPrims = collider.GetNbTouchedPrimitives();
+    const udword* touchedPrims = collider.GetTouchedPrimitives();
+
+    std::vector<collision_data>& cdata = collisionPairInserter->collisions();
+    ConvexPrimitive triangle;
+
+    for(int i=0; i < numTouchedPrims; ++i){
+        int vertexIndex[3];
+        Vector3 vertex[3];
+        mesh->getTriangle(touchedPrims[i], vertexIndex[0], vertexIndex[1], vertexIndex[2]);
+        for(int j=0; j < 3; ++j){
+            float x, y, z;
+            IceMaths::Point v;
+            mesh->getVertex(vertexIndex[j], x, y, z);
+            IceMaths::TransformPoint4x3(v, IceMaths::Point(x, y, z), *(mesh->transform));
+            vertex[j] = Vector3(v.x, v.y, v.z);
+        }
+        triangle.setTriangle(vertex[0], vertex[1], vertex[2]);
+        if(collideTriangleBox(triangle, box, cdata) && !detectAllContacts){
+            break;
+        }
+    }
+
+    // the normals point from the mesh to the box
+    if(boxIndex == 0){
+        for(size_t i=0; i < cdata.size(); ++i){
+            cdata[i].n_vector *= -1;
+        }
+    }
+
+    return !cdata.empty();
+}
+
+
 double ColdetModelPair::computeDistance(double *point0, double *point1)
 {
     if(models[0]->isValid() && models[1]->isValid()){
@@ -623,6 +819,29 @@ double ColdetModelPair::computeDistance(int& triangle0, double* point0, int& tri
 }
 
 
+double ColdetModelPair::computeBoundingBoxDistance()
+{
+    if(models[0]->isValid() && models[1]->isValid() &&
+       models[0]->dataSet->model.GetTree() && models[1]->dataSet->model.GetTree()){
+
+        IceMaths::Point c0, e0, c1, e1;
+        getWorldBoundingBox(models[0]->dataSet->model, *models[0]->transform, c0, e0);
+        getWorldBoundingBox(models[1]->dataSet->model, *models[1]->transform, c1, e1);
+
+        double d2 = 0.0;
+        for(int i=0; i < 3; ++i){
+            double gap = fabs(c0[i] - c1[i]) - (e0[i] + e1[i]);
+            if(gap > 0.0){
+                d2 += gap * gap;
+            }
+        }
+        return sqrt(d2);
+    }
+
+    return -1;
+}
+
+
 bool ColdetModelPair::detectIntersection()
 {
     if(models[0]->isValid() && models[1]->isValid()){
@@ -26,6 +26,8 @@
 
 namespace hrp {
 
+    class ConvexPrimitive;
+
     class HRP_COLLISION_EXPORT ColdetModelPair : public Referenced
     {
       public:
@@ -64,6 +66,15 @@ namespace hrp {
         */
         double computeDistance(int& out_triangle0, double* out_point0, int& out_triangle1, double* out_point1);
 
+        /**
+           @brief compute the distance between the bounding boxes of the two models
+
+           The boxes are the root boxes of the AABB trees aligned to the world axes.
+           This is a lower bound of computeDistance() that is much cheaper to compute.
+           @return the distance, or -1 if a model is not built
+        */
+        double computeBoundingBoxDistance();
+
         bool detectIntersection();
 
         double tolerance() const { return tolerance_; }
@@ -91,6 +102,9 @@ namespace hrp {
 		bool detectSphereMeshCollisions(bool detectAllContacts);
         bool detectPlaneCylinderCollisions(bool detectAllContacts);
         bool detectPlaneMeshCollisions(bool detectAllContacts);
+        bool detectConvexPrimitiveCollisions(bool detectAllContacts);
+        bool detectBoxMeshCollisions(bool detectAllContacts);
+        bool getConvexPrimitive(int index, ConvexPrimitive& out_primitive);
 
         ColdetModelPtr models[2];
         double tolerance_;
@@ -17,11 +17,16 @@
 #include "ColdetModel.h"
 #include "Opcode/Opcode.h"
 #include <vector>
+#include <map>
+#include <boost/cstdint.hpp>
 
 using namespace std;
 using namespace hrp;
 
 namespace hrp {
+     class AABBTreeAccessor;
+     struct TreeNodeRef;
+
      struct triangle3 {
         int triangles[3];
      };
@@ -44,6 +49,8 @@ namespace hrp {
         ColdetModel::PrimitiveType pType;
         std::vector<float> pParams;
 
+        ColdetModel::AABBTreeLayout treeLayout;
+
         std::vector<triangle3> neighbor;
 
         int getAABBTreeDepth() {
@@ -61,12 +68,19 @@ namespace hrp {
 
       private:
         int refCounter;
+        bool isRegistered;
+        boost::uint64_t contentHash;
         int AABBTreeMaxDepth;
         std::vector<int> numBBMap;
         std::vector<int> numLeafMap;
-        int computeDepth(const Opcode::AABBCollisionNode* node, int currentDepth, int max );
+        int computeDepth(const AABBTreeAccessor& tree, const TreeNodeRef& node, int currentDepth, int max );
+        void computeNeighbors();
+        void setNeighborTriangleSub(std::map<VertexIndexPair, int>& vertex2TriangleMap, int triangle, int vertex0, int vertex1);
+        void setNeighbor(int triangle0, int triangle1);
 
         friend class ColdetModel;
+        friend class ColdetModelCache;
+        friend class ColdetModelSharedDataSetRegistry;
     };
 }
 
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2008, AIST, the University of Tokyo and General Robotix Inc.
+ * All rights reserved. This program is made available under the terms of the
+ * Eclipse Public License v1.0 which accompanies this distribution, and is
+ * available at http://www.eclipse.org/legal/epl-v10.html
+ * Contributors:
+ * National Institute of Advanced Industrial Science and Technology (AIST)
+ */
+
+#include "ColdetModelSharedDataSetRegistry.h"
+#include "ColdetModelSharedDataSet.h"
+
+#include <cstring>
+#include <hrpUtil/Fnv1aHash.h>
+
+using namespace std;
+using namespace hrp;
+
+namespace {
+
+    typedef boost::detail::lightweight_mutex::scoped_lock ScopedLock;
+
+    template <class T>
+    bool isSameVector(const std::vector<T>& v1, const std::vector<T>& v2)
+    {
+        if(v1.size() != v2.size()){
+            return false;
+        }
+        return v1.empty() || memcmp(&v1[0], &v2[0], v1.size() * sizeof(T)) == 0;
+    }
+
+    bool isSameShape(const ColdetModelSharedDataSet* d1, const ColdetModelSharedDataSet* d2)
+    {
+        return (d1->pType == d2->pType &&
+                d1->treeLayout == d2->treeLayout &&
+                isSameVector(d1->pParams, d2->pParams) &&
+                isSameVector(d1->triangles, d2->triangles) &&
+                isSameVector(d1->vertices, d2->vertices));
+    }
+}
+
+
+ColdetModelSharedDataSetRegistry& ColdetModelSharedDataSetRegistry::instance()
+{
+    static ColdetModelSharedDataSetRegistry registry;
+    return registry;
+}
+
+
+void ColdetModelSharedDataSetRegistry::ref(ColdetModelSharedDataSet* dataSet)
+{
+    ScopedLock lock(mutex);
+    dataSet->refCounter++;
+}
+
+
+/**
+   @if jp
+   参照カウントを減らし、0 になればレジストリから外して削除する。
+   @endif
+*/
+void ColdetModelSharedDataSetRegistry::unref(ColdetModelSharedDataSet* dataSet)
+{
+    {
+        ScopedLock lock(mutex);
+        if(--dataSet->refCounter > 0){
+            return;
+        }
+        if(dataSet->isRegistered){
+            pair<HashToDataSetMap::iterator, HashToDataSetMap::iterator> range =
+                dataSets.equal_range(dataSet->contentHash);
+            for(HashToDataSetMap::iterator p = range.first; p != range.second; ++p){
+                if(p->second == dataSet){
+                    dataSets.erase(p);
+                    break;
+                }
+            }
+            dataSet->isRegistered = false;
+        }
+    }
+    delete dataSet;
+}
+
+
+ColdetModelSharedDataSet* ColdetModelSharedDataSetRegistry::findSub(ColdetModelSharedDataSet* dataSet)
+{
+    pair<HashToDataSetMap::iterator, HashToDataSetMap::iterator> range =
+        dataSets.equal_range(dataSet->contentHash);
+    for(HashToDataSetMap::iterator p = range.first; p != range.second; ++p){
+        if(isSameShape(p->second, dataSet)){
+            return p->second;
+        }
+    }
+    return 0;
+}
+
+
+/**
+   @if jp
+   登録の検索に使う、形状の内容のハッシュ値を計算する。
+   @else
+   Calculates the hash of the shape used to look up the registered data sets.
+   @endif
+*/
+boost::uint64_t ColdetModelSharedDataSetRegistry::calcContentHash(const ColdetModelSharedDataSet* dataSet)
+{
+    Fnv1aHash hash;
+    hash.add(&dataSet->pType, sizeof(dataSet->pType));
+    hash.add(&dataSet->treeLayout, sizeof(dataSet->treeLayout));
+    hash.addVector(dataSet->pParams);
+    hash.addVector(dataSet->triangles);
+    hash.addVector(dataSet->vertices);
+    return hash.value();
+}
+
+
+/**
+   @if jp
+   dataSet と同じ形状の登録済みデータセットを探す。
+   見つかったデータセットの参照カウントは呼び出し側のために一つ増やされる。
+   @else
+   Finds a registered data set whose shape equals the one of dataSet.
+   The reference count of the found data set is incremented for the caller.
+   @return 0 if there is no such data set
+   @endif
+*/
+ColdetModelSharedDataSet* ColdetModelSharedDataSetRegistry::find(ColdetModelSharedDataSet* dataSet)
+{
+    dataSet->contentHash = calcContentHash(dataSet);
+
+    ScopedLock lock(mutex);
+    ColdetModelSharedDataSet* found = findSub(dataSet);
+    if(found){
+        found->refCounter++;
+    }
+    return found;
+}
+
+
+/**
+   @if jp
+   構築済みの dataSet を登録する。find() の後に同じ形状のデータセットが他のスレッドで
+   登録されていた場合は、dataSet の参照を一つ外してそちらを返す。
+   @else
+   Registers dataSet, which must have been built after find() failed.
+   If another thread has registered the same shape in the meantime, one
+   reference to dataSet is released and the registered data set is returned
+   with its reference count incremented.
+   @return the data set which the caller should use
+   @endif
+*/
+ColdetModelSharedDataSet* ColdetModelSharedDataSetRegistry::add(ColdetModelSharedDataSet* dataSet)
+{
+    ColdetModelSharedDataSet* found;
+    {
+        ScopedLock lock(mutex);
+        found = findSub(dataSet);
+        if(!found){
+            dataSets.insert(make_pair(dataSet->contentHash, dataSet));
+            dataSet->isRegistered = true;
+            return dataSet;
+        }
+        found->refCounter++;
+    }
+    unref(dataSet);
+    return found;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2008, AIST, the University of Tokyo and General Robotix Inc.
+ * All rights reserved. This program is made available under the terms of the
+ * Eclipse Public License v1.0 which accompanies this distribution, and is
+ * available at http://www.eclipse.org/legal/epl-v10.html
+ * Contributors:
+ * National Institute of Advanced Industrial Science and Technology (AIST)
+ */
+
+#ifndef OPENHRP_COLDET_MODEL_SHARED_DATA_SET_REGISTRY_H_INCLUDED
+#define OPENHRP_COLDET_MODEL_SHARED_DATA_SET_REGISTRY_H_INCLUDED
+
+#include <map>
+#include <boost/cstdint.hpp>
+#include <boost/detail/lightweight_mutex.hpp>
+
+namespace hrp {
+
+    class ColdetModelSharedDataSet;
+
+    /**
+       @if jp
+       同じ形状の ColdetModel どうしで構築済みの ColdetModelSharedDataSet を
+       共有するための、プロセス全体で一つのレジストリ。
+       @else
+       Process-wide registry of built ColdetModelSharedDataSet objects.
+
+       A data set is registered when it has been built and is looked up by a
+       hash of its vertices, triangles, primitive type, primitive parameters
+       and tree layout.
+       A ColdetModel whose shape equals a registered one drops its own data set
+       and shares the registered one instead of building another tree, so that
+       many instances of the same object keep only one copy of the tree.
+       A registered data set is never modified. ColdetModel copies it before
+       modifying its shape. The reference counts of all the data sets are
+       updated through the registry because they may be shared by models
+       owned by different threads.
+       @endif
+    */
+    class ColdetModelSharedDataSetRegistry
+    {
+      public:
+
+        static ColdetModelSharedDataSetRegistry& instance();
+
+        void ref(ColdetModelSharedDataSet* dataSet);
+        void unref(ColdetModelSharedDataSet* dataSet);
+
+        ColdetModelSharedDataSet* find(ColdetModelSharedDataSet* dataSet);
+        ColdetModelSharedDataSet* add(ColdetModelSharedDataSet* dataSet);
+
+        static boost::uint64_t calcContentHash(const ColdetModelSharedDataSet* dataSet);
+
+      private:
+
+        ColdetModelSharedDataSetRegistry() { }
+
+        typedef std::multimap<boost::uint64_t, ColdetModelSharedDataSet*> HashToDataSetMap;
+        HashToDataSetMap dataSets;
+
+        boost::detail::lightweight_mutex mutex;
+
+        ColdetModelSharedDataSet* findSub(ColdetModelSharedDataSet* dataSet);
+    };
+}
+
+#endif
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2008, AIST, the University of Tokyo and General Robotix Inc.
+ * All rights reserved. This program is made available under the terms of the
+ * Eclipse Public License v1.0 which accompanies this distribution, and is
+ * available at http://www.eclipse.org/legal/epl-v10.html
+ * Contributors:
+ * National Institute of Advanced Industrial Science and Technology (AIST)
+ */
+
+#include "ColdetPointCloud.h"
+#include <algorithm>
+
+using namespace std;
+using namespace hrp;
+
+namespace {
+
+    // the maximum number of points in a leaf node
+    const int MAX_NUM_LEAF_POINTS = 8;
+
+    class CoordinateLess
+    {
+      public:
+        CoordinateLess(int axis) : axis(axis) { }
+        bool operator()(const Vector3& p1, const Vector3& p2) const {
+            return p1[axis] < p2[axis];
+        }
+      private:
+        int axis;
+    };
+}
+
+
+ColdetPointCloud::ColdetPointCloud()
+    : radius_(0.0)
+{
+
+}
+
+
+void ColdetPointCloud::build(const std::vector<Vector3>& cloud, double radius)
+{
+    points_ = cloud;
+    radius_ = radius;
+    nodes_.clear();
+
+    if(!points_.empty()){
+        nodes_.reserve(4 * points_.size() / MAX_NUM_LEAF_POINTS + 1);
+        nodes_.push_back(Node());
+        buildSub(0, 0, points_.size());
+    }
+}
+
+
+void ColdetPointCloud::clear()
+{
+    points_.clear();
+    nodes_.clear();
+    radius_ = 0.0;
+}
+
+
+/**
+   @if jp
+   点の範囲を最も長い軸の中央値で二分して子ノードを作る。
+   @endif
+*/
+void ColdetPointCloud::buildSub(int nodeIndex, int begin, int end)
+{
+    Vector3 min(points_[begin]);
+    Vector3 max(points_[begin]);
+    for(int i=begin+1; i < end; ++i){
+        min = min.cwiseMin(points_[i]);
+        max = max.cwiseMax(points_[i]);
+    }
+
+    Node& node = nodes_[nodeIndex];
+    node.center = (max + min) * 0.5;
+    node.extents = (max - min) * 0.5 + Vector3::Constant(radius_);
+    node.begin = begin;
+    node.end = end;
+
+    if(end - begin <= MAX_NUM_LEAF_POINTS){
+        node.child = -1;
+        return;
+    }
+
+    int axis;
+    (max - min).maxCoeff(&axis);
+    int middle = (begin + end) / 2;
+    nth_element(points_.begin() + begin, points_.begin() + middle, points_.begin() + end, CoordinateLess(axis));
+
+    int child = nodes_.size();
+    node.child = child;
+    nodes_.push_back(Node());
+    nodes_.push_back(Node());
+    buildSub(child, begin, middle);
+    buildSub(child + 1, middle, end);
+}
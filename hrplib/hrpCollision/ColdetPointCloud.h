@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2008, AIST, the University of Tokyo and General Robotix Inc.
+ * All rights reserved. This program is made available under the terms of the
+ * Eclipse Public License v1.0 which accompanies this distribution, and is
+ * available at http://www.eclipse.org/legal/epl-v10.html
+ * Contributors:
+ * National Institute of Advanced Industrial Science and Technology (AIST)
+ */
+
+#ifndef HRPCOLLISION_COLDET_POINT_CLOUD_H_INCLUDED
+#define HRPCOLLISION_COLDET_POINT_CLOUD_H_INCLUDED
+
+#include "config.h"
+#include <hrpUtil/Eigen3d.h>
+#include <vector>
+
+namespace hrp {
+
+    /**
+       @if jp
+       干渉チェック用に索引付けされたポイントクラウド。各点には同じ半径の球が割り当てられる。
+       @else
+       A point cloud indexed for collision checks with ColdetModel.
+
+       A sphere of the same radius is assigned to every point. The points are
+       sorted into a binary tree of axis aligned boxes, which are enlarged by
+       the radius, so that ColdetModel::checkCollisionWithPointCloud() can
+       traverse the tree of a model and the tree of the cloud together instead
+       of testing the points one by one.
+       The points are given in the world frame.
+       @endif
+    */
+    class HRP_COLLISION_EXPORT ColdetPointCloud
+    {
+      public:
+
+        /**
+           A node of the tree. The children of an inner node are the nodes
+           at child and child + 1. A leaf node has the points from
+           begin to end - 1 of points().
+        */
+        struct Node
+        {
+            Vector3 center;
+            Vector3 extents; ///< half extents including the radius
+            int child;       ///< -1 for a leaf node
+            int begin;
+            int end;
+        };
+
+        ColdetPointCloud();
+
+        /**
+         * @brief build the index of a point cloud
+         * @param cloud points in the world frame
+         * @param radius radius of spheres assigned to the points
+         */
+        void build(const std::vector<Vector3>& cloud, double radius);
+
+        void clear();
+
+        bool empty() const { return points_.empty(); }
+
+        double radius() const { return radius_; }
+
+        /**
+         * @brief get the points sorted in the order of the leaf nodes
+         */
+        const std::vector<Vector3>& points() const { return points_; }
+
+        /**
+         * @brief get the nodes of the tree. The first node is the root.
+         */
+        const std::vector<Node>& nodes() const { return nodes_; }
+
+      private:
+        std::vector<Vector3> points_;
+        std::vector<Node> nodes_;
+        double radius_;
+
+        void buildSub(int nodeIndex, int begin, int end);
+    };
+}
+
+#endif
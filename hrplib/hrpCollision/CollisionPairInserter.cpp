@@ -12,6 +12,7 @@
 #include "ColdetModelSharedDataSet.h"
 #include "Opcode/Opcode.h"
 #include <cstdio>
+#include <cmath>
 #include <iostream>
 #include <vector>
 
@@ -39,6 +40,28 @@ namespace {
     const int CD_ALL_CONTACTS = 1;
     const int CD_FIRST_CONTACT = 2;
     const int CD_ERR_COLLIDE_OUT_OF_MEMORY = 2;
+
+    // the maximum number of triangles collected by get_triangles_in_convex_neighbor()
+    const int MAX_NUM_NEIGHBOR = 22;
+
+    const double POINT_EPS = 1.0e-12; // 1 micro meter to judge two contact points are identical
+    const double POINT_CELL_SIZE = 1.0e-6; // sqrt(POINT_EPS)
+    const int INITIAL_NUM_POINT_BUCKETS = 256;
+
+    // cells beyond this index (4e12 meters) are merged into the boundary cell
+    const double MAX_POINT_CELL = 4.0e18;
+
+    // returns the 64 bit index of the grid cell containing the coordinate v
+    inline boost::int64_t point_cell(double v)
+    {
+        double c = floor(v / POINT_CELL_SIZE);
+        if(!(c > -MAX_POINT_CELL)){ // includes NaN
+            return -(boost::int64_t)MAX_POINT_CELL;
+        } else if(c > MAX_POINT_CELL){
+            return (boost::int64_t)MAX_POINT_CELL;
+        }
+        return (boost::int64_t)c;
+    }
     
     enum {
         FV = 1,
@@ -49,8 +72,10 @@ namespace {
 
 
 CollisionPairInserter::CollisionPairInserter()
+    : neighborTriangles(MAX_NUM_NEIGHBOR),
+      pointBuckets(INITIAL_NUM_POINT_BUCKETS, -1)
 {
-
+    foundTriangles.reserve(MAX_NUM_NEIGHBOR);
 }
 
 
@@ -124,18 +149,20 @@ void CollisionPairInserter::triangleIndexToPoint(ColdetModelSharedDataSet* model
 }
 
 void CollisionPairInserter::get_triangles_in_convex_neighbor(ColdetModelSharedDataSet* model, int id, col_tri* tri_convex_neighbor, std::vector<int>& foundTriangles, int& count){
-    int k;
-    for(int i=0; i<foundTriangles.size(); i++)
-        if(foundTriangles[i] == id){
-            k = i;
-            break;
-        }
+    // foundTriangles[k] is the triangle stored in tri_convex_neighbor[k]
+    size_t k = 0;
+    while(k < foundTriangles.size() && foundTriangles[k] != id){
+        ++k;
+    }
+    if(k == foundTriangles.size()){
+        return;
+    }
 
     for(int i=0; i<3; i++){
         int nei = model->neighbor[id].triangles[i];
         if(nei < 0)
             continue;
-        int j=0;
+        size_t j=0;
         for(; j<foundTriangles.size(); j++)
             if(foundTriangles[j] == nei)
                 break;
@@ -155,7 +182,7 @@ void CollisionPairInserter::get_triangles_in_convex_neighbor(ColdetModelSharedDa
 
 int CollisionPairInserter::get_triangles_in_convex_neighbor(ColdetModelSharedDataSet* model, int id, col_tri* tri_convex_neighbor, int min_num){
 
-    std::vector<int> foundTriangles;
+    foundTriangles.clear();
     int count=0;
     triangleIndexToPoint(model, id, tri_convex_neighbor[count++]);
     tri_convex_neighbor[0].status = 0;
@@ -346,32 +373,91 @@ void CollisionPairInserter::find_signed_distance(
     int obj)
 {
     const int MIN_NUM_NEIGHBOR = 10;
-    col_tri* tri_convex_neighbor = new col_tri[22];
+    col_tri* tri_convex_neighbor = &neighborTriangles[0];
     int num = get_triangles_in_convex_neighbor(model, id, tri_convex_neighbor, MIN_NUM_NEIGHBOR);
 
     for(int i=0; i<num; ++i){
         find_signed_distance(signed_distance, &tri_convex_neighbor[i], contactIndex, ctype, obj);
     }
-
-    delete [] tri_convex_neighbor;
 }
 
+// Only the points of the previous contacts registered in the hashed grid
+// by add_points() in the 27 cells around the k-th point are compared.
 int CollisionPairInserter::new_point_test(int k)
 {
-    const double eps = 1.0e-12; // 1 micro meter to judge two contact points are identical
-
     int last = cdContact.size()-1;
-    
-    for(int i=0; i < last; ++i){
-        for(int j=0; j < cdContact[i].num_of_i_points; ++j){
-            Vector3 dv(cdContact[i].i_points[j] - cdContact[last].i_points[k]);
-            double d = cdContact[i].depth - cdContact[last].depth;
-            if(dv.dot(dv) < eps && d*d < eps) return 0;
+    const Vector3& p = cdContact[last].i_points[k];
+
+    const boost::int64_t x = point_cell(p[0]);
+    const boost::int64_t y = point_cell(p[1]);
+    const boost::int64_t z = point_cell(p[2]);
+
+    for(int dx=-1; dx <= 1; ++dx){
+        for(int dy=-1; dy <= 1; ++dy){
+            for(int dz=-1; dz <= 1; ++dz){
+                int e = pointBuckets[point_bucket(x + dx, y + dy, z + dz)];
+                while(e >= 0){
+                    const point_entry& entry = pointEntries[e];
+                    if(entry.contactIndex < last){
+                        const collision_data& contact = cdContact[entry.contactIndex];
+                        Vector3 dv(contact.i_points[entry.pointIndex] - p);
+                        double d = contact.depth - cdContact[last].depth;
+                        if(dv.dot(dv) < POINT_EPS && d*d < POINT_EPS) return 0;
+                    }
+                    e = entry.next;
+                }
+            }
         }
     }
     return 1;
 }
 
+int CollisionPairInserter::point_bucket(boost::int64_t x, boost::int64_t y, boost::int64_t z) const
+{
+    boost::uint64_t h =
+        ((boost::uint64_t)x * 73856093u) ^ ((boost::uint64_t)y * 19349663u) ^ ((boost::uint64_t)z * 83492791u);
+    h ^= (h >> 32);
+    return (int)(h & (pointBuckets.size() - 1));
+}
+
+void CollisionPairInserter::clear_points()
+{
+    for(size_t i=0; i < pointEntries.size(); ++i){
+        pointBuckets[pointEntries[i].bucket] = -1;
+    }
+    pointEntries.clear();
+}
+
+// The number of the buckets is doubled when the entries outnumber them.
+// The buffers keep their capacity over clear_points() and nothing is
+// allocated once they have grown enough.
+void CollisionPairInserter::add_points(int contactIndex)
+{
+    const collision_data& contact = cdContact[contactIndex];
+
+    if(pointEntries.size() + contact.num_of_i_points > pointBuckets.size()){
+        pointBuckets.assign(pointBuckets.size() * 2, -1);
+        for(size_t i=0; i < pointEntries.size(); ++i){
+            point_entry& entry = pointEntries[i];
+            const Vector3& p = cdContact[entry.contactIndex].i_points[entry.pointIndex];
+            entry.bucket = point_bucket(point_cell(p[0]), point_cell(p[1]), point_cell(p[2]));
+            entry.next = pointBuckets[entry.bucket];
+            pointBuckets[entry.bucket] = i;
+        }
+    }
+
+    for(int i=0; i < contact.num_of_i_points; ++i){
+        const Vector3& p = contact.i_points[i];
+        point_entry entry;
+        entry.contactIndex = contactIndex;
+        entry.pointIndex = i;
+        entry.bucket = point_bucket(point_cell(p[0]), point_cell(p[1]), point_cell(p[2]));
+        entry.next = pointBuckets[entry.bucket];
+        pointBuckets[entry.bucket] = pointEntries.size();
+        pointEntries.push_back(entry);
+    }
+}
+
 
 //
 // obsolute signatures
@@ -408,22 +494,23 @@ int CollisionPairInserter::apply(
     contact.m.noalias() = CD_Rot2 * m1;
         examine_normal_vector(id1, id2, ctype);
 
+    if(cdContact.size() == 1){
+        clear_points();
+    }
+    // a point identical to a point of the previous contacts is not new
+    for(int i=0; i < num_of_i_points; ++i){
+        contact.i_point_new[i] = new_point_test(i);
+    }
+    add_points(cdContact.size() - 1);
+
 #ifdef DEPTH_CHECK
     // analyze_neighborhood_of_i_point(b1, b2, cdContactsCount, ctype);
     // remove the intersecting point if depth is deeper than MAX_DEPTH meter
-    if(fabs(contact.depth) < MAX_DEPTH){
-        for(int i=0; i < num_of_i_points; ++i){
-            contact.i_point_new[i] = new_point_test(i);
-        }
-    } else {
+    if(fabs(contact.depth) >= MAX_DEPTH){
         for(int i=0; i < num_of_i_points; ++i){
             contact.i_point_new[i] = 0;
         }
     }
-#else
-    for(int i=0; i < num_of_i_points; ++i){
-        contact.i_point_new[i] = 1;
-    }
 #endif
 
     return CD_OK;
@@ -12,6 +12,7 @@
 #define HRPCOLLISION_COLLISION_PAIR_INSERTER_H_INCLUDED
 
 #include "CollisionPairInserterBase.h"
+#include <boost/cstdint.hpp>
 
 namespace hrp {
 
@@ -59,6 +60,23 @@ namespace hrp {
             Vector3 n;
         };
 
+        class point_entry
+        {
+          public:
+            int contactIndex;
+            int pointIndex;
+            int bucket;
+            int next; // index of the next entry in the same bucket, or -1
+        };
+
+        // buffers reused by every call to avoid heap allocation per contact
+        std::vector<col_tri> neighborTriangles;
+        std::vector<int> foundTriangles;
+
+        // hashed grid of the intersecting points looked up by new_point_test()
+        std::vector<int> pointBuckets;
+        std::vector<point_entry> pointEntries;
+
         static void copy_tri(col_tri* t1, tri* t2);
         
         static void copy_tri(col_tri* t1, col_tri* t2);
@@ -86,6 +104,12 @@ namespace hrp {
         void find_signed_distance(Vector3& signed_distance1, ColdetModelSharedDataSet* model0, int id1, int contactIndex, int ctype, int obj);
 
         int new_point_test(int k);
+
+        int point_bucket(boost::int64_t x, boost::int64_t y, boost::int64_t z) const;
+
+        void clear_points();
+
+        void add_points(int contactIndex);
     };
 }
 
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2008, AIST, the University of Tokyo and General Robotix Inc.
+ * All rights reserved. This program is made available under the terms of the
+ * Eclipse Public License v1.0 which accompanies this distribution, and is
+ * available at http://www.eclipse.org/legal/epl-v10.html
+ * Contributors:
+ * National Institute of Advanced Industrial Science and Technology (AIST)
+ * General Robotix Inc.
+ */
+
+/**
+   Compares the i_point_new flags given by CollisionPairInserter with the
+   exhaustive comparison of every pair of contact points.
+
+   A box whose faces are finely meshed is put on a meshed floor, so the
+   contacts share many identical points. The scene is also moved far from
+   the origin to check the grid cells of large coordinates.
+   The program returns a non-zero value if a flag differs.
+*/
+
+#include "ColdetModel.h"
+#include "ColdetModelPair.h"
+#include <cstdio>
+#include <cmath>
+#include <ctime>
+#include <vector>
+
+using namespace std;
+using namespace hrp;
+
+namespace {
+
+    const double POINT_EPS = 1.0e-12;
+    const double MAX_DEPTH = 0.1;
+
+    ColdetModelPtr createFloor(int n, double size, double amplitude)
+    {
+        ColdetModelPtr model(new ColdetModel());
+        model->setNumVertices((n+1)*(n+1));
+        for(int i=0; i <= n; ++i){
+            for(int j=0; j <= n; ++j){
+                model->setVertex(i*(n+1)+j, size*(i/(double)n - 0.5), size*(j/(double)n - 0.5),
+                                 amplitude * sin(i*0.7) * cos(j*0.3));
+            }
+        }
+        model->setNumTriangles(n*n*2);
+        int t = 0;
+        for(int i=0; i < n; ++i){
+            for(int j=0; j < n; ++j){
+                int a = i*(n+1)+j, b = a+1, c = a+n+1, d = c+1;
+                model->setTriangle(t++, a, c, b);
+                model->setTriangle(t++, b, c, d);
+            }
+        }
+        model->build();
+        return model;
+    }
+
+    ColdetModelPtr createBox(int n, double hx, double hy, double hz)
+    {
+        ColdetModelPtr model(new ColdetModel());
+        const int numFaceVertices = (n+1)*(n+1);
+        model->setNumVertices(numFaceVertices * 6);
+        model->setNumTriangles(n*n*2*6);
+        const double h[3] = { hx, hy, hz };
+        int v = 0, t = 0;
+        for(int f=0; f < 6; ++f){
+            int axis = f / 2;
+            double sign = (f % 2) ? 1.0 : -1.0;
+            int u = (axis + 1) % 3, w = (axis + 2) % 3;
+            int top = v;
+            for(int i=0; i <= n; ++i){
+                for(int j=0; j <= n; ++j){
+                    double p[3];
+                    p[axis] = sign * h[axis];
+                    p[u] = h[u] * (2.0*i/n - 1.0);
+                    p[w] = h[w] * (2.0*j/n - 1.0);
+                    model->setVertex(v++, p[0], p[1], p[2]);
+                }
+            }
+            for(int i=0; i < n; ++i){
+                for(int j=0; j < n; ++j){
+                    int a = top+i*(n+1)+j, b = a+1, c = a+n+1, d = c+1;
+                    if(sign > 0.0){
+                        model->setTriangle(t++, a, c, b);
+                        model->setTriangle(t++, b, c, d);
+                    } else {
+                        model->setTriangle(t++, a, b, c);
+                        model->setTriangle(t++, b, d, c);
+                    }
+                }
+            }
+        }
+        model->build();
+        return model;
+    }
+
+    // the flag computed by comparing the point with all the points of the previous contacts
+    int isNewPoint(const vector<collision_data>& contacts, int index, int k)
+    {
+        const collision_data& contact = contacts[index];
+#ifdef DEPTH_CHECK
+        if(fabs(contact.depth) >= MAX_DEPTH){
+            return 0;
+        }
+#endif
+        for(int i=0; i < index; ++i){
+            for(int j=0; j < contacts[i].num_of_i_points; ++j){
+                Vector3 dv(contacts[i].i_points[j] - contact.i_points[k]);
+                double d = contacts[i].depth - contact.depth;
+                if(dv.dot(dv) < POINT_EPS && d*d < POINT_EPS){
+                    return 0;
+                }
+            }
+        }
+        return 1;
+    }
+
+    int checkScene(const char* name, double offset)
+    {
+        ColdetModelPtr box = createBox(60, 0.12, 0.06, 0.03);
+        ColdetModelPtr floor = createFloor(400, 2.0, 0.0);
+        ColdetModelPtr bumpyFloor = createFloor(40, 2.0, 0.003);
+
+        double R[9] = { 1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0 };
+        double p[3] = { offset, offset, 0.0 };
+        floor->setPosition(R, p);
+        bumpyFloor->setPosition(R, p);
+
+        ColdetModelPair pairs[2] = { ColdetModelPair(box, floor), ColdetModelPair(box, bumpyFloor) };
+
+        long numPoints = 0;
+        long numNewPoints = 0;
+        long numMismatches = 0;
+        double time = 0.0;
+
+        for(int step=0; step < 20; ++step){
+            double th = 0.002 * sin(step * 0.1);
+            double Rb[9] = { cos(th), 0.0, sin(th), 0.0, 1.0, 0.0, -sin(th), 0.0, cos(th) };
+            double pb[3] = { offset + 0.00013 * step, offset + 0.0007 * (step % 7), 0.028 - 0.00001 * step };
+            box->setPosition(Rb, pb);
+
+            for(int i=0; i < 2; ++i){
+                clock_t start = clock();
+                vector<collision_data>& contacts = pairs[i].detectCollisions();
+                time += (double)(clock() - start) / CLOCKS_PER_SEC;
+
+                for(size_t j=0; j < contacts.size(); ++j){
+                    for(int k=0; k < contacts[j].num_of_i_points; ++k){
+                        ++numPoints;
+                        numNewPoints += contacts[j].i_point_new[k];
+                        if(contacts[j].i_point_new[k] != isNewPoint(contacts, j, k)){
+                            ++numMismatches;
+                        }
+                    }
+                }
+            }
+        }
+
+        printf("%s: %ld points, %ld new points, %ld mismatches, detection %.3f [s]\n",
+               name, numPoints, numNewPoints, numMismatches, time);
+
+        return (numPoints > 0 && numNewPoints < numPoints && numMismatches == 0) ? 0 : 1;
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    int result = 0;
+    result |= checkScene("near the origin", 0.0);
+    result |= checkScene("far from the origin", 5000.0);
+    return result;
+}
@@ -0,0 +1,942 @@
+/*
+ * Copyright (c) 2008, AIST, the University of Tokyo and General Robotix Inc.
+ * All rights reserved. This program is made available under the terms of the
+ * Eclipse Public License v1.0 which accompanies this distribution, and is
+ * available at http://www.eclipse.org/legal/epl-v10.html
+ * Contributors:
+ * National Institute of Advanced Industrial Science and Technology (AIST)
+ */
+
+#include "ConvexCollider.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using namespace std;
+using namespace hrp;
+
+namespace {
+
+    const double PI = 3.14159265358979323846;
+
+    /**
+       A face of a primitive is its contact feature when the angle between
+       its normal and the contact normal is smaller than acos() of this value
+    */
+    const double cosFaceFeature = 0.95;
+
+    /**
+       An edge or a side line of a primitive is its contact feature when
+       the angle between it and the contact plane is smaller than asin() of this value
+    */
+    const double sinEdgeFeature = 0.05;
+
+    /**
+       The number of the vertices of the polygons approximating the caps
+       of cylinders and cones
+    */
+    const int numCapVertices = 8;
+
+    /**
+       An axis other than the face normals is chosen as the contact normal
+       only when its overlap is smaller than this ratio of the current one
+    */
+    const double nonFaceAxisRatio = 0.95;
+
+    /**
+       The ratio for a triangle of a mesh surface is smaller because the
+       edges shared by the triangles on a flat surface must not make the
+       normal of the surface tilt
+    */
+    const double triangleNonFaceAxisRatio = 0.5;
+
+    const int maxGjkIterations = 64;
+    const int maxEpaIterations = 64;
+    const double epaTolerance = 1.0e-6;
+
+
+    void addContact(vector<collision_data>& out_contacts, const Vector3& point, const Vector3& normal, double depth)
+    {
+        collision_data col = collision_data();
+        col.depth = depth;
+        col.num_of_i_points = 1;
+        col.i_point_new[0] = 1;
+        col.i_point_new[1] = 0;
+        col.i_point_new[2] = 0;
+        col.i_point_new[3] = 0;
+        col.n_vector = normal;
+        col.i_points[0] = point;
+        out_contacts.push_back(col);
+    }
+
+
+    double projectedBoxRadius(const ConvexPrimitive& box, const Vector3& axis)
+    {
+        const Vector3& size = box.extents();
+        return (size[0] * fabs(axis.dot(box.axis(0))) +
+                size[1] * fabs(axis.dot(box.axis(1))) +
+                size[2] * fabs(axis.dot(box.axis(2))));
+    }
+
+
+    /**
+       Keeps the part of a polygon, a segment or a point on the negative side
+       of the plane whose normal is n and whose offset is d.
+    */
+    void clip(vector<Vector3>& points, const Vector3& n, double d)
+    {
+        const size_t numPoints = points.size();
+
+        if(numPoints == 1){
+            if(n.dot(points[0]) > d){
+                points.clear();
+            }
+        } else if(numPoints == 2){
+            double d0 = n.dot(points[0]) - d;
+            double d1 = n.dot(points[1]) - d;
+            if(d0 > 0.0 && d1 > 0.0){
+                points.clear();
+            } else if(d0 > 0.0){
+                points[0] += (d0 / (d0 - d1)) * (points[1] - points[0]);
+            } else if(d1 > 0.0){
+                points[1] += (d1 / (d1 - d0)) * (points[0] - points[1]);
+            }
+        } else if(numPoints >= 3){
+            vector<Vector3> clipped;
+            for(size_t i=0; i < numPoints; ++i){
+                const Vector3& p0 = points[i];
+                const Vector3& p1 = points[(i + 1) % numPoints];
+                double d0 = n.dot(p0) - d;
+                double d1 = n.dot(p1) - d;
+                if(d0 <= 0.0){
+                    clipped.push_back(p0);
+                }
+                if((d0 < 0.0 && d1 > 0.0) || (d0 > 0.0 && d1 < 0.0)){
+                    clipped.push_back(p0 + (d0 / (d0 - d1)) * (p1 - p0));
+                }
+            }
+            points.swap(clipped);
+        }
+    }
+
+
+    Vector3 polygonNormal(const vector<Vector3>& polygon)
+    {
+        Vector3 n((polygon[1] - polygon[0]).cross(polygon[2] - polygon[0]));
+        double len = n.norm();
+        return (len > 0.0) ? Vector3(n / len) : n;
+    }
+
+
+    /**
+       Computes the closest points of segments p0-p1 and q0-q1.
+    */
+    void computeClosestPointsOfSegments(const Vector3& p0, const Vector3& p1, const Vector3& q0, const Vector3& q1,
+                                        Vector3& out_p, Vector3& out_q)
+    {
+        Vector3 d1(p1 - p0);
+        Vector3 d2(q1 - q0);
+        Vector3 r(p0 - q0);
+        double a = d1.squaredNorm();
+        double e = d2.squaredNorm();
+        double f = d2.dot(r);
+        double s = 0.0;
+        double t = 0.0;
+
+        if(a <= 1.0e-20 && e <= 1.0e-20){
+            // both segments are points
+        } else if(a <= 1.0e-20){
+            t = std::min(std::max(f / e, 0.0), 1.0);
+        } else {
+            double c = d1.dot(r);
+            if(e <= 1.0e-20){
+                s = std::min(std::max(-c / a, 0.0), 1.0);
+            } else {
+                double b = d1.dot(d2);
+                double denom = a * e - b * b;
+                if(denom > 1.0e-20){
+                    s = std::min(std::max((b * f - c * e) / denom, 0.0), 1.0);
+                }
+                t = (b * s + f) / e;
+                if(t < 0.0){
+                    t = 0.0;
+                    s = std::min(std::max(-c / a, 0.0), 1.0);
+                } else if(t > 1.0){
+                    t = 1.0;
+                    s = std::min(std::max((b - c) / a, 0.0), 1.0);
+                }
+            }
+        }
+        out_p = p0 + s * d1;
+        out_q = q0 + t * d2;
+    }
+
+
+    /**
+       Generates the contacts from the contact features of a and b,
+       which are the faces, the edges or the points of them touching each other.
+       The incident feature is clipped by the side planes of the reference one
+       and its points behind the reference one are the contacts.
+       @param n the contact normal pointing from a to b
+    */
+    void generateContacts(const ConvexPrimitive& a, const ConvexPrimitive& b, const Vector3& n, double depth,
+                          vector<collision_data>& out_contacts)
+    {
+        vector<Vector3> featureA;
+        vector<Vector3> featureB;
+        a.getFeature(n, featureA);
+        b.getFeature(-n, featureB);
+
+        bool isAReference;
+        if(featureA.size() >= 3 && featureB.size() >= 3){
+            // the face more parallel to the contact plane
+            isAReference = (fabs(polygonNormal(featureA).dot(n)) + 0.01 >= fabs(polygonNormal(featureB).dot(n)));
+        } else {
+            isAReference = (featureA.size() >= featureB.size());
+        }
+        const vector<Vector3>& ref = isAReference ? featureA : featureB;
+        vector<Vector3>& inc = isAReference ? featureB : featureA;
+        const Vector3 refNormal(isAReference ? n : Vector3(-n));
+
+        const size_t numContacts = out_contacts.size();
+
+        if(ref.size() >= 3){
+            Vector3 faceNormal(polygonNormal(ref));
+            if(faceNormal.dot(refNormal) < 0.0){
+                faceNormal = -faceNormal;
+            }
+            Vector3 center(Vector3::Zero());
+            for(size_t i=0; i < ref.size(); ++i){
+                center += ref[i];
+            }
+            center /= ref.size();
+            for(size_t i=0; i < ref.size() && !inc.empty(); ++i){
+                const Vector3& p0 = ref[i];
+                const Vector3& p1 = ref[(i + 1) % ref.size()];
+                Vector3 side((p1 - p0).cross(faceNormal));
+                if(side.dot(center - p0) > 0.0){
+                    side = -side;
+                }
+                clip(inc, side, side.dot(p0));
+            }
+            for(size_t i=0; i < inc.size(); ++i){
+                double separation = faceNormal.dot(inc[i] - ref[0]);
+                if(separation <= 0.0){
+                    addContact(out_contacts, inc[i] - (0.5 * separation) * faceNormal, n, -separation);
+                }
+            }
+
+        } else if(ref.size() == 2 && inc.size() == 2){
+            Vector3 refDir(ref[1] - ref[0]);
+            Vector3 incDir(inc[1] - inc[0]);
+            double refLen = refDir.norm();
+            double incLen = incDir.norm();
+            if(refDir.cross(incDir).norm() <= sinEdgeFeature * refLen * incLen){
+                // parallel segments touch along the common part of them
+                clip(inc, refDir, refDir.dot(ref[1]));
+                clip(inc, -refDir, -refDir.dot(ref[0]));
+                for(size_t i=0; i < inc.size(); ++i){
+                    double separation = refNormal.dot(inc[i] - ref[0]);
+                    if(separation <= 0.0){
+                        addContact(out_contacts, inc[i] - (0.5 * separation) * refNormal, n, -separation);
+                    }
+                }
+            } else {
+                Vector3 p, q;
+                computeClosestPointsOfSegments(ref[0], ref[1], inc[0], inc[1], p, q);
+                addContact(out_contacts, 0.5 * (p + q), n, depth);
+            }
+
+        } else if(inc.size() == 1){
+            addContact(out_contacts, inc[0] + (0.5 * depth) * refNormal, n, depth);
+        }
+
+        if(out_contacts.size() == numContacts){
+            addContact(out_contacts, 0.5 * (a.support(n) + b.support(-n)), n, depth);
+        }
+    }
+
+
+    /**
+       Finds the axis of the minimum overlap of two boxes by the separating axis test.
+       @return false if the boxes are separated
+    */
+    bool findBoxBoxPenetration(const ConvexPrimitive& a, const ConvexPrimitive& b, Vector3& out_normal, double& out_depth)
+    {
+        const Vector3 t(b.center() - a.center());
+        out_depth = numeric_limits<double>::max();
+
+        for(int i=0; i < 6; ++i){
+            const Vector3 axis(i < 3 ? a.axis(i) : b.axis(i - 3));
+            double distance = axis.dot(t);
+            double overlap = projectedBoxRadius(a, axis) + projectedBoxRadius(b, axis) - fabs(distance);
+            if(overlap < 0.0){
+                return false;
+            }
+            if(overlap < out_depth){
+                out_depth = overlap;
+                out_normal = (distance >= 0.0) ? axis : Vector3(-axis);
+            }
+        }
+
+        for(int i=0; i < 3; ++i){
+            for(int j=0; j < 3; ++j){
+                Vector3 axis(a.axis(i).cross(b.axis(j)));
+                double len = axis.norm();
+                if(len < 1.0e-6){
+                    continue;
+                }
+                axis /= len;
+                double distance = axis.dot(t);
+                double overlap = projectedBoxRadius(a, axis) + projectedBoxRadius(b, axis) - fabs(distance);
+                if(overlap < 0.0){
+                    return false;
+                }
+                if(overlap < nonFaceAxisRatio * out_depth){
+                    out_depth = overlap;
+                    out_normal = (distance >= 0.0) ? axis : Vector3(-axis);
+                }
+            }
+        }
+        return true;
+    }
+
+
+    Vector3 supportOfDifference(const ConvexPrimitive& a, const ConvexPrimitive& b, const Vector3& d)
+    {
+        return a.support(d) - b.support(-d);
+    }
+
+
+    /**
+       The newest point of the simplex is the last one.
+       The simplex is reduced to the feature closest to the origin and
+       the next search direction is set.
+    */
+    void updateLineSimplex(Vector3* w, int& n, Vector3& d)
+    {
+        const Vector3 a(w[1]);
+        const Vector3 ab(w[0] - a);
+        const Vector3 ao(-a);
+        if(ab.dot(ao) > 0.0){
+            d = ab.cross(ao).cross(ab);
+        } else {
+            w[0] = a;
+            n = 1;
+            d = ao;
+        }
+    }
+
+
+    void updateTriangleSimplex(Vector3* w, int& n, Vector3& d)
+    {
+        const Vector3 a(w[2]);
+        const Vector3 b(w[1]);
+        const Vector3 c(w[0]);
+        const Vector3 ab(b - a);
+        const Vector3 ac(c - a);
+        const Vector3 ao(-a);
+        const Vector3 abc(ab.cross(ac));
+
+        if(abc.cross(ac).dot(ao) > 0.0){
+            if(ac.dot(ao) > 0.0){
+                w[0] = c;
+                w[1] = a;
+                n = 2;
+                d = ac.cross(ao).cross(ac);
+                return;
+            }
+        } else if(ab.cross(abc).dot(ao) <= 0.0){
+            d = (abc.dot(ao) > 0.0) ? abc : Vector3(-abc);
+            return;
+        }
+        w[0] = b;
+        w[1] = a;
+        n = 2;
+        updateLineSimplex(w, n, d);
+    }
+
+
+    /**
+       @return true if the tetrahedron encloses the origin
+    */
+    bool updateTetrahedronSimplex(Vector3* w, int& n, Vector3& d)
+    {
+        static const int faces[3][3] = { { 2, 1, 0 }, { 1, 0, 2 }, { 0, 2, 1 } };
+
+        const Vector3 a(w[3]);
+        for(int i=0; i < 3; ++i){
+            const Vector3 b(w[faces[i][0]]);
+            const Vector3 c(w[faces[i][1]]);
+            Vector3 normal((b - a).cross(c - a));
+            if(normal.dot(w[faces[i][2]] - a) > 0.0){
+                normal = -normal;
+            }
+            if(normal.dot(-a) > 0.0){
+                w[0] = c;
+                w[1] = b;
+                w[2] = a;
+                n = 3;
+                updateTriangleSimplex(w, n, d);
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    /**
+       Adds points of the Minkowski difference to a simplex which contains
+       the origin on it until it becomes a tetrahedron.
+    */
+    bool expandSimplex(const ConvexPrimitive& a, const ConvexPrimitive& b, Vector3* w, int n)
+    {
+        while(n < 4){
+            Vector3 directions[6];
+            int numDirections = 0;
+            if(n == 3){
+                Vector3 normal((w[1] - w[0]).cross(w[2] - w[0]));
+                directions[numDirections++] = normal;
+                directions[numDirections++] = -normal;
+            } else {
+                for(int i=0; i < 3; ++i){
+                    Vector3 axis(Vector3::Zero());
+                    axis[i] = 1.0;
+                    directions[numDirections++] = axis;
+                    directions[numDirections++] = -axis;
+                }
+            }
+            bool added = false;
+            for(int i=0; i < numDirections && !added; ++i){
+                const Vector3 s(supportOfDifference(a, b, directions[i]));
+                double offset;
+                if(n == 1){
+                    offset = (s - w[0]).norm();
+                } else if(n == 2){
+                    Vector3 line(w[1] - w[0]);
+                    offset = (s - w[0]).cross(line).norm() / line.norm();
+                } else {
+                    offset = fabs((s - w[0]).dot(directions[i])) / directions[i].norm();
+                }
+                if(offset > 1.0e-9){
+                    w[n++] = s;
+                    added = true;
+                }
+            }
+            if(!added){
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    /**
+       Finds a tetrahedron enclosing the origin in the Minkowski difference
+       of a and b by GJK.
+       @return false if a and b are separated or just touching
+    */
+    bool findEnclosingSimplex(const ConvexPrimitive& a, const ConvexPrimitive& b, Vector3* out_simplex)
+    {
+        Vector3 d(b.center() - a.center());
+        if(d.squaredNorm() < 1.0e-20){
+            d = Vector3(1.0, 0.0, 0.0);
+        }
+        int n = 1;
+        out_simplex[0] = supportOfDifference(a, b, d);
+        d = -out_simplex[0];
+
+        for(int i=0; i < maxGjkIterations; ++i){
+            if(d.squaredNorm() < 1.0e-20){
+                // the origin is on the simplex
+                return expandSimplex(a, b, out_simplex, n);
+            }
+            const Vector3 s(supportOfDifference(a, b, d));
+            if(s.dot(d) <= 0.0){
+                return false;
+            }
+            out_simplex[n++] = s;
+            if(n == 2){
+                updateLineSimplex(out_simplex, n, d);
+            } else if(n == 3){
+                updateTriangleSimplex(out_simplex, n, d);
+            } else if(updateTetrahedronSimplex(out_simplex, n, d)){
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    struct EpaFace
+    {
+        int v[3];
+        Vector3 normal;
+        double distance;
+        bool isValid;
+    };
+
+
+    void addEpaFace(vector<EpaFace>& faces, const vector<Vector3>& vertices, const Vector3& inner, int v0, int v1, int v2)
+    {
+        EpaFace face;
+        face.v[0] = v0;
+        face.v[1] = v1;
+        face.v[2] = v2;
+        face.normal = (vertices[v1] - vertices[v0]).cross(vertices[v2] - vertices[v0]);
+        if(face.normal.dot(vertices[v0] - inner) < 0.0){
+            face.v[1] = v2;
+            face.v[2] = v1;
+            face.normal = -face.normal;
+        }
+        double len = face.normal.norm();
+        face.distance = 0.0;
+        face.isValid = (len > 1.0e-12);
+        if(face.isValid){
+            face.normal /= len;
+            face.distance = face.normal.dot(vertices[v0]);
+        }
+        faces.push_back(face);
+    }
+
+
+    void addHorizonEdge(vector< pair<int, int> >& edges, int v0, int v1)
+    {
+        for(size_t i=0; i < edges.size(); ++i){
+            if(edges[i].first == v1 && edges[i].second == v0){
+                edges.erase(edges.begin() + i);
+                return;
+            }
+        }
+        edges.push_back(make_pair(v0, v1));
+    }
+
+
+    /**
+       Computes the penetration of a and b by EPA from a tetrahedron enclosing the origin.
+       @param out_normal the direction in which b should be moved to separate them
+    */
+    bool computePenetration(const ConvexPrimitive& a, const ConvexPrimitive& b, const Vector3* simplex,
+                            Vector3& out_normal, double& out_depth)
+    {
+        vector<Vector3> vertices(simplex, simplex + 4);
+        const Vector3 inner(0.25 * (simplex[0] + simplex[1] + simplex[2] + simplex[3]));
+
+        if(fabs((simplex[1] - simplex[0]).cross(simplex[2] - simplex[0]).dot(simplex[3] - simplex[0])) < 1.0e-18){
+            return false;
+        }
+
+        vector<EpaFace> faces;
+        addEpaFace(faces, vertices, inner, 0, 1, 2);
+        addEpaFace(faces, vertices, inner, 0, 3, 1);
+        addEpaFace(faces, vertices, inner, 0, 2, 3);
+        addEpaFace(faces, vertices, inner, 1, 3, 2);
+
+        vector< pair<int, int> > horizon;
+
+        for(int iter=0; iter < maxEpaIterations; ++iter){
+
+            int closest = -1;
+            for(size_t i=0; i < faces.size(); ++i){
+                if(faces[i].isValid && (closest < 0 || faces[i].distance < faces[closest].distance)){
+                    closest = i;
+                }
+            }
+            if(closest < 0){
+                return false;
+            }
+            const Vector3 normal(faces[closest].normal);
+            const double distance = faces[closest].distance;
+            out_normal = normal;
+            out_depth = std::max(distance, 0.0);
+
+            const Vector3 s(supportOfDifference(a, b, normal));
+            if(s.dot(normal) - distance < epaTolerance){
+                return true;
+            }
+
+            const int index = vertices.size();
+            vertices.push_back(s);
+            horizon.clear();
+            for(size_t i=0; i < faces.size(); ++i){
+                EpaFace& face = faces[i];
+                if(face.isValid && face.normal.dot(s - vertices[face.v[0]]) > 0.0){
+                    face.isValid = false;
+                    addHorizonEdge(horizon, face.v[0], face.v[1]);
+                    addHorizonEdge(horizon, face.v[1], face.v[2]);
+                    addHorizonEdge(horizon, face.v[2], face.v[0]);
+                }
+            }
+            if(horizon.empty()){
+                return true;
+            }
+            for(size_t i=0; i < horizon.size(); ++i){
+                addEpaFace(faces, vertices, inner, horizon[i].first, horizon[i].second, index);
+            }
+        }
+        return true;
+    }
+}
+
+
+void ConvexPrimitive::setBox(const Vector3& p, const Matrix33& R, const Vector3& halfExtents)
+{
+    type_ = BOX;
+    this->p = p;
+    this->R = R;
+    size = halfExtents;
+}
+
+
+void ConvexPrimitive::setCylinder(const Vector3& p, const Matrix33& R, double radius, double halfHeight)
+{
+    type_ = CYLINDER;
+    this->p = p;
+    this->R = R;
+    size = Vector3(radius, halfHeight, radius);
+}
+
+
+void ConvexPrimitive::setCone(const Vector3& p, const Matrix33& R, double radius, double halfHeight)
+{
+    type_ = CONE;
+    this->p = p;
+    this->R = R;
+    size = Vector3(radius, halfHeight, radius);
+}
+
+
+void ConvexPrimitive::setTriangle(const Vector3& v0, const Vector3& v1, const Vector3& v2)
+{
+    type_ = TRIANGLE;
+    vertices[0] = v0;
+    vertices[1] = v1;
+    vertices[2] = v2;
+    p = (v0 + v1 + v2) / 3.0;
+    R.setIdentity();
+    size.setZero();
+}
+
+
+double ConvexPrimitive::boundingRadius() const
+{
+    switch(type_){
+    case BOX:
+        return size.norm();
+    case CYLINDER:
+    case CONE:
+        return sqrt(size[0] * size[0] + size[1] * size[1]);
+    default:
+        return std::max((vertices[0] - p).norm(), std::max((vertices[1] - p).norm(), (vertices[2] - p).norm()));
+    }
+}
+
+
+/**
+   @if jp
+   方向 d に最も遠い点 (サポート点) を返す。
+   @endif
+*/
+Vector3 ConvexPrimitive::support(const Vector3& d) const
+{
+    switch(type_){
+
+    case BOX:
+    {
+        Vector3 s(p);
+        for(int i=0; i < 3; ++i){
+            s += ((R.col(i).dot(d) >= 0.0) ? size[i] : -size[i]) * R.col(i);
+        }
+        return s;
+    }
+    case CYLINDER:
+    {
+        const Vector3 axis(R.col(1));
+        const double a = axis.dot(d);
+        Vector3 s(p + ((a >= 0.0) ? size[1] : -size[1]) * axis);
+        const Vector3 r(d - a * axis);
+        const double len = r.norm();
+        if(len > 1.0e-12){
+            s += (size[0] / len) * r;
+        }
+        return s;
+    }
+    case CONE:
+    {
+        const Vector3 axis(R.col(1));
+        const Vector3 apex(p + size[1] * axis);
+        Vector3 rim(p - size[1] * axis);
+        const Vector3 r(d - axis.dot(d) * axis);
+        const double len = r.norm();
+        if(len > 1.0e-12){
+            rim += (size[0] / len) * r;
+        }
+        return (apex.dot(d) >= rim.dot(d)) ? apex : rim;
+    }
+    default:
+    {
+        int k = 0;
+        for(int i=1; i < 3; ++i){
+            if(vertices[i].dot(d) > vertices[k].dot(d)){
+                k = i;
+            }
+        }
+        return vertices[k];
+    }
+    }
+}
+
+
+/**
+   @if jp
+   方向 d に最も遠い面、辺または点を頂点列として返す。
+   @else
+   Gets the face, the edge or the point of the primitive furthest in the
+   unit direction d. A face is given as a convex polygon and the caps of
+   cylinders and cones are approximated by regular polygons.
+   @endif
+*/
+void ConvexPrimitive::getFeature(const Vector3& d, std::vector<Vector3>& out_points) const
+{
+    out_points.clear();
+
+    switch(type_){
+    case BOX:
+        getBoxFeature(d, out_points);
+        break;
+    case CYLINDER:
+        getCylinderFeature(d, out_points);
+        break;
+    case CONE:
+        getConeFeature(d, out_points);
+        break;
+    default:
+        getTriangleFeature(d, out_points);
+        break;
+    }
+}
+
+
+void ConvexPrimitive::getBoxFeature(const Vector3& d, std::vector<Vector3>& out_points) const
+{
+    const Vector3 dl(R.transpose() * d);
+
+    int i = 0;
+    for(int k=1; k < 3; ++k){
+        if(fabs(dl[k]) > fabs(dl[i])){
+            i = k;
+        }
+    }
+    if(fabs(dl[i]) >= cosFaceFeature){
+        const int j = (i + 1) % 3;
+        const int k = (i + 2) % 3;
+        const Vector3 c(p + ((dl[i] >= 0.0) ? size[i] : -size[i]) * R.col(i));
+        const Vector3 u(size[j] * R.col(j));
+        const Vector3 v(size[k] * R.col(k));
+        out_points.push_back(c + u + v);
+        out_points.push_back(c - u + v);
+        out_points.push_back(c - u - v);
+        out_points.push_back(c + u - v);
+        return;
+    }
+
+    const Vector3 s(support(d));
+    int k = 0;
+    for(int m=1; m < 3; ++m){
+        if(fabs(dl[m]) < fabs(dl[k])){
+            k = m;
+        }
+    }
+    if(fabs(dl[k]) <= sinEdgeFeature){
+        const Vector3 axis(R.col(k));
+        const Vector3 c(s - axis.dot(s - p) * axis);
+        out_points.push_back(c + size[k] * axis);
+        out_points.push_back(c - size[k] * axis);
+    } else {
+        out_points.push_back(s);
+    }
+}
+
+
+void ConvexPrimitive::getCapFeature(const Vector3& capCenter, std::vector<Vector3>& out_points) const
+{
+    for(int i=0; i < numCapVertices; ++i){
+        double angle = 2.0 * PI * i / numCapVertices;
+        out_points.push_back(capCenter + size[0] * (cos(angle) * R.col(0) + sin(angle) * R.col(2)));
+    }
+}
+
+
+void ConvexPrimitive::getCylinderFeature(const Vector3& d, std::vector<Vector3>& out_points) const
+{
+    const Vector3 axis(R.col(1));
+    const double a = axis.dot(d);
+
+    if(fabs(a) >= cosFaceFeature){
+        getCapFeature(p + ((a >= 0.0) ? size[1] : -size[1]) * axis, out_points);
+
+    } else if(fabs(a) <= sinEdgeFeature){
+        const Vector3 r((d - a * axis).normalized());
+        const Vector3 c(p + size[0] * r);
+        out_points.push_back(c + size[1] * axis);
+        out_points.push_back(c - size[1] * axis);
+
+    } else {
+        out_points.push_back(support(d));
+    }
+}
+
+
+void ConvexPrimitive::getConeFeature(const Vector3& d, std::vector<Vector3>& out_points) const
+{
+    const Vector3 axis(R.col(1));
+    const double a = axis.dot(d);
+
+    if(-a >= cosFaceFeature){
+        getCapFeature(p - size[1] * axis, out_points);
+        return;
+    }
+
+    Vector3 r(d - a * axis);
+    const double len = r.norm();
+    if(len > 1.0e-12){
+        r /= len;
+    } else {
+        r = R.col(0);
+    }
+    const Vector3 apex(p + size[1] * axis);
+    const Vector3 rim(p - size[1] * axis + size[0] * r);
+    const Vector3 sideLine((apex - rim).normalized());
+    if(fabs(sideLine.dot(d)) <= sinEdgeFeature && r.dot(d) > 0.0){
+        out_points.push_back(rim);
+        out_points.push_back(apex);
+    } else {
+        out_points.push_back(support(d));
+    }
+}
+
+
+void ConvexPrimitive::getTriangleFeature(const Vector3& d, std::vector<Vector3>& out_points) const
+{
+    double s[3];
+    double maxEdgeLength = 0.0;
+    for(int i=0; i < 3; ++i){
+        s[i] = vertices[i].dot(d);
+        maxEdgeLength = std::max(maxEdgeLength, (vertices[(i + 1) % 3] - vertices[i]).norm());
+    }
+    const double threshold = std::max(s[0], std::max(s[1], s[2])) - sinEdgeFeature * maxEdgeLength;
+    for(int i=0; i < 3; ++i){
+        if(s[i] >= threshold){
+            out_points.push_back(vertices[i]);
+        }
+    }
+}
+
+
+/**
+   @if jp
+   直方体どうしは分離軸判定、それ以外は GJK と EPA で法線と侵入深さを求め、
+   接触する面や辺をクリッピングして接触点を得る。
+   @endif
+*/
+bool hrp::collideConvexPrimitives(const ConvexPrimitive& a, const ConvexPrimitive& b,
+                                  std::vector<collision_data>& out_contacts)
+{
+    const double r = a.boundingRadius() + b.boundingRadius();
+    if((b.center() - a.center()).squaredNorm() > r * r){
+        return false;
+    }
+
+    Vector3 normal;
+    double depth;
+
+    if(a.type() == ConvexPrimitive::BOX && b.type() == ConvexPrimitive::BOX){
+        if(!findBoxBoxPenetration(a, b, normal, depth)){
+            return false;
+        }
+    } else {
+        Vector3 simplex[4];
+        if(!findEnclosingSimplex(a, b, simplex)){
+            return false;
+        }
+        if(!computePenetration(a, b, simplex, normal, depth)){
+            return false;
+        }
+    }
+
+    if(depth <= 0.0){
+        return false;
+    }
+
+    generateContacts(a, b, normal, depth, out_contacts);
+
+    return true;
+}
+
+
+/**
+   @if jp
+   分離軸判定の軸のうち、直方体を三角形の裏側へ押し込まない軸で重なりが最小のものを法線とする。
+   @endif
+*/
+bool hrp::collideTriangleBox(const ConvexPrimitive& triangle, const ConvexPrimitive& box,
+                             std::vector<collision_data>& out_contacts)
+{
+    const Vector3 edges[3] = {
+        triangle.vertex(1) - triangle.vertex(0),
+        triangle.vertex(2) - triangle.vertex(1),
+        triangle.vertex(0) - triangle.vertex(2)
+    };
+    Vector3 faceNormal(edges[0].cross(-edges[2]));
+    const double len = faceNormal.norm();
+    if(len < 1.0e-12){
+        return false;
+    }
+    faceNormal /= len;
+
+    // only the box penetrating the front side is in contact with the triangle
+    const double boxRadius = projectedBoxRadius(box, faceNormal);
+    const double height = faceNormal.dot(box.center() - triangle.vertex(0));
+    if(height - boxRadius >= 0.0 || height + boxRadius <= 0.0){
+        return false;
+    }
+    Vector3 normal(faceNormal);
+    double depth = boxRadius - height;
+
+    for(int i=0; i < 12; ++i){
+        Vector3 axis(i < 3 ? box.axis(i) : Vector3(edges[(i - 3) / 3].cross(box.axis((i - 3) % 3))));
+        double axisLen = axis.norm();
+        if(axisLen < 1.0e-6){
+            continue;
+        }
+        axis /= axisLen;
+
+        double tmin = axis.dot(triangle.vertex(0));
+        double tmax = tmin;
+        for(int j=1; j < 3; ++j){
+            double t = axis.dot(triangle.vertex(j));
+            tmin = std::min(tmin, t);
+            tmax = std::max(tmax, t);
+        }
+        const double c = axis.dot(box.center());
+        const double r = projectedBoxRadius(box, axis);
+        const double overlapPlus = tmax - (c - r);
+        const double overlapMinus = (c + r) - tmin;
+        if(overlapPlus <= 0.0 || overlapMinus <= 0.0){
+            return false;
+        }
+        if(overlapMinus < overlapPlus){
+            axis = -axis;
+        }
+        const double overlap = std::min(overlapPlus, overlapMinus);
+        if(axis.dot(faceNormal) > -1.0e-6 && overlap < triangleNonFaceAxisRatio * depth){
+            normal = axis;
+            depth = overlap;
+        }
+    }
+
+    generateContacts(triangle, box, normal, depth, out_contacts);
+
+    return true;
+}
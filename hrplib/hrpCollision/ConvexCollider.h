@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2008, AIST, the University of Tokyo and General Robotix Inc.
+ * All rights reserved. This program is made available under the terms of the
+ * Eclipse Public License v1.0 which accompanies this distribution, and is
+ * available at http://www.eclipse.org/legal/epl-v10.html
+ * Contributors:
+ * National Institute of Advanced Industrial Science and Technology (AIST)
+ */
+
+#ifndef HRPCOLLISION_CONVEX_COLLIDER_H_INCLUDED
+#define HRPCOLLISION_CONVEX_COLLIDER_H_INCLUDED
+
+#include <vector>
+#include <hrpUtil/EigenTypes.h>
+#include "CollisionData.h"
+
+namespace hrp {
+
+    /**
+       @if jp
+       接触計算のためにワールド座標で表した凸形状 (直方体、円柱、円錐、三角形)。
+       @else
+       A convex shape expressed in the world frame for the analytic contact
+       generation of ColdetModelPair.
+
+       The axis of a cylinder and a cone is the local Y axis and the apex of
+       a cone is on its positive side as well as VRML97.
+       extents() gives the half extents of a box and the radius and the half
+       height of a cylinder and a cone.
+       @endif
+    */
+    class ConvexPrimitive
+    {
+      public:
+        enum Type { BOX, CYLINDER, CONE, TRIANGLE };
+
+        void setBox(const Vector3& p, const Matrix33& R, const Vector3& halfExtents);
+        void setCylinder(const Vector3& p, const Matrix33& R, double radius, double halfHeight);
+        void setCone(const Vector3& p, const Matrix33& R, double radius, double halfHeight);
+        void setTriangle(const Vector3& v0, const Vector3& v1, const Vector3& v2);
+
+        Type type() const { return type_; }
+        const Vector3& center() const { return p; }
+        Vector3 axis(int i) const { return R.col(i); }
+        const Vector3& extents() const { return size; }
+        const Vector3& vertex(int i) const { return vertices[i]; }
+
+        double boundingRadius() const;
+
+        Vector3 support(const Vector3& d) const;
+        void getFeature(const Vector3& d, std::vector<Vector3>& out_points) const;
+
+      private:
+        Type type_;
+        Vector3 p;
+        Matrix33 R;
+        Vector3 size;
+        Vector3 vertices[3];
+
+        void getBoxFeature(const Vector3& d, std::vector<Vector3>& out_points) const;
+        void getCylinderFeature(const Vector3& d, std::vector<Vector3>& out_points) const;
+        void getConeFeature(const Vector3& d, std::vector<Vector3>& out_points) const;
+        void getTriangleFeature(const Vector3& d, std::vector<Vector3>& out_points) const;
+        void getCapFeature(const Vector3& capCenter, std::vector<Vector3>& out_points) const;
+    };
+
+    /**
+       @if jp
+       二つの凸形状の接触点を out_contacts に追加する。法線は a から b へ向く。
+       @else
+       Appends the contacts of two convex primitives to out_contacts.
+       The normals point from a to b.
+       @return true if they are penetrating
+       @endif
+    */
+    bool collideConvexPrimitives(const ConvexPrimitive& a, const ConvexPrimitive& b,
+                                 std::vector<collision_data>& out_contacts);
+
+    /**
+       @if jp
+       メッシュ表面の三角形と直方体の接触点を out_contacts に追加する。法線は三角形から直方体へ向く。
+       @else
+       Appends the contacts of a triangle of a mesh surface and a box to out_contacts.
+       The front side of the triangle is given by the counterclockwise order of
+       its vertices and the box is never pushed to its back side.
+       The normals point from the triangle to the box.
+       @return true if they are penetrating
+       @endif
+    */
+    bool collideTriangleBox(const ConvexPrimitive& triangle, const ConvexPrimitive& box,
+                            std::vector<collision_data>& out_contacts);
+}
+
+#endif
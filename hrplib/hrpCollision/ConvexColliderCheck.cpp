@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2008, AIST, the University of Tokyo and General Robotix Inc.
+ * All rights reserved. This program is made available under the terms of the
+ * Eclipse Public License v1.0 which accompanies this distribution, and is
+ * available at http://www.eclipse.org/legal/epl-v10.html
+ * Contributors:
+ * National Institute of Advanced Industrial Science and Technology (AIST)
+ * General Robotix Inc.
+ */
+
+/**
+   Checks the contacts given by the analytic contact generation of
+   ColdetModelPair for box-box, box-mesh and cylinder pairs.
+
+   In each scene a primitive rests on another shape with a known
+   penetration, so the depth, the direction of the normal and the region
+   which must contain the contact points are known in advance.
+   The normals are expected to point from the first model to the second one.
+   The program returns a non-zero value if a contact differs.
+*/
+
+#include "ColdetModel.h"
+#include "ColdetModelPair.h"
+#include <cstdio>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+using namespace hrp;
+
+namespace {
+
+    const double DEPTH_EPS = 1.0e-5;
+    const double NORMAL_EPS = 1.0e-4;
+    const double POINT_EPS = 1.0e-4;
+    const double PI = 3.14159265358979323846;
+
+    ColdetModelPtr createBox(double sx, double sy, double sz)
+    {
+        ColdetModelPtr model(new ColdetModel());
+        model->setNumVertices(8);
+        for(int i=0; i < 8; ++i){
+            model->setVertex(i, (i & 1) ? sx/2.0 : -sx/2.0, (i & 2) ? sy/2.0 : -sy/2.0,
+                             (i & 4) ? sz/2.0 : -sz/2.0);
+        }
+        static const int faces[12][3] = {
+            { 0, 2, 1 }, { 1, 2, 3 }, { 4, 5, 6 }, { 5, 7, 6 },
+            { 0, 1, 4 }, { 1, 5, 4 }, { 2, 6, 3 }, { 3, 6, 7 },
+            { 0, 4, 2 }, { 2, 4, 6 }, { 1, 3, 5 }, { 3, 7, 5 } };
+        model->setNumTriangles(12);
+        for(int i=0; i < 12; ++i){
+            model->setTriangle(i, faces[i][0], faces[i][1], faces[i][2]);
+        }
+        model->setPrimitiveType(ColdetModel::SP_BOX);
+        model->setNumPrimitiveParams(3);
+        model->setPrimitiveParam(0, sx);
+        model->setPrimitiveParam(1, sy);
+        model->setPrimitiveParam(2, sz);
+        model->build();
+        return model;
+    }
+
+    // the axis is the local Y axis as well as VRML97
+    ColdetModelPtr createCylinder(int n, double radius, double height)
+    {
+        ColdetModelPtr model(new ColdetModel());
+        model->setNumVertices(n*2 + 2);
+        for(int i=0; i < n; ++i){
+            double th = 2.0 * PI * i / n;
+            model->setVertex(i, radius * cos(th), height/2.0, -radius * sin(th));
+            model->setVertex(n+i, radius * cos(th), -height/2.0, -radius * sin(th));
+        }
+        int top = n*2, bottom = n*2 + 1;
+        model->setVertex(top, 0.0, height/2.0, 0.0);
+        model->setVertex(bottom, 0.0, -height/2.0, 0.0);
+        model->setNumTriangles(n*4);
+        int t = 0;
+        for(int i=0; i < n; ++i){
+            int j = (i + 1) % n;
+            model->setTriangle(t++, top, i, j);
+            model->setTriangle(t++, bottom, n+j, n+i);
+            model->setTriangle(t++, i, n+i, n+j);
+            model->setTriangle(t++, i, n+j, j);
+        }
+        model->setPrimitiveType(ColdetModel::SP_CYLINDER);
+        model->setNumPrimitiveParams(5);
+        model->setPrimitiveParam(0, radius);
+        model->setPrimitiveParam(1, height);
+        model->setPrimitiveParam(2, 1.0f);
+        model->setPrimitiveParam(3, 1.0f);
+        model->setPrimitiveParam(4, 1.0f);
+        model->build();
+        return model;
+    }
+
+    ColdetModelPtr createFloor(int n, double size)
+    {
+        ColdetModelPtr model(new ColdetModel());
+        model->setNumVertices((n+1)*(n+1));
+        for(int i=0; i <= n; ++i){
+            for(int j=0; j <= n; ++j){
+                model->setVertex(i*(n+1)+j, size*(i/(double)n - 0.5), size*(j/(double)n - 0.5), 0.0);
+            }
+        }
+        model->setNumTriangles(n*n*2);
+        int t = 0;
+        for(int i=0; i < n; ++i){
+            for(int j=0; j < n; ++j){
+                int a = i*(n+1)+j, b = a+1, c = a+n+1, d = c+1;
+                model->setTriangle(t++, a, c, b);
+                model->setTriangle(t++, b, c, d);
+            }
+        }
+        model->build();
+        return model;
+    }
+
+    void setPosition(ColdetModelPtr model, const Matrix33& R, const Vector3& p)
+    {
+        double Ra[9], pa[3];
+        for(int i=0; i < 3; ++i){
+            for(int j=0; j < 3; ++j){
+                Ra[i*3+j] = R(i, j);
+            }
+            pa[i] = p[i];
+        }
+        model->setPosition(Ra, pa);
+    }
+
+    Matrix33 rotationX(double th)
+    {
+        Matrix33 R;
+        R << 1.0, 0.0, 0.0,
+             0.0, cos(th), -sin(th),
+             0.0, sin(th), cos(th);
+        return R;
+    }
+
+    Matrix33 rotationZ(double th)
+    {
+        Matrix33 R;
+        R << cos(th), -sin(th), 0.0,
+             sin(th), cos(th), 0.0,
+             0.0, 0.0, 1.0;
+        return R;
+    }
+
+    /**
+       The contact points must be in the box given by the world coordinates
+       [lower, upper] and, if radius is positive, within the distance of
+       radius from the vertical line through center.
+    */
+    struct Expectation
+    {
+        double depth;
+        Vector3 normal;
+        int minNumPoints;
+        Vector3 lower;
+        Vector3 upper;
+        Vector3 center;
+        double radius;
+    };
+
+    int checkPair(const char* name, ColdetModelPtr model0, ColdetModelPtr model1, const Expectation& e)
+    {
+        ColdetModelPair pair(model0, model1);
+        vector<collision_data>& contacts = pair.detectCollisions();
+
+        int numPoints = 0;
+        int numErrors = 0;
+
+        for(size_t i=0; i < contacts.size(); ++i){
+            const collision_data& c = contacts[i];
+            if(fabs(c.depth - e.depth) > DEPTH_EPS){
+                printf("%s: contact %d has depth %g instead of %g\n", name, (int)i, c.depth, e.depth);
+                ++numErrors;
+            }
+            if((c.n_vector - e.normal).norm() > NORMAL_EPS){
+                printf("%s: contact %d has normal (%g, %g, %g) instead of (%g, %g, %g)\n", name, (int)i,
+                       c.n_vector[0], c.n_vector[1], c.n_vector[2], e.normal[0], e.normal[1], e.normal[2]);
+                ++numErrors;
+            }
+            for(int j=0; j < c.num_of_i_points; ++j){
+                const Vector3& p = c.i_points[j];
+                bool inside = true;
+                for(int k=0; k < 3; ++k){
+                    if(p[k] < e.lower[k] - POINT_EPS || p[k] > e.upper[k] + POINT_EPS){
+                        inside = false;
+                    }
+                }
+                if(e.radius > 0.0){
+                    Vector3 d(p - e.center);
+                    d[2] = 0.0;
+                    if(d.norm() > e.radius + POINT_EPS){
+                        inside = false;
+                    }
+                }
+                if(!inside){
+                    printf("%s: contact point (%g, %g, %g) is out of the contact region\n", name, p[0], p[1], p[2]);
+                    ++numErrors;
+                }
+                ++numPoints;
+            }
+        }
+
+        if(numPoints < e.minNumPoints){
+            printf("%s: %d contact points are less than %d\n", name, numPoints, e.minNumPoints);
+            ++numErrors;
+        }
+
+        printf("%s: %d contacts, %d points, %d errors\n", name, (int)contacts.size(), numPoints, numErrors);
+
+        return (numErrors == 0) ? 0 : 1;
+    }
+
+    // a box of 0.2 x 0.1 x 0.06 rotated around the Z axis sinks 1mm into a large box
+    int checkBoxBox()
+    {
+        ColdetModelPtr base = createBox(1.0, 1.0, 1.0);
+        ColdetModelPtr box = createBox(0.2, 0.1, 0.06);
+        setPosition(base, Matrix33::Identity(), Vector3(0.0, 0.0, -0.5));
+        setPosition(box, rotationZ(0.3), Vector3(0.1, -0.05, 0.029));
+
+        Expectation e;
+        e.depth = 0.001;
+        e.normal = Vector3(0.0, 0.0, 1.0);
+        e.minNumPoints = 4;
+        double r = sqrt(0.1*0.1 + 0.05*0.05);
+        e.lower = Vector3(0.1 - r, -0.05 - r, -0.001);
+        e.upper = Vector3(0.1 + r, -0.05 + r, 0.0);
+        e.center = Vector3(0.1, -0.05, 0.0);
+        e.radius = r;
+
+        int result = checkPair("box-box", base, box, e);
+
+        // the normal is reversed when the order of the models is reversed
+        e.normal = -e.normal;
+        result |= checkPair("box-box (reversed)", box, base, e);
+
+        return result;
+    }
+
+    // a box of 0.2 x 0.1 x 0.06 sinks 1mm into a meshed floor
+    int checkBoxMesh()
+    {
+        ColdetModelPtr floor = createFloor(20, 2.0);
+        ColdetModelPtr box = createBox(0.2, 0.1, 0.06);
+        setPosition(floor, Matrix33::Identity(), Vector3(0.0, 0.0, 0.0));
+        setPosition(box, rotationZ(-0.4), Vector3(0.03, 0.02, 0.029));
+
+        Expectation e;
+        e.depth = 0.001;
+        e.normal = Vector3(0.0, 0.0, -1.0);
+        e.minNumPoints = 4;
+        double r = sqrt(0.1*0.1 + 0.05*0.05);
+        e.lower = Vector3(0.03 - r, 0.02 - r, -0.001);
+        e.upper = Vector3(0.03 + r, 0.02 + r, 0.0);
+        e.center = Vector3(0.03, 0.02, 0.0);
+        e.radius = r;
+
+        int result = checkPair("box-mesh", box, floor, e);
+
+        e.normal = -e.normal;
+        result |= checkPair("mesh-box", floor, box, e);
+
+        return result;
+    }
+
+    int checkCylinder()
+    {
+        ColdetModelPtr base = createBox(1.0, 1.0, 1.0);
+        setPosition(base, Matrix33::Identity(), Vector3(0.0, 0.0, -0.5));
+
+        // a standing cylinder of radius 0.05 sinks 1mm with its bottom cap
+        ColdetModelPtr standing = createCylinder(32, 0.05, 0.2);
+        setPosition(standing, rotationX(PI / 2.0), Vector3(0.1, 0.2, 0.099));
+
+        Expectation e;
+        e.depth = 0.001;
+        e.normal = Vector3(0.0, 0.0, 1.0);
+        e.minNumPoints = 3;
+        e.lower = Vector3(0.05, 0.15, -0.001);
+        e.upper = Vector3(0.15, 0.25, 0.0);
+        e.center = Vector3(0.1, 0.2, 0.0);
+        e.radius = 0.05;
+
+        int result = checkPair("box-cylinder (cap)", base, standing, e);
+
+        // a lying cylinder touches with the line of its side
+        ColdetModelPtr lying = createCylinder(32, 0.05, 0.2);
+        setPosition(lying, rotationZ(0.5), Vector3(-0.1, 0.0, 0.049));
+
+        e.minNumPoints = 2;
+        double hx = 0.1 * sin(0.5), hy = 0.1 * cos(0.5);
+        e.lower = Vector3(-0.1 - hx, -hy, -0.001);
+        e.upper = Vector3(-0.1 + hx, hy, 0.0);
+        e.radius = 0.0;
+
+        result |= checkPair("box-cylinder (side)", base, lying, e);
+
+        // two cylinders stacked with their caps
+        ColdetModelPtr upper = createCylinder(32, 0.04, 0.1);
+        setPosition(upper, rotationX(PI / 2.0), Vector3(0.12, 0.2, 0.198 + 0.05));
+
+        e.normal = Vector3(0.0, 0.0, 1.0);
+        e.minNumPoints = 3;
+        e.lower = Vector3(0.08, 0.16, 0.198);
+        e.upper = Vector3(0.15, 0.24, 0.199);
+        e.center = Vector3(0.12, 0.2, 0.0);
+        e.radius = 0.04;
+
+        result |= checkPair("cylinder-cylinder", standing, upper, e);
+
+        return result;
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    int result = 0;
+    result |= checkBoxBox();
+    result |= checkBoxMesh();
+    result |= checkCylinder();
+    return result;
+}
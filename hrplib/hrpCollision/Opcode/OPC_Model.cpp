@@ -210,6 +210,42 @@ bool Model::Build(const OPCODECREATE& create)
 	return true;
 }
 
+#if 1 // Added by AIST
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Builds a collision model from an optimized tree that has been built beforehand.
+ *	\param		create		[in] model creation structure
+ *	\param		tree		[in] optimized tree matching create.mNoLeaf and create.mQuantized
+ *	\return		true if success
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Model::Build(const OPCODECREATE& create, AABBOptimizedTree* tree)
+{
+	// Checkings
+	if(!tree)	return false;
+	if(!create.mIMesh || !create.mIMesh->IsValid())
+	{
+		DELETESINGLE(tree);
+		return false;
+	}
+
+	Release();
+
+	SetMeshInterface(create.mIMesh);
+
+	// Setup model code as CreateTree() does, but keep the given tree
+	if(create.mNoLeaf)		mModelCode |= OPC_NO_LEAF;
+	else					mModelCode &= ~OPC_NO_LEAF;
+
+	if(create.mQuantized)	mModelCode |= OPC_QUANTIZED;
+	else					mModelCode &= ~OPC_QUANTIZED;
+
+	mTree = tree;
+
+	return true;
+}
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
  *	Gets the number of bytes used by the tree.
@@ -36,6 +36,19 @@
 		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 		override(BaseModel)	bool				Build(const OPCODECREATE& create);
 
+#if 1 // Added by AIST
+		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+		/**
+		 *	Builds a collision model from an optimized tree that has been built beforehand,
+		 *	e.g. a tree restored from a cache file. The model takes the ownership of the tree.
+		 *	\param		create		[in] model creation structure
+		 *	\param		tree		[in] optimized tree matching create.mNoLeaf and create.mQuantized
+		 *	\return		true if success
+		 */
+		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+							bool				Build(const OPCODECREATE& create, AABBOptimizedTree* tree);
+#endif
+
 #ifdef __MESHMERIZER_H__
 		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 		/**
@@ -266,6 +266,22 @@ bool AABBCollisionTree::Build(AABBTree* tree)
 	return true;
 }
 
+#if 1 // Added by AIST
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Replaces the nodes with an array that has been restored from a serialized tree.
+ *	\param		nodes			[in] linked nodes allocated with new[]
+ *	\param		nb_nodes		[in] number of nodes
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void AABBCollisionTree::SetNodes(AABBCollisionNode* nodes, udword nb_nodes)
+{
+	if(nodes!=mNodes)	DELETEARRAY(mNodes);
+	mNodes = nodes;
+	mNbNodes = nb_nodes;
+}
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
  *	Refits the collision tree after vertices have been modified.
@@ -192,6 +192,18 @@
 	class OPCODE_API AABBCollisionTree : public AABBOptimizedTree
 	{
 		IMPLEMENT_COLLISION_TREE(AABBCollisionTree, AABBCollisionNode)
+#if 1 // Added by AIST
+		public:
+		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+		/**
+		 *	Replaces the nodes with an array that has been restored from a serialized tree.
+		 *	The tree takes the ownership of the array, which must be allocated with new[].
+		 *	\param		nodes			[in] linked nodes in the layout of Build(AABBTree*)
+		 *	\param		nb_nodes		[in] number of nodes
+		 */
+		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+						void				SetNodes(AABBCollisionNode* nodes, udword nb_nodes);
+#endif
 	};
 
 	class OPCODE_API AABBNoLeafTree : public AABBOptimizedTree
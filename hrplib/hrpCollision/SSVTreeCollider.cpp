@@ -1,10 +1,24 @@
 #include <iostream>
 #include "SSVTreeCollider.h"
 #include "DistFuncs.h"
+#include "AABBTreeAccessor.h"
+#include "Opcode/OPC_BoxBoxOverlap.h"
+
+using hrp::AABBTreeAccessor;
+using hrp::TreeNodeRef;
 
 static bool debug = false;
 
+/**
+ * the SSVs are stored only in the nodes of normal trees
+ */
+static bool hasNormalTree(const Model* model)
+{
+    return model->HasLeafNodes() && !model->IsQuantized();
+}
+
 SSVTreeCollider::SSVTreeCollider()
+    : mTree0(0), mTree1(0)
 {
 }
 
@@ -14,17 +28,40 @@ bool SSVTreeCollider::Distance(BVTCache& cache,
 {
     // Checkings
     if(!cache.Model0 || !cache.Model1)								return false;
-    if(cache.Model0->HasLeafNodes()!=cache.Model1->HasLeafNodes())	return false;
-    if(cache.Model0->IsQuantized()!=cache.Model1->IsQuantized())	return false;
 
     // Checkings
     if(!Setup(cache.Model0->GetMeshInterface(), cache.Model1->GetMeshInterface()))	return false;
     
-    // Simple double-dispatch
-    const AABBCollisionTree* T0 = (const AABBCollisionTree*)cache.Model0->GetTree();
-    const AABBCollisionTree* T1 = (const AABBCollisionTree*)cache.Model1->GetTree();
-    Distance(T0, T1, world0, world1, &cache, minD, point0, point1);
-	return true;
+    if(hasNormalTree(cache.Model0) && hasNormalTree(cache.Model1)){
+        // Simple double-dispatch
+        const AABBCollisionTree* T0 = (const AABBCollisionTree*)cache.Model0->GetTree();
+        const AABBCollisionTree* T1 = (const AABBCollisionTree*)cache.Model1->GetTree();
+        Distance(T0, T1, world0, world1, &cache, minD, point0, point1);
+        return true;
+    }
+
+    AABBTreeAccessor tree0(*cache.Model0);
+    AABBTreeAccessor tree1(*cache.Model1);
+    mTree0 = &tree0;
+    mTree1 = &tree1;
+
+    InitQuery(world0, world1);
+
+    mId0 = GetFirstPrimitive(mTree0);
+    mId1 = GetFirstPrimitive(mTree1);
+    Point p0, p1;
+    minD = PrimDist(mId0, mId1, p0, p1);
+
+    _Distance(tree0.root(), tree1.root(), minD, p0, p1);
+
+    TransformPoint4x3(point0, p0, *world1);
+    TransformPoint4x3(point1, p1, *world1);
+
+    cache.id0 = mId0;
+    cache.id1 = mId1;
+
+    mTree0 = mTree1 = 0;
+    return true;
 }
 
 void SSVTreeCollider::Distance(const AABBCollisionTree* tree0, 
@@ -74,16 +111,69 @@ bool SSVTreeCollider::Collide(BVTCache& cache, double tolerance,
 {
     // Checkings
     if(!cache.Model0 || !cache.Model1)								return false;
-    if(cache.Model0->HasLeafNodes()!=cache.Model1->HasLeafNodes())	return false;
-    if(cache.Model0->IsQuantized()!=cache.Model1->IsQuantized())	return false;
 
     // Checkings
     if(!Setup(cache.Model0->GetMeshInterface(), cache.Model1->GetMeshInterface()))	return false;
     
-    // Simple double-dispatch
-    const AABBCollisionTree* T0 = (const AABBCollisionTree*)cache.Model0->GetTree();
-    const AABBCollisionTree* T1 = (const AABBCollisionTree*)cache.Model1->GetTree();
-    return Collide(T0, T1, world0, world1, &cache, tolerance);
+    if(hasNormalTree(cache.Model0) && hasNormalTree(cache.Model1)){
+        // Simple double-dispatch
+        const AABBCollisionTree* T0 = (const AABBCollisionTree*)cache.Model0->GetTree();
+        const AABBCollisionTree* T1 = (const AABBCollisionTree*)cache.Model1->GetTree();
+        return Collide(T0, T1, world0, world1, &cache, tolerance);
+    }
+
+    AABBTreeAccessor tree0(*cache.Model0);
+    AABBTreeAccessor tree1(*cache.Model1);
+    mTree0 = &tree0;
+    mTree1 = &tree1;
+
+    InitQuery(world0, world1);
+
+    bool collided = _Collide(tree0.root(), tree1.root(), tolerance);
+    if(collided){
+        cache.id0 = mId0;
+        cache.id1 = mId1;
+    }
+
+    mTree0 = mTree1 = 0;
+    return collided;
+}
+
+bool SSVTreeCollider::Collide(BVTCache& cache,
+                              const Matrix4x4* world0, const Matrix4x4* world1)
+{
+    // Checkings
+    if(!cache.Model0 || !cache.Model1)								return false;
+
+    if(hasNormalTree(cache.Model0) && hasNormalTree(cache.Model1)){
+        return AABBTreeCollider::Collide(cache, world0, world1);
+    }
+
+    // Checkings
+    if(!Setup(cache.Model0->GetMeshInterface(), cache.Model1->GetMeshInterface()))	return false;
+
+    AABBTreeAccessor tree0(*cache.Model0);
+    AABBTreeAccessor tree1(*cache.Model1);
+    mTree0 = &tree0;
+    mTree1 = &tree1;
+
+    InitQuery(world0, world1);
+
+    // the nodes are not passed to the collision pair inserter
+    mNowNode0 = null;
+    mNowNode1 = null;
+
+    if(!CheckTemporalCoherence(&cache)){
+        _CollideTriangles(tree0.root(), tree1.root());
+    }
+
+    if(GetContactStatus()){
+        cache.id0 = mPairs.GetEntry(0);
+        cache.id1 = mPairs.GetEntry(1);
+    }
+
+    mTree0 = mTree1 = 0;
+    return true;
 }
 
 bool SSVTreeCollider::Collide(const AABBCollisionTree* tree0, 
@@ -109,25 +199,32 @@ bool SSVTreeCollider::Collide(const AABBCollisionTree* tree0,
 
 float SSVTreeCollider::SsvSsvDist(const AABBCollisionNode *b0, 
                                   const AABBCollisionNode *b1)
+{
+    return SsvSsvDist(b0->mAABB, b1->mAABB);
+}
+
+float SSVTreeCollider::SsvSsvDist(const CollisionAABB& a0, const CollisionAABB& a1)
 {
     CollisionAABB::ssv_type t1, t2;
-    t1 = b0->mAABB.mType;
-    t2 = b1->mAABB.mType;
+    t1 = a0.mType;
+    t2 = a1.mType;
     if (t1 == CollisionAABB::SSV_PSS && t2 == CollisionAABB::SSV_PSS){
-        return PssPssDist(b0->mAABB.mRadius, b0->mAABB.mCenter, 
-                          b1->mAABB.mRadius, b1->mAABB.mCenter);
+        return PssPssDist(a0.mRadius, a0.mCenter, 
+                          a1.mRadius, a1.mCenter);
     }else if (t1 == CollisionAABB::SSV_PSS && t2 == CollisionAABB::SSV_LSS){
-        return PssLssDist(b0->mAABB.mRadius, b0->mAABB.mCenter,
-                          b1->mAABB.mRadius, b1->mAABB.mPoint0, b1->mAABB.mPoint1);
+        return PssLssDist(a0.mRadius, a0.mCenter,
+                          a1.mRadius, a1.mPoint0, a1.mPoint1);
     }else if (t1 == CollisionAABB::SSV_LSS && t2 == CollisionAABB::SSV_PSS){
-        return LssPssDist(b0->mAABB.mRadius, b0->mAABB.mPoint0, b0->mAABB.mPoint1,
-                          b1->mAABB.mRadius, b1->mAABB.mCenter);
+        return LssPssDist(a0.mRadius, a0.mPoint0, a0.mPoint1,
+                          a1.mRadius, a1.mCenter);
     }else if (t1 == CollisionAABB::SSV_LSS && t2 == CollisionAABB::SSV_LSS){
-        return PssPssDist(sqrtf(b0->GetSize()), b0->mAABB.mCenter, 
-                          sqrtf(b1->GetSize()), b1->mAABB.mCenter);
+        return PssPssDist(sqrtf(a0.mExtents.SquareMagnitude()), a0.mCenter, 
+                          sqrtf(a1.mExtents.SquareMagnitude()), a1.mCenter);
     }else{
         std::cerr << "this ssv combination is not supported" << std::endl;
     }
+    // the pair is treated as far apart so that it is never descended into
+    return MAX_FLOAT;
 }
 
 float SSVTreeCollider::PssPssDist(float r0, const Point& center0, float r1, const Point& center1)
@@ -239,6 +336,139 @@ bool SSVTreeCollider::_Collide(const AABBCollisionNode* b0, const AABBCollisionN
     return false;
 }
 
+/**
+ * @brief gets the box of a node of a tree of any layout and creates its SSV
+ */
+void SSVTreeCollider::GetSSV(const AABBTreeAccessor* tree, const TreeNodeRef& node, CollisionAABB& out_box)
+{
+    tree->getBox(node, out_box.mCenter, out_box.mExtents);
+    out_box.CreateSSV();
+}
+
+udword SSVTreeCollider::GetFirstPrimitive(const AABBTreeAccessor* tree)
+{
+    TreeNodeRef node = tree->root();
+    while(!tree->isPrimitive(node)){
+        node = tree->getNeg(node);
+    }
+    return tree->getPrimitive(node);
+}
+
+void SSVTreeCollider::_Distance(const TreeNodeRef& n0, const TreeNodeRef& n1,
+                                float& minD, Point& point0, Point& point1)
+{
+    CollisionAABB a0, a1;
+    GetSSV(mTree0, n0, a0);
+    GetSSV(mTree1, n1, a1);
+
+    // Perform BV-BV distance test
+    float d = SsvSsvDist(a0, a1);
+
+    if(d > minD) return;
+
+    bool isLeaf0 = mTree0->isPrimitive(n0);
+    bool isLeaf1 = mTree1->isPrimitive(n1);
+
+    if(isLeaf0 && isLeaf1) { 
+        udword id0 = mTree0->getPrimitive(n0);
+        udword id1 = mTree1->getPrimitive(n1);
+        Point p0, p1;
+        d = PrimDist(id0, id1, p0, p1);
+        if (d < minD){
+            minD = d;
+            point0 = p0;
+            point1 = p1;
+            mId0 = id0;
+            mId1 = id1;
+        }
+        return;
+    }
+
+    if(isLeaf1 || (!isLeaf0 && (a0.mExtents.SquareMagnitude() > a1.mExtents.SquareMagnitude())))
+	{
+            _Distance(mTree0->getNeg(n0), n1, minD, point0, point1);
+            _Distance(mTree0->getPos(n0), n1, minD, point0, point1);
+	}
+    else
+	{
+            _Distance(n0, mTree1->getNeg(n1), minD, point0, point1);
+            _Distance(n0, mTree1->getPos(n1), minD, point0, point1);
+	}
+}
+
+bool SSVTreeCollider::_Collide(const TreeNodeRef& n0, const TreeNodeRef& n1,
+                               double tolerance)
+{
+    CollisionAABB a0, a1;
+    GetSSV(mTree0, n0, a0);
+    GetSSV(mTree1, n1, a1);
+
+    // Perform BV-BV distance test
+    float d = SsvSsvDist(a0, a1);
+
+    if(d > tolerance) return false;
+
+    bool isLeaf0 = mTree0->isPrimitive(n0);
+    bool isLeaf1 = mTree1->isPrimitive(n1);
+
+    if(isLeaf0 && isLeaf1) { 
+        udword id0 = mTree0->getPrimitive(n0);
+        udword id1 = mTree1->getPrimitive(n1);
+        Point p0, p1;
+        d = PrimDist(id0, id1, p0, p1);
+        if (d <= tolerance){
+            mId0 = id0;
+            mId1 = id1;
+            return true;
+        }else{
+            return false;
+        }
+    }
+
+    if(isLeaf1 || (!isLeaf0 && (a0.mExtents.SquareMagnitude() > a1.mExtents.SquareMagnitude())))
+	{
+            if (_Collide(mTree0->getNeg(n0), n1, tolerance)) return true;
+            if (_Collide(mTree0->getPos(n0), n1, tolerance)) return true;
+	}
+    else
+	{
+            if (_Collide(n0, mTree1->getNeg(n1), tolerance)) return true;
+            if (_Collide(n0, mTree1->getPos(n1), tolerance)) return true;
+	}
+    return false;
+}
+
+void SSVTreeCollider::_CollideTriangles(const TreeNodeRef& n0, const TreeNodeRef& n1)
+{
+    Point c0, e0, c1, e1;
+    mTree0->getBox(n0, c0, e0);
+    mTree1->getBox(n1, c1, e1);
+
+    // Perform BV-BV overlap test
+    if(!BoxBoxOverlap(e0, c0, e1, c1)) return;
+
+    bool isLeaf0 = mTree0->isPrimitive(n0);
+    bool isLeaf1 = mTree1->isPrimitive(n1);
+
+    if(isLeaf0 && isLeaf1) {
+        PrimTest(mTree0->getPrimitive(n0), mTree1->getPrimitive(n1));
+        return;
+    }
+
+    if(isLeaf1 || (!isLeaf0 && (e0.SquareMagnitude() > e1.SquareMagnitude())))
+	{
+            _CollideTriangles(mTree0->getNeg(n0), n1);
+            if(ContactFound()) return;
+            _CollideTriangles(mTree0->getPos(n0), n1);
+	}
+    else
+	{
+            _CollideTriangles(n0, mTree1->getNeg(n1));
+            if(ContactFound()) return;
+            _CollideTriangles(n0, mTree1->getPos(n1));
+	}
+}
+
 float SSVTreeCollider::PrimDist(udword id0, udword id1, Point& point0, Point& point1)
 {
     // Request vertices from the app
@@ -6,6 +6,11 @@
 
 using namespace Opcode;
 
+namespace hrp {
+    class AABBTreeAccessor;
+    struct TreeNodeRef;
+}
+
 /**
  * @brief collision detector based on SSV(Sphere Swept Volume)
  */
@@ -45,6 +50,19 @@ public:
     bool Collide(BVTCache& cache, double tolerance,
                  const Matrix4x4* world0=null, const Matrix4x4* world1=null);
 
+    /**
+     * @brief detect intersecting triangles between links.
+     *
+     * Unlike AABBTreeCollider::Collide(), the trees of the links may have
+     * any layouts, which may differ from each other.
+     * The intersecting triangles are passed to the collision pair inserter.
+     * @param cache
+     * @param world0 transformation of the first link
+     * @param world1 transformation of the second link
+     * @return true if computed successfully, false otherwise
+     */
+    bool Collide(BVTCache& cache, const Matrix4x4* world0, const Matrix4x4* world1);
+
 protected:
      /**
      * @brief compute distance between SSV(Swept Sphere Volume)s
@@ -54,6 +72,14 @@ protected:
      */
      float SsvSsvDist(const AABBCollisionNode* b0, const AABBCollisionNode *b1);
 
+     /**
+     * @brief compute distance between SSV(Swept Sphere Volume)s
+     * @param a0 box of the left tree whose SSV has been created
+     * @param a1 box of the right tree whose SSV has been created
+     * @param return distance
+     */
+     float SsvSsvDist(const CollisionAABB& a0, const CollisionAABB& a1);
+
     /**
      * @brief compute distance between primitives(triangles)
      * @param id0 index of the first primitive
@@ -79,6 +105,18 @@ private:
     
     bool _Collide(const AABBCollisionNode* b0, const AABBCollisionNode* b1,
                   double tolerance);
+
+    // traversals for the trees of any layouts
+    const hrp::AABBTreeAccessor* mTree0;
+    const hrp::AABBTreeAccessor* mTree1;
+
+    void _Distance(const hrp::TreeNodeRef& n0, const hrp::TreeNodeRef& n1,
+                   float& minD, Point& point0, Point& point1);
+    bool _Collide(const hrp::TreeNodeRef& n0, const hrp::TreeNodeRef& n1,
+                  double tolerance);
+    void _CollideTriangles(const hrp::TreeNodeRef& n0, const hrp::TreeNodeRef& n1);
+    void GetSSV(const hrp::AABBTreeAccessor* tree, const hrp::TreeNodeRef& node, CollisionAABB& out_box);
+    udword GetFirstPrimitive(const hrp::AABBTreeAccessor* tree);
     /**
      * @brief compute distance between PSS(Point Swept Sphere)
      * @param r0 radius of the first sphere
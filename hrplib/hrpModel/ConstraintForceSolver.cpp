@@ -29,6 +29,7 @@
 #include <hrpCollision/ColdetModelPair.h>
 
 #include <limits>
+#include <algorithm>
 #include <boost/format.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <boost/random.hpp>
@@ -120,6 +121,7 @@ namespace hrp
 
         bool addCollisionCheckLinkPair
         (int bodyIndex1, Link* link1, int bodyIndex2, Link* link2, double muStatic, double muDynamic, double culling_thresh, double restitution, double epsilon);
+        bool setContactReduction(Link* link1, Link* link2, int maxNumContactPoints);
 		bool addExtraJoint
 		(int bodyIndex1, Link* link1, int bodyIndex2, Link* link2, const double* link1LocalPos, const double* link2LocalPos, const short jointType, const double* jointAxis );
 
@@ -216,6 +218,7 @@ namespace hrp
             double culling_thresh;
 			double restitution;
             double epsilon;
+            int maxNumContactPoints; // 0 if contact points are not reduced
         };
         typedef intrusive_ptr<LinkPair> LinkPairPtr;
         typedef std::vector<LinkPairPtr> LinkPairArray;
@@ -281,6 +284,7 @@ namespace hrp
 		void initExtraJoints(int bodyIndex);
         void setConstraintPoints(CollisionSequence& collisions);
         void setContactConstraintPoints(LinkPair& linkPair, CollisionPointSequence& collisionPoints);
+        void reduceContactPoints(LinkPair& linkPair);
         void setFrictionVectors(ConstraintPoint& constraintPoint);
 		void setExtraJointConstraintPoints(ExtraJointLinkPairPtr& linkPair);
         void putContactPoints();
@@ -432,11 +436,27 @@ bool CFSImpl::addCollisionCheckLinkPair
         linkPair->culling_thresh = culling_thresh;
 		linkPair->restitution = restitution;
         linkPair->epsilon = epsilon;
+        linkPair->maxNumContactPoints = 0;
     }
 
     return (index >= 0 && !isRegistered);
 }
 
+
+bool CFSImpl::setContactReduction(Link* link1, Link* link2, int maxNumContactPoints)
+{
+    for(size_t i=0; i < collisionCheckLinkPairs.size(); ++i){
+        LinkPair* linkPair = collisionCheckLinkPairs[i].get();
+        if(linkPair &&
+           ((linkPair->link[0] == link1 && linkPair->link[1] == link2) ||
+            (linkPair->link[0] == link2 && linkPair->link[1] == link1))){
+            linkPair->maxNumContactPoints = std::max(maxNumContactPoints, 0);
+            return true;
+        }
+    }
+    return false;
+}
+
 bool CFSImpl::addExtraJoint(int bodyIndex1, Link* link1, int bodyIndex2, Link* link2, const double* link1LocalPos, const double* link2LocalPos, const short jointType, const double* jointAxis )
 {
 	ExtraJointLinkPairPtr linkPair;
@@ -867,81 +887,225 @@ void CFSImpl::setContactConstraintPoints(LinkPair& linkPair, CollisionPointSeque
             constraintPoints.pop_back();
         } else {
             numExtractedPoints++;
-            contact.globalIndex = globalNumConstraintVectors++;
+        }
+    }
 
-            // check velocities
-            Vector3 v[2];
-            for(int k=0; k < 2; ++k){
-                Link* link = linkPair.link[k];
-                if(link->isRoot() && link->jointType == Link::FIXED_JOINT){
-                    v[k].setZero();
-                } else {
-                    v[k] = link->vo + link->w.cross(contact.point);
-                    if (link->isCrawler){
-                        // tentative
-                        // invalid depths should be fixed
-                        if (contact.depth > allowedPenetrationDepth*2){
-                            contact.depth = allowedPenetrationDepth*2;
-                        }
-                        Vector3 axis = link->R*link->a;
-                        Vector3 n;
-                        getVector3(n, collision.normal);
-                        Vector3 dir = axis.cross(n);
-                        if (k) dir *= -1;
-                        dir.normalize();
-                        v[k] += link->u*dir;
+    if(linkPair.maxNumContactPoints > 0 && numExtractedPoints > linkPair.maxNumContactPoints){
+        reduceContactPoints(linkPair);
+    }
+
+    for(size_t j=0; j < constraintPoints.size(); ++j){
+
+        ConstraintPoint& contact = constraintPoints[j];
+
+        contact.globalIndex = globalNumConstraintVectors++;
+
+        // check velocities
+        Vector3 v[2];
+        for(int k=0; k < 2; ++k){
+            Link* link = linkPair.link[k];
+            if(link->isRoot() && link->jointType == Link::FIXED_JOINT){
+                v[k].setZero();
+            } else {
+                v[k] = link->vo + link->w.cross(contact.point);
+                if (link->isCrawler){
+                    // tentative
+                    // invalid depths should be fixed
+                    if (contact.depth > allowedPenetrationDepth*2){
+                        contact.depth = allowedPenetrationDepth*2;
                     }
+                    Vector3 axis = link->R*link->a;
+                    const Vector3& n = contact.normalTowardInside[1];
+                    Vector3 dir = axis.cross(n);
+                    if (k) dir *= -1;
+                    dir.normalize();
+                    v[k] += link->u*dir;
                 }
             }
-            contact.relVelocityOn0 = v[1] - v[0];
+        }
+        contact.relVelocityOn0 = v[1] - v[0];
 
-            contact.normalProjectionOfRelVelocityOn0 = contact.normalTowardInside[1].dot(contact.relVelocityOn0);
+        contact.normalProjectionOfRelVelocityOn0 = contact.normalTowardInside[1].dot(contact.relVelocityOn0);
 
-            if( ! areThereImpacts){
-                if(contact.normalProjectionOfRelVelocityOn0 < -1.0e-6){
-                    areThereImpacts = true;
-                }
+        if( ! areThereImpacts){
+            if(contact.normalProjectionOfRelVelocityOn0 < -1.0e-6){
+                areThereImpacts = true;
             }
+        }
 
-            Vector3 v_tangent(contact.relVelocityOn0 - contact.normalProjectionOfRelVelocityOn0 * contact.normalTowardInside[1]);
-
-            contact.globalFrictionIndex = globalNumFrictionVectors;
-
-            double vt_square = v_tangent.dot(v_tangent);
-            static const double vsqrthresh = VEL_THRESH_OF_DYNAMIC_FRICTION * VEL_THRESH_OF_DYNAMIC_FRICTION;
-            bool isSlipping = (vt_square > vsqrthresh);
-            contact.mu = isSlipping ? linkPair.muDynamic : linkPair.muStatic;
-
-            if( !ONLY_STATIC_FRICTION_FORMULATION && isSlipping){
-                contact.numFrictionVectors = 1;
-                double vt_mag = sqrt(vt_square);
-                Vector3 t1(v_tangent / vt_mag);
-                Vector3 t2(contact.normalTowardInside[1].cross(t1));
-                Vector3 t3(t2.cross(contact.normalTowardInside[1]));
-                contact.frictionVector[0][0] = t3.normalized();
-                contact.frictionVector[0][1] = -contact.frictionVector[0][0];
-
-                // proportional dynamic friction near zero velocity
-                if(PROPORTIONAL_DYNAMIC_FRICTION){
-                    vt_mag *= 10000.0;
-                    if(vt_mag < contact.mu){
-                        contact.mu = vt_mag;
-                    }
+        Vector3 v_tangent(contact.relVelocityOn0 - contact.normalProjectionOfRelVelocityOn0 * contact.normalTowardInside[1]);
+
+        contact.globalFrictionIndex = globalNumFrictionVectors;
+
+        double vt_square = v_tangent.dot(v_tangent);
+        static const double vsqrthresh = VEL_THRESH_OF_DYNAMIC_FRICTION * VEL_THRESH_OF_DYNAMIC_FRICTION;
+        bool isSlipping = (vt_square > vsqrthresh);
+        contact.mu = isSlipping ? linkPair.muDynamic : linkPair.muStatic;
+
+        if( !ONLY_STATIC_FRICTION_FORMULATION && isSlipping){
+            contact.numFrictionVectors = 1;
+            double vt_mag = sqrt(vt_square);
+            Vector3 t1(v_tangent / vt_mag);
+            Vector3 t2(contact.normalTowardInside[1].cross(t1));
+            Vector3 t3(t2.cross(contact.normalTowardInside[1]));
+            contact.frictionVector[0][0] = t3.normalized();
+            contact.frictionVector[0][1] = -contact.frictionVector[0][0];
+
+            // proportional dynamic friction near zero velocity
+            if(PROPORTIONAL_DYNAMIC_FRICTION){
+                vt_mag *= 10000.0;
+                if(vt_mag < contact.mu){
+                    contact.mu = vt_mag;
                 }
+            }
+        } else {
+            if(ENABLE_STATIC_FRICTION){
+                contact.numFrictionVectors = (STATIC_FRICTION_BY_TWO_CONSTRAINTS ? 2 : 4);
+                setFrictionVectors(contact);
             } else {
-                if(ENABLE_STATIC_FRICTION){
-                    contact.numFrictionVectors = (STATIC_FRICTION_BY_TWO_CONSTRAINTS ? 2 : 4);
-                    setFrictionVectors(contact);
-                } else {
-                    contact.numFrictionVectors = 0;
-                }
+                contact.numFrictionVectors = 0;
             }
-            globalNumFrictionVectors += contact.numFrictionVectors;
         }
+        globalNumFrictionVectors += contact.numFrictionVectors;
     }
 }
 
 
+/**
+   Reduces the contact points of a link pair to linkPair.maxNumContactPoints.
+
+   The deepest point is kept first. Then the two points farthest from each
+   other in the contact plane and the farthest points on both sides of the
+   line between them are kept, which maximizes the area of the contact
+   polygon. Further points are chosen as the ones farthest from the kept
+   points. Each removed point is assigned to the nearest kept point, which
+   takes over the depth of the removed point if it is deeper.
+   The kept points remain in the original order.
+*/
+void CFSImpl::reduceContactPoints(LinkPair& linkPair)
+{
+    ConstraintPointArray& constraintPoints = linkPair.constraintPoints;
+    const int numPoints = constraintPoints.size();
+    const int maxNumPoints = linkPair.maxNumContactPoints;
+
+    int deepest = 0;
+    Vector3 normal(Vector3::Zero());
+    for(int i=0; i < numPoints; ++i){
+        normal += constraintPoints[i].normalTowardInside[1];
+        if(constraintPoints[i].depth > constraintPoints[deepest].depth){
+            deepest = i;
+        }
+    }
+    double norm = normal.norm();
+    if(norm > 1.0e-6){
+        normal /= norm;
+    } else {
+        normal = constraintPoints[deepest].normalTowardInside[1];
+    }
+
+    // the points projected on the contact plane
+    std::vector<Vector3> points(numPoints);
+    for(int i=0; i < numPoints; ++i){
+        const Vector3& p = constraintPoints[i].point;
+        points[i] = p - normal.dot(p) * normal;
+    }
+
+    int candidates[5];
+    int numCandidates = 0;
+    candidates[numCandidates++] = deepest;
+
+    int ends[2] = { deepest, -1 };
+    for(int k=0; k < 2; ++k){
+        double maxDistance = -1.0;
+        for(int i=0; i < numPoints; ++i){
+            double d = (points[i] - points[ends[0]]).squaredNorm();
+            if(d > maxDistance){
+                maxDistance = d;
+                ends[1] = i;
+            }
+        }
+        candidates[numCandidates++] = ends[1];
+        ends[0] = ends[1];
+    }
+
+    // the farthest points on the positive and negative sides of the diagonal
+    const Vector3 diagonal(points[candidates[2]] - points[candidates[1]]);
+    int sides[2] = { -1, -1 };
+    double maxAreas[2] = { 0.0, 0.0 };
+    for(int i=0; i < numPoints; ++i){
+        double area = normal.dot(diagonal.cross(points[i] - points[candidates[1]]));
+        int side = (area > 0.0) ? 0 : 1;
+        if(fabs(area) > maxAreas[side]){
+            maxAreas[side] = fabs(area);
+            sides[side] = i;
+        }
+    }
+    for(int k=0; k < 2; ++k){
+        if(sides[k] >= 0){
+            candidates[numCandidates++] = sides[k];
+        }
+    }
+
+    // squared distance to the nearest kept point (-1 for kept points)
+    std::vector<double> distances(numPoints, std::numeric_limits<double>::max());
+    std::vector<int> nearest(numPoints);
+    std::vector<int> kept;
+    kept.reserve(maxNumPoints);
+
+    int candidateIndex = 0;
+    while((int)kept.size() < maxNumPoints){
+        int next = -1;
+        while(candidateIndex < numCandidates && next < 0){
+            int c = candidates[candidateIndex++];
+            if(distances[c] > 0.0){
+                next = c;
+            }
+        }
+        if(next < 0){
+            // points coinciding with the kept ones are never chosen
+            double maxDistance = 0.0;
+            for(int i=0; i < numPoints; ++i){
+                if(distances[i] > maxDistance){
+                    maxDistance = distances[i];
+                    next = i;
+                }
+            }
+            if(next < 0){
+                break;
+            }
+        }
+        nearest[next] = kept.size();
+        distances[next] = -1.0;
+        kept.push_back(next);
+        for(int i=0; i < numPoints; ++i){
+            if(distances[i] >= 0.0){
+                double d = (points[i] - points[next]).squaredNorm();
+                if(d < distances[i]){
+                    distances[i] = d;
+                    nearest[i] = kept.size() - 1;
+                }
+            }
+        }
+    }
+
+    for(int i=0; i < numPoints; ++i){
+        if(distances[i] >= 0.0){
+            ConstraintPoint& keptPoint = constraintPoints[kept[nearest[i]]];
+            if(constraintPoints[i].depth > keptPoint.depth){
+                keptPoint.depth = constraintPoints[i].depth;
+            }
+        }
+    }
+
+    std::sort(kept.begin(), kept.end());
+    for(size_t i=0; i < kept.size(); ++i){
+        if(kept[i] != (int)i){
+            constraintPoints[i] = constraintPoints[kept[i]];
+        }
+    }
+    constraintPoints.resize(kept.size());
+}
+
 
 void CFSImpl::setFrictionVectors(ConstraintPoint& contact)
 {
@@ -1045,6 +1209,7 @@ void CFSImpl::putContactPoints()
             os << " " << linkPair->link[1]->name << " of " << linkPair->bodyData[1]->body->modelName();
             os << "\n";
             os << " culling thresh: " << linkPair->culling_thresh << "\n";
+            os << " max num contact points: " << linkPair->maxNumContactPoints << "\n";
 
             ConstraintPointArray& constraintPoints = linkPair->constraintPoints;
             for(size_t j=0; j < constraintPoints.size(); ++j){
@@ -2190,6 +2355,17 @@ bool ConstraintForceSolver::addCollisionCheckLinkPair
 }
 
 
+/**
+   Limits the number of the contact points of a registered link pair.
+   The reduction is disabled when maxNumContactPoints is 0.
+   @return false if the pair has not been registered by addCollisionCheckLinkPair()
+*/
+bool ConstraintForceSolver::setContactReduction(Link* link1, Link* link2, int maxNumContactPoints)
+{
+    return impl->setContactReduction(link1, link2, maxNumContactPoints);
+}
+
+
 void ConstraintForceSolver::clearCollisionCheckLinkPairs()
 {
     impl->world.clearCollisionPairs();
@@ -123,34 +123,116 @@ namespace {
         return (limitseq.length() == 0) ? defaultValue : limitseq[0];
     }
     
+    void setPrimitiveInfo(ColdetModelPtr& coldetModel, ShapePrimitiveType primitiveType,
+                          const FloatSequence& primitiveParameters,
+                          const double *R, const double *p)
+    {
+        switch(primitiveType){
+        case SP_BOX:
+            coldetModel->setPrimitiveType(ColdetModel::SP_BOX);
+            break;
+        case SP_CYLINDER:
+            coldetModel->setPrimitiveType(ColdetModel::SP_CYLINDER);
+            break;
+        case SP_CONE:
+            coldetModel->setPrimitiveType(ColdetModel::SP_CONE);
+            break;
+        case SP_SPHERE:
+            coldetModel->setPrimitiveType(ColdetModel::SP_SPHERE);
+            break;
+        case SP_PLANE:
+            coldetModel->setPrimitiveType(ColdetModel::SP_PLANE);
+            break;
+        default:
+            break;
+        }
+        coldetModel->setNumPrimitiveParams(primitiveParameters.length());
+        for (unsigned int i=0; i<primitiveParameters.length(); i++){
+            coldetModel->setPrimitiveParam(i, primitiveParameters[i]);
+        }
+        coldetModel->setPrimitivePosition(R, p);
+    }
+
+
+    /**
+       Creates a ColdetModel from the geometry given by BodyInfo::linkCollisionGeometry().
+       The vertices of the geometry are already expressed in the link local frame.
+    */
+    ColdetModelPtr createColdetModelFromGeometry(const LinkCollisionGeometry& geometry, ColdetModel::AABBTreeLayout treeLayout)
+    {
+        ColdetModelPtr coldetModel(new ColdetModel());
+        coldetModel->setName(std::string(geometry.linkName));
+        coldetModel->setAABBTreeLayout(treeLayout);
+
+        const FloatSequence& vertices = geometry.vertices;
+        const LongSequence& triangles = geometry.triangles;
+        const int numVertices = vertices.length() / 3;
+        const int numTriangles = triangles.length() / 3;
+
+        if(numTriangles > 0){
+            coldetModel->setNumVertices(numVertices);
+            coldetModel->setNumTriangles(numTriangles);
+            if(geometry.primitiveType != SP_MESH){
+                const DblArray12& T = geometry.primitiveTransformMatrix;
+                double R[9] = { T[0], T[1], T[2], T[4], T[5], T[6], T[8], T[9], T[10] };
+                double p[3] = { T[3], T[7], T[11] };
+                setPrimitiveInfo(coldetModel, geometry.primitiveType, geometry.primitiveParameters, R, p);
+            }
+            for(int i=0; i < numVertices; ++i){
+                coldetModel->setVertex(i, vertices[i*3], vertices[i*3+1], vertices[i*3+2]);
+            }
+            for(int i=0; i < numTriangles; ++i){
+                coldetModel->setTriangle(i, triangles[i*3], triangles[i*3+1], triangles[i*3+2]);
+            }
+            coldetModel->build();
+        }
+        return coldetModel;
+    }
+
+    
     static Link *createNewLink() { return new Link(); }
     class ModelLoaderHelper
     {
     public:
         ModelLoaderHelper() {
             collisionDetectionModelLoading = false;
+            collisionGeometryAvailable = false;
+            decimationTolerance = 0.0;
+            treeLayout = ColdetModel::AABB_TREE_NORMAL;
             createLinkFunc = createNewLink;
         }
 
         void enableCollisionDetectionModelLoading(bool isEnabled) {
             collisionDetectionModelLoading = isEnabled;
         };
+        void setCollisionMeshDecimationTolerance(double tolerance) {
+            decimationTolerance = tolerance;
+        }
+        void setAABBTreeLayout(ColdetModel::AABBTreeLayout layout) {
+            treeLayout = layout;
+        }
         void setLinkFactory(Link *(*f)()) { createLinkFunc = f; }
 
         bool createBody(BodyPtr& body,  BodyInfo_ptr bodyInfo);
+        bool createColdetModels(BodyPtr body, BodyInfo_ptr bodyInfo, Link* targetLink);
         
     private:
         BodyPtr body;
         LinkInfoSequence_var linkInfoSeq;
         ShapeInfoSequence_var shapeInfoSeq;
+        LinkCollisionGeometrySequence_var collisionGeometrySeq;
         ExtraJointInfoSequence_var extraJointInfoSeq;
         bool collisionDetectionModelLoading;
+        bool collisionGeometryAvailable;
+        double decimationTolerance;
+        ColdetModel::AABBTreeLayout treeLayout;
         Link *(*createLinkFunc)();
 
+        void fetchCollisionGeometries(BodyInfo_ptr bodyInfo);
         Link* createLink(int index, const Matrix33& parentRs);
         void createSensors(Link* link, const SensorInfoSequence& sensorInfoSeq, const Matrix33& Rs);
         void createLights(Link* link, const LightInfoSequence& lightInfoSeq, const Matrix33& Rs);
-        void createColdetModel(Link* link, const LinkInfo& linkInfo);
+        void createColdetModel(Link* link, const LinkInfo& linkInfo, int index);
         void addLinkPrimitiveInfo(ColdetModelPtr& coldetModel, 
                                   const double *R, const double *p,
                                   const ShapeInfo& shapeInfo);
@@ -171,9 +253,13 @@ bool ModelLoaderHelper::createBody(BodyPtr& body, BodyInfo_ptr bodyInfo)
 
     int n = bodyInfo->links()->length();
     linkInfoSeq = bodyInfo->links();
-    shapeInfoSeq = bodyInfo->shapes();
 	extraJointInfoSeq = bodyInfo->extraJoints();
 
+    // the visual data is not transferred unless the collision detection models are built
+    if(collisionDetectionModelLoading){
+        fetchCollisionGeometries(bodyInfo);
+    }
+
     int rootIndex = -1;
 
     for(int i=0; i < n; ++i){
@@ -207,6 +293,66 @@ bool ModelLoaderHelper::createBody(BodyPtr& body, BodyInfo_ptr bodyInfo)
 }
 
 
+/**
+   Receives the collision geometries of all the links.
+   A model loader which does not provide BodyInfo::collisionGeometries()
+   is handled by receiving the whole ShapeInfoSequence instead.
+*/
+void ModelLoaderHelper::fetchCollisionGeometries(BodyInfo_ptr bodyInfo)
+{
+    collisionGeometryAvailable = false;
+    try {
+        collisionGeometrySeq = bodyInfo->collisionGeometries(decimationTolerance);
+        collisionGeometryAvailable = (collisionGeometrySeq->length() == linkInfoSeq->length());
+    } catch(CORBA::BAD_OPERATION& ex){
+    } catch(CORBA::NO_IMPLEMENT& ex){
+    }
+    if(!collisionGeometryAvailable){
+        shapeInfoSeq = bodyInfo->shapes();
+    }
+}
+
+
+/**
+   Builds the coldet models of the links of a body which has been created
+   without them. If targetLink is given, only the geometry of the link is
+   received from the model loader.
+*/
+bool ModelLoaderHelper::createColdetModels(BodyPtr body, BodyInfo_ptr bodyInfo, Link* targetLink)
+{
+    this->body = body;
+
+    if(targetLink && targetLink->index >= 0){
+        try {
+            LinkCollisionGeometry_var geometry =
+                bodyInfo->linkCollisionGeometry(targetLink->index, decimationTolerance);
+            // the link order of the body usually equals the one of the model file
+            if(targetLink->name == geometry->linkName.in()){
+                targetLink->coldetModel = createColdetModelFromGeometry(geometry.in(), treeLayout);
+                return true;
+            }
+        } catch(CORBA::BAD_OPERATION& ex){
+        } catch(CORBA::NO_IMPLEMENT& ex){
+        } catch(CORBA::BAD_PARAM& ex){
+        }
+    }
+
+    linkInfoSeq = bodyInfo->links();
+    fetchCollisionGeometries(bodyInfo);
+
+    bool created = false;
+    int n = linkInfoSeq->length();
+    for(int i=0; i < n; ++i){
+        Link* link = body->link(std::string(linkInfoSeq[i].name));
+        if(link && (!targetLink || link == targetLink)){
+            createColdetModel(link, linkInfoSeq[i], i);
+            created = true;
+        }
+    }
+    return created;
+}
+
+
 Link* ModelLoaderHelper::createLink(int index, const Matrix33& parentRs)
 {
     const LinkInfo& linkInfo = linkInfoSeq[index];
@@ -313,7 +459,7 @@ Link* ModelLoaderHelper::createLink(int index, const Matrix33& parentRs)
     createLights(link, linkInfo.lights, Rs);
 
     if(collisionDetectionModelLoading){
-        createColdetModel(link, linkInfo);
+        createColdetModel(link, linkInfo, index);
     }
 
     return link;
@@ -448,8 +594,13 @@ void ModelLoaderHelper::createSensors(Link* link, const SensorInfoSequence& sens
 }
 
 
-void ModelLoaderHelper::createColdetModel(Link* link, const LinkInfo& linkInfo)
+void ModelLoaderHelper::createColdetModel(Link* link, const LinkInfo& linkInfo, int index)
 {
+    if(collisionGeometryAvailable){
+        link->coldetModel = createColdetModelFromGeometry(collisionGeometrySeq[index], treeLayout);
+        return;
+    }
+
     int totalNumVertices = 0;
     int totalNumTriangles = 0;
     const TransformedShapeIndexSequence& shapeIndices = linkInfo.shapeIndices;
@@ -482,6 +633,7 @@ void ModelLoaderHelper::createColdetModel(Link* link, const LinkInfo& linkInfo)
 
     ColdetModelPtr coldetModel(new ColdetModel());
     coldetModel->setName(std::string(linkInfo.name));
+    coldetModel->setAABBTreeLayout(treeLayout);
     if(totalNumTriangles > 0){
         coldetModel->setNumVertices(totalNumVertices);
         coldetModel->setNumTriangles(totalNumTriangles);
@@ -562,30 +714,7 @@ void ModelLoaderHelper::addLinkPrimitiveInfo(ColdetModelPtr& coldetModel,
                                              const double *R, const double *p,
                                              const ShapeInfo& shapeInfo)
 {
-    switch(shapeInfo.primitiveType){
-    case SP_BOX:
-        coldetModel->setPrimitiveType(ColdetModel::SP_BOX);
-        break;
-    case SP_CYLINDER:
-        coldetModel->setPrimitiveType(ColdetModel::SP_CYLINDER);
-        break;
-    case SP_CONE:
-        coldetModel->setPrimitiveType(ColdetModel::SP_CONE);
-        break;
-    case SP_SPHERE:
-        coldetModel->setPrimitiveType(ColdetModel::SP_SPHERE);
-        break;
-    case SP_PLANE:
-        coldetModel->setPrimitiveType(ColdetModel::SP_PLANE);
-        break;
-    default:
-        break;
-    }
-    coldetModel->setNumPrimitiveParams(shapeInfo.primitiveParameters.length());
-    for (unsigned int i=0; i<shapeInfo.primitiveParameters.length(); i++){
-        coldetModel->setPrimitiveParam(i, shapeInfo.primitiveParameters[i]);
-    }
-    coldetModel->setPrimitivePosition(R, p);
+    setPrimitiveInfo(coldetModel, shapeInfo.primitiveType, shapeInfo.primitiveParameters, R, p);
 }
 
 void ModelLoaderHelper::setExtraJoints()
@@ -630,6 +759,30 @@ bool hrp::loadBodyFromBodyInfo(BodyPtr body, OpenHRP::BodyInfo_ptr bodyInfo, boo
     return false;
 }
 
+bool hrp::loadCollisionGeometry(BodyPtr body, OpenHRP::BodyInfo_ptr bodyInfo, double decimationTolerance,
+                                ColdetModel::AABBTreeLayout treeLayout)
+{
+    if(!CORBA::is_nil(bodyInfo)){
+        ModelLoaderHelper helper;
+        helper.setCollisionMeshDecimationTolerance(decimationTolerance);
+        helper.setAABBTreeLayout(treeLayout);
+        return helper.createColdetModels(body, bodyInfo, 0);
+    }
+    return false;
+}
+
+bool hrp::loadCollisionGeometry(Link* link, OpenHRP::BodyInfo_ptr bodyInfo, double decimationTolerance,
+                                ColdetModel::AABBTreeLayout treeLayout)
+{
+    if(link && link->body && !CORBA::is_nil(bodyInfo)){
+        ModelLoaderHelper helper;
+        helper.setCollisionMeshDecimationTolerance(decimationTolerance);
+        helper.setAABBTreeLayout(treeLayout);
+        return helper.createColdetModels(link->body, bodyInfo, link);
+    }
+    return false;
+}
+
 BodyInfo_var hrp::loadBodyInfo(const char* url, int& argc, char* argv[])
 {
     CORBA::ORB_var orb = CORBA::ORB_init(argc, argv);
@@ -27,6 +27,20 @@
 namespace hrp
 {
     HRPMODEL_API bool loadBodyFromBodyInfo(BodyPtr body, OpenHRP::BodyInfo_ptr bodyInfo, bool loadGeometryForCollisionDetection = false, Link *(*f)()=NULL);
+
+    /**
+       Builds the coldet models of a body loaded without them.
+       Only the collision geometries are received from the model loader, and
+       the meshes are decimated by the grid of decimationTolerance [m] if it is positive.
+       The trees of the coldet models are built with treeLayout, and a compact layout
+       saves memory for large static meshes such as terrains.
+       The version with a link receives the geometry of the link only.
+    */
+    HRPMODEL_API bool loadCollisionGeometry(BodyPtr body, OpenHRP::BodyInfo_ptr bodyInfo, double decimationTolerance = 0.0,
+                                            ColdetModel::AABBTreeLayout treeLayout = ColdetModel::AABB_TREE_NORMAL);
+    HRPMODEL_API bool loadCollisionGeometry(Link* link, OpenHRP::BodyInfo_ptr bodyInfo, double decimationTolerance = 0.0,
+                                            ColdetModel::AABBTreeLayout treeLayout = ColdetModel::AABB_TREE_NORMAL);
+
     HRPMODEL_API OpenHRP::BodyInfo_var loadBodyInfo(const char* url, int& argc, char* argv[]);
     HRPMODEL_API OpenHRP::BodyInfo_var loadBodyInfo(const char* url, CORBA_ORB_var orb);
     HRPMODEL_API OpenHRP::BodyInfo_var loadBodyInfo(const char* url, CosNaming::NamingContext_var cxt);
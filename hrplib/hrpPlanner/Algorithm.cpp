@@ -9,7 +9,7 @@ using namespace PathEngine;
 Algorithm::Algorithm(PathPlanner* planner) 
   : start_(planner->getConfigurationSpace()->size()),
     goal_ (planner->getConfigurationSpace()->size()),
-    isRunning_(false), planner_(planner), verbose_(false)
+    isRunning_(false), planner_(planner), verbose_(false), goalSampler_(NULL)
 {
   properties_["interpolation-distance"] = "0.1"; 
   roadmap_ = RoadmapPtr(new Roadmap(planner_));
@@ -52,6 +52,9 @@ bool Algorithm::tryDirectConnection()
 {
   Mobility *mobility = planner_->getMobility();
 
+  // the goal is not known before sampling
+  if (goalSampler_) return false;
+
   if (mobility->isReachable(start_, goal_)){
     path_.push_back(start_);
     path_.push_back(goal_);
@@ -80,7 +83,7 @@ bool Algorithm::preparePlanning()
   path_.clear();
 
   std::cout << "start:" << start_ << std::endl;
-  std::cout << "goal:" << goal_ << std::endl;
+  if (!goalSampler_) std::cout << "goal:" << goal_ << std::endl;
 
   // validity checks of start&goal configurations
   ConfigurationSpace *cspace = planner_->getConfigurationSpace();
@@ -92,6 +95,7 @@ bool Algorithm::preparePlanning()
       std::cerr << "start configuration is not collision-free" << std::endl;
       return false;
   }
+  if (goalSampler_) return true;
   if (!cspace->isValid(goal_)){
       std::cerr << "goal configuration is invalid" << std::endl;
       return false;
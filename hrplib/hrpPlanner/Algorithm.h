@@ -13,6 +13,7 @@
 namespace PathEngine {
     class PathPlanner;
     class Algorithm;
+    class GoalSampler;
 
     /**
      * 経路計画アルゴリズム生成関数
@@ -95,6 +96,13 @@ namespace PathEngine {
          * @brief デバッグ出力の制御
          */
         bool verbose_;
+
+        /**
+         * @brief 目標コンフィギュレーションをサンプリングするオブジェクト
+         *
+         * setGoalSampler()によってセットされる。セットされている場合はgoal_を使わない。
+         */
+        GoalSampler* goalSampler_;
     public:
         /**
          * @brief コンストラクタ
@@ -135,9 +143,17 @@ namespace PathEngine {
          */
         void setGoalConfiguration(const Configuration &pos) {goal_ = pos;}
 
+        /**
+         * @brief 終了位置の代わりに目標コンフィギュレーションをサンプリングするオブジェクトを設定する
+         *
+         * 対応しているアルゴリズムはRRTのみ。
+         * @param sampler 目標コンフィギュレーションをサンプリングするオブジェクト。NULLの場合は終了位置を使う
+         */
+        void setGoalSampler(GoalSampler* sampler) {goalSampler_ = sampler;}
+
         /**
          * @brief 初期位置と終了位置を直接結べないか検査する
-         * @return 結べた場合はtrue, それ以外はfalse
+         * @return 結べた場合はtrue, それ以外はfalse。目標をサンプリングする場合は常にfalse
          */
         bool tryDirectConnection();
 
@@ -13,11 +13,13 @@ ConfigurationSpace::ConfigurationSpace(unsigned int i_size) : m_size(i_size)
     m_ubounds.resize(m_size);
     m_lbounds.resize(m_size);
     m_isUnboundedRotation.resize(m_size);
+    m_resolutions.resize(m_size);
     
     for (unsigned int i=0; i<m_size; i++){
         m_weights[i] = 1.0;
         m_ubounds[i] = m_lbounds[i] = 0.0;
         m_isUnboundedRotation[i] = false;
+        m_resolutions[i] = 0.0;
     }
 }
 
@@ -89,3 +91,8 @@ bool ConfigurationSpace::unboundedRotation(unsigned int i_rank)
 {
     return m_isUnboundedRotation[i_rank];
 }
+
+double& ConfigurationSpace::resolution(unsigned int i_rank)
+{
+    return m_resolutions[i_rank];
+}
@@ -67,6 +67,13 @@ namespace PathEngine {
          */
         bool unboundedRotation(unsigned int i_rank);
 
+        /**
+         * @brief get resolution of \e i_rank th element, which is used to quantize configurations for the collision check cache of PathPlanner. default is 0
+         * @param i_rank rank of the element
+         * @return resolution. values are not quantized when it is 0
+         */
+        double& resolution(unsigned int i_rank);
+
         /**
          * @brief generate random position
          * @return generated position
@@ -85,6 +92,7 @@ namespace PathEngine {
         std::vector<double> m_lbounds;
         std::vector<double> m_weights;
         std::vector<bool> m_isUnboundedRotation;
+        std::vector<double> m_resolutions;
     };
 };
 
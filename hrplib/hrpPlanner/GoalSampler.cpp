@@ -0,0 +1,143 @@
+// -*- mode: c++; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 4; -*-
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <hrpModel/Body.h>
+#include <hrpModel/Link.h>
+#include <hrpModel/JointPath.h>
+#include "PathPlanner.h"
+#include "ConfigurationSpace.h"
+#include "GoalSampler.h"
+
+using namespace PathEngine;
+using namespace hrp;
+
+GoalSampler::GoalSampler(PathPlanner *planner)
+    : planner_(planner), p_(Vector3::Zero()), R_(Matrix33::Identity()), numThreads_(1),
+      countSeeds_(0), countIKFailures_(0), countOutOfRange_(0), countCollisions_(0)
+{
+}
+
+bool GoalSampler::setJointPath(const std::string &baseLink, const std::string &endLink)
+{
+    BodyPtr body = planner_->robot();
+    if (!body || !body->link(baseLink) || !body->link(endLink)) {
+        std::cerr << "GoalSampler::setJointPath() : link(" << baseLink << " or "
+                  << endLink << ") not found" << std::endl;
+        return false;
+    }
+    baseLinkName_ = baseLink;
+    endLinkName_ = endLink;
+
+    // every solve starts from these angles so that the goals do not
+    // depend on which solve ran before on the same robot
+    JointPathPtr path = body->getJointPath(body->link(baseLink), body->link(endLink));
+    initialAngles_.resize(path->numJoints());
+    for (int i=0; i<path->numJoints(); i++) {
+        initialAngles_[i] = path->joint(i)->q;
+    }
+    return true;
+}
+
+void GoalSampler::setTarget(const Vector3 &p, const Matrix33 &R)
+{
+    p_ = p;
+    R_ = R;
+}
+
+GoalSampler::SolveResult GoalSampler::solve(Configuration &cfg)
+{
+    BodyPtr body = planner_->robot();
+    JointPathPtr path = body->getJointPath(body->link(baseLinkName_), body->link(endLinkName_));
+    for (int i=0; i<path->numJoints(); i++) {
+        path->joint(i)->q = initialAngles_[i];
+    }
+
+    // the seed is applied to the robot of the calling thread
+    if (!planner_->setConfiguration(cfg)) return OutOfRange;
+    if (!path->calcInverseKinematics(p_, R_)) return IKFailed;
+
+    const double inf = std::numeric_limits<double>::max();
+    for (int i=0; i<path->numJoints(); i++) {
+        Link *joint = path->joint(i);
+        bool isInRange = joint->q >= joint->llimit && joint->q <= joint->ulimit;
+        // the solution of a rotational joint may be off the range by whole turns
+        if (!isInRange && joint->jointType == Link::ROTATIONAL_JOINT
+            && joint->llimit > -inf && joint->ulimit < inf) {
+            joint->q -= 2*M_PI*floor((joint->q - joint->llimit)/(2*M_PI));
+            isInRange = joint->q <= joint->ulimit;
+        }
+        if (!isInRange) return OutOfRange;
+    }
+    body->calcForwardKinematics();
+
+    Configuration goal = cfg;
+    if (!extractConfigFunc_(planner_, goal)) return OutOfRange;
+    if (!planner_->getConfigurationSpace()->isValid(goal)) return OutOfRange;
+
+    // the solution is applied again so that the check is the same as the planner's
+    if (planner_->checkCollision(goal)) return Collided;
+
+    cfg = goal;
+    return Valid;
+}
+
+unsigned int GoalSampler::sample(unsigned int numSeeds, std::vector<Configuration> &goals)
+{
+    if (baseLinkName_.empty()) {
+        std::cerr << "GoalSampler::sample() : joint path is not set" << std::endl;
+        return 0;
+    }
+    if (!extractConfigFunc_) {
+        std::cerr << "GoalSampler::sample() : function to extract configuration is not set" << std::endl;
+        return 0;
+    }
+
+    // seeds are made sequentially to use random numbers in a fixed order
+    ConfigurationSpace *cspace = planner_->getConfigurationSpace();
+    std::vector<Configuration> seeds;
+    seeds.reserve(numSeeds);
+    for (unsigned int i=0; i<numSeeds; i++) {
+        seeds.push_back(cspace->random());
+    }
+
+    // the workers of the running algorithm are used if they exist
+    unsigned int numThreads = 1;
+    bool ownsWorkers = false;
+    if (planner_->numWorkers() > 0) {
+        numThreads = std::min(numThreads_, planner_->numWorkers());
+    } else if (numThreads_ > 1 && planner_->setupWorkers(numThreads_)) {
+        numThreads = numThreads_;
+        ownsWorkers = true;
+    }
+    if (numThreads < 1) numThreads = 1;
+
+    int n = seeds.size();
+    std::vector<char> results(n, IKFailed);
+#pragma omp parallel for schedule(dynamic) num_threads(numThreads)
+    for (int i=0; i<n; i++) {
+        results[i] = solve(seeds[i]);
+    }
+    if (ownsWorkers) planner_->clearWorkers();
+
+    unsigned int numGoals = 0;
+    for (int i=0; i<n; i++) {
+        switch (results[i]) {
+        case Valid:
+            goals.push_back(seeds[i]);
+            numGoals++;
+            break;
+        case IKFailed:
+            countIKFailures_++;
+            break;
+        case OutOfRange:
+            countOutOfRange_++;
+            break;
+        case Collided:
+            countCollisions_++;
+            break;
+        }
+    }
+    countSeeds_ += n;
+    return numGoals;
+}
@@ -0,0 +1,144 @@
+// -*- mode: c++; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 4; -*-
+#ifndef __GOAL_SAMPLER_H__
+#define __GOAL_SAMPLER_H__
+
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+#include <hrpUtil/Eigen3d.h>
+#include "Configuration.h"
+#include "exportdef.h"
+
+namespace PathEngine {
+    class PathPlanner;
+
+    typedef boost::function2<bool, PathPlanner *, Configuration &> extractConfigFunc;
+
+    /**
+     * @brief 逆運動学を解いて干渉しない目標コンフィギュレーションをサンプリングする
+     *
+     * ランダムなコンフィギュレーションを初期値として、基準リンクから手先リンクまでの
+     * 逆運動学を解き、関節の可動範囲とコンフィギュレーション空間の範囲に収まり、
+     * PathPlanner::checkCollision()で干渉しない解を目標コンフィギュレーションとする。
+     * 逆運動学と干渉チェックはPathPlanner::setupWorkers()で用意した
+     * ロボットの複製を使って並列に行う。
+     * Algorithm::setGoalSampler()で設定すると、RRTは経路計画中に得られた目標を
+     * ゴールからのツリーに追加する。
+     */
+    class HRPPLANNER_API GoalSampler {
+    public:
+        /**
+         * @brief コンストラクタ
+         * @param planner パスプランナー
+         */
+        GoalSampler(PathPlanner *planner);
+
+        /**
+         * @brief 逆運動学を解く関節列を設定する
+         *
+         * 逆運動学は毎回、このときのロボットの関節角度から解き始める。
+         * コンフィギュレーションで決まる関節は、ランダムに生成した初期値の角度になる。
+         * @param baseLink 基準リンクの名前
+         * @param endLink 手先リンクの名前
+         * @return ロボットにリンクが見つかった場合true
+         */
+        bool setJointPath(const std::string &baseLink, const std::string &endLink);
+
+        /**
+         * @brief 手先リンクの目標位置姿勢を設定する
+         * @param p ワールド座標系での位置
+         * @param R ワールド座標系での姿勢
+         */
+        void setTarget(const hrp::Vector3 &p, const hrp::Matrix33 &R);
+
+        /**
+         * @brief ロボットの姿勢からコンフィギュレーションを求める関数をセットする
+         *
+         * PathPlanner::setApplyConfigFunc()でセットした関数の逆変換となるようにする。
+         * 並列に呼び出されるので、ロボットはPathPlanner::robot()で取得する。
+         * sample()を呼ぶ前にセットする必要がある。
+         * @param i_func ロボットの姿勢からコンフィギュレーションを求める関数。
+         * 第2引数には初期値が渡される
+         */
+        void setExtractConfigFunc(extractConfigFunc i_func) { extractConfigFunc_ = i_func; }
+
+        /**
+         * @brief 並列に逆運動学を解くスレッド数を設定する
+         *
+         * 作業領域が既に用意されている場合は、その数を上限とする。
+         * @param n スレッド数
+         */
+        void numThreads(unsigned int n) { numThreads_ = n; }
+
+        /**
+         * @brief 並列に逆運動学を解くスレッド数を取得する
+         * @return スレッド数
+         */
+        unsigned int numThreads() const { return numThreads_; }
+
+        /**
+         * @brief 目標コンフィギュレーションをサンプリングする
+         *
+         * 初期値は逐次に生成するので、乱数の種が同じであれば同じ結果になる。
+         * 干渉チェックはPathPlanner::checkCollision()で行うので、経路計画の外で
+         * 呼び出す場合は障害物の干渉チェック用モデルの位置が更新されている必要がある。
+         * @param numSeeds 逆運動学を解く初期値の数
+         * @param goals 得られた目標コンフィギュレーションが追加される
+         * @return 得られた目標コンフィギュレーションの数。関節列かコンフィギュレーションを
+         * 求める関数が設定されていない場合は0
+         */
+        unsigned int sample(unsigned int numSeeds, std::vector<Configuration> &goals);
+
+        /**
+         * @brief 逆運動学を解いた回数を取得する
+         * @return 逆運動学を解いた回数
+         */
+        unsigned int countSeeds() const { return countSeeds_; }
+
+        /**
+         * @brief 逆運動学が収束しなかった回数を取得する
+         * @return 逆運動学が収束しなかった回数
+         */
+        unsigned int countIKFailures() const { return countIKFailures_; }
+
+        /**
+         * @brief 解が可動範囲外だった回数を取得する
+         * @return 解が関節の可動範囲かコンフィギュレーション空間の範囲外だった回数
+         */
+        unsigned int countOutOfRange() const { return countOutOfRange_; }
+
+        /**
+         * @brief 解が干渉していた回数を取得する
+         * @return 解が干渉していた回数
+         */
+        unsigned int countCollisions() const { return countCollisions_; }
+    private:
+        /**
+         * @brief 一つの初期値から逆運動学を解いた結果
+         */
+        enum SolveResult {
+            Valid,       ///< 干渉しない解が得られた
+            IKFailed,    ///< 逆運動学が収束しなかった
+            OutOfRange,  ///< 解が可動範囲外だった
+            Collided     ///< 解が干渉していた
+        };
+
+        /**
+         * @brief 呼び出したスレッドのロボットで逆運動学を解く
+         * @param cfg 初期値。Validの場合は目標コンフィギュレーションに書き換えられる
+         * @return 結果
+         */
+        SolveResult solve(Configuration &cfg);
+
+        PathPlanner *planner_;
+        std::string baseLinkName_, endLinkName_;
+        std::vector<double> initialAngles_;
+        hrp::Vector3 p_;
+        hrp::Matrix33 R_;
+        extractConfigFunc extractConfigFunc_;
+        unsigned int numThreads_;
+        unsigned int countSeeds_, countIKFailures_, countOutOfRange_, countCollisions_;
+    };
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "PathPlanner.h"
 #include "Mobility.h"
+#include <algorithm>
 
 using namespace PathEngine;
 
@@ -8,6 +9,14 @@ double Mobility::interpolationDistance_ = 0.1;
 bool Mobility::isReachable(Configuration& from, Configuration& to,
                            bool checkCollision) const
 {
+    if (checkCollision && planner_->isClearanceBasedEdgeCheckEnabled()){
+        double bound = maxDisplacementPerDistance();
+        if (bound > 0){
+            int ret = isReachableByClearance(from, to, bound);
+            if (ret >= 0) return ret != 0;
+        }
+    }
+
     std::vector<Configuration> path;
     if (!getPath(from, to, path)) return false;
 #if 0
@@ -39,5 +48,34 @@ bool Mobility::getPath(Configuration &from, Configuration &to,
     return true;
 }
 
+/**
+   If the clearance at distance s along the path is c, configurations
+   within c/bound from s are collision free. Near obstacles where this
+   range is shorter than interpolationDistance(), configurations are
+   checked at the same interval as getPath(). A positive clearance
+   already tells that the configuration itself is collision free, so
+   the exact distance is computed only for pairs closer than the
+   clearance which gives a step of interpolationDistance().
+*/
+int Mobility::isReachableByClearance(const Configuration& from, const Configuration& to,
+                                     double bound) const
+{
+    double d = distance(from, to);
+    double threshold = bound*interpolationDistance();
+    double s = 0;
+    while (true){
+        Configuration pos = s == 0 ? from : (s >= d ? to : interpolate(from, to, s/d));
+        double clearance = planner_->computeClearance(pos, threshold);
+        if (clearance < 0) return -1;
 
-
+        double step = clearance/bound;
+        if (step < interpolationDistance()){
+            if (clearance == 0 && planner_->checkCollision(pos)) return 0;
+            if (s >= d) return 1;
+            s = std::min(s + interpolationDistance(), d);
+        }else{
+            if (s + step >= d) return 1;
+            s += step;
+        }
+    }
+}
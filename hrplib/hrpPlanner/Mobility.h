@@ -105,6 +105,17 @@ namespace PathEngine {
      * @return
      */
     virtual double distance(const Configuration& from, const Configuration& to) const = 0;
+
+    /**
+     * @brief コンフィギュレーション空間での距離1あたりのロボット表面上の点の移動量の上限
+     *
+     * PathPlanner::enableClearanceBasedEdgeCheck()が有効な場合に、isReachable()が
+     * 干渉チェックを省略できる区間を求めるのに使う。
+     * interpolate()で補間した経路に沿った距離に対する上限を返すこと。
+     * @return 移動量の上限。上限が分からない場合は0
+     */
+    virtual double maxDisplacementPerDistance() const { return 0; }
+
     /**
      * @brief 補間時の隣接する2点間の最大距離を設定する
      * @param d 隣接する2点間の最大距離
@@ -121,6 +132,13 @@ namespace PathEngine {
      * @brief 補間時の隣接する2点間の最大距離
      */
     static double interpolationDistance_;
+
+    /**
+     * @brief 干渉チェックペアの最小距離を使ってfromからtoへ干渉なしに移動可能かどうかを調べる
+     * @param bound maxDisplacementPerDistance()の値
+     * @return 移動可能であれば1、そうでなければ0、最小距離が計算できない場合は-1
+     */
+    int isReachableByClearance(const Configuration& from, const Configuration& to, double bound) const;
   };
 };
 #endif // __MOBILITY_H__
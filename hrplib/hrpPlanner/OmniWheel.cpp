@@ -4,6 +4,7 @@
 #include "OmniWheel.h"
 #define _USE_MATH_DEFINES // for MSVC
 #include <math.h>
+#include <algorithm>
 
 using namespace PathEngine;
 
@@ -53,5 +54,20 @@ double OmniWheel::distance(const Configuration& from, const Configuration& to) c
     return sqrt(v);
 }
 
+/**
+   When the weighted distance of the translation and the rotation is d,
+   a point at robotRadius() from the base link moves at most
+   d*sqrt(1/wxy^2 + robotRadius()^2/wth^2).
+*/
+double OmniWheel::maxDisplacementPerDistance() const
+{
+    ConfigurationSpace *cspace = planner_->getConfigurationSpace();
+    double radius = planner_->robotRadius();
+    if (cspace->size() != 3 || radius < 0) return 0;
 
+    double wxy = std::min(cspace->weight(0), cspace->weight(1));
+    double wth = cspace->weight(2);
+    if (wxy <= 0 || wth <= 0) return 0;
 
+    return sqrt(1.0/(wxy*wxy) + radius*radius/(wth*wth));
+}
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <cstdio>
+#include <algorithm>
 #include "Roadmap.h"
 #include "RoadmapNode.h"
 #include "ConfigurationSpace.h"
@@ -13,6 +14,8 @@ PRM::PRM(PathPlanner* path)
   // デフォルト値セット
   properties_["max-dist"] = "1.0";
   properties_["max-points"] = "100";
+  properties_["num-threads"] = "1";
+  properties_["lazy"] = "0";
 }
 
 PRM::~PRM() {
@@ -31,15 +34,32 @@ bool PRM::buildRoadmap()
       return false;
     }
     
-    // ランダムに与えた点
-    Configuration pos = cspace->random();
-    numTotalPoints++;
-    
+    // ランダムに与えた点。乱数は逐次版と同じ順序で使う
+    unsigned long numSamples = std::max<unsigned long>(maxPoints_ - numPoints, numThreads_);
+    std::vector<Configuration> samples;
+    samples.reserve(numSamples);
+    for (unsigned long i=0; i<numSamples; i++) {
+      samples.push_back(cspace->random());
+    }
+
+    // 干渉チェックは並列に行う
+    int n = samples.size();
+    std::vector<char> isFree(n, false);
+#pragma omp parallel for schedule(dynamic) num_threads(numThreads_)
+    for (int i=0; i<n; i++) {
+      if (isRunning_) {
+        isFree[i] = !planner_->checkCollision(samples[i]);
+      }
+    }
+
     // 干渉する位置でなければ追加
-    if (!planner_->checkCollision(pos)) {
-        RoadmapNodePtr node = RoadmapNodePtr(new RoadmapNode(pos));
-      roadmap_->addNode(node);
-      numPoints++;
+    for (int i=0; i<n && numPoints < maxPoints_; i++) {
+      numTotalPoints++;
+      if (isFree[i]) {
+        RoadmapNodePtr node = RoadmapNodePtr(new RoadmapNode(samples[i]));
+        roadmap_->addNode(node);
+        numPoints++;
+      }
     }
     printf("creating nodes, registered : %ld / tested : %ld\r", numPoints, numTotalPoints); 
   }
@@ -48,34 +68,150 @@ bool PRM::buildRoadmap()
   // エッジを作成
   Mobility* mobility = planner_->getMobility();
   RoadmapNodePtr from, to;
+  std::vector<NodePair> pairs;
   unsigned int n = roadmap_->nNodes();
   for (unsigned long i=0; i<n; i++) {
-    if (!isRunning_) {
-      return false;
-    }
     from = roadmap_->node(i);
     for (unsigned long j=i+1; j<n; j++) {
       to = roadmap_->node(j);
       if (mobility->distance(from->position(), to->position()) < maxDist_) {
-	roadmap_->tryConnection(from, to);
+        pairs.push_back(NodePair(from, to));
       }
     }
   }
 
+  return tryConnections(pairs);
+}
+
+bool PRM::tryConnections(std::vector<NodePair>& pairs)
+{
+  Mobility* mobility = planner_->getMobility();
+  bool isReversible = mobility->isReversible();
+
+  int n = pairs.size();
+  if (lazy_) {
+    // 到達可能かどうかはlazySearch()で必要になったときに検査する
+    for (int i=0; i<n; i++) {
+      roadmap_->addUncheckedEdge(pairs[i].first, pairs[i].second);
+      roadmap_->addUncheckedEdge(pairs[i].second, pairs[i].first);
+    }
+    return true;
+  }
+
+  std::vector<char> forward(n, false), backward(n, false);
+#pragma omp parallel for schedule(dynamic) num_threads(numThreads_)
+  for (int i=0; i<n; i++) {
+    if (!isRunning_) {
+      continue;
+    }
+    Configuration& from = pairs[i].first->position();
+    Configuration& to = pairs[i].second->position();
+    forward[i] = mobility->isReachable(from, to);
+    if (!isReversible) {
+      backward[i] = mobility->isReachable(to, from);
+    }
+  }
+
+  if (!isRunning_) {
+    return false;
+  }
+
+  for (int i=0; i<n; i++) {
+    if (forward[i]) {
+      roadmap_->addEdge(pairs[i].first, pairs[i].second);
+      if (isReversible) roadmap_->addEdge(pairs[i].second, pairs[i].first);
+    }
+    if (backward[i]) {
+      roadmap_->addEdge(pairs[i].second, pairs[i].first);
+    }
+  }
+
   return true;
 }
 
+std::vector<RoadmapNodePtr> PRM::lazySearch(RoadmapNodePtr startNode, RoadmapNodePtr goalNode)
+{
+  Mobility* mobility = planner_->getMobility();
+  bool isReversible = mobility->isReversible();
+  unsigned long numChecked = 0, numRemoved = 0;
+
+  std::vector<RoadmapNodePtr> nodePath;
+  while (isRunning_) {
+    nodePath = roadmap_->shortestPath(startNode, goalNode);
+
+    // 経路上の未検査のエッジ
+    std::vector<int> edges;
+    for (unsigned int i=0; i+1<nodePath.size(); i++) {
+      if (!roadmap_->isChecked(nodePath[i], nodePath[i+1])) edges.push_back(i);
+    }
+    if (edges.empty()) {
+      std::cout << "lazy search: " << numChecked << " edges checked, "
+                << numRemoved << " edges removed" << std::endl;
+      return nodePath;
+    }
+
+    // 1:到達可能 2:到達不能 0:未検査
+    int n = edges.size();
+    std::vector<char> results(n, 0);
+    bool isBlocked = false;
+#pragma omp parallel for schedule(dynamic) num_threads(numThreads_)
+    for (int i=0; i<n; i++) {
+      // 逐次の場合は到達できないエッジが見つかった時点で打ち切る
+      if (!isRunning_ || isBlocked) {
+        continue;
+      }
+      Configuration& from = nodePath[edges[i]]->position();
+      Configuration& to = nodePath[edges[i]+1]->position();
+      results[i] = mobility->isReachable(from, to) ? 1 : 2;
+      if (results[i] == 2 && numThreads_ == 1) {
+        isBlocked = true;
+      }
+    }
+
+    for (int i=0; i<n; i++) {
+      RoadmapNodePtr from = nodePath[edges[i]], to = nodePath[edges[i]+1];
+      if (results[i] == 1) {
+        roadmap_->setChecked(from, to);
+        if (isReversible) roadmap_->setChecked(to, from);
+        numChecked++;
+      } else if (results[i] == 2) {
+        roadmap_->removeEdge(from, to);
+        if (isReversible) roadmap_->removeEdge(to, from);
+        numChecked++;
+        numRemoved++;
+      }
+    }
+  }
+
+  nodePath.clear();
+  return nodePath;
+}
+
 bool PRM::calcPath() 
 {
     std::cout << "PRM::calcPath()" << std::endl;
+  if (goalSampler_) {
+    std::cerr << "PRM::calcPath() : goal sampling is not supported" << std::endl;
+    return false;
+  }
   // Max Dists
   maxDist_  = atof(properties_["max-dist"].c_str());
 
   // Max Points
   maxPoints_ = atoi(properties_["max-points"].c_str());
 
+  // Num Threads
+  int numThreads = atoi(properties_["num-threads"].c_str());
+  numThreads_ = 1;
+  if (numThreads > 1 && planner_->setupWorkers(numThreads)) numThreads_ = numThreads;
+
+  // Lazy
+  lazy_ = atoi(properties_["lazy"].c_str()) != 0;
+
   std::cerr << "maxDist:" << maxDist_ << std::endl;
   std::cerr << "maxPoints:" << maxPoints_ << std::endl;
+  std::cerr << "numThreads:" << numThreads_ << std::endl;
+  std::cerr << "lazy:" << lazy_ << std::endl;
 
   if (roadmap_->nNodes() == 0) buildRoadmap();
 
@@ -87,16 +223,18 @@ bool PRM::calcPath()
   roadmap_->addNode(goalNode);
 
   RoadmapNodePtr node;
+  std::vector<NodePair> pairs;
   for (unsigned long i=0; i<roadmap_->nNodes(); i++) {
     node = roadmap_->node(i);
     const Configuration& pos = node->position();
     if (mobility->distance(start_, pos) < maxDist_) {
-      roadmap_->tryConnection(startNode, node);
+      pairs.push_back(NodePair(startNode, node));
     }
     if (mobility->distance(goal_, pos) < maxDist_) {
-      roadmap_->tryConnection(goalNode, node);
+      pairs.push_back(NodePair(goalNode, node));
     }
   }
+  tryConnections(pairs);
 
   std::cout << "start node has " << startNode->nChildren()
 	    << " childrens" << std::endl;
@@ -104,7 +242,13 @@ bool PRM::calcPath()
 	    << " parents" << std::endl;
 
   std::vector<RoadmapNodePtr> nodePath;
-  nodePath = roadmap_->DFS(startNode, goalNode);
+  if (lazy_) {
+    nodePath = lazySearch(startNode, goalNode);
+  } else {
+    nodePath = roadmap_->DFS(startNode, goalNode);
+  }
+
+  planner_->clearWorkers();
   for (unsigned int i=0; i<nodePath.size(); i++){
     path_.push_back(nodePath[i]->position());
   }
@@ -113,4 +257,3 @@ bool PRM::calcPath()
 
   return path_.size() != 0;
 }
-
@@ -9,9 +9,9 @@
 
 #include "Algorithm.h"
 #include "PathPlanner.h"
+#include "RoadmapNode.h"
 
 namespace PathEngine {
-  class RoadmapNode;
 
   /**
    * @brief PRM アルゴリズム実装クラス
@@ -27,11 +27,39 @@ namespace PathEngine {
     // ランダムに選んだ点からの選ばれるノードの範囲
     double maxDist_;
 
+    // 干渉チェックを行うスレッドの数
+    unsigned int numThreads_;
+
+    // エッジの検査を経路探索時まで遅らせるか
+    bool lazy_;
+
+    typedef std::pair<RoadmapNodePtr, RoadmapNodePtr> NodePair;
+
     /**
      * @brief ロードマップを生成する
      * @return stopPlanning()によって中断された場合はfalse、それ以外はtrue
      */
     bool buildRoadmap();
+
+    /**
+     * @brief ノードの組の接続を並列に試み、接続できた組にエッジを追加する
+     *
+     * エッジはRoadmap::tryConnection()を順に呼んだ場合と同じ順序で追加される。
+     * @param pairs 接続元と接続先の組
+     * @return stopPlanning()によって中断された場合はfalse、それ以外はtrue
+     */
+    bool tryConnections(std::vector<NodePair>& pairs);
+
+    /**
+     * @brief 未検査のエッジを経路上に現れたものだけ検査しながら最短経路を探索する
+     *
+     * 最短経路上の未検査のエッジを検査し、到達できないエッジを削除して探索を
+     * 繰り返す。検査の結果はロードマップに残り、次回以降の探索で再利用される。
+     * @param startNode 初期ノード
+     * @param goalNode 終了ノード
+     * @return 検査済みのエッジだけからなる経路。見つからない場合は空
+     */
+    std::vector<RoadmapNodePtr> lazySearch(RoadmapNodePtr startNode, RoadmapNodePtr goalNode);
     
   public:
     /**
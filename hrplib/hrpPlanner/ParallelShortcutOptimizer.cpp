@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <functional>
+#include "Mobility.h"
+#include "PathPlanner.h"
+#include "TimeUtil.h"
+#include "ParallelShortcutOptimizer.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef WIN32
+#define random() rand()
+#endif
+
+using namespace PathEngine;
+
+unsigned int ParallelShortcutOptimizer::numThreads_ = 0;
+double ParallelShortcutOptimizer::timeLimit_ = 1.0;
+unsigned int ParallelShortcutOptimizer::maxFailures_ = 10;
+
+namespace {
+
+    // the number of candidates checked by a thread in an iteration
+    const int CANDIDATES_PER_THREAD = 8;
+
+    // the minimum number of candidates in an iteration
+    const int MIN_CANDIDATES = 32;
+
+    // shortcuts which shorten the path by less than this ratio of its
+    // length are ignored so that the iterations converge
+    const double MIN_GAIN_RATIO = 1e-3;
+
+    /**
+       A shortcut from cfg1 on the segment index1 to cfg2 on the segment
+       index2. It replaces the waypoints from index1+1 to index2.
+    */
+    struct Shortcut
+    {
+        Shortcut(int index1, int index2, const Configuration& cfg1, const Configuration& cfg2,
+                 double gain)
+            : index1(index1), index2(index2), cfg1(cfg1), cfg2(cfg2), gain(gain) {}
+
+        int index1, index2;
+        Configuration cfg1, cfg2;
+        double gain;
+    };
+
+    int randomIndex(int n)
+    {
+        return std::min((int)(((float)random())/RAND_MAX*n), n-1);
+    }
+}
+
+std::vector<Configuration> ParallelShortcutOptimizer::optimize(const std::vector<Configuration> &path)
+{
+    if (path.size() < 3) return path;
+
+    Mobility *mobility = planner_->getMobility();
+    int numThreads = numThreads_;
+#ifdef _OPENMP
+    if (numThreads == 0) numThreads = omp_get_num_procs();
+#endif
+    if (numThreads < 1) numThreads = 1;
+    bool hasWorkers = numThreads > 1 && planner_->setupWorkers(numThreads);
+    if (!hasWorkers) numThreads = 1;
+
+    std::vector<Configuration> optimized = path;
+    std::vector<double> lengths;
+    unsigned int numFailures = 0, numShortcuts = 0;
+    tick_t startTick = get_tick();
+    while (numFailures < maxFailures_ && tick2sec(get_tick() - startTick) < timeLimit_) {
+        int nSegment = optimized.size()-1;
+        if (nSegment < 2) break;
+
+        // lengths[i] is the length of the path from the first waypoint to the i-th
+        lengths.resize(optimized.size());
+        lengths[0] = 0;
+        for (int i=0; i<nSegment; i++) {
+            lengths[i+1] = lengths[i] + mobility->distance(optimized[i], optimized[i+1]);
+        }
+        double minGain = MIN_GAIN_RATIO*lengths[nSegment];
+
+        // candidates are made sequentially to use random numbers in a fixed order
+        std::vector<Shortcut> candidates;
+        int numCandidates = std::max(numThreads*CANDIDATES_PER_THREAD, MIN_CANDIDATES);
+        for (int i=0; i<numCandidates; i++) {
+            int index1 = randomIndex(nSegment);
+            int index2;
+            do {
+                index2 = randomIndex(nSegment);
+            } while (index1 == index2);
+            if (index2 < index1) std::swap(index1, index2);
+
+            double ratio1 = ((double)random())/RAND_MAX;
+            double ratio2 = ((double)random())/RAND_MAX;
+            Configuration cfg1 = mobility->interpolate(optimized[index1], optimized[index1+1], ratio1);
+            Configuration cfg2 = mobility->interpolate(optimized[index2], optimized[index2+1], ratio2);
+            double s1 = lengths[index1] + ratio1*(lengths[index1+1] - lengths[index1]);
+            double s2 = lengths[index2] + ratio2*(lengths[index2+1] - lengths[index2]);
+            double gain = s2 - s1 - mobility->distance(cfg1, cfg2);
+            if (gain > minGain) {
+                candidates.push_back(Shortcut(index1, index2, cfg1, cfg2, gain));
+            }
+        }
+
+        // the parts of the segments left before cfg1 and after cfg2 are
+        // checked again since they are sampled at different points
+        int n = candidates.size();
+        std::vector<char> isReachable(n, false);
+#pragma omp parallel for schedule(dynamic) num_threads(numThreads)
+        for (int i=0; i<n; i++) {
+            Shortcut& shortcut = candidates[i];
+            isReachable[i] = mobility->isReachable(shortcut.cfg1, shortcut.cfg2)
+                && mobility->isReachable(optimized[shortcut.index1], shortcut.cfg1)
+                && mobility->isReachable(shortcut.cfg2, optimized[shortcut.index2+1]);
+        }
+
+        // take the reachable shortcuts from the largest gain unless they
+        // share segments with a shortcut already taken
+        std::vector<std::pair<double, int> > order;
+        for (int i=0; i<n; i++) {
+            if (isReachable[i]) order.push_back(std::make_pair(candidates[i].gain, i));
+        }
+        std::sort(order.begin(), order.end(), std::greater<std::pair<double, int> >());
+        std::vector<char> isUsed(nSegment, false);
+        std::vector<std::pair<int, int> > selected;
+        for (unsigned int i=0; i<order.size(); i++) {
+            const Shortcut& shortcut = candidates[order[i].second];
+            bool isFree = true;
+            for (int j=shortcut.index1; j<=shortcut.index2 && isFree; j++) {
+                isFree = !isUsed[j];
+            }
+            if (!isFree) continue;
+            for (int j=shortcut.index1; j<=shortcut.index2; j++) isUsed[j] = true;
+            selected.push_back(std::make_pair(shortcut.index1, order[i].second));
+        }
+        if (selected.empty()) {
+            numFailures++;
+            continue;
+        }
+        numFailures = 0;
+        numShortcuts += selected.size();
+
+        std::sort(selected.begin(), selected.end());
+        std::vector<Configuration> shortened;
+        shortened.reserve(optimized.size() + 2*selected.size());
+        int next = 0;
+        for (unsigned int i=0; i<selected.size(); i++) {
+            const Shortcut& shortcut = candidates[selected[i].second];
+            for (int j=next; j<=shortcut.index1; j++) shortened.push_back(optimized[j]);
+            shortened.push_back(shortcut.cfg1);
+            shortened.push_back(shortcut.cfg2);
+            next = shortcut.index2 + 1;
+        }
+        for (unsigned int j=next; j<optimized.size(); j++) shortened.push_back(optimized[j]);
+        optimized.swap(shortened);
+    }
+
+    if (hasWorkers) planner_->clearWorkers();
+    std::cout << "ParallelShortcutOptimizer: " << numShortcuts << " shortcuts in "
+              << tick2sec(get_tick() - startTick) << "[s]" << std::endl;
+    return optimized;
+}
@@ -0,0 +1,76 @@
+// -*- C++ -*-
+#ifndef __PARALLEL_SHORTCUT_OPTIMIZER_H_
+#define __PARALLEL_SHORTCUT_OPTIMIZER_H_
+
+#include "Optimizer.h"
+
+namespace PathEngine{
+  /**
+   * @brief ランダムなショートカットの候補を並列に検査して経路を最適化する
+   *
+   * 経路上の2点を結ぶ候補をまとめて生成し、PathPlanner::setupWorkers()で用意した
+   * ロボットの複製を使って並列に到達可能か検査する。到達可能な候補のうち、
+   * 経路が短くなるものから互いに重ならないものを選んで一度に置き換える。
+   * これを制限時間を過ぎるか、maxFailures()回続けて短くならなくなるまで繰り返す。
+   */
+  class ParallelShortcutOptimizer : public Optimizer
+  {
+  public:
+    /**
+     * @brief コンストラクタ
+     */
+    ParallelShortcutOptimizer(PathPlanner *planner) : Optimizer(planner) {}
+
+    /**
+     * @brief デストラクタ
+     */
+    virtual ~ParallelShortcutOptimizer() {}
+
+    /**
+     * @brief 親クラスのドキュメントを参照
+     */
+    std::vector<Configuration> optimize(const std::vector<Configuration> &path);
+
+    /**
+     * @brief 並列に検査するスレッド数を設定する
+     * @param n スレッド数。0の場合はプロセッサ数
+     */
+    static void numThreads(unsigned int n) { numThreads_ = n; }
+
+    /**
+     * @brief 並列に検査するスレッド数を取得する
+     * @return スレッド数。0の場合はプロセッサ数
+     */
+    static unsigned int numThreads() { return numThreads_; }
+
+    /**
+     * @brief 最適化にかける時間の上限を設定する
+     * @param t 時間の上限[s]
+     */
+    static void timeLimit(double t) { timeLimit_ = t; }
+
+    /**
+     * @brief 最適化にかける時間の上限を取得する
+     * @return 時間の上限[s]
+     */
+    static double timeLimit() { return timeLimit_; }
+
+    /**
+     * @brief 最適化を打ち切るまでに続けて失敗する回数を設定する
+     * @param n 経路が短くならなかった繰り返しの回数
+     */
+    static void maxFailures(unsigned int n) { maxFailures_ = n; }
+
+    /**
+     * @brief 最適化を打ち切るまでに続けて失敗する回数を取得する
+     * @return 経路が短くならなかった繰り返しの回数
+     */
+    static unsigned int maxFailures() { return maxFailures_; }
+  private:
+    static unsigned int numThreads_;
+    static double timeLimit_;
+    static unsigned int maxFailures_;
+  };
+};
+
+#endif
@@ -1,5 +1,10 @@
 #include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
 #include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <hrpUtil/Fnv1aHash.h>
 // planning algorithms
 #include "RRT.h"
 #include "PRM.h"
@@ -9,21 +14,161 @@
 // optimizers
 #include "ShortcutOptimizer.h"
 #include "RandomShortcutOptimizer.h"
+#include "ParallelShortcutOptimizer.h"
 //
 #include "ConfigurationSpace.h"
 #include "PathPlanner.h"
+#include "Roadmap.h"
+#include "RoadmapNode.h"
 
 #include <hrpCorba/OpenHRPCommon.hh>
 #include <hrpModel/Body.h>
 #include <hrpModel/Link.h>
 #include <hrpModel/ModelLoaderUtil.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using namespace PathEngine;
 using namespace hrp;
 
 //static const bool USE_INTERNAL_COLLISION_DETECTOR = false;
 static const bool USE_INTERNAL_COLLISION_DETECTOR = true;
 
+namespace {
+
+    const char roadmapMagic[8] = { 'H', 'R', 'P', 'R', 'D', 'M', 'P', '\0' };
+    const boost::uint32_t roadmapVersion = 1;
+
+    boost::uint64_t hashShape(ColdetModel* model)
+    {
+        return model ? model->getShapeHash() : 0;
+    }
+
+    bool hasSamePrimitive(const ColdetModel& model1, const ColdetModel& model2)
+    {
+        if (model1.getPrimitiveType() != model2.getPrimitiveType()) return false;
+        if (model1.getPrimitiveType() == ColdetModel::SP_MESH) return true;
+        double R1[9], p1[3], R2[9], p2[3];
+        model1.getPrimitivePosition(R1, p1);
+        model2.getPrimitivePosition(R2, p2);
+        return memcmp(R1, R2, sizeof(R1)) == 0 && memcmp(p1, p2, sizeof(p1)) == 0;
+    }
+
+    template <class T>
+    void writeValue(std::ostream& os, const T& value)
+    {
+        os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <class T>
+    bool readValue(std::istream& is, T& value)
+    {
+        is.read(reinterpret_cast<char*>(&value), sizeof(value));
+        return is.good();
+    }
+
+    void writeString(std::ostream& os, const std::string& str)
+    {
+        writeValue(os, (boost::uint32_t)str.size());
+        os.write(str.data(), str.size());
+    }
+
+    bool readString(std::istream& is, std::string& str)
+    {
+        boost::uint32_t size;
+        if (!readValue(is, size) || size > 4096) return false;
+        str.resize(size);
+        if (size > 0) is.read(&str[0], size);
+        return is.good();
+    }
+
+    /**
+       The state of a collision check pair recorded with a roadmap. The
+       pose of a link of the robot depends on the configuration and is
+       left zero.
+    */
+    struct CheckPairRecord
+    {
+        std::string names[2];
+        unsigned char isRobot[2];
+        boost::uint64_t shapes[2];
+        double poses[2][12];
+        double tolerance;
+
+        bool hasSameState(const CheckPairRecord& record) const {
+            return tolerance == record.tolerance
+                && shapes[0] == record.shapes[0] && shapes[1] == record.shapes[1]
+                && memcmp(poses, record.poses, sizeof(poses)) == 0;
+        }
+
+        std::string key() const { return names[0] + "|" + names[1]; }
+
+        void write(std::ostream& os) const {
+            for (int i=0; i<2; i++){
+                writeString(os, names[i]);
+                writeValue(os, isRobot[i]);
+                writeValue(os, shapes[i]);
+                for (int j=0; j<12; j++) writeValue(os, poses[i][j]);
+            }
+            writeValue(os, tolerance);
+        }
+
+        bool read(std::istream& is) {
+            for (int i=0; i<2; i++){
+                if (!readString(is, names[i]) || !readValue(is, isRobot[i])
+                    || !readValue(is, shapes[i])) return false;
+                for (int j=0; j<12; j++){
+                    if (!readValue(is, poses[i][j])) return false;
+                }
+            }
+            return readValue(is, tolerance);
+        }
+    };
+
+    void makeCheckPairRecords(WorldPtr world, BodyPtr robot,
+                              std::vector<ColdetModelPair>& pairs,
+                              std::vector<CheckPairRecord>& records)
+    {
+        std::map<ColdetModel*, std::pair<Body*, Link*> > owners;
+        for (int i=0; i<world->numBodies(); i++){
+            BodyPtr body = world->body(i);
+            for (int j=0; j<body->numLinks(); j++){
+                Link* l = body->link(j);
+                if (l->coldetModel) owners[l->coldetModel.get()] = std::make_pair(body.get(), l);
+            }
+        }
+
+        records.resize(pairs.size());
+        for (unsigned int i=0; i<pairs.size(); i++){
+            CheckPairRecord& record = records[i];
+            for (int j=0; j<2; j++){
+                ColdetModel* model = pairs[i].model(j);
+                std::map<ColdetModel*, std::pair<Body*, Link*> >::iterator it = owners.find(model);
+                record.isRobot[j] = 0;
+                memset(record.poses[j], 0, sizeof(record.poses[j]));
+                if (it == owners.end()){
+                    record.names[j] = "";
+                } else {
+                    Body* body = it->second.first;
+                    Link* l = it->second.second;
+                    record.names[j] = body->name() + ":" + l->name;
+                    record.isRobot[j] = body == robot.get();
+                    if (!record.isRobot[j]){
+                        for (int k=0; k<3; k++){
+                            record.poses[j][k] = l->p[k];
+                            for (int m=0; m<3; m++) record.poses[j][3+k*3+m] = l->R(k, m);
+                        }
+                    }
+                }
+                record.shapes[j] = hashShape(model);
+            }
+            record.tolerance = pairs[i].tolerance();
+        }
+    }
+}
+
 // ----------------------------------------------
 // ネームサーバからオブジェクトを取得
 // ----------------------------------------------
@@ -108,6 +253,9 @@ PathPlanner::PathPlanner(unsigned int dim,
     registerOptimizer("RandomShortcut", 
                       OptimizerCreate<RandomShortcutOptimizer>,
                       OptimizerDelete<RandomShortcutOptimizer>);
+    registerOptimizer("ParallelShortcut", 
+                      OptimizerCreate<ParallelShortcutOptimizer>,
+                      OptimizerDelete<ParallelShortcutOptimizer>);
 		    
     allCharacterPositions_ = new OpenHRP::CharacterPositionSequence;
 
@@ -115,6 +263,21 @@ PathPlanner::PathPlanner(unsigned int dim,
     bboxMode_ = false;
 
     dt_ = 0.01;
+
+    countWorkerCollisionCheck_ = 0;
+    timeWorkerCollisionCheck_ = 0.0;
+    timeWorkerForwardKinematics_ = 0.0;
+
+    isCollisionCheckCacheEnabled_ = false;
+    maxCollisionCheckCacheSize_ = 0;
+    countCollisionCheckCacheHit_ = 0;
+    countCollisionCheckCacheMiss_ = 0;
+
+    isClearanceBasedEdgeCheckEnabled_ = false;
+    countClearanceQuery_ = 0;
+    robotRadius_ = -1;
+
+    isObstacleMergeEnabled_ = false;
 }
 
 // ----------------------------------------------
@@ -268,6 +431,8 @@ void PathPlanner::initPlanner(const std::string &nameServer) {
 
     world_->clearBodies();
     checkPairs_.clear();
+    clearMergedCheckPairs();
+    clearCollisionCheckCache();
 
 }
 
@@ -332,6 +497,9 @@ void PathPlanner::setCharacterPosition(const char* character,
     Matrix33 R;
     getMatrix33FromRowMajorArray(R, pos.get_buffer(), 3);
     l->setSegmentAttitude(R);
+
+    clearCollisionCheckCache();
+    clearMergedCheckPairs();
 }
 
 void computeBoundingBox(BodyPtr body, double min[3], double max[3])
@@ -453,6 +621,9 @@ void PathPlanner::setRobotName(const std::string &name) {
     }
 
     model_ = world_->body(name);
+    clearCollisionCheckCache();
+    clearMergedCheckPairs();
+    robotRadius_ = -1;
     if (!model_) {
         std::cerr << "PathPlanner::setRobotName() : robot(" << name << ") not found" << std::endl;
         return;
@@ -548,6 +719,8 @@ void PathPlanner::registerIntersectionCheckPair(const char* charName1,
             }
         }
     }
+    clearCollisionCheckCache();
+    clearMergedCheckPairs();
 }
 // ----------------------------------------------
 // 初期化
@@ -562,6 +735,7 @@ void PathPlanner::initSimulation () {
     for(int i=0; i < n; ++i){
         world_->body(i)->initializeConfiguration();
     }
+    clearCollisionCheckCache();
   
     _setupCharacterData();
   
@@ -583,25 +757,105 @@ bool PathPlanner::checkCollision (const Configuration &pos) {
         std::cerr << "checkCollision(" << pos << ")" << std::endl;
     }
 #endif
-    if (!setConfiguration(pos)) return true;
+    CollisionCheckCacheKey key;
+    if (isCollisionCheckCacheEnabled_ && !debug_) {
+        makeCollisionCheckCacheKey(pos, key);
+        int cached = -1;
+#pragma omp critical (PathPlanner_collisionCheckCache)
+        {
+            std::map<CollisionCheckCacheKey, bool>::iterator it = collisionCheckCache_.find(key);
+            if (it != collisionCheckCache_.end()) {
+                cached = it->second;
+                countCollisionCheckCacheHit_++;
+            } else {
+                countCollisionCheckCacheMiss_++;
+            }
+        }
+        if (cached >= 0) return cached != 0;
+    }
 
-    // 干渉チェック
-    bool ret = checkCollision();
+    bool ret;
+    if (!setConfiguration(pos)) {
+        ret = true;
+    } else {
+        // 干渉チェック
+        ret = checkCollision();
 
-    if (debug_) {
-        // 結果を得る
-        OpenHRP::WorldState_var state;
-        getWorldState(state);
+        if (debug_) {
+            // 結果を得る
+            OpenHRP::WorldState_var state;
+            getWorldState(state);
+
+            static double nowTime = 0;
+            state->time = nowTime;
+            nowTime += dt_;
 
-        static double nowTime = 0;
-        state->time = nowTime;
-        nowTime += dt_;
+            onlineViewer_->update(state);
+        }
+    }
 
-        onlineViewer_->update(state);
+    if (isCollisionCheckCacheEnabled_ && !debug_) {
+#pragma omp critical (PathPlanner_collisionCheckCache)
+        {
+            if (collisionCheckCache_.size() >= maxCollisionCheckCacheSize_) {
+                collisionCheckCache_.clear();
+            }
+            collisionCheckCache_[key] = ret;
+        }
     }
     return ret;
 }
 
+double PathPlanner::computeClearance(const Configuration &pos, double threshold)
+{
+    if (!USE_INTERNAL_COLLISION_DETECTOR || customCollisionDetector_ || debug_
+        || !pointCloud_.empty()){
+        return -1;
+    }
+
+    if (!setConfiguration(pos)) return 0;
+
+#pragma omp atomic
+    countClearanceQuery_++;
+
+    int workerIndex = currentWorkerIndex();
+    BodyPtr body = workerIndex >= 0 ? workers_[workerIndex].robot : model_;
+    std::vector<ColdetModelPair>& pairs
+        = workerIndex >= 0 ? workers_[workerIndex].checkPairs : activeCheckPairs();
+
+    Link *l;
+    for (int i=0; i<body->numLinks(); i++){
+        l = body->link(i);
+        l->coldetModel->setPosition(l->R, l->p);
+    }
+
+    // バウンディングボックス間の距離が近いペアから距離を計算する。
+    // ボックス間の距離がそれまでの最小距離かthreshold以上になれば、
+    // 残りのペアの距離はそれ以上なので計算しない
+    std::vector<std::pair<double, unsigned int> > bounds;
+    bounds.reserve(pairs.size());
+    for (unsigned int i=0; i<pairs.size(); i++){
+        double d = pairs[i].computeBoundingBoxDistance();
+        if (d < 0) continue;
+        bounds.push_back(std::make_pair(d - pairs[i].tolerance(), i));
+    }
+    std::sort(bounds.begin(), bounds.end());
+
+    double clearance = std::numeric_limits<double>::max();
+    double p0[3], p1[3];
+    for (unsigned int i=0; i<bounds.size() && bounds[i].first < clearance; i++){
+        if (bounds[i].first >= threshold){
+            clearance = bounds[i].first;
+            break;
+        }
+        ColdetModelPair& pair = pairs[bounds[i].second];
+        double d = pair.computeDistance(p0, p1) - pair.tolerance();
+        if (d <= 0) return 0;
+        if (d < clearance) clearance = d;
+    }
+    return clearance;
+}
+
 void PathPlanner::getWorldState(OpenHRP::WorldState_out wstate)
 {
     if(debug_){
@@ -622,6 +876,11 @@ void PathPlanner::getWorldState(OpenHRP::WorldState_out wstate)
 
 bool PathPlanner::checkCollision()
 {
+    int workerIndex = currentWorkerIndex();
+    if (workerIndex >= 0){
+        return workerCheckCollision(workers_[workerIndex]);
+    }
+
     if (customCollisionDetector_){
         timeForwardKinematics_.begin();
         customCollisionDetector_->updatePositions();
@@ -652,26 +911,37 @@ bool PathPlanner::defaultCheckCollision()
     timeForwardKinematics_.end();
     timeCollisionCheck_.begin();
     if(USE_INTERNAL_COLLISION_DETECTOR){
-        for (unsigned int i=0; i<checkPairs_.size(); i++){
-            if (checkPairs_[i].tolerance() == 0){
-                if (checkPairs_[i].checkCollision()){
-		    collidingPair_.first  = checkPairs_[i].model(0)->name();
-		    collidingPair_.second = checkPairs_[i].model(1)->name();
+        std::vector<ColdetModelPair>& checkPairs = activeCheckPairs();
+        for (unsigned int i=0; i<checkPairs.size(); i++){
+            if (checkPairs[i].tolerance() == 0){
+                if (checkPairs[i].checkCollision()){
+		    collidingPair_.first  = checkPairs[i].model(0)->name();
+		    collidingPair_.second = checkPairs[i].model(1)->name();
+                    if (&checkPairs == &mergedCheckPairs_ && mergedCheckPairObstacles_[i] >= 0
+                        && !checkPairs[i].collisions().empty()){
+                        // 統合したモデルの三角形から元のモデルを求める。
+                        // メッシュ同士の干渉チェックではid1が2番目のモデルの三角形になる
+                        const MergedObstacle& obstacle = mergedObstacles_[mergedCheckPairObstacles_[i]];
+                        int triangle = checkPairs[i].collisions()[0].id1;
+                        int k = std::upper_bound(obstacle.triangleOffsets.begin(),
+                                                 obstacle.triangleOffsets.end(), triangle)
+                            - obstacle.triangleOffsets.begin() - 1;
+                        if (k >= 0) collidingPair_.second = obstacle.names[k];
+                    }
                     timeCollisionCheck_.end();
                     return true;
                 }
             } else{
-                if (checkPairs_[i].detectIntersection()) {
+                if (checkPairs[i].detectIntersection()) {
                     timeCollisionCheck_.end();
                     return true;
                 }
             } 
         } 
-        if (pointCloud_.size() > 0){
+        if (!pointCloud_.empty()){
             for (int i=0; i<model_->numLinks(); i++){
                 Link *l = model_->link(i);
-                if (l->coldetModel->checkCollisionWithPointCloud(pointCloud_,
-                                                                 radius_)){
+                if (l->coldetModel->checkCollisionWithPointCloud(pointCloud_)){
                     timeCollisionCheck_.end();
                     return true;
                 }
@@ -688,6 +958,128 @@ bool PathPlanner::defaultCheckCollision()
     }
 }
 
+// ----------------------------------------------
+// 作業領域を使った干渉チェック
+// ----------------------------------------------
+bool PathPlanner::workerCheckCollision(Worker& worker)
+{
+    worker.timeForwardKinematics.begin();
+    Link *l;
+    for (int j=0; j<worker.robot->numLinks(); j++){
+        l = worker.robot->link(j);
+        l->coldetModel->setPosition(l->R, l->p);
+    }
+    worker.timeForwardKinematics.end();
+
+    worker.timeCollisionCheck.begin();
+    std::vector<ColdetModelPair>& checkPairs = worker.checkPairs;
+    for (unsigned int i=0; i<checkPairs.size(); i++){
+        bool collided;
+        if (checkPairs[i].tolerance() == 0){
+            collided = checkPairs[i].checkCollision();
+        }else{
+            collided = checkPairs[i].detectIntersection();
+        }
+        if (collided){
+            worker.timeCollisionCheck.end();
+            return true;
+        }
+    }
+    if (!pointCloud_.empty()){
+        for (int i=0; i<worker.robot->numLinks(); i++){
+            l = worker.robot->link(i);
+            if (l->coldetModel->checkCollisionWithPointCloud(pointCloud_)){
+                worker.timeCollisionCheck.end();
+                return true;
+            }
+        }
+    }
+    worker.timeCollisionCheck.end();
+    return false;
+}
+
+int PathPlanner::currentWorkerIndex() const
+{
+#ifdef _OPENMP
+    if (!workers_.empty() && omp_in_parallel()){
+        int index = omp_get_thread_num();
+        if (index < (int)workers_.size()) return index;
+    }
+#endif
+    return -1;
+}
+
+// ----------------------------------------------
+// 並列干渉チェック用の作業領域を用意
+// ----------------------------------------------
+bool PathPlanner::setupWorkers(unsigned int n)
+{
+    clearWorkers();
+
+#ifndef _OPENMP
+    return false;
+#else
+    if (n < 2 || !model_) return false;
+    if (!USE_INTERNAL_COLLISION_DETECTOR || customCollisionDetector_ || debug_){
+        std::cerr << "PathPlanner::setupWorkers() : parallel collision check is not available"
+                  << std::endl;
+        return false;
+    }
+
+    workers_.resize(n);
+    for (unsigned int i=0; i<n; i++){
+        Worker& worker = workers_[i];
+        worker.robot = BodyPtr(new Body(*model_));
+
+        // ColdetModel of the robot -> ColdetModel of the clone
+        std::map<ColdetModel*, ColdetModelPtr> cloneModels;
+        for (int j=0; j<model_->numLinks(); j++){
+            ColdetModelPtr org = model_->link(j)->coldetModel;
+            ColdetModelPtr clone = worker.robot->link(j)->coldetModel;
+            if (!org) continue;
+            // the pairs with a primitive are checked at its offset from the link,
+            // so a clone which lost the offset would give different results
+            if (!clone || !hasSamePrimitive(*org, *clone)){
+                std::cerr << "PathPlanner::setupWorkers() : the clone of "
+                          << model_->link(j)->name << " differs from the robot" << std::endl;
+                workers_.clear();
+                return false;
+            }
+            cloneModels[org.get()] = clone;
+        }
+
+        // the obstacles are also cloned because the reference counts of
+        // ColdetModelPtr are not thread safe. The clones share the built
+        // trees, which are not modified.
+        std::vector<ColdetModelPair>& checkPairs = activeCheckPairs();
+        worker.checkPairs.reserve(checkPairs.size());
+        for (unsigned int j=0; j<checkPairs.size(); j++){
+            ColdetModelPtr models[2];
+            for (int k=0; k<2; k++){
+                ColdetModel* org = checkPairs[j].model(k);
+                std::map<ColdetModel*, ColdetModelPtr>::iterator it = cloneModels.find(org);
+                if (it == cloneModels.end()){
+                    it = cloneModels.insert(std::make_pair(org, ColdetModelPtr(new ColdetModel(*org)))).first;
+                }
+                models[k] = it->second;
+            }
+            worker.checkPairs.push_back(ColdetModelPair(models[0], models[1], checkPairs[j].tolerance()));
+        }
+    }
+    return true;
+#endif
+}
+
+void PathPlanner::clearWorkers()
+{
+    for (unsigned int i=0; i<workers_.size(); i++){
+        countWorkerCollisionCheck_ += workers_[i].timeCollisionCheck.numCalls();
+        timeWorkerCollisionCheck_ += workers_[i].timeCollisionCheck.totalTime();
+        timeWorkerForwardKinematics_ += workers_[i].timeForwardKinematics.totalTime();
+    }
+    workers_.clear();
+}
+
 // ----------------------------------------------
 // アルゴリズム登録
 // ----------------------------------------------
@@ -734,17 +1126,14 @@ bool PathPlanner::checkCollision(const std::vector<Configuration> &path) {
 bool PathPlanner::calcPath()
 {
     path_.clear();
-    BodyPtr body;
-    Link *l;
-    for (int i=0; i<world_->numBodies(); i++){
-        body = world_->body(i);
-        body->calcForwardKinematics();
-        for (int j=0; j<body->numLinks(); j++){
-            l = body->link(j);
-            l->coldetModel->setPosition(l->R, l->p);
-        }
+    updateColdetModelPositions();
+    updateRobotRadius();
+    if (isObstacleMergeEnabled_){
+        updateMergedCheckPairs();
+    }else{
+        clearMergedCheckPairs();
     }
-    std::cout << "The number of collision check pairs = " << checkPairs_.size() << std::endl;
+    std::cout << "The number of collision check pairs = " << activeCheckPairs().size() << std::endl;
     if (!algorithm_->preparePlanning()){
         std::cout << "preparePlanning() failed" << std::endl;
         return false;
@@ -860,23 +1249,427 @@ void PathPlanner::_updateCharacterPositions()
 }
 
 
+unsigned int PathPlanner::countCollisionCheck() const
+{
+    unsigned int count = timeCollisionCheck_.numCalls() + countWorkerCollisionCheck_;
+    for (unsigned int i=0; i<workers_.size(); i++){
+        count += workers_[i].timeCollisionCheck.numCalls();
+    }
+    return count;
+}
+
 double PathPlanner::timeCollisionCheck() const
 {
-    return timeCollisionCheck_.totalTime();
+    double time = timeCollisionCheck_.totalTime() + timeWorkerCollisionCheck_;
+    for (unsigned int i=0; i<workers_.size(); i++){
+        time += workers_[i].timeCollisionCheck.totalTime();
+    }
+    return time;
 }
 
 double PathPlanner::timeForwardKinematics() const
 {
-    return timeForwardKinematics_.totalTime();
+    double time = timeForwardKinematics_.totalTime() + timeWorkerForwardKinematics_;
+    for (unsigned int i=0; i<workers_.size(); i++){
+        time += workers_[i].timeForwardKinematics.totalTime();
+    }
+    return time;
 }
 
 void PathPlanner::setApplyConfigFunc(applyConfigFunc i_func)
 {
     m_applyConfigFunc = i_func;
+    clearCollisionCheckCache();
+}
+
+// ----------------------------------------------
+// 干渉チェック結果のキャッシュ
+// ----------------------------------------------
+void PathPlanner::enableCollisionCheckCache(bool enable, unsigned int maxSize)
+{
+    isCollisionCheckCacheEnabled_ = enable;
+    maxCollisionCheckCacheSize_ = maxSize;
+    clearCollisionCheckCache();
+}
+
+void PathPlanner::clearCollisionCheckCache()
+{
+    collisionCheckCache_.clear();
+}
+
+void PathPlanner::makeCollisionCheckCacheKey(const Configuration& pos, CollisionCheckCacheKey& key)
+{
+    key.resize(pos.size());
+    for (unsigned int i=0; i<pos.size(); i++){
+        double v = pos[i];
+        if (i < cspace_.size() && cspace_.unboundedRotation(i)){
+            v = fmod(v, 2*M_PI);
+            if (v < 0) v += 2*M_PI;
+        }
+        double resolution = i < cspace_.size() ? cspace_.resolution(i) : 0.0;
+        if (resolution > 0){
+            key[i] = (long long)floor(v/resolution);
+        }else{
+            memcpy(&key[i], &v, sizeof(v));
+        }
+    }
+}
+
+void PathPlanner::updateRobotRadius()
+{
+    robotRadius_ = -1;
+    if (!model_) return;
+
+    Link *root = model_->rootLink();
+    double radius = 0;
+    for (int i=0; i<model_->numLinks(); i++){
+        Link *l = model_->link(i);
+        if (!l->coldetModel) continue;
+        for (int j=0; j<l->coldetModel->getNumVertices(); j++){
+            float x, y, z;
+            l->coldetModel->getVertex(j, x, y, z);
+            Vector3 v(l->R*Vector3(x, y, z) + l->p - root->p);
+            double r = v.norm();
+            if (r > radius) radius = r;
+        }
+    }
+    robotRadius_ = radius;
+}
+
+void PathPlanner::updateColdetModelPositions()
+{
+    BodyPtr body;
+    Link *l;
+    for (int i=0; i<world_->numBodies(); i++){
+        body = world_->body(i);
+        body->calcForwardKinematics();
+        for (int j=0; j<body->numLinks(); j++){
+            l = body->link(j);
+            l->coldetModel->setPosition(l->R, l->p);
+        }
+    }
+}
+
+// ----------------------------------------------
+// 静的な障害物の統合
+// ----------------------------------------------
+void PathPlanner::enableObstacleMerge(bool enable)
+{
+    isObstacleMergeEnabled_ = enable;
+    if (!enable) clearMergedCheckPairs();
+}
+
+void PathPlanner::clearMergedCheckPairs()
+{
+    mergedObstacles_.clear();
+    mergedCheckPairs_.clear();
+    mergedCheckPairObstacles_.clear();
+}
+
+/**
+   ロボットのリンクと許容距離の組ごとに、干渉チェックするロボット以外のメッシュのモデルを集め、
+   同じモデルの集合は一つの統合したモデルを共有する。
+   統合するモデルが一つしかない場合は元のペアをそのまま使う。
+*/
+void PathPlanner::updateMergedCheckPairs()
+{
+    clearMergedCheckPairs();
+    if (!USE_INTERNAL_COLLISION_DETECTOR || !model_) return;
+
+    std::map<ColdetModel*, Link*> robotLinks, obstacleLinks;
+    for (int i=0; i<world_->numBodies(); i++){
+        BodyPtr body = world_->body(i);
+        for (int j=0; j<body->numLinks(); j++){
+            Link *l = body->link(j);
+            if (!l->coldetModel) continue;
+            if (body == model_){
+                robotLinks[l->coldetModel.get()] = l;
+            }else if (l->coldetModel->getPrimitiveType() == ColdetModel::SP_MESH){
+                obstacleLinks[l->coldetModel.get()] = l;
+            }
+        }
+    }
+
+    // (ロボットのモデル, 許容距離) -> 元のペアのインデックス
+    typedef std::pair<ColdetModel*, double> GroupKey;
+    std::vector<GroupKey> groupKeys;
+    std::map<GroupKey, std::vector<unsigned int> > groups;
+    std::vector<unsigned int> others;
+    for (unsigned int i=0; i<checkPairs_.size(); i++){
+        ColdetModelPair& pair = checkPairs_[i];
+        int robotSide = -1;
+        for (int j=0; j<2; j++){
+            if (robotLinks.count(pair.model(j)) && obstacleLinks.count(pair.model(1-j))) robotSide = j;
+        }
+        if (robotSide < 0){
+            others.push_back(i);
+            continue;
+        }
+        GroupKey key(pair.model(robotSide), pair.tolerance());
+        if (groups.count(key) == 0) groupKeys.push_back(key);
+        groups[key].push_back(i);
+    }
+
+    for (unsigned int i=0; i<others.size(); i++){
+        mergedCheckPairs_.push_back(checkPairs_[others[i]]);
+        mergedCheckPairObstacles_.push_back(-1);
+    }
+
+    std::map<std::vector<ColdetModel*>, int> obstacleIndices;
+    for (unsigned int i=0; i<groupKeys.size(); i++){
+        ColdetModel* robotModel = groupKeys[i].first;
+        std::vector<unsigned int>& pairIndices = groups[groupKeys[i]];
+        if (pairIndices.size() == 1){
+            mergedCheckPairs_.push_back(checkPairs_[pairIndices[0]]);
+            mergedCheckPairObstacles_.push_back(-1);
+            continue;
+        }
+
+        std::vector<ColdetModel*> models;
+        for (unsigned int j=0; j<pairIndices.size(); j++){
+            ColdetModelPair& pair = checkPairs_[pairIndices[j]];
+            int obstacleSide = pair.model(0) == robotModel ? 1 : 0;
+            models.push_back(pair.model(obstacleSide));
+        }
+        std::sort(models.begin(), models.end());
+        models.erase(std::unique(models.begin(), models.end()), models.end());
+
+        std::map<std::vector<ColdetModel*>, int>::iterator it = obstacleIndices.find(models);
+        if (it == obstacleIndices.end()){
+            MergedObstacle obstacle;
+            obstacle.model = ColdetModelPtr(new ColdetModel());
+            obstacle.model->setName("merged obstacles");
+            int numVertices = 0, numTriangles = 0;
+            for (unsigned int j=0; j<models.size(); j++){
+                numVertices += models[j]->getNumVertices();
+                numTriangles += models[j]->getNumTriangles();
+            }
+            obstacle.model->setNumVertices(numVertices);
+            obstacle.model->setNumTriangles(numTriangles);
+            int vertexOffset = 0, triangleOffset = 0;
+            for (unsigned int j=0; j<models.size(); j++){
+                ColdetModel* model = models[j];
+                Link *l = obstacleLinks[model];
+                for (int k=0; k<model->getNumVertices(); k++){
+                    float x, y, z;
+                    model->getVertex(k, x, y, z);
+                    Vector3 v(l->R*Vector3(x, y, z) + l->p);
+                    obstacle.model->setVertex(vertexOffset + k, v[0], v[1], v[2]);
+                }
+                for (int k=0; k<model->getNumTriangles(); k++){
+                    int v1, v2, v3;
+                    model->getTriangle(k, v1, v2, v3);
+                    obstacle.model->setTriangle(triangleOffset + k, vertexOffset + v1,
+                                                vertexOffset + v2, vertexOffset + v3);
+                }
+                obstacle.triangleOffsets.push_back(triangleOffset);
+                obstacle.names.push_back(model->name());
+                vertexOffset += model->getNumVertices();
+                triangleOffset += model->getNumTriangles();
+            }
+            obstacle.model->build();
+            obstacle.model->setPosition(Matrix33::Identity(), Vector3::Zero());
+            it = obstacleIndices.insert(std::make_pair(models, (int)mergedObstacles_.size())).first;
+            mergedObstacles_.push_back(obstacle);
+        }
+
+        mergedCheckPairs_.push_back(ColdetModelPair(robotModel, mergedObstacles_[it->second].model,
+                                                    groupKeys[i].second));
+        mergedCheckPairObstacles_.push_back(it->second);
+    }
+}
+
+// ----------------------------------------------
+// ロードマップの保存と読み込み
+// ----------------------------------------------
+boost::uint64_t PathPlanner::robotSignature()
+{
+    Fnv1aHash hash;
+    hash.addString(model_->name());
+    boost::uint32_t dim = cspace_.size();
+    hash.add(&dim, sizeof(dim));
+    hash.addString(mobilityName_);
+    for (int i=0; i<model_->numLinks(); i++){
+        Link *l = model_->link(i);
+        hash.addString(l->name);
+        if (l->jointType == Link::ROTATIONAL_JOINT || l->jointType == Link::SLIDE_JOINT){
+            hash.add(&l->q, sizeof(l->q));
+        }
+        boost::uint64_t shape = hashShape(l->coldetModel.get());
+        hash.add(&shape, sizeof(shape));
+    }
+    return hash.value();
+}
+
+boost::uint64_t PathPlanner::pointCloudSignature()
+{
+    Fnv1aHash hash;
+    double radius = pointCloud_.radius();
+    hash.add(&radius, sizeof(radius));
+    const std::vector<Vector3>& points = pointCloud_.points();
+    for (unsigned int i=0; i<points.size(); i++){
+        hash.add(points[i].data(), 3*sizeof(double));
+    }
+    return hash.value();
+}
+
+bool PathPlanner::saveRoadmap(const std::string& filename)
+{
+    if (!algorithm_ || !model_) return false;
+
+    std::ofstream ofs(filename.c_str(), std::ios::binary);
+    if (!ofs) {
+        std::cerr << "PathPlanner::saveRoadmap() : failed to open " << filename << std::endl;
+        return false;
+    }
+
+    updateColdetModelPositions();
+    std::vector<CheckPairRecord> records;
+    makeCheckPairRecords(world_, model_, checkPairs_, records);
+
+    ofs.write(roadmapMagic, sizeof(roadmapMagic));
+    writeValue(ofs, roadmapVersion);
+    writeValue(ofs, robotSignature());
+    writeValue(ofs, pointCloudSignature());
+    writeValue(ofs, (boost::uint32_t)records.size());
+    for (unsigned int i=0; i<records.size(); i++){
+        records[i].write(ofs);
+    }
+    if (!algorithm_->getRoadmap()->write(ofs)) {
+        std::cerr << "PathPlanner::saveRoadmap() : failed to write " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+   ロボットの表面上の点は、コンフィギュレーション空間で距離dだけ移動する間に
+   Mobility::maxDisplacementPerDistance()*d以上動かない。
+   エッジのどちらかの端点で、変化したペアのバウンディングボックス間の距離が
+   この移動量より大きければ、そのエッジは変化したペアでは干渉しない。
+*/
+bool PathPlanner::loadRoadmap(const std::string& filename, bool incremental)
+{
+    if (!algorithm_ || !model_ || !mobility_) return false;
+
+    std::ifstream ifs(filename.c_str(), std::ios::binary);
+    if (!ifs) {
+        std::cerr << "PathPlanner::loadRoadmap() : failed to open " << filename << std::endl;
+        return false;
+    }
+
+    updateColdetModelPositions();
+
+    char magic[sizeof(roadmapMagic)];
+    boost::uint32_t version, numRecords;
+    boost::uint64_t signature, pointCloud;
+    ifs.read(magic, sizeof(magic));
+    if (!ifs || memcmp(magic, roadmapMagic, sizeof(roadmapMagic)) != 0
+        || !readValue(ifs, version) || version != roadmapVersion) {
+        std::cerr << "PathPlanner::loadRoadmap() : " << filename << " is not a roadmap file" << std::endl;
+        return false;
+    }
+    if (!readValue(ifs, signature) || signature != robotSignature()) {
+        std::cerr << "PathPlanner::loadRoadmap() : the roadmap was made for another robot" << std::endl;
+        return false;
+    }
+
+    std::map<std::string, CheckPairRecord> savedRecords;
+    if (!readValue(ifs, pointCloud) || !readValue(ifs, numRecords)) return false;
+    for (boost::uint32_t i=0; i<numRecords; i++){
+        CheckPairRecord record;
+        if (!record.read(ifs)) return false;
+        savedRecords[record.key()] = record;
+    }
+
+    // 保存時から変化した干渉チェックペア
+    std::vector<CheckPairRecord> records;
+    makeCheckPairRecords(world_, model_, checkPairs_, records);
+    std::vector<unsigned int> changedPairs;
+    bool isAllChanged = pointCloud != pointCloudSignature();
+    for (unsigned int i=0; i<records.size(); i++){
+        std::map<std::string, CheckPairRecord>::iterator it = savedRecords.find(records[i].key());
+        if (it != savedRecords.end() && records[i].hasSameState(it->second)) continue;
+        changedPairs.push_back(i);
+        if (records[i].isRobot[0] == records[i].isRobot[1]) isAllChanged = true;
+    }
+    if ((isAllChanged || !changedPairs.empty()) && !incremental) {
+        std::cerr << "PathPlanner::loadRoadmap() : the environment has changed" << std::endl;
+        return false;
+    }
+
+    RoadmapPtr roadmap = algorithm_->getRoadmap();
+    if (!roadmap->read(ifs, cspace_.size())) {
+        std::cerr << "PathPlanner::loadRoadmap() : failed to read " << filename << std::endl;
+        return false;
+    }
+    clearCollisionCheckCache();
+    if (!isAllChanged && changedPairs.empty()) return true;
+
+    // 各ノードで変化したペアのバウンディングボックス間の距離の下限を求める
+    updateRobotRadius();
+    double bound = mobility_->maxDisplacementPerDistance();
+    std::map<RoadmapNode*, double> clearances;
+    for (unsigned int i=0; i<roadmap->nNodes(); i++){
+        RoadmapNodePtr node = roadmap->node(i);
+        double clearance = 0;
+        if (!isAllChanged && bound > 0 && USE_INTERNAL_COLLISION_DETECTOR
+            && setConfiguration(node->position())) {
+            for (int j=0; j<model_->numLinks(); j++){
+                Link *l = model_->link(j);
+                l->coldetModel->setPosition(l->R, l->p);
+            }
+            clearance = std::numeric_limits<double>::max();
+            for (unsigned int j=0; j<changedPairs.size() && clearance > 0; j++){
+                ColdetModelPair& pair = checkPairs_[changedPairs[j]];
+                double d = pair.computeBoundingBoxDistance();
+                clearance = d < 0 ? 0 : std::min(clearance, d - pair.tolerance());
+            }
+        }
+        clearances[node.get()] = clearance;
+    }
+
+    // 変化したペアに近づくエッジを再検査する
+    // 逆向きに移動できる場合は逆向きのエッジの結果を使う
+    bool isReversible = mobility_->isReversible();
+    std::map<std::pair<RoadmapNode*, RoadmapNode*>, bool> results;
+    unsigned int numChecked = 0, numRemoved = 0;
+    for (unsigned int i=0; i<roadmap->nNodes(); i++){
+        RoadmapNodePtr from = roadmap->node(i);
+        std::vector<RoadmapNodePtr> blocked;
+        for (unsigned int j=0; j<from->nChildren(); j++){
+            RoadmapNodePtr to = from->child(j);
+            if (!roadmap->isChecked(from, to)) continue;
+            double d = mobility_->distance(from->position(), to->position());
+            double clearance = std::max(clearances[from.get()], clearances[to.get()]);
+            if (clearance > bound*d) continue;
+            std::pair<RoadmapNode*, RoadmapNode*> edge(from.get(), to.get());
+            if (isReversible && edge.first > edge.second) std::swap(edge.first, edge.second);
+            std::map<std::pair<RoadmapNode*, RoadmapNode*>, bool>::iterator it = results.find(edge);
+            bool isReachable;
+            if (isReversible && it != results.end()) {
+                isReachable = it->second;
+            } else {
+                isReachable = mobility_->isReachable(from->position(), to->position());
+                results[edge] = isReachable;
+                numChecked++;
+            }
+            if (!isReachable) blocked.push_back(to);
+        }
+        for (unsigned int j=0; j<blocked.size(); j++){
+            roadmap->removeEdge(from, blocked[j]);
+            numRemoved++;
+        }
+    }
+    std::cout << "loadRoadmap: " << numChecked << " edges revalidated, "
+              << numRemoved << " edges removed" << std::endl;
+    return true;
 }
 
 BodyPtr PathPlanner::robot()
 {
+    int workerIndex = currentWorkerIndex();
+    if (workerIndex >= 0) return workers_[workerIndex].robot;
     return model_;
 }
 
@@ -888,6 +1681,6 @@ WorldPtr PathPlanner::world()
 void PathPlanner::setPointCloud(const std::vector<Vector3>& i_cloud, 
                                 double i_radius)
 {
-    pointCloud_ = i_cloud;
-    radius_ = i_radius;
+    pointCloud_.build(i_cloud, i_radius);
+    clearCollisionCheckCache();
 }
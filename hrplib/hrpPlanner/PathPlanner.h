@@ -7,7 +7,9 @@
 #include <map>
 #include <iostream>
 #include <sstream>
+#include <limits>
 #include <boost/function.hpp>
+#include <boost/cstdint.hpp>
 #include "hrpUtil/TimeMeasure.h"
 
 #include "exportdef.h"
@@ -18,6 +20,7 @@
 #include "Optimizer.h"
 #include "CollisionDetector.h"
 #include "hrpCollision/ColdetModelPair.h"
+#include "hrpCollision/ColdetPointCloud.h"
 #undef random
 
 #include <hrpCorba/ORBwrap.h>
@@ -155,14 +158,135 @@ namespace PathEngine {
 
         std::vector<hrp::ColdetModelPair> checkPairs_;
         //< point cloud created by vision or range sensor
-        std::vector<hrp::Vector3> pointCloud_; 
-        double radius_; ///< radius of spheres assigned to points
+        hrp::ColdetPointCloud pointCloud_; 
 
 	std::pair<std::string, std::string> collidingPair_;
 
         CollisionDetector *customCollisionDetector_;
 
         bool defaultCheckCollision();
+
+        /**
+         * @brief 並列に干渉チェックを行うスレッドの作業領域
+         *
+         * 経路計画対象のロボットの複製と、それを使う干渉チェックペアを持つ。
+         * 複製のColdetModelは干渉チェック用の木構造を元のモデルと共有する。
+         */
+        struct Worker {
+            hrp::BodyPtr robot;
+            std::vector<hrp::ColdetModelPair> checkPairs;
+            TimeMeasure timeCollisionCheck, timeForwardKinematics;
+        };
+        std::vector<Worker> workers_;
+
+        /**
+         * @brief 破棄した作業領域で行った干渉チェックの回数と時間
+         */
+        unsigned int countWorkerCollisionCheck_;
+        double timeWorkerCollisionCheck_, timeWorkerForwardKinematics_;
+
+        /**
+         * @brief 呼び出したスレッドが使う作業領域のインデックスを取得する
+         * @return 作業領域のインデックス。並列領域の外では-1
+         */
+        int currentWorkerIndex() const;
+
+        bool workerCheckCollision(Worker& worker);
+
+        /**
+         * @brief 量子化したコンフィギュレーションから干渉の有無へのキャッシュ
+         */
+        typedef std::vector<long long> CollisionCheckCacheKey;
+        std::map<CollisionCheckCacheKey, bool> collisionCheckCache_;
+        bool isCollisionCheckCacheEnabled_;
+        unsigned int maxCollisionCheckCacheSize_;
+        unsigned int countCollisionCheckCacheHit_, countCollisionCheckCacheMiss_;
+
+        /**
+         * @brief コンフィギュレーションをConfigurationSpace::resolution()で量子化してキーを作る
+         */
+        void makeCollisionCheckCacheKey(const Configuration& pos, CollisionCheckCacheKey& key);
+
+        /**
+         * @brief 最小距離を使った経路の干渉チェックを行うかどうか
+         */
+        bool isClearanceBasedEdgeCheckEnabled_;
+
+        /**
+         * @brief computeClearance()を呼び出した回数
+         */
+        unsigned int countClearanceQuery_;
+
+        /**
+         * @brief ロボットの基準リンクの原点から最も遠い頂点までの距離。未計算の場合は負
+         */
+        double robotRadius_;
+
+        /**
+         * @brief 現在の姿勢からrobotRadius_を計算する
+         */
+        void updateRobotRadius();
+
+        /**
+         * @brief 全てのキャラクタの順運動学を計算し、干渉チェック用モデルの位置を更新する
+         */
+        void updateColdetModelPositions();
+
+        /**
+         * @brief 静的な障害物を統合した干渉チェックペアを使うかどうか
+         */
+        bool isObstacleMergeEnabled_;
+
+        /**
+         * @brief 複数の障害物のリンクを統合したワールド座標系のモデル
+         */
+        struct MergedObstacle {
+            hrp::ColdetModelPtr model;
+            /// 統合した各モデルの最初の三角形のインデックス
+            std::vector<int> triangleOffsets;
+            /// 統合した各モデルの名前
+            std::vector<std::string> names;
+        };
+        std::vector<MergedObstacle> mergedObstacles_;
+
+        /**
+         * @brief 統合したモデルを使う干渉チェックペア。空の場合はcheckPairs_を使う
+         */
+        std::vector<hrp::ColdetModelPair> mergedCheckPairs_;
+
+        /**
+         * @brief mergedCheckPairs_の各ペアの2番目のモデルのmergedObstacles_でのインデックス。
+         * 統合していないペアは-1
+         */
+        std::vector<int> mergedCheckPairObstacles_;
+
+        /**
+         * @brief 障害物の現在の位置でmergedCheckPairs_を作る
+         */
+        void updateMergedCheckPairs();
+
+        /**
+         * @brief mergedCheckPairs_を破棄する
+         */
+        void clearMergedCheckPairs();
+
+        /**
+         * @brief 干渉チェックに使うペアを取得する
+         * @return 統合したモデルを使うペアがあればmergedCheckPairs_、なければcheckPairs_
+         */
+        std::vector<hrp::ColdetModelPair>& activeCheckPairs() {
+            return mergedCheckPairs_.empty() ? checkPairs_ : mergedCheckPairs_;
+        }
+
+        /**
+         * @brief ロボットの形状、関節角度、移動能力から作ったハッシュ値を取得する
+         */
+        boost::uint64_t robotSignature();
+
+        /**
+         * @brief ポイントクラウドの点と半径から作ったハッシュ値を取得する
+         */
+        boost::uint64_t pointCloudSignature();
     public:
         /**
          * @brief 物理世界を取得する
@@ -172,10 +296,38 @@ namespace PathEngine {
 
         /**
          * @brief ロボットを取得する
+         *
+         * setupWorkers()で作業領域を用意した後、並列領域の中から呼び出すと
+         * そのスレッドが使うロボットの複製を返す。
          * @return ロボット
          */
         hrp::BodyPtr robot();
 
+        /**
+         * @brief 並列に干渉チェックを行うための作業領域を用意する
+         *
+         * 作業領域ごとにロボットを複製し、干渉チェックペアのロボット側のモデルを
+         * 複製のものに置き換える。OpenMPのスレッド番号がnより小さい並列領域の中では、
+         * checkCollision()とrobot()はそのスレッドの作業領域を使う。
+         * 他のキャラクタのモデルは全スレッドで共有されるので、並列領域の中で
+         * 動かしてはならない。
+         * @param n 作業領域の数(スレッド数)
+         * @return 作業領域を用意した場合true。OpenMPが無効な場合、独自の干渉検出器を
+         * 使う場合、デバッグモードの場合はfalse
+         */
+        bool setupWorkers(unsigned int n);
+
+        /**
+         * @brief setupWorkers()で用意した作業領域を破棄する
+         */
+        void clearWorkers();
+
+        /**
+         * @brief 作業領域の数を取得する
+         * @return 作業領域の数
+         */
+        unsigned int numWorkers() const { return workers_.size(); }
+
         /**
          * @brief コンフィギュレーションベクトルからロボットの姿勢をセットする関数をセットする
          * @param i_func コンフィギュレーションベクトルからロボットの姿勢をセットする関数
@@ -369,6 +521,12 @@ namespace PathEngine {
          */
         void setGoalConfiguration(const Configuration &pos) {algorithm_->setGoalConfiguration(pos);}
 
+        /**
+         * @brief ゴール位置の代わりに目標コンフィギュレーションをサンプリングするオブジェクトを設定する
+         * @param sampler 目標コンフィギュレーションをサンプリングするオブジェクト。NULLの場合はゴール位置を使う
+         */
+        void setGoalSampler(GoalSampler* sampler) {algorithm_->setGoalSampler(sampler);}
+
         /**
          * @brief 経路計画を行う
          * @return 計画が正常に終了した場合true、それ以外はfalseを返す
@@ -386,6 +544,31 @@ namespace PathEngine {
          */
         RoadmapPtr getRoadmap() { return algorithm_->getRoadmap();}
 
+        /**
+         * @brief ロードマップをファイルに保存する
+         *
+         * ロードマップと共に、ロボットの形状と関節角度、移動能力から作ったシグネチャと、
+         * 干渉チェックペアごとの形状、位置、許容距離、ポイントクラウドを記録する。
+         * setCollisionDetector()で設定した干渉検出器の状態は記録しない。
+         * @param filename ファイル名
+         * @return 保存できた場合true
+         */
+        bool saveRoadmap(const std::string& filename);
+
+        /**
+         * @brief saveRoadmap()で保存したロードマップを読み込む
+         *
+         * ロボットのシグネチャが保存時と異なる場合は読み込まない。
+         * 干渉チェックペアの形状、位置、許容距離かポイントクラウドが保存時と異なる場合、
+         * incrementalがfalseなら読み込まず、trueなら変化したペアの近くを通るエッジだけを
+         * 再検査し、到達できなくなったエッジを削除する。
+         * 到達可能か検査していないエッジは再検査しない。
+         * @param filename ファイル名
+         * @param incremental 環境が変化していた場合にエッジを再検査して使う場合true
+         * @return 読み込めた場合true
+         */
+        bool loadRoadmap(const std::string& filename, bool incremental = false);
+
         /**
          * @brief 計画された経路の補間されたものを取得する
          * @return 補間された経路
@@ -428,6 +611,21 @@ namespace PathEngine {
          */
         bool checkCollision(const Configuration &pos);
 
+        /**
+         * @brief 干渉チェックペアの間の最小距離を計算する
+         *
+         * 各ペアのColdetModelPair::computeDistance()からtoleranceを引いた値の最小値を返す。
+         * バウンディングボックス間の距離がthreshold以上のペアは、距離を計算せずに
+         * ボックス間の距離を使うので、最小距離がthreshold以上の場合は下限値が返る。
+         * 独自の干渉検出器を使う場合、ポイントクラウドが設定されている場合、
+         * デバッグモードの場合は計算できない。
+         * @param pos ロボットの位置
+         * @param threshold 距離を正確に計算する範囲
+         * @return 最小距離。干渉している場合は0、計算できない場合は負の値
+         */
+        double computeClearance(const Configuration &pos,
+                                double threshold = std::numeric_limits<double>::max());
+
         /**
          * @brief パスの干渉検出を行う
          * @param path パス
@@ -452,23 +650,105 @@ namespace PathEngine {
          * @brief 干渉チェックを呼び出した回数を取得する
          * @return 干渉チェックを呼び出した回数
          */
-        unsigned int countCollisionCheck() const { return timeCollisionCheck_.numCalls();}
+        unsigned int countCollisionCheck() const;
 
         /**
          * @brief 干渉チェックに使用した時間[s]を取得する
+         *
+         * 作業領域で並列に行った干渉チェックの時間は各スレッドの時間の合計となる。
          * @return 干渉チェックに使用した時間[s]
          */
         double timeCollisionCheck() const;
 
+        /**
+         * @brief 干渉チェック結果のキャッシュが使われた回数を取得する
+         * @return キャッシュが使われた回数
+         */
+        unsigned int countCollisionCheckCacheHit() const { return countCollisionCheckCacheHit_; }
+
+        /**
+         * @brief 干渉チェック結果がキャッシュになかった回数を取得する
+         * @return キャッシュになかった回数
+         */
+        unsigned int countCollisionCheckCacheMiss() const { return countCollisionCheckCacheMiss_; }
+
         double timeForwardKinematics() const;
 
+        /**
+         * @brief computeClearance()を呼び出した回数を取得する
+         * @return computeClearance()を呼び出した回数
+         */
+        unsigned int countClearanceQuery() const { return countClearanceQuery_; }
+
         void boundingBoxMode(bool mode) { bboxMode_ = mode; } 
 
 	const std::pair<std::string, std::string> &collidingPair() { return collidingPair_; }
 
         void setCollisionDetector(CollisionDetector *i_cd){
             customCollisionDetector_ = i_cd; 
+            clearCollisionCheckCache();
         }
+
+        /**
+         * @brief 干渉チェック結果のキャッシュを使うかどうかを設定する
+         *
+         * 有効にすると、checkCollision(const Configuration&)の結果を
+         * ConfigurationSpace::resolution()で量子化したコンフィギュレーションごとに記憶し、
+         * 同じ値に量子化されるコンフィギュレーションでは干渉チェックを省略する。
+         * キャッシュはsetCharacterPosition()などで干渉チェックの対象が変わると破棄される。
+         * キャラクタを直接動かした場合はclearCollisionCheckCache()を呼ぶこと。
+         * @param enable trueで有効
+         * @param maxSize 記憶する結果の数の上限。超えるとキャッシュを空にする
+         */
+        void enableCollisionCheckCache(bool enable, unsigned int maxSize = 1000000);
+
+        /**
+         * @brief 干渉チェック結果のキャッシュを破棄する
+         */
+        void clearCollisionCheckCache();
+
+        /**
+         * @brief 最小距離を使った経路の干渉チェックを行うかどうかを設定する
+         *
+         * 有効にすると、Mobility::isReachable()は一定間隔で干渉チェックする代わりに
+         * computeClearance()で得た最小距離の分だけ先の姿勢へ進む。
+         * 移動量の上限はコンフィギュレーションがロボットの基準リンクの位置と向きを表すものとして
+         * 計算するので、関節角度を変えるsetApplyConfigFunc()と組み合わせてはならない。
+         * @param enable trueで有効
+         */
+        void enableClearanceBasedEdgeCheck(bool enable) { isClearanceBasedEdgeCheckEnabled_ = enable; }
+
+        /**
+         * @brief 最小距離を使った経路の干渉チェックが有効かどうか
+         * @return 有効な場合true
+         */
+        bool isClearanceBasedEdgeCheckEnabled() const { return isClearanceBasedEdgeCheckEnabled_; }
+
+        /**
+         * @brief ロボットの基準リンクの原点から最も遠い頂点までの距離を取得する
+         *
+         * calcPath()の開始時の関節角度で計算する。
+         * @return 基準リンクの原点から最も遠い頂点までの距離。未計算の場合は負の値
+         */
+        double robotRadius() const { return robotRadius_; }
+
+        /**
+         * @brief 静的な障害物を統合したモデルで干渉チェックを行うかどうかを設定する
+         *
+         * 有効にすると、calcPath()の開始時に、ロボットの各リンクと干渉チェックする
+         * ロボット以外のリンクのモデルを、その時点の位置でワールド座標系の一つのモデルに統合し、
+         * ロボットのリンクごとに一度の干渉チェックで済ませる。許容距離が異なるペアと、
+         * 形状がプリミティブのモデルは統合しない。
+         * 統合したモデルは次のcalcPath()まで更新されないので、その間に障害物を動かしてはならない。
+         * @param enable trueで有効
+         */
+        void enableObstacleMerge(bool enable);
+
+        /**
+         * @brief 静的な障害物を統合したモデルで干渉チェックを行うかどうか
+         * @return 有効な場合true
+         */
+        bool isObstacleMergeEnabled() const { return isObstacleMergeEnabled_; }
     };
 };
 #endif // __PATH_PLANNER_H__
@@ -1,7 +1,9 @@
 // -*- mode: c++; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 4; -*-
+#include <algorithm>
 #include "Roadmap.h"
 #include "RoadmapNode.h"
 #include "ConfigurationSpace.h"
+#include "GoalSampler.h"
 #include "RRT.h"
 
 using namespace PathEngine;
@@ -14,6 +16,9 @@ RRT::RRT(PathPlanner* plan) : Algorithm(plan)
     // set default properties
     properties_["max-trials"] = "10000";
     properties_["eps"] = "0.1";
+    properties_["num-threads"] = "1";
+    properties_["goal-sampling-seeds"] = "32";
+    properties_["goal-sampling-interval"] = "100";
 
     Tstart_ = Ta_ = roadmap_;
     Tgoal_  = Tb_ = RoadmapPtr(new Roadmap(planner_));
@@ -27,11 +32,19 @@ RRT::~RRT()
 }
 
 int RRT::extend(RoadmapPtr tree, Configuration& qRand, bool reverse) {
+    RoadmapNodePtr newNode;
+    return extend(tree, qRand, reverse, newNode);
+}
+
+int RRT::extend(RoadmapPtr tree, Configuration& qRand, bool reverse,
+                RoadmapNodePtr& newNode) {
     if (debug) std::cout << "RRT::extend("<< qRand << ", " << reverse << ")" 
                          << std::endl;
 
     RoadmapNodePtr minNode;
     double min;
+    // ツリーは他のスレッドが伸ばしている可能性がある
+#pragma omp critical (RRT_tree)
     tree->findNearestNode(qRand, minNode, min);
     if (debug) std::cout << "nearest : pos = (" << minNode->position() 
                          << "), d = " << min << std::endl;
@@ -56,9 +69,12 @@ int RRT::extend(RoadmapPtr tree, Configuration& qRand, bool reverse) {
 
         if (reverse){
             if (mobility->isReachable(qRand, minNode->position())){
-                RoadmapNodePtr newNode = RoadmapNodePtr(new RoadmapNode(qRand));
-                tree->addNode(newNode);
-                tree->addEdge(newNode, minNode);
+                newNode = RoadmapNodePtr(new RoadmapNode(qRand));
+#pragma omp critical (RRT_tree)
+                {
+                    tree->addNode(newNode);
+                    tree->addEdge(newNode, minNode);
+                }
                 if (min <= eps_) {
                     if (debug) std::cout << "reached(" << qRand << ")"<< std::endl;
                     return Reached;
@@ -73,9 +89,12 @@ int RRT::extend(RoadmapPtr tree, Configuration& qRand, bool reverse) {
             }
         }else{
             if (mobility->isReachable(minNode->position(), qRand)){
-                RoadmapNodePtr newNode = RoadmapNodePtr(new RoadmapNode(qRand));
-                tree->addNode(newNode);
-                tree->addEdge(minNode, newNode);
+                newNode = RoadmapNodePtr(new RoadmapNode(qRand));
+#pragma omp critical (RRT_tree)
+                {
+                    tree->addNode(newNode);
+                    tree->addEdge(minNode, newNode);
+                }
                 if (min <= eps_) {
                     if (debug) std::cout << "reached(" << qRand << ")"<< std::endl;
                     return Reached;
@@ -95,13 +114,19 @@ int RRT::extend(RoadmapPtr tree, Configuration& qRand, bool reverse) {
 }
 
 int RRT::connect(RoadmapPtr tree,const Configuration &qNew, bool reverse) {
+    RoadmapNodePtr newNode;
+    return connect(tree, qNew, reverse, newNode);
+}
+
+int RRT::connect(RoadmapPtr tree,const Configuration &qNew, bool reverse,
+                 RoadmapNodePtr& newNode) {
     if (debug) std::cout << "RRT::connect(" << qNew << ")" << std::endl;
 
     int ret = Reached;
     Configuration q = qNew;
 
     do {
-        ret = extend(tree, q, reverse);
+        ret = extend(tree, q, reverse, newNode);
         q = qNew;
     } while (ret == Advanced);
     return ret;
@@ -113,9 +138,11 @@ void RRT::extractPath() {
 
 void RRT::extractPath(std::vector<Configuration>& o_path) {
     //std::cout << "RRT::path" << std::endl;
-    RoadmapNodePtr startMidNode = Tstart_->lastAddedNode();
-    RoadmapNodePtr goalMidNode  = Tgoal_ ->lastAddedNode();
+    extractPath(Tstart_->lastAddedNode(), Tgoal_->lastAddedNode(), o_path);
+}
 
+void RRT::extractPath(RoadmapNodePtr startMidNode, RoadmapNodePtr goalMidNode,
+                      std::vector<Configuration>& o_path) {
     o_path.clear();
     if (!startMidNode || !goalMidNode) return;
 
@@ -144,24 +171,41 @@ void RRT::extractPath(std::vector<Configuration>& o_path) {
 
 bool RRT::extendOneStep()
 {
-    Configuration qNew = planner_->getConfigurationSpace()->random();
+    RoadmapNodePtr startMidNode, goalMidNode;
+    if (extendOneStep(Ta_ == Tstart_, startMidNode, goalMidNode)) {
+        return true;
+    }
+    if (extendFromStart_ && extendFromGoal_){
+        swapTrees();
+    }
+    return false;
+}
+
+bool RRT::extendOneStep(bool forward, RoadmapNodePtr& startMidNode,
+                        RoadmapNodePtr& goalMidNode)
+{
+    Configuration qNew(planner_->getConfigurationSpace()->size());
+#pragma omp critical (RRT_random)
+    qNew = planner_->getConfigurationSpace()->random();
+
+    RoadmapNodePtr nodeA, nodeB;
     if (extendFromStart_ && extendFromGoal_){
-        
-        if (extend(Ta_, qNew, Tb_ == Tstart_) != Trapped) {
-            if (connect(Tb_, qNew, Ta_ == Tstart_) == Reached) {
+        RoadmapPtr Ta = forward ? Tstart_ : Tgoal_;
+        RoadmapPtr Tb = forward ? Tgoal_ : Tstart_;
+        if (extend(Ta, qNew, !forward, nodeA) != Trapped) {
+            if (connect(Tb, qNew, forward, nodeB) == Reached) {
+                startMidNode = forward ? nodeA : nodeB;
+                goalMidNode  = forward ? nodeB : nodeA;
                 return true;
             }
         }
-        swapTrees();
     }else if (extendFromStart_ && !extendFromGoal_){
-        if (extend(Tstart_, qNew) != Trapped) {
-            Configuration p = goal_;
-            int ret;
-            do {
-                ret = extend(Tstart_, p);
-                p = goal_;
-            }while (ret == Advanced);
-            if (ret == Reached) return true;
+        if (extend(Tstart_, qNew, false, nodeA) != Trapped) {
+            if (connect(Tstart_, goal_, false, nodeB) == Reached) {
+                startMidNode = nodeB;
+                goalMidNode = Tgoal_->node(0);
+                return true;
+            }
         }
     }else if (!extendFromStart_ && extendFromGoal_){
         std::cout << "this case is not implemented" << std::endl;
@@ -170,6 +214,55 @@ bool RRT::extendOneStep()
     return false;
 }
 
+void RRT::sampleGoals()
+{
+    std::vector<Configuration> goals;
+    goalSampler_->sample(goalSamplingSeeds_, goals);
+    for (unsigned int i=0; i<goals.size(); i++) {
+        Tgoal_->addNode(RoadmapNodePtr(new RoadmapNode(goals[i])));
+    }
+    if (verbose_) {
+        std::cout << goals.size() << " goals are sampled" << std::endl;
+    }
+}
+
+bool RRT::calcPathInParallel()
+{
+    RoadmapNodePtr startMidNode, goalMidNode;
+    bool isSucceed = false;
+
+    // 目標をサンプリングする場合は、ツリーを伸ばす合間に目標を追加する
+    int interval = goalSampler_ ? goalSamplingInterval_ : times_;
+    for (int begin=0; begin<times_ && !isSucceed; begin+=interval) {
+        if (goalSampler_) sampleGoals();
+        int end = std::min(begin+interval, times_);
+#pragma omp parallel for schedule(dynamic) num_threads(numThreads_)
+        for (int i=begin; i<end; i++) {
+            // 他のスレッドが書き換えるので、結果と同じ排他区間で読む
+            bool isFound;
+#pragma omp critical (RRT_result)
+            isFound = isSucceed;
+            if (isFound) continue;
+
+            // スタートとゴールからのツリーを交互に先に伸ばす
+            RoadmapNodePtr startMid, goalMid;
+            if (extendOneStep(i % 2 == 0, startMid, goalMid)) {
+#pragma omp critical (RRT_result)
+                if (!isSucceed) {
+                    isSucceed = true;
+                    startMidNode = startMid;
+                    goalMidNode = goalMid;
+                }
+            }
+        }
+    }
+
+    if (isSucceed) {
+        extractPath(startMidNode, goalMidNode, path_);
+    }
+    return isSucceed;
+}
+
 bool RRT::calcPath() 
 {
     if (verbose_) std::cout << "RRT::calcPath" << std::endl;
@@ -180,29 +273,55 @@ bool RRT::calcPath()
     // eps
     eps_ = atof(properties_["eps"].c_str());
 
+    // 目標のサンプリング
+    goalSamplingSeeds_ = atoi(properties_["goal-sampling-seeds"].c_str());
+    goalSamplingInterval_ = std::max(atoi(properties_["goal-sampling-interval"].c_str()), 1);
+
+    // スレッド数
+    int numThreads = atoi(properties_["num-threads"].c_str());
+    numThreads_ = 1;
+    if (numThreads > 1 && planner_->setupWorkers(numThreads)) numThreads_ = numThreads;
+
     if (verbose_){
         std::cout << "times:" << times_ << std::endl;
         std::cout << "eps:" << eps_ << std::endl;
+        std::cout << "numThreads:" << numThreads_ << std::endl;
     }
 
     RoadmapNodePtr startNode = RoadmapNodePtr(new RoadmapNode(start_));
-    RoadmapNodePtr goalNode  = RoadmapNodePtr(new RoadmapNode(goal_));
-
     Tstart_->addNode(startNode);
-    Tgoal_ ->addNode(goalNode);
+
+    // 目標をサンプリングする場合は、サンプリングした目標をゴールからのツリーの根とし、
+    // ゴールからのツリーも伸ばす
+    bool extendFromGoal = extendFromGoal_;
+    if (goalSampler_) {
+        extendFromGoal_ = true;
+    } else {
+        RoadmapNodePtr goalNode  = RoadmapNodePtr(new RoadmapNode(goal_));
+        Tgoal_ ->addNode(goalNode);
+    }
 
     bool isSucceed = false;
   
-    for (int i=0; i<times_; i++) {
-        //if (!isRunning_) break;
-        if (verbose_){
-            printf("%5d/%5dtrials : %5d/%5dnodes\r", i+1, times_, Tstart_->nNodes(),Tgoal_->nNodes());
-            fflush(stdout);
+    if (numThreads_ > 1) {
+        isSucceed = calcPathInParallel();
+        planner_->clearWorkers();
+    } else {
+        for (int i=0; i<times_; i++) {
+            //if (!isRunning_) break;
+            if (goalSampler_ && (i % goalSamplingInterval_ == 0 || Tgoal_->nNodes() == 0)) {
+                sampleGoals();
+            }
+            if (verbose_){
+                printf("%5d/%5dtrials : %5d/%5dnodes\r", i+1, times_, Tstart_->nNodes(),Tgoal_->nNodes());
+                fflush(stdout);
+            }
+            if (isSucceed = extendOneStep()) break;
         }
-        if (isSucceed = extendOneStep()) break;
+        extractPath();
     }
+    extendFromGoal_ = extendFromGoal;
   
-    extractPath();
     Tgoal_->integrate(Tstart_);
 
     if (verbose_) {
@@ -51,6 +51,13 @@ namespace PathEngine {
      */
     int extend(RoadmapPtr tree, Configuration& qRand, bool reverse=false);
 
+    /**
+     * @brief ランダムな点に向かってツリーを伸ばす。複数のスレッドから同時に呼び出せる
+     * @param newNode 伸ばせた場合は追加したノードがセットされる
+     * @return extend()と同じ
+     */
+    int extend(RoadmapPtr tree, Configuration& qRand, bool reverse, RoadmapNodePtr& newNode);
+
     /**
      * @brief RRT-connect の connect 関数。伸ばせなくなるまで extend する
      * @param tree ツリー
@@ -60,8 +67,41 @@ namespace PathEngine {
      */
     int connect(RoadmapPtr tree, const Configuration& qNew, bool reverse=false);
 
+    /**
+     * @brief RRT-connect の connect 関数。複数のスレッドから同時に呼び出せる
+     * @param newNode 最後に追加したノードがセットされる
+     * @return connect()と同じ
+     */
+    int connect(RoadmapPtr tree, const Configuration& qNew, bool reverse, RoadmapNodePtr& newNode);
+
+    /**
+     * @brief ツリーを伸ばす処理を1回だけ行う。複数のスレッドから同時に呼び出せる
+     * @param forward trueの時スタートからのツリーを、falseの時ゴールからのツリーを先に伸ばす
+     * @param startMidNode パスが見つかった場合、スタートからのツリーの接続点がセットされる
+     * @param goalMidNode パスが見つかった場合、ゴールからのツリーの接続点がセットされる
+     * @return パスが見つかった場合true
+     */
+    bool extendOneStep(bool forward, RoadmapNodePtr& startMidNode, RoadmapNodePtr& goalMidNode);
+
+    /**
+     * @brief 2つのツリーの接続点から経路を抽出する
+     */
+    void extractPath(RoadmapNodePtr startMidNode, RoadmapNodePtr goalMidNode,
+                     std::vector<Configuration>& o_path);
+
+    /**
+     * @brief 複数のスレッドでツリーを伸ばし、最初に見つかったパスをpath_にセットする
+     * @return パスが見つかった場合true
+     */
+    bool calcPathInParallel();
+
     void swapTrees();
 
+    /**
+     * @brief goalSampler_で目標コンフィギュレーションをサンプリングし、ゴールからのツリーに追加する
+     */
+    void sampleGoals();
+
     /**
      * ランダムな点に向けてどれだけのばすか
      */
@@ -72,6 +112,21 @@ namespace PathEngine {
      */
     int times_;
 
+    /**
+     * ツリーを伸ばすスレッドの数
+     */
+    unsigned int numThreads_;
+
+    /**
+     * 目標コンフィギュレーションを一度にサンプリングするときの逆運動学の初期値の数
+     */
+    unsigned int goalSamplingSeeds_;
+
+    /**
+     * 目標コンフィギュレーションをサンプリングする間隔(試行回数)
+     */
+    int goalSamplingInterval_;
+
     /**
      * スタートからツリーをのばすか否か
      */
@@ -1,4 +1,9 @@
 // -*- mode: c++; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 4; -*-
+#include <map>
+#include <queue>
+#include <algorithm>
+#include <functional>
+#include <boost/cstdint.hpp>
 #include "PathPlanner.h"
 #include "Mobility.h"
 #include "RoadmapNode.h"
@@ -6,10 +11,27 @@
 
 using namespace PathEngine;
 
+namespace {
+
+    template <class T>
+    void writeValue(std::ostream& os, const T& value)
+    {
+        os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <class T>
+    bool readValue(std::istream& is, T& value)
+    {
+        is.read(reinterpret_cast<char*>(&value), sizeof(value));
+        return is.good();
+    }
+}
+
 void Roadmap::clear()
 {
     nodes_.clear();
     m_nEdges = 0;
+    uncheckedEdges_.clear();
 }
 
 Roadmap::~Roadmap()
@@ -24,12 +46,30 @@ void Roadmap::addEdge(RoadmapNodePtr from, RoadmapNodePtr to)
     m_nEdges++;
 }
 
+void Roadmap::addUncheckedEdge(RoadmapNodePtr from, RoadmapNodePtr to)
+{
+    addEdge(from, to);
+    uncheckedEdges_.insert(Edge(from.get(), to.get()));
+}
+
+bool Roadmap::isChecked(RoadmapNodePtr from, RoadmapNodePtr to) const
+{
+    return uncheckedEdges_.find(Edge(from.get(), to.get())) == uncheckedEdges_.end();
+}
+
+void Roadmap::setChecked(RoadmapNodePtr from, RoadmapNodePtr to)
+{
+    uncheckedEdges_.erase(Edge(from.get(), to.get()));
+}
+
 void Roadmap::integrate(RoadmapPtr rdmp)
 {
     for (unsigned int i=0; i<nodes_.size(); i++){
         rdmp->addNode(nodes_[i]);
     }
     nodes_.clear();
+    rdmp->uncheckedEdges_.insert(uncheckedEdges_.begin(), uncheckedEdges_.end());
+    uncheckedEdges_.clear();
 }
 
 RoadmapNodePtr Roadmap::node(unsigned int index)
@@ -47,6 +87,7 @@ void Roadmap::findNearestNode(const Configuration& pos,
         return;
     }
 
+    timeFindNearestNode_.begin();
     node = nodes_[0];
     Mobility *mobility = planner_->getMobility();
     distance = mobility->distance(node->position(), pos);
@@ -59,6 +100,7 @@ void Roadmap::findNearestNode(const Configuration& pos,
             node = nodes_[i];
         }
     }
+    timeFindNearestNode_.end();
 }
 
 RoadmapNodePtr Roadmap::lastAddedNode()
@@ -109,6 +151,55 @@ std::vector<RoadmapNodePtr > Roadmap::DFS(RoadmapNodePtr startNode, RoadmapNodeP
     return path;
 }
 
+std::vector<RoadmapNodePtr > Roadmap::shortestPath(RoadmapNodePtr startNode, RoadmapNodePtr goalNode)
+{
+    std::map<RoadmapNode*, int> indices;
+    for (unsigned int i=0; i<nodes_.size(); i++) {
+        indices[nodes_[i].get()] = i;
+    }
+
+    std::vector<double> distances(nodes_.size(), -1);
+    std::vector<int> previous(nodes_.size(), -1);
+    std::vector<RoadmapNodePtr> path;
+    if (indices.count(startNode.get()) == 0 || indices.count(goalNode.get()) == 0) {
+        return path;
+    }
+
+    Mobility *mobility = planner_->getMobility();
+    typedef std::pair<double, int> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > queue;
+    int start = indices[startNode.get()], goal = indices[goalNode.get()];
+    distances[start] = 0;
+    queue.push(Entry(0, start));
+    while (!queue.empty()) {
+        Entry entry = queue.top();
+        queue.pop();
+        int index = entry.second;
+        if (entry.first > distances[index]) continue;
+        if (index == goal) break;
+
+        RoadmapNodePtr node = nodes_[index];
+        for (unsigned int i=0; i<node->nChildren(); i++) {
+            RoadmapNodePtr child = node->child(i);
+            int childIndex = indices[child.get()];
+            double d = distances[index]
+                + mobility->distance(node->position(), child->position());
+            if (distances[childIndex] < 0 || d < distances[childIndex]) {
+                distances[childIndex] = d;
+                previous[childIndex] = index;
+                queue.push(Entry(d, childIndex));
+            }
+        }
+    }
+
+    if (distances[goal] < 0) return path;
+    for (int index = goal; index >= 0; index = previous[index]) {
+        path.push_back(nodes_[index]);
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
 void Roadmap::tryConnection(RoadmapNodePtr from, RoadmapNodePtr to, bool tryReverse)
 {
     Mobility *mobility = planner_->getMobility();
@@ -125,5 +216,94 @@ void Roadmap::tryConnection(RoadmapNodePtr from, RoadmapNodePtr to, bool tryReve
 
 bool Roadmap::removeEdge(RoadmapNodePtr from, RoadmapNodePtr to)
 {
-    return from->removeChild(to) && to->removeParent(from);
+    if (from->removeChild(to) && to->removeParent(from)){
+        m_nEdges--;
+        uncheckedEdges_.erase(Edge(from.get(), to.get()));
+        return true;
+    }
+    return false;
+}
+
+/**
+   The node count and the configurations are followed by the edges of
+   each node. An edge is stored as (index of the child << 1) and its
+   lowest bit is set if the edge is unchecked.
+*/
+bool Roadmap::write(std::ostream& os) const
+{
+    std::map<RoadmapNode*, boost::uint32_t> indices;
+    for (unsigned int i=0; i<nodes_.size(); i++) {
+        indices[nodes_[i].get()] = i;
+    }
+
+    boost::uint32_t dim = nodes_.empty() ? 0 : nodes_[0]->position().size();
+    writeValue(os, dim);
+    writeValue(os, (boost::uint32_t)nodes_.size());
+    for (unsigned int i=0; i<nodes_.size(); i++) {
+        Configuration& pos = nodes_[i]->position();
+        for (unsigned int j=0; j<dim; j++) {
+            writeValue(os, pos.value(j));
+        }
+    }
+
+    std::vector<boost::uint32_t> edges;
+    for (unsigned int i=0; i<nodes_.size(); i++) {
+        RoadmapNodePtr node = nodes_[i];
+        edges.clear();
+        for (unsigned int j=0; j<node->nChildren(); j++) {
+            RoadmapNodePtr child = node->child(j);
+            std::map<RoadmapNode*, boost::uint32_t>::iterator it = indices.find(child.get());
+            if (it == indices.end()) continue;
+            boost::uint32_t edge = it->second << 1;
+            if (!isChecked(node, child)) edge |= 1;
+            edges.push_back(edge);
+        }
+        writeValue(os, (boost::uint32_t)edges.size());
+        for (unsigned int j=0; j<edges.size(); j++) {
+            writeValue(os, edges[j]);
+        }
+    }
+    return os.good();
+}
+
+bool Roadmap::read(std::istream& is, unsigned int dim)
+{
+    clear();
+
+    boost::uint32_t fileDim, numNodes;
+    if (!readValue(is, fileDim) || !readValue(is, numNodes)) return false;
+    if (numNodes > 0 && fileDim != dim) return false;
+
+    nodes_.reserve(numNodes);
+    for (boost::uint32_t i=0; i<numNodes; i++) {
+        Configuration pos(dim);
+        for (unsigned int j=0; j<dim; j++) {
+            if (!readValue(is, pos.value(j))) {
+                clear();
+                return false;
+            }
+        }
+        addNode(RoadmapNodePtr(new RoadmapNode(pos)));
+    }
+
+    for (boost::uint32_t i=0; i<numNodes; i++) {
+        boost::uint32_t numEdges;
+        if (!readValue(is, numEdges)) {
+            clear();
+            return false;
+        }
+        for (boost::uint32_t j=0; j<numEdges; j++) {
+            boost::uint32_t edge;
+            if (!readValue(is, edge) || (edge >> 1) >= numNodes) {
+                clear();
+                return false;
+            }
+            if (edge & 1) {
+                addUncheckedEdge(nodes_[i], nodes_[edge >> 1]);
+            } else {
+                addEdge(nodes_[i], nodes_[edge >> 1]);
+            }
+        }
+    }
+    return true;
 }
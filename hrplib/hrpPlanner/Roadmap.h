@@ -3,7 +3,10 @@
 #define __ROADMAP_H__
 
 #include <vector>
+#include <set>
+#include <iostream>
 #include <boost/shared_ptr.hpp>
+#include <hrpUtil/TimeMeasure.h>
 #include "Configuration.h"
 #include "RoadmapNode.h"
 #include "exportdef.h"
@@ -43,6 +46,30 @@ namespace PathEngine{
          */
         void addEdge(RoadmapNodePtr from, RoadmapNodePtr to);
 
+        /**
+         * @brief 到達可能か検査していない有向エッジを追加する
+         * @param from エッジの始点
+         * @param to エッジの終点
+         */
+        void addUncheckedEdge(RoadmapNodePtr from, RoadmapNodePtr to);
+
+        /**
+         * @brief エッジが到達可能か検査済みであるか調べる
+         *
+         * addEdge()で追加したエッジは検査済みとみなす。
+         * @param from エッジの始点
+         * @param to エッジの終点
+         * @return 検査済みであればtrue
+         */
+        bool isChecked(RoadmapNodePtr from, RoadmapNodePtr to) const;
+
+        /**
+         * @brief エッジを検査済みにする
+         * @param from エッジの始点
+         * @param to エッジの終点
+         */
+        void setChecked(RoadmapNodePtr from, RoadmapNodePtr to);
+
         /**
          * @brief 有向エッジを削除する
          * @param from エッジの始点
@@ -82,6 +109,12 @@ namespace PathEngine{
          */
         void findNearestNode(const Configuration& cfg, RoadmapNodePtr &node, double &distance); 
 
+        /**
+         * @brief findNearestNode()にかかった時間の合計を取得する
+         * @return 時間の合計[s]
+         */
+        double timeFindNearestNode() const { return timeFindNearestNode_.totalTime(); }
+
         /**
          * @brief 最後に追加されたノードを取得する
          * @return 最後に追加されたノード。ノードが一つもない場合はNULL
@@ -103,6 +136,14 @@ namespace PathEngine{
          */
         std::vector<RoadmapNodePtr > DFS(RoadmapNodePtr startNode, RoadmapNodePtr goalNode);
 
+        /**
+         * @brief エッジの長さを移動能力の距離とした最短経路探索(ダイクストラ法)
+         * @param startNode 初期ノード
+         * @param goalNode 終了ノード
+         * @return 探索結果を納めたパス。到達できない場合は空
+         */
+        std::vector<RoadmapNodePtr > shortestPath(RoadmapNodePtr startNode, RoadmapNodePtr goalNode);
+
         /**
          * @brief 2つのノードの接続を試み、接続できた場合はエッジを追加する
          * @param from 接続元
@@ -115,6 +156,26 @@ namespace PathEngine{
          * @brief ロードマップをクリアする
          */
         void clear();
+
+        /**
+         * @brief ロードマップをバイナリ形式で書き出す
+         *
+         * ノードのコンフィギュレーションと、子ノードのインデックスで表したエッジを書き出す。
+         * 到達可能か検査していないエッジはその印も書き出す。
+         * @param os 出力先
+         * @return 書き出せた場合true
+         */
+        bool write(std::ostream& os) const;
+
+        /**
+         * @brief write()で書き出したロードマップを読み込む
+         *
+         * 現在のノードとエッジは破棄される。
+         * @param is 入力元
+         * @param dim コンフィギュレーション空間の次元
+         * @return 読み込めた場合true。失敗した場合ロードマップは空になる
+         */
+        bool read(std::istream& is, unsigned int dim);
     private:
         /**
          * @brief ノードのリスト
@@ -122,6 +183,15 @@ namespace PathEngine{
         std::vector<RoadmapNodePtr> nodes_;
         PathPlanner *planner_;
         unsigned int m_nEdges;
+
+        typedef std::pair<RoadmapNode*, RoadmapNode*> Edge;
+
+        /**
+         * @brief 到達可能か検査していないエッジの集合
+         */
+        std::set<Edge> uncheckedEdges_;
+
+        TimeMeasure timeFindNearestNode_;
     };
 };
 
@@ -4,6 +4,7 @@
 #include "TGT.h"
 #define _USE_MATH_DEFINES // for MSVC
 #include <math.h>
+#include <algorithm>
 
 using namespace PathEngine;
 
@@ -158,3 +159,19 @@ double TGT::distance(const Configuration& from, const Configuration& to) const
     //std::cout << "d = " << sqrt(dx*dx + dy*dy) << " +  " << dth1 << " + " <<  dth2 << std::endl;
     return sqrt(dx*dx + dy*dy) + dth1 + dth2;
 }
+
+/**
+   A point at robotRadius() from the base link moves robotRadius() times
+   the angle while turning and as far as the base link while going straight.
+*/
+double TGT::maxDisplacementPerDistance() const
+{
+    ConfigurationSpace *cspace = planner_->getConfigurationSpace();
+    double radius = planner_->robotRadius();
+    if (cspace->size() != 3 || radius < 0) return 0;
+
+    double wxy = std::min(cspace->weight(0), cspace->weight(1));
+    if (wxy <= 0 || cspace->weight(2) <= 0) return 0;
+
+    return std::max(1.0/wxy, radius/cspace->weight(2));
+}
@@ -31,6 +31,11 @@ namespace PathEngine {
          */
         double distance(const Configuration& from, const Configuration& to) const;
 
+        /**
+         * @brief 親クラスのドキュメントを参照
+         */
+        double maxDisplacementPerDistance() const;
+
         /**
          * @brief 親クラスのドキュメントを参照
          */
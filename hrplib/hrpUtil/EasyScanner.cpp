@@ -9,7 +9,12 @@
 #include <cstdlib>
 #include <cmath>
 #include <cstring>
+#include <sstream>
+#include <locale>
 #include <boost/format.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <errno.h>
 
 #include "EasyScanner.h"
@@ -90,6 +95,151 @@ static inline double mystrtod(const char* nptr, char** endptr) {
 #endif
 
 
+static inline bool isDigit(char c)
+{
+    return (unsigned)(c - '0') < 10;
+}
+
+
+static const double powersOf10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+/*
+  Decimal floating point parser which does not depend on the C locale.
+
+  The result is exact when the significand fits in 53 bits and the decimal
+  exponent is within +-22, which covers the numbers written in model files.
+  The other numbers are converted by a stream with the classic locale,
+  and the forms which are not decimal numbers are left to mystrtod().
+*/
+static double parseDouble(const char* nptr, char** endptr)
+{
+    const char* p = nptr;
+    bool negative = false;
+    if(*p == '+'){
+        p++;
+    } else if(*p == '-'){
+        negative = true;
+        p++;
+    }
+    const char* digits = p;
+
+    boost::uint64_t significand = 0;
+    int numSignificantDigits = 0;
+    int exponent = 0;
+    bool truncated = false;
+    bool valid = false;
+
+    while(isDigit(*p)){
+        valid = true;
+        if(numSignificantDigits < 19){
+            significand = significand * 10 + (*p - '0');
+            if(significand > 0) numSignificantDigits++;
+        } else {
+            exponent++;
+            if(*p != '0') truncated = true;
+        }
+        p++;
+    }
+    if(*p == 'x' || *p == 'X'){
+        return mystrtod(nptr, endptr);
+    }
+    if(*p == '.'){
+        const char* dot = p++;
+        while(isDigit(*p)){
+            valid = true;
+            if(numSignificantDigits < 19){
+                significand = significand * 10 + (*p - '0');
+                if(significand > 0) numSignificantDigits++;
+                exponent--;
+            } else if(*p != '0'){
+                truncated = true;
+            }
+            p++;
+        }
+        if(!valid){
+            p = dot;
+        }
+    }
+    if(!valid){
+        return mystrtod(nptr, endptr);
+    }
+    if(*p == 'e' || *p == 'E'){
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if(*q == '+'){
+            q++;
+        } else if(*q == '-'){
+            negativeExponent = true;
+            q++;
+        }
+        if(isDigit(*q)){
+            int e = 0;
+            do {
+                if(e < 100000) e = e * 10 + (*q - '0');
+                q++;
+            } while(isDigit(*q));
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+    *endptr = (char*)p;
+
+    double value;
+    if(significand == 0){
+        value = 0.0;
+    } else if(!truncated && significand <= (boost::uint64_t(1) << 53) && exponent >= -22 && exponent <= 22){
+        value = (double)significand;
+        if(exponent < 0){
+            value /= powersOf10[-exponent];
+        } else {
+            value *= powersOf10[exponent];
+        }
+    } else {
+        std::istringstream is(std::string(digits, p));
+        is.imbue(std::locale::classic());
+        is >> value;
+        if(!is){
+            // out of range
+            return mystrtod(nptr, endptr);
+        }
+    }
+    return negative ? -value : value;
+}
+
+
+/*
+  Fast path of strtol(nptr, endptr, 0) for plain decimal numbers.
+*/
+static long parseInt(const char* nptr, char** endptr)
+{
+    const char* p = nptr;
+    bool negative = false;
+    if(*p == '+'){
+        p++;
+    } else if(*p == '-'){
+        negative = true;
+        p++;
+    }
+    // octal and hexadecimal numbers are left to strtol()
+    if(isDigit(*p) && !(*p == '0' && (isDigit(p[1]) || p[1] == 'x' || p[1] == 'X'))){
+        long value = 0;
+        int n = 0;
+        do {
+            value = value * 10 + (*p++ - '0');
+        } while(isDigit(*p) && ++n < 9);
+        if(!isDigit(*p)){
+            *endptr = (char*)p;
+            return negative ? -value : value;
+        }
+    }
+    return strtol(nptr, endptr, 0);
+}
+
+
 std::string EasyScanner::Exception::getFullMessage()
 {
     string m(message);
@@ -127,6 +277,7 @@ void EasyScanner::init()
     textBuf = 0;
     size = 0;
     textBufEnd = 0;
+    isMemoryMappedFileMode = false;
     lineNumberOffset = 1;
     
     commentChar = '#';
@@ -152,6 +303,7 @@ EasyScanner::EasyScanner(const EasyScanner& org, bool copyText) :
     commentChar = org.commentChar;
     quoteChar = org.quoteChar;
     isLineOriented = org.isLineOriented;
+    isMemoryMappedFileMode = org.isMemoryMappedFileMode;
     filename = org.filename;
     defaultErrorMessage = org.defaultErrorMessage;
     lineNumber = org.lineNumber;
@@ -176,7 +328,7 @@ EasyScanner::EasyScanner(const EasyScanner& org, bool copyText) :
 /*! This function directly sets a text in the main memory */
 void EasyScanner::setText(const char* text, int len)
 {
-    if(textBuf) delete[] textBuf;
+    releaseText();
 
     size = len;
     textBuf = new char[size+1];
@@ -191,7 +343,18 @@ void EasyScanner::setText(const char* text, int len)
 
 EasyScanner::~EasyScanner()
 {
-    if(textBuf) delete[] textBuf;
+    releaseText();
+}
+
+
+void EasyScanner::releaseText()
+{
+    if(mappedRegion){
+        mappedRegion.reset();
+    } else if(textBuf){
+        delete[] textBuf;
+    }
+    textBuf = 0;
 }
 
 
@@ -267,6 +430,37 @@ void EasyScanner::setQuoteChar(char qs)
 }
 
 
+void EasyScanner::setMemoryMappedFileMode(bool on)
+{
+    isMemoryMappedFileMode = on;
+}
+
+
+/**
+   The scanner relies on the terminating null character. A mapped region is
+   terminated by the zero-filled remainder of its last page, so a file whose
+   size is a multiple of the page size is not mapped.
+*/
+bool EasyScanner::mapFile(const string& filename)
+{
+    using namespace boost::interprocess;
+
+    if(size <= 0 || size % mapped_region::get_page_size() == 0){
+        return false;
+    }
+    try {
+        file_mapping file(filename.c_str(), read_only);
+        mappedRegion.reset(new mapped_region(file, copy_on_write, 0, size));
+    }
+    catch(const interprocess_exception& ex){
+        mappedRegion.reset();
+        return false;
+    }
+    textBuf = static_cast<char*>(mappedRegion->get_address());
+    return true;
+}
+
+
 /**
    This function loads a text from a given file.
    The function thorws EasyScanner::Exception when the file cannot be loaded.
@@ -296,10 +490,12 @@ void EasyScanner::loadFile(const string& filename)
     fseek(file, 0, SEEK_END);
     size = ftell(file);
     rewind(file);
-    if(textBuf) delete[] textBuf;
-    textBuf = new char[size+1];
-    size_t s = fread(textBuf, sizeof(char), size, file);
-    textBuf[size] = 0;
+    releaseText();
+    if(!isMemoryMappedFileMode || !mapFile(filename)){
+        textBuf = new char[size+1];
+        size_t s = fread(textBuf, sizeof(char), size, file);
+        textBuf[size] = 0;
+    }
     fclose(file);
     text = textBuf;
     textBufEnd = textBuf + size;
@@ -391,12 +587,12 @@ int EasyScanner::readToken()
 
     if(isdigit((unsigned char)*text) || *text == '+' || *text == '-'){
         char* tail;
-        intValue = strtol(text, &tail, 0);
+        intValue = parseInt(text, &tail);
         if(tail != text){
             text = tail;
             return T_INTEGER;
         }
-        doubleValue = mystrtod(text, &tail);
+        doubleValue = parseDouble(text, &tail);
         if(tail != text){
             text = tail;
             return T_DOUBLE;
@@ -488,7 +684,7 @@ bool EasyScanner::readDouble()
 
     if(checkLF()) return false;
 
-    doubleValue = mystrtod(text, &tail);
+    doubleValue = parseDouble(text, &tail);
 
     if(tail != text){
         text = tail;
@@ -504,7 +700,7 @@ bool EasyScanner::readInt()
 
     if(checkLF()) return false;
 
-    intValue = strtol(text, &tail, 0);
+    intValue = parseInt(text, &tail);
     if(tail != text){
         text = tail;
         return true;
@@ -514,6 +710,40 @@ bool EasyScanner::readInt()
 }
 
 
+/**
+   Counts the number tokens which continue up to endChar without moving the
+   current position. This is used to allocate an array before reading the numbers.
+   Note that a token like "1-2" is counted as one.
+   @return -1 if a token other than numbers appears before endChar
+*/
+int EasyScanner::countNumberTokens(int endChar)
+{
+    char* org = text;
+    int orgLineNumber = lineNumber;
+
+    int n = 0;
+    while(true){
+        skipSpace();
+        if(*text == endChar){
+            break;
+        }
+        char* head = text;
+        while(isalnum((unsigned char)*text) || *text == '.' || *text == '+' || *text == '-'){
+            text++;
+        }
+        if(text == head){
+            n = -1;
+            break;
+        }
+        ++n;
+    }
+
+    text = org;
+    lineNumber = orgLineNumber;
+    return n;
+}
+
+
 bool EasyScanner::readChar()
 {
     skipSpace();
@@ -22,6 +22,8 @@
 #include <vector>
 #include <boost/shared_ptr.hpp>
 
+namespace boost { namespace interprocess { class mapped_region; } }
+
 namespace hrp {
 
     class HRP_UTIL_EXPORT  EasyScanner {
@@ -74,6 +76,12 @@ namespace hrp {
         void setQuoteChar(char qc);
         void setWhiteSpaceChar(char ws);
 
+        /**
+           If on, loadFile() maps the file into memory instead of copying it into a buffer.
+           The file must not be modified while it is scanned.
+        */
+        void setMemoryMappedFileMode(bool on);
+
         void loadFile(const std::string& filename);
 
         void setText(const char* text, int len);
@@ -92,6 +100,7 @@ namespace hrp {
 
         bool readDouble();
         bool readInt();
+        int  countNumberTokens(int endChar);
         bool readChar();
         bool readChar(int chara);
         int  peekChar();
@@ -241,6 +250,8 @@ namespace hrp {
 
     private:
         void init();
+        void releaseText();
+        bool mapFile(const std::string& filename);
         int extractQuotedString();
 
         inline void skipToLineEnd();
@@ -251,6 +262,8 @@ namespace hrp {
         char* textBuf;
         int size;
         char* textBufEnd;
+        bool isMemoryMappedFileMode;
+        boost::shared_ptr<boost::interprocess::mapped_region> mappedRegion;
         int lineNumberOffset;
         int commentChar;
         int quoteChar;
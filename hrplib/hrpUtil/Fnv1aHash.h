@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2008, AIST, the University of Tokyo and General Robotix Inc.
+ * All rights reserved. This program is made available under the terms of the
+ * Eclipse Public License v1.0 which accompanies this distribution, and is
+ * available at http://www.eclipse.org/legal/epl-v10.html
+ * Contributors:
+ * National Institute of Advanced Industrial Science and Technology (AIST)
+ */
+
+/*!
+  @file Fnv1aHash.h
+*/
+
+#ifndef OPENHRP_UTIL_FNV1A_HASH_H_INCLUDED
+#define OPENHRP_UTIL_FNV1A_HASH_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+namespace hrp {
+
+    /**
+       64 bit FNV-1a hash.
+       The data given by successive add() calls are hashed as one byte sequence.
+       addString() and addVector() also hash the number of the elements so that
+       the boundaries of the sequences are distinguished.
+    */
+    class Fnv1aHash
+    {
+      public:
+        Fnv1aHash() : hash(14695981039346656037ULL) { }
+
+        void add(const void* data, size_t size) {
+            const unsigned char* p = static_cast<const unsigned char*>(data);
+            const unsigned char* end = p + size;
+            while(p != end){
+                hash ^= *p++;
+                hash *= 1099511628211ULL;
+            }
+        }
+
+        void addString(const std::string& str) {
+            boost::uint32_t size = str.size();
+            add(&size, sizeof(size));
+            add(str.data(), size);
+        }
+
+        template <class T> void addVector(const std::vector<T>& v) {
+            boost::uint32_t size = v.size();
+            add(&size, sizeof(size));
+            if(size > 0){
+                add(&v[0], size * sizeof(T));
+            }
+        }
+
+        boost::uint64_t value() const { return hash; }
+
+      private:
+        boost::uint64_t hash;
+    };
+}
+
+#endif
@@ -18,6 +18,7 @@
 #include <cmath>
 #include <vector>
 #include <map>
+#include <set>
 #include <hrpUtil/Eigen3d.h>
 
 using namespace std;
@@ -51,14 +52,39 @@ namespace hrp {
 
         // for normal generation
         std::vector<Vector3> faceNormals;
-        std::vector< std::vector<int> > vertexIndexToFaceIndicesMap;
-        std::vector< std::vector<int> > vertexIndexToNormalIndicesMap;
+
+        /*
+          Vertex-face adjacency sorted by the vertex index (counting sort).
+          The faces sharing vertex v are stored in adjacentFaces from vertexFaceOffsets[v]
+          and their number is numAdjacentFaces[v]. The normals generated for v are stored
+          in vertexNormalIndices with the same offsets.
+        */
+        std::vector<int> vertexFaceOffsets;
+        std::vector<int> adjacentFaces;
+        std::vector<int> numAdjacentFaces;
+        std::vector<int> vertexNormalIndices;
+        std::vector<int> numVertexNormals;
+
+        bool isParallelConversionMode;
+
+        // messages are stored here instead of being emitted when this is not null
+        std::vector<std::string>* messageBuffer;
+
+        struct ShapeNodeInfo
+        {
+            VrmlShape* shapeNode;
+            AbstractVrmlGroup* parentNode;
+            int indexInParent;
+        };
 
         enum RemapType { REMAP_COLOR, REMAP_NORMAL };
 
 
         SFNode getOriginalGeometry(VrmlShapePtr shapeNode);
         bool traverseShapeNodes(VrmlNode* node, AbstractVrmlGroup* parentNode, int indexInParent);
+        void collectShapeNodes(VrmlNode* node, AbstractVrmlGroup* parentNode, int indexInParent,
+                               std::vector<ShapeNodeInfo>& out_shapes);
+        bool convertShapeNodesInParallel(VrmlNode* topNode);
         bool convertShapeNode(VrmlShape* shapeNode);
         bool convertIndexedFaceSet(VrmlIndexedFaceSet* faceSet);
 
@@ -97,6 +123,8 @@ TMSImpl::TMSImpl(TriangleMeshShaper* self) : self(self)
 {
     divisionNumber = 20;
     isNormalGenerationMode = true;
+    isParallelConversionMode = false;
+    messageBuffer = 0;
 }
 
 
@@ -130,6 +158,22 @@ void TriangleMeshShaper::setNormalGenerationMode(bool on)
 }
 
 
+/*!
+  @if jp
+  シーングラフ中の Shape ノードを収集してから、それらをスレッドで並列に整形するかどうかを指定する。
+  並列化は OpenMP を有効にしてビルドした場合のみ行われる。
+  @else
+  If on, apply() first collects the shape nodes of the scene graph and then
+  converts them on a thread pool. The result is the same as the serial
+  conversion. The conversion is only parallelized when OpenMP is enabled.
+  @endif
+*/
+void TriangleMeshShaper::setParallelConversionMode(bool on)
+{
+    impl->isParallelConversionMode = on;
+}
+
+
 /*!
   @if jp
   変換後のShapeノードに対して、変換前のノードが持っていたGeometryNodeを返す。
@@ -168,7 +212,12 @@ SFNode TMSImpl::getOriginalGeometry(VrmlShapePtr shapeNode)
 */
 VrmlNodePtr TriangleMeshShaper::apply(VrmlNodePtr topNode)
 {
-    bool resultOfTopNode = impl->traverseShapeNodes(topNode.get(), 0, 0);
+    bool resultOfTopNode;
+    if(impl->isParallelConversionMode){
+        resultOfTopNode = impl->convertShapeNodesInParallel(topNode.get());
+    } else {
+        resultOfTopNode = impl->traverseShapeNodes(topNode.get(), 0, 0);
+    }
     return resultOfTopNode ? topNode : VrmlNodePtr();
 }
 
@@ -205,6 +254,144 @@ bool TMSImpl::traverseShapeNodes(VrmlNode* node, AbstractVrmlGroup* parentNode,
 }
 
 
+void TMSImpl::collectShapeNodes
+(VrmlNode* node, AbstractVrmlGroup* parentNode, int indexInParent, std::vector<ShapeNodeInfo>& out_shapes)
+{
+    if(node->isCategoryOf(PROTO_INSTANCE_NODE)){
+        VrmlProtoInstance* protoInstance = static_cast<VrmlProtoInstance*>(node);
+        if(protoInstance->actualNode){
+            collectShapeNodes(protoInstance->actualNode.get(), parentNode, indexInParent, out_shapes);
+        }
+
+    } else if(node->isCategoryOf(GROUPING_NODE)){
+        AbstractVrmlGroup* group = static_cast<AbstractVrmlGroup*>(node);
+        int numChildren = group->countChildren();
+        for(int i = 0; i < numChildren; i++){
+            collectShapeNodes(group->getChild(i), group, i, out_shapes);
+        }
+
+    } else if(node->isCategoryOf(SHAPE_NODE)){
+        ShapeNodeInfo info;
+        info.shapeNode = static_cast<VrmlShape*>(node);
+        info.parentNode = parentNode;
+        info.indexInParent = indexInParent;
+        out_shapes.push_back(info);
+    }
+}
+
+
+namespace {
+
+    /**
+       Registers the nodes modified by the conversion of the shape.
+       @return false if one of them has already been registered by another shape.
+    */
+    bool claimShapeNodes(VrmlShape* shapeNode, std::set<VrmlNode*>& claimedNodes)
+    {
+        VrmlNode* nodes[5] = { shapeNode->geometry.get(), 0, 0, 0, 0 };
+        if(VrmlIndexedFaceSet* faceSet = dynamic_cast<VrmlIndexedFaceSet*>(nodes[0])){
+            nodes[1] = faceSet->coord.get();
+            nodes[2] = faceSet->color.get();
+            nodes[3] = faceSet->normal.get();
+            nodes[4] = faceSet->texCoord.get();
+        }
+        for(int i=0; i < 5; ++i){
+            if(nodes[i] && claimedNodes.find(nodes[i]) != claimedNodes.end()){
+                return false;
+            }
+        }
+        for(int i=0; i < 5; ++i){
+            if(nodes[i]){
+                claimedNodes.insert(nodes[i]);
+            }
+        }
+        return true;
+    }
+}
+
+
+/**
+   The parallel version of traverseShapeNodes().
+
+   Shapes sharing a geometry, coordinate, color, normal or texture coordinate node
+   with a preceding shape are converted serially after the others so that no node is
+   modified by two threads. Messages are emitted and inconvertible shapes are removed
+   in the traversal order.
+*/
+bool TMSImpl::convertShapeNodesInParallel(VrmlNode* topNode)
+{
+    vector<ShapeNodeInfo> shapes;
+    collectShapeNodes(topNode, 0, 0, shapes);
+    const int numShapes = shapes.size();
+
+    vector<int> parallelShapes;
+    vector<int> serialShapes;
+    std::set<VrmlNode*> claimedNodes;
+    for(int i=0; i < numShapes; ++i){
+        if(claimShapeNodes(shapes[i].shapeNode, claimedNodes)){
+            parallelShapes.push_back(i);
+        } else {
+            serialShapes.push_back(i);
+        }
+    }
+
+    vector<char> results(numShapes, false);
+    vector< vector<string> > messages(numShapes);
+    const int numParallelShapes = parallelShapes.size();
+
+#pragma omp parallel
+    {
+        TMSImpl worker(self);
+        worker.divisionNumber = divisionNumber;
+        worker.isNormalGenerationMode = isNormalGenerationMode;
+
+#pragma omp for schedule(dynamic)
+        for(int i=0; i < numParallelShapes; ++i){
+            int shapeIndex = parallelShapes[i];
+            worker.messageBuffer = &messages[shapeIndex];
+            results[shapeIndex] = worker.convertShapeNode(shapes[shapeIndex].shapeNode);
+        }
+
+#pragma omp critical
+        shapeToOriginalGeometryMap.insert(worker.shapeToOriginalGeometryMap.begin(),
+                                          worker.shapeToOriginalGeometryMap.end());
+    }
+
+    vector<string>* orgMessageBuffer = messageBuffer;
+    for(size_t i=0; i < serialShapes.size(); ++i){
+        int shapeIndex = serialShapes[i];
+        messageBuffer = &messages[shapeIndex];
+        results[shapeIndex] = convertShapeNode(shapes[shapeIndex].shapeNode);
+    }
+    messageBuffer = orgMessageBuffer;
+
+    for(int i=0; i < numShapes; ++i){
+        for(size_t j=0; j < messages[i].size(); ++j){
+            putMessage(messages[i][j]);
+        }
+        if(!results[i] && shapes[i].parentNode){
+            putMessage("Node is inconvertible and removed from the scene graph");
+        }
+    }
+
+    // remove the children from the back so that the remaining indices stay valid
+    std::set< std::pair<AbstractVrmlGroup*, int> > removedChildren;
+    for(int i = numShapes - 1; i >= 0; --i){
+        ShapeNodeInfo& info = shapes[i];
+        if(!results[i] && info.parentNode){
+            if(removedChildren.insert(make_pair(info.parentNode, info.indexInParent)).second){
+                info.parentNode->removeChild(info.indexInParent);
+            }
+        }
+    }
+
+    if(topNode->isCategoryOf(SHAPE_NODE) && numShapes > 0){
+        return results[0];
+    }
+    return true;
+}
+
+
 bool TMSImpl::convertShapeNode(VrmlShape* shapeNode)
 {
     bool result = false;
@@ -966,15 +1153,9 @@ void TMSImpl::calculateFaceNormals(VrmlIndexedFaceSetPtr& triangleMesh)
     const MFInt32& triangles = triangleMesh->coordIndex;
     const int numFaces = triangles.size() / 4;
 
-    faceNormals.clear();
-
-    if(triangleMesh->normalPerVertex){
-        vertexIndexToFaceIndicesMap.clear();
-        vertexIndexToFaceIndicesMap.resize(numVertices);
-    }
+    faceNormals.resize(numFaces);
 
     for(int faceIndex=0; faceIndex < numFaces; ++faceIndex){
-
         Vector3Ref v0(getVector3Ref(vertices[triangles[faceIndex * 4 + 0]].data()));
         Vector3Ref v1(getVector3Ref(vertices[triangles[faceIndex * 4 + 1]].data()));
         Vector3Ref v2(getVector3Ref(vertices[triangles[faceIndex * 4 + 2]].data()));
@@ -982,14 +1163,32 @@ void TMSImpl::calculateFaceNormals(VrmlIndexedFaceSetPtr& triangleMesh)
 	if ( ! normal.isZero() ) {
 		normal.normalize();
 	}
-        faceNormals.push_back(normal);
+        faceNormals[faceIndex] = normal;
+    }
 
-        if(triangleMesh->normalPerVertex){
+    // sort the face corners by the vertex index
+    vertexFaceOffsets.assign(numVertices + 1, 0);
+    for(int faceIndex=0; faceIndex < numFaces; ++faceIndex){
+        for(int i=0; i < 3; ++i){
+            ++vertexFaceOffsets[triangles[faceIndex * 4 + i] + 1];
+        }
+    }
+    for(int i=0; i < numVertices; ++i){
+        vertexFaceOffsets[i + 1] += vertexFaceOffsets[i];
+    }
+
+    if(triangleMesh->normalPerVertex){
+        adjacentFaces.resize(vertexFaceOffsets[numVertices]);
+        numAdjacentFaces.assign(numVertices, 0);
+
+        for(int faceIndex=0; faceIndex < numFaces; ++faceIndex){
+            const Vector3& normal = faceNormals[faceIndex];
             for(int i=0; i < 3; ++i){
                 int vertexIndex = triangles[faceIndex * 4 + i];
-                vector<int>& facesOfVertex = vertexIndexToFaceIndicesMap[vertexIndex];
+                int* facesOfVertex = &adjacentFaces[vertexFaceOffsets[vertexIndex]];
+                int& numFacesOfVertex = numAdjacentFaces[vertexIndex];
                 bool isSameNormalFaceFound = false;
-                for(int j=0; j < facesOfVertex.size(); ++j){
+                for(int j=0; j < numFacesOfVertex; ++j){
                     const Vector3& otherNormal = faceNormals[facesOfVertex[j]];
                     const Vector3 d(otherNormal - normal);
                     // the same face is not appended
@@ -999,18 +1198,20 @@ void TMSImpl::calculateFaceNormals(VrmlIndexedFaceSetPtr& triangleMesh)
                     }
                 }
                 if(!isSameNormalFaceFound){
-                    facesOfVertex.push_back(faceIndex);
+                    facesOfVertex[numFacesOfVertex++] = faceIndex;
                 }
             }
         }
     }
+
+    // each corner adds at most one normal to its vertex
+    vertexNormalIndices.resize(vertexFaceOffsets[numVertices]);
+    numVertexNormals.assign(numVertices, 0);
 }
 
 
 void TMSImpl::setVertexNormals(VrmlIndexedFaceSetPtr& triangleMesh)
 {
-    const MFVec3f& vertices = triangleMesh->coord->point;
-    const int numVertices = vertices.size();
     const MFInt32& triangles = triangleMesh->coordIndex;
     const int numFaces = triangles.size() / 4;
 
@@ -1019,9 +1220,6 @@ void TMSImpl::setVertexNormals(VrmlIndexedFaceSetPtr& triangleMesh)
     normalIndices.clear();
     normalIndices.reserve(triangles.size());
 
-    vertexIndexToNormalIndicesMap.clear();
-    vertexIndexToNormalIndicesMap.resize(numVertices);
-
     //const double cosCreaseAngle = cos(triangleMesh->creaseAngle);
 
     for(int faceIndex=0; faceIndex < numFaces; ++faceIndex){
@@ -1029,13 +1227,14 @@ void TMSImpl::setVertexNormals(VrmlIndexedFaceSetPtr& triangleMesh)
         for(int i=0; i < 3; ++i){
 
             int vertexIndex = triangles[faceIndex * 4 + i];
-            vector<int>& facesOfVertex = vertexIndexToFaceIndicesMap[vertexIndex];
+            const int* facesOfVertex = &adjacentFaces[vertexFaceOffsets[vertexIndex]];
+            const int numFacesOfVertex = numAdjacentFaces[vertexIndex];
             const Vector3& currentFaceNormal = faceNormals[faceIndex];
             Vector3 normal = currentFaceNormal;
             bool normalIsFaceNormal = true;
 
             // avarage normals of the faces whose crease angle is below the 'creaseAngle' variable
-            for(int j=0; j < facesOfVertex.size(); ++j){
+            for(int j=0; j < numFacesOfVertex; ++j){
                 int adjoingFaceIndex = facesOfVertex[j];
                 const Vector3& adjoingFaceNormal = faceNormals[adjoingFaceIndex];
                 double angle = acos(currentFaceNormal.dot(adjoingFaceNormal)
@@ -1054,8 +1253,9 @@ void TMSImpl::setVertexNormals(VrmlIndexedFaceSetPtr& triangleMesh)
 
             for(int j=0; j < 3; ++j){
                 int vertexIndex2 = triangles[faceIndex * 4 + j];
-                vector<int>& normalIndicesOfVertex = vertexIndexToNormalIndicesMap[vertexIndex2];
-                for(int k=0; k < normalIndicesOfVertex.size(); ++k){
+                const int* normalIndicesOfVertex = &vertexNormalIndices[vertexFaceOffsets[vertexIndex2]];
+                const int numNormalsOfVertex = numVertexNormals[vertexIndex2];
+                for(int k=0; k < numNormalsOfVertex; ++k){
                     int index = normalIndicesOfVertex[k];
                     const SFVec3f& norg = normals[index];
                     const Vector3 d(Vector3(norg[0], norg[1], norg[2]) - normal);
@@ -1070,7 +1270,7 @@ void TMSImpl::setVertexNormals(VrmlIndexedFaceSetPtr& triangleMesh)
                 n[0] = normal[0]; n[1] = normal[1]; n[2] = normal[2]; 
                 normalIndex = normals.size();
                 normals.push_back(n);
-                vertexIndexToNormalIndicesMap[vertexIndex].push_back(normalIndex);
+                vertexNormalIndices[vertexFaceOffsets[vertexIndex] + numVertexNormals[vertexIndex]++] = normalIndex;
             }
             
           normalIndexFound:
@@ -1091,10 +1291,6 @@ void TMSImpl::setFaceNormals(VrmlIndexedFaceSetPtr& triangleMesh)
     normalIndices.clear();
     normalIndices.reserve(numFaces);
 
-    const int numVertices = triangleMesh->coord->point.size();
-    vertexIndexToNormalIndicesMap.clear();
-    vertexIndexToNormalIndicesMap.resize(numVertices);
-
     for(int faceIndex=0; faceIndex < numFaces; ++faceIndex){
 
         const Vector3& normal = faceNormals[faceIndex];
@@ -1103,8 +1299,9 @@ void TMSImpl::setFaceNormals(VrmlIndexedFaceSetPtr& triangleMesh)
         // find the same normal from the existing normals
         for(int i=0; i < 3; ++i){
             int vertexIndex = triangles[faceIndex * 4 + i];
-            vector<int>& normalIndicesOfVertex = vertexIndexToNormalIndicesMap[vertexIndex];
-            for(int j=0; j < normalIndicesOfVertex.size(); ++j){
+            const int* normalIndicesOfVertex = &vertexNormalIndices[vertexFaceOffsets[vertexIndex]];
+            const int numNormalsOfVertex = numVertexNormals[vertexIndex];
+            for(int j=0; j < numNormalsOfVertex; ++j){
                 int index = normalIndicesOfVertex[j];
                 const SFVec3f& norg = normals[index];
                 const Vector3 n(norg[0], norg[1], norg[2]);
@@ -1121,7 +1318,7 @@ void TMSImpl::setFaceNormals(VrmlIndexedFaceSetPtr& triangleMesh)
             normals.push_back(n);
             for(int i=0; i < 3; ++i){
                 int vertexIndex = triangles[faceIndex * 4 + i];
-                vertexIndexToNormalIndicesMap[vertexIndex].push_back(normalIndex);
+                vertexNormalIndices[vertexFaceOffsets[vertexIndex] + numVertexNormals[vertexIndex]++] = normalIndex;
             }
         }
       normalIndexFound2:
@@ -1132,7 +1329,9 @@ void TMSImpl::setFaceNormals(VrmlIndexedFaceSetPtr& triangleMesh)
 
 void TMSImpl::putMessage(const std::string& message)
 {
-    if(!self->sigMessage.empty()){
+    if(messageBuffer){
+        messageBuffer->push_back(message);
+    } else if(!self->sigMessage.empty()){
         self->sigMessage(message + "\n" );
     }
 }
@@ -32,6 +32,7 @@ namespace hrp
 
         void setDivisionNumber(int n);
         void setNormalGenerationMode(bool on);
+        void setParallelConversionMode(bool on);
         VrmlNodePtr apply(VrmlNodePtr topNode);
         SFNode getOriginalGeometry(VrmlShapePtr shapeNode);
         void defaultTextureMapping(VrmlShape* shapeNode);
@@ -51,6 +51,26 @@ VrmlNode::VrmlNode()
 }
 
 
+/**
+   The reference counter is not copied so that a copied node can be
+   owned independently of the original one.
+*/
+VrmlNode::VrmlNode(const VrmlNode& org)
+    : defName(org.defName),
+      categorySet(org.categorySet)
+{
+    refCounter = 0;
+}
+
+
+VrmlNode& VrmlNode::operator=(const VrmlNode& org)
+{
+    defName = org.defName;
+    categorySet = org.categorySet;
+    return *this;
+}
+
+
 VrmlNode::~VrmlNode()
 {
 
@@ -123,8 +123,11 @@ namespace hrp {
       public:
 
 	VrmlNode();
+	VrmlNode(const VrmlNode& org);
 	virtual ~VrmlNode();
 
+	VrmlNode& operator=(const VrmlNode& org);
+
 	static const char* getLabelOfFieldType(int type);
 	
 	std::string defName;
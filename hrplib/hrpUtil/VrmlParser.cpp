@@ -17,7 +17,11 @@
 #include <cmath>
 #include <vector>
 #include <list>
+#include <map>
+#include <set>
+#include <typeinfo>
 #include <iostream>
+#include <boost/lexical_cast.hpp>
 #include <hrpUtil/EasyScanner.h>
 #include <hrpUtil/UrlUtil.h>
 
@@ -296,6 +300,560 @@ namespace {
         U_EXTERNPROTO
 
     };
+
+
+    struct NodeTypeInfo
+    {
+        const std::type_info* type;
+        VrmlNode* (*copy)(const VrmlNode* org);
+    };
+
+    template<class NodeType> VrmlNode* copyNode(const VrmlNode* org)
+    {
+        return new NodeType(*static_cast<const NodeType*>(org));
+    }
+
+#define VRML_NODE_TYPE_INFO(NodeType) { &typeid(NodeType), copyNode<NodeType> }
+
+    /**
+       The node types which can be copied from a PROTO template.
+       Inline and proto instance nodes are not included.
+    */
+    const NodeTypeInfo nodeTypeInfos[] = {
+        VRML_NODE_TYPE_INFO(VrmlTransform),
+        VRML_NODE_TYPE_INFO(VrmlGroup),
+        VRML_NODE_TYPE_INFO(VrmlShape),
+        VRML_NODE_TYPE_INFO(VrmlAppearance),
+        VRML_NODE_TYPE_INFO(VrmlMaterial),
+        VRML_NODE_TYPE_INFO(VrmlImageTexture),
+        VRML_NODE_TYPE_INFO(VrmlTextureTransform),
+        VRML_NODE_TYPE_INFO(VrmlBox),
+        VRML_NODE_TYPE_INFO(VrmlCone),
+        VRML_NODE_TYPE_INFO(VrmlCylinder),
+        VRML_NODE_TYPE_INFO(VrmlSphere),
+        VRML_NODE_TYPE_INFO(VrmlFontStyle),
+        VRML_NODE_TYPE_INFO(VrmlText),
+        VRML_NODE_TYPE_INFO(VrmlIndexedLineSet),
+        VRML_NODE_TYPE_INFO(VrmlIndexedFaceSet),
+        VRML_NODE_TYPE_INFO(VrmlColor),
+        VRML_NODE_TYPE_INFO(VrmlCoordinate),
+        VRML_NODE_TYPE_INFO(VrmlTextureCoordinate),
+        VRML_NODE_TYPE_INFO(VrmlNormal),
+        VRML_NODE_TYPE_INFO(VrmlCylinderSensor),
+        VRML_NODE_TYPE_INFO(VrmlPointSet),
+        VRML_NODE_TYPE_INFO(VrmlPixelTexture),
+        VRML_NODE_TYPE_INFO(VrmlMovieTexture),
+        VRML_NODE_TYPE_INFO(VrmlElevationGrid),
+        VRML_NODE_TYPE_INFO(VrmlExtrusion),
+        VRML_NODE_TYPE_INFO(VrmlSwitch),
+        VRML_NODE_TYPE_INFO(VrmlLOD),
+        VRML_NODE_TYPE_INFO(VrmlCollision),
+        VRML_NODE_TYPE_INFO(VrmlAnchor),
+        VRML_NODE_TYPE_INFO(VrmlBillboard),
+        VRML_NODE_TYPE_INFO(VrmlFog),
+        VRML_NODE_TYPE_INFO(VrmlWorldInfo),
+        VRML_NODE_TYPE_INFO(VrmlPointLight),
+        VRML_NODE_TYPE_INFO(VrmlDirectionalLight),
+        VRML_NODE_TYPE_INFO(VrmlSpotLight),
+        VRML_NODE_TYPE_INFO(VrmlViewpoint),
+        VRML_NODE_TYPE_INFO(VrmlNavigationInfo),
+        VRML_NODE_TYPE_INFO(VrmlBackground),
+        VRML_NODE_TYPE_INFO(VrmlUnsupportedNode)
+    };
+
+#undef VRML_NODE_TYPE_INFO
+
+    const NodeTypeInfo* findNodeTypeInfo(VrmlNode* node)
+    {
+        const std::type_info& type = typeid(*node);
+        const int n = sizeof(nodeTypeInfos) / sizeof(nodeTypeInfos[0]);
+        for(int i=0; i < n; ++i){
+            if(*nodeTypeInfos[i].type == type){
+                return &nodeTypeInfos[i];
+            }
+        }
+        return 0;
+    }
+
+    /**
+       Calls visitor(member) for each member of a node which can be given by a
+       PROTO field with IS. The position of a member in this order identifies
+       the same member of a copy of the node.
+    */
+    template<class Visitor> void visitNodeFields(VrmlNode* node, Visitor& visitor)
+    {
+        if(VrmlGroup* group = dynamic_cast<VrmlGroup*>(node)){
+            visitor(group->bboxCenter);
+            visitor(group->bboxSize);
+            visitor(group->children);
+            if(VrmlTransform* n = dynamic_cast<VrmlTransform*>(node)){
+                visitor(n->center);
+                visitor(n->rotation);
+                visitor(n->scale);
+                visitor(n->scaleOrientation);
+                visitor(n->translation);
+            } else if(VrmlCollision* n = dynamic_cast<VrmlCollision*>(node)){
+                visitor(n->collide);
+                visitor(n->proxy);
+            } else if(VrmlAnchor* n = dynamic_cast<VrmlAnchor*>(node)){
+                visitor(n->description);
+                visitor(n->parameter);
+                visitor(n->url);
+            } else if(VrmlBillboard* n = dynamic_cast<VrmlBillboard*>(node)){
+                visitor(n->axisOfRotation);
+            }
+        } else if(VrmlSwitch* n = dynamic_cast<VrmlSwitch*>(node)){
+            visitor(n->choice);
+            visitor(n->whichChoice);
+        } else if(VrmlLOD* n = dynamic_cast<VrmlLOD*>(node)){
+            visitor(n->range);
+            visitor(n->center);
+            visitor(n->level);
+        } else if(VrmlShape* n = dynamic_cast<VrmlShape*>(node)){
+            visitor(n->geometry);
+        } else if(VrmlMaterial* n = dynamic_cast<VrmlMaterial*>(node)){
+            visitor(n->ambientIntensity);
+            visitor(n->diffuseColor);
+            visitor(n->emissiveColor);
+            visitor(n->shininess);
+            visitor(n->specularColor);
+            visitor(n->transparency);
+        } else if(VrmlImageTexture* n = dynamic_cast<VrmlImageTexture*>(node)){
+            visitor(n->url);
+            visitor(n->repeatS);
+            visitor(n->repeatT);
+        } else if(VrmlPixelTexture* n = dynamic_cast<VrmlPixelTexture*>(node)){
+            visitor(n->image);
+            visitor(n->repeatS);
+            visitor(n->repeatT);
+        } else if(VrmlMovieTexture* n = dynamic_cast<VrmlMovieTexture*>(node)){
+            visitor(n->url);
+            visitor(n->loop);
+            visitor(n->speed);
+            visitor(n->startTime);
+            visitor(n->stopTime);
+            visitor(n->repeatS);
+            visitor(n->repeatT);
+        } else if(VrmlTextureTransform* n = dynamic_cast<VrmlTextureTransform*>(node)){
+            visitor(n->center);
+            visitor(n->rotation);
+            visitor(n->scale);
+            visitor(n->translation);
+        } else if(VrmlBox* n = dynamic_cast<VrmlBox*>(node)){
+            visitor(n->size);
+        } else if(VrmlCone* n = dynamic_cast<VrmlCone*>(node)){
+            visitor(n->bottom);
+            visitor(n->bottomRadius);
+            visitor(n->height);
+            visitor(n->side);
+        } else if(VrmlCylinder* n = dynamic_cast<VrmlCylinder*>(node)){
+            visitor(n->bottom);
+            visitor(n->height);
+            visitor(n->radius);
+            visitor(n->side);
+            visitor(n->top);
+        } else if(VrmlSphere* n = dynamic_cast<VrmlSphere*>(node)){
+            visitor(n->radius);
+        } else if(VrmlFontStyle* n = dynamic_cast<VrmlFontStyle*>(node)){
+            visitor(n->family);
+            visitor(n->horizontal);
+            visitor(n->justify);
+            visitor(n->language);
+            visitor(n->leftToRight);
+            visitor(n->size);
+            visitor(n->spacing);
+            visitor(n->style);
+            visitor(n->topToBottom);
+        } else if(VrmlText* n = dynamic_cast<VrmlText*>(node)){
+            visitor(n->fstring);
+            visitor(n->length);
+            visitor(n->maxExtent);
+        } else if(VrmlIndexedLineSet* lineSet = dynamic_cast<VrmlIndexedLineSet*>(node)){
+            visitor(lineSet->colorIndex);
+            visitor(lineSet->colorPerVertex);
+            visitor(lineSet->coordIndex);
+            if(VrmlIndexedFaceSet* n = dynamic_cast<VrmlIndexedFaceSet*>(node)){
+                visitor(n->ccw);
+                visitor(n->convex);
+                visitor(n->creaseAngle);
+                visitor(n->normalIndex);
+                visitor(n->normalPerVertex);
+                visitor(n->solid);
+                visitor(n->texCoordIndex);
+            }
+        } else if(VrmlColor* n = dynamic_cast<VrmlColor*>(node)){
+            visitor(n->color);
+        } else if(VrmlCoordinate* n = dynamic_cast<VrmlCoordinate*>(node)){
+            visitor(n->point);
+        } else if(VrmlTextureCoordinate* n = dynamic_cast<VrmlTextureCoordinate*>(node)){
+            visitor(n->point);
+        } else if(VrmlNormal* n = dynamic_cast<VrmlNormal*>(node)){
+            visitor(n->vector);
+        } else if(VrmlCylinderSensor* n = dynamic_cast<VrmlCylinderSensor*>(node)){
+            visitor(n->autoOffset);
+            visitor(n->diskAngle);
+            visitor(n->enabled);
+            visitor(n->maxAngle);
+            visitor(n->minAngle);
+            visitor(n->offset);
+        } else if(VrmlElevationGrid* n = dynamic_cast<VrmlElevationGrid*>(node)){
+            visitor(n->xDimension);
+            visitor(n->zDimension);
+            visitor(n->xSpacing);
+            visitor(n->zSpacing);
+            visitor(n->height);
+            visitor(n->ccw);
+            visitor(n->colorPerVertex);
+            visitor(n->creaseAngle);
+            visitor(n->normalPerVertex);
+            visitor(n->solid);
+        } else if(VrmlExtrusion* n = dynamic_cast<VrmlExtrusion*>(node)){
+            visitor(n->crossSection);
+            visitor(n->spine);
+            visitor(n->scale);
+            visitor(n->orientation);
+            visitor(n->beginCap);
+            visitor(n->endCap);
+            visitor(n->solid);
+            visitor(n->ccw);
+            visitor(n->convex);
+            visitor(n->creaseAngle);
+        } else if(VrmlFog* n = dynamic_cast<VrmlFog*>(node)){
+            visitor(n->color);
+            visitor(n->visibilityRange);
+            visitor(n->fogType);
+        } else if(VrmlWorldInfo* n = dynamic_cast<VrmlWorldInfo*>(node)){
+            visitor(n->title);
+            visitor(n->info);
+        } else if(VrmlPointLight* n = dynamic_cast<VrmlPointLight*>(node)){
+            visitor(n->location);
+            visitor(n->on);
+            visitor(n->intensity);
+            visitor(n->color);
+            visitor(n->radius);
+            visitor(n->ambientIntensity);
+            visitor(n->attenuation);
+        } else if(VrmlDirectionalLight* n = dynamic_cast<VrmlDirectionalLight*>(node)){
+            visitor(n->ambientIntensity);
+            visitor(n->color);
+            visitor(n->direction);
+            visitor(n->intensity);
+            visitor(n->on);
+        } else if(VrmlSpotLight* n = dynamic_cast<VrmlSpotLight*>(node)){
+            visitor(n->location);
+            visitor(n->direction);
+            visitor(n->on);
+            visitor(n->color);
+            visitor(n->intensity);
+            visitor(n->radius);
+            visitor(n->ambientIntensity);
+            visitor(n->attenuation);
+            visitor(n->beamWidth);
+            visitor(n->cutOffAngle);
+        } else if(VrmlViewpoint* n = dynamic_cast<VrmlViewpoint*>(node)){
+            visitor(n->fieldOfView);
+            visitor(n->jump);
+            visitor(n->orientation);
+            visitor(n->position);
+            visitor(n->description);
+        } else if(VrmlNavigationInfo* n = dynamic_cast<VrmlNavigationInfo*>(node)){
+            visitor(n->avatarSize);
+            visitor(n->headlight);
+            visitor(n->speed);
+            visitor(n->type);
+            visitor(n->visibilityLimit);
+        } else if(VrmlBackground* n = dynamic_cast<VrmlBackground*>(node)){
+            visitor(n->groundAngle);
+            visitor(n->groundColor);
+            visitor(n->skyAngle);
+            visitor(n->skyColor);
+            visitor(n->backUrl);
+            visitor(n->bottomUrl);
+            visitor(n->frontUrl);
+            visitor(n->leftUrl);
+            visitor(n->rightUrl);
+            visitor(n->topUrl);
+        }
+    }
+
+
+    //! finds the index of the member at an address in visitNodeFields()
+    class NodeFieldIndexFinder
+    {
+    public:
+        NodeFieldIndexFinder(const void* address) : address(address), index(0), foundIndex(-1) { }
+        template<class T> void operator()(T& member) {
+            if(&member == address){
+                foundIndex = index;
+            }
+            ++index;
+        }
+        const void* address;
+        int index;
+        int foundIndex;
+    };
+
+
+    // SFTime and SFColor are the same types as SFFloat and SFVec3f, and
+    // the variant field stores them in the same way
+    inline void setNodeField(SFInt32& out_value, VrmlVariantField& field)    { out_value = field.sfInt32(); }
+    inline void setNodeField(MFInt32& out_value, VrmlVariantField& field)    { out_value = field.mfInt32(); }
+    inline void setNodeField(SFFloat& out_value, VrmlVariantField& field)    { out_value = field.sfFloat(); }
+    inline void setNodeField(MFFloat& out_value, VrmlVariantField& field)    { out_value = field.mfFloat(); }
+    inline void setNodeField(SFBool& out_value, VrmlVariantField& field)     { out_value = field.sfBool(); }
+    inline void setNodeField(SFVec2f& out_value, VrmlVariantField& field)    { out_value = field.sfVec2f(); }
+    inline void setNodeField(MFVec2f& out_value, VrmlVariantField& field)    { out_value = field.mfVec2f(); }
+    inline void setNodeField(SFVec3f& out_value, VrmlVariantField& field)    { out_value = field.sfVec3f(); }
+    inline void setNodeField(MFVec3f& out_value, VrmlVariantField& field)    { out_value = field.mfVec3f(); }
+    inline void setNodeField(SFRotation& out_value, VrmlVariantField& field) { out_value = field.sfRotation(); }
+    inline void setNodeField(MFRotation& out_value, VrmlVariantField& field) { out_value = field.mfRotation(); }
+    inline void setNodeField(SFString& out_value, VrmlVariantField& field)   { out_value = field.sfString(); }
+    inline void setNodeField(MFString& out_value, VrmlVariantField& field)   { out_value = field.mfString(); }
+    inline void setNodeField(SFNode& out_value, VrmlVariantField& field)     { out_value = field.sfNode(); }
+    inline void setNodeField(MFNode& out_value, VrmlVariantField& field)     { out_value = field.mfNode(); }
+    inline void setNodeField(SFImage& out_value, VrmlVariantField& field)    { out_value = field.sfImage(); }
+
+
+    //! sets a field value to the member of an index in visitNodeFields()
+    class NodeFieldSetter
+    {
+    public:
+        NodeFieldSetter(int targetIndex, VrmlVariantField& field)
+            : targetIndex(targetIndex), index(0), field(field) { }
+        template<class T> void operator()(T& member) {
+            if(index++ == targetIndex){
+                setNodeField(member, field);
+            }
+        }
+    private:
+        int targetIndex;
+        int index;
+        VrmlVariantField& field;
+    };
+
+
+    /**
+       Copies a node tree of a PROTO template.
+       The members which are given by the PROTO fields with IS are not copied
+       because they are replaced with the field values of each instance.
+    */
+    class ProtoTemplateNodeCopier
+    {
+    public:
+        ProtoTemplateNodeCopier(const set<const void*>& boundFields)
+            : failed(false), boundFields(boundFields) { }
+
+        VrmlNode* copy(VrmlNode* org);
+
+        //! the original and the copied nodes in the pre-order
+        vector<VrmlNode*> orgNodes;
+        vector<VrmlNode*> copiedNodes;
+
+        bool failed;
+
+    private:
+        const set<const void*>& boundFields;
+
+        void copyChildren(VrmlNode* org, VrmlNode* node);
+
+        template<class NodePtr> void copyChild(const NodePtr& orgChild, NodePtr& child) {
+            if(orgChild && !boundFields.count(&orgChild)){
+                child = static_cast<typename NodePtr::element_type*>(copy(orgChild.get()));
+            }
+        }
+
+        void copyChildren(const MFNode& orgChildren, MFNode& children) {
+            if(!boundFields.count(&orgChildren)){
+                for(size_t i=0; i < orgChildren.size(); ++i){
+                    if(orgChildren[i]){
+                        children[i] = copy(orgChildren[i].get());
+                    }
+                }
+            }
+        }
+    };
+
+
+    VrmlNode* ProtoTemplateNodeCopier::copy(VrmlNode* org)
+    {
+        const NodeTypeInfo* info = findNodeTypeInfo(org);
+        if(!info){
+            failed = true;
+            return 0;
+        }
+        VrmlNode* node = info->copy(org);
+        orgNodes.push_back(org);
+        copiedNodes.push_back(node);
+        copyChildren(org, node);
+        return node;
+    }
+
+
+    void ProtoTemplateNodeCopier::copyChildren(VrmlNode* org, VrmlNode* node)
+    {
+        if(VrmlGroup* group = dynamic_cast<VrmlGroup*>(node)){
+            copyChildren(static_cast<VrmlGroup*>(org)->children, group->children);
+            if(VrmlCollision* collision = dynamic_cast<VrmlCollision*>(node)){
+                copyChild(static_cast<VrmlCollision*>(org)->proxy, collision->proxy);
+            }
+        } else if(VrmlShape* shape = dynamic_cast<VrmlShape*>(node)){
+            VrmlShape* orgShape = static_cast<VrmlShape*>(org);
+            copyChild(orgShape->appearance, shape->appearance);
+            copyChild(orgShape->geometry, shape->geometry);
+        } else if(VrmlAppearance* appearance = dynamic_cast<VrmlAppearance*>(node)){
+            VrmlAppearance* orgAppearance = static_cast<VrmlAppearance*>(org);
+            copyChild(orgAppearance->material, appearance->material);
+            copyChild(orgAppearance->texture, appearance->texture);
+            copyChild(orgAppearance->textureTransform, appearance->textureTransform);
+        } else if(VrmlIndexedLineSet* lineSet = dynamic_cast<VrmlIndexedLineSet*>(node)){
+            VrmlIndexedLineSet* orgLineSet = static_cast<VrmlIndexedLineSet*>(org);
+            copyChild(orgLineSet->coord, lineSet->coord);
+            copyChild(orgLineSet->color, lineSet->color);
+            if(VrmlIndexedFaceSet* faceSet = dynamic_cast<VrmlIndexedFaceSet*>(node)){
+                VrmlIndexedFaceSet* orgFaceSet = static_cast<VrmlIndexedFaceSet*>(org);
+                copyChild(orgFaceSet->normal, faceSet->normal);
+                copyChild(orgFaceSet->texCoord, faceSet->texCoord);
+            }
+        } else if(VrmlText* text = dynamic_cast<VrmlText*>(node)){
+            copyChild(static_cast<VrmlText*>(org)->fontStyle, text->fontStyle);
+        } else if(VrmlPointSet* pointSet = dynamic_cast<VrmlPointSet*>(node)){
+            VrmlPointSet* orgPointSet = static_cast<VrmlPointSet*>(org);
+            copyChild(orgPointSet->coord, pointSet->coord);
+            copyChild(orgPointSet->color, pointSet->color);
+        } else if(VrmlElevationGrid* grid = dynamic_cast<VrmlElevationGrid*>(node)){
+            VrmlElevationGrid* orgGrid = static_cast<VrmlElevationGrid*>(org);
+            copyChild(orgGrid->color, grid->color);
+            copyChild(orgGrid->normal, grid->normal);
+            copyChild(orgGrid->texCoord, grid->texCoord);
+        } else if(VrmlSwitch* switchNode = dynamic_cast<VrmlSwitch*>(node)){
+            copyChildren(static_cast<VrmlSwitch*>(org)->choice, switchNode->choice);
+        } else if(VrmlLOD* lod = dynamic_cast<VrmlLOD*>(node)){
+            copyChildren(static_cast<VrmlLOD*>(org)->level, lod->level);
+        }
+    }
+
+
+    /**
+       A PROTO entity compiled into a node tree.
+
+       The tree is parsed once with the default field values, and the members
+       given with IS are recorded as the bindings to the PROTO fields.
+       An instance is created by copying the tree and by setting the field
+       values of the instance to the bound members.
+    */
+    class ProtoTemplate
+    {
+    public:
+        ProtoTemplate() : isCompilable(true) { }
+
+        VrmlNodePtr node;
+
+        //! set to false when the entity contains something that cannot be copied
+        bool isCompilable;
+
+        struct FieldReference
+        {
+            void* address;
+            string fieldName;
+        };
+        //! members given with IS, which are recorded while the entity is parsed
+        vector<FieldReference> fieldReferences;
+
+        void removeFieldReferences(const void* address);
+        bool resolveBindings();
+        VrmlNodePtr instantiate(VrmlProtoInstance* protoInstance);
+
+    private:
+        struct Binding
+        {
+            int nodeIndex;
+            int fieldIndex;
+            string fieldName;
+        };
+        vector<Binding> bindings;
+        set<const void*> boundFields;
+    };
+
+    typedef boost::shared_ptr<ProtoTemplate> ProtoTemplatePtr;
+
+
+    void ProtoTemplate::removeFieldReferences(const void* address)
+    {
+        vector<FieldReference>::iterator p = fieldReferences.begin();
+        while(p != fieldReferences.end()){
+            if(p->address == address){
+                p = fieldReferences.erase(p);
+            } else {
+                ++p;
+            }
+        }
+    }
+
+
+    /**
+       Converts the recorded member addresses into the pairs of a node index
+       and a field index given by visitNodeFields().
+       @return false if a member is not a field of a node of the tree
+    */
+    bool ProtoTemplate::resolveBindings()
+    {
+        for(size_t i=0; i < fieldReferences.size(); ++i){
+            boundFields.insert(fieldReferences[i].address);
+        }
+        if(!node){
+            return fieldReferences.empty();
+        }
+
+        ProtoTemplateNodeCopier copier(boundFields);
+        VrmlNodePtr copied = copier.copy(node.get());
+        if(copier.failed){
+            return false;
+        }
+
+        for(size_t i=0; i < fieldReferences.size(); ++i){
+            const FieldReference& ref = fieldReferences[i];
+            bool found = false;
+            for(size_t j=0; j < copier.orgNodes.size(); ++j){
+                NodeFieldIndexFinder finder(ref.address);
+                visitNodeFields(copier.orgNodes[j], finder);
+                if(finder.foundIndex >= 0){
+                    Binding binding;
+                    binding.nodeIndex = j;
+                    binding.fieldIndex = finder.foundIndex;
+                    binding.fieldName = ref.fieldName;
+                    bindings.push_back(binding);
+                    found = true;
+                    break;
+                }
+            }
+            if(!found){
+                return false;
+            }
+        }
+        fieldReferences.clear();
+
+        return true;
+    }
+
+
+    VrmlNodePtr ProtoTemplate::instantiate(VrmlProtoInstance* protoInstance)
+    {
+        if(!node){
+            return 0;
+        }
+
+        ProtoTemplateNodeCopier copier(boundFields);
+        VrmlNodePtr instanceNode = copier.copy(node.get());
+
+        for(size_t i=0; i < bindings.size(); ++i){
+            const Binding& binding = bindings[i];
+            VrmlVariantField& field = *protoInstance->getField(binding.fieldName);
+            NodeFieldSetter setter(binding.fieldIndex, field);
+            visitNodeFields(copier.copiedNodes[binding.nodeIndex], setter);
+        }
+
+        return instanceNode;
+    }
 }
 
 
@@ -315,6 +873,14 @@ namespace hrp {
         typedef map<VrmlProto*, EasyScannerPtr> ProtoToEntityScannerMap;
         ProtoToEntityScannerMap protoToEntityScannerMap;
 
+        /**
+           Compiled PROTO entities. A null template means that the entity
+           is parsed again for each instance.
+        */
+        typedef map<VrmlProtoPtr, ProtoTemplatePtr> ProtoToTemplateMap;
+        ProtoToTemplateMap protoToTemplateMap;
+        ProtoTemplate* compilingProtoTemplate;
+
         typedef map<string, VrmlNodePtr> TDefNodeMap;
         typedef pair<string, VrmlNodePtr> TDefNodePair;
         typedef map<string, VrmlProtoPtr> TProtoMap;
@@ -323,15 +889,44 @@ namespace hrp {
         TProtoMap protoMap;
         TDefNodeMap defNodeMap;
 
+        /**
+           Node trees of the inline files loaded by the parser, keyed by the path
+           and the modification time. An inline file referenced more than once is
+           parsed once and its node tree is shared in the same way as DEF / USE.
+           The map is only used by the parser of the top file, on one thread.
+        */
+        typedef map<string, VrmlNodePtr> InlineNodeMap;
+        InlineNodeMap inlineNodeMap;
+
+        //! keys of the inline files referred from each inline file
+        typedef map<string, vector<string> > InlineFileGraph;
+        InlineFileGraph inlineFileGraph;
+
+        struct PendingInline
+        {
+            VrmlInlinePtr inlineNode;
+            int childIndex;
+            string filename;
+            string key;
+            list<string> ancestorPaths;
+        };
+        vector<PendingInline> pendingInlines;
+
         void load(const string& filename);
         VrmlNodePtr readSpecificNode(VrmlNodeCategory nodeCategory, int symbol, const std::string& symbolString);
         VrmlNodePtr readInlineNode(VrmlNodeCategory nodeCategory);
-        VrmlNodePtr newInlineSource(std::string& io_filename);
+        void addInlineSource(VrmlInlinePtr inlineNode, std::string& io_filename);
+        VrmlNodePtr loadInlineFile(const std::string& filename, const list<string>& ancestorPaths,
+                                   vector<PendingInline>& out_pendingInlines);
+        void loadPendingInlines();
+        void checkInlineFileLoop();
         VrmlProtoPtr defineProto();
   
         VrmlNodePtr readNode(VrmlNodeCategory nodeCategory);
         VrmlProtoInstancePtr readProtoInstanceNode(const std::string& proto_name, VrmlNodeCategory nodeCategory);
         VrmlNodePtr evalProtoInstance(VrmlProtoInstancePtr proto, VrmlNodeCategory nodeCategory);
+        ProtoTemplatePtr getProtoTemplate(VrmlProtoPtr proto, EasyScannerPtr entityScanner);
+        bool isCompilableProtoEntity(EasyScannerPtr entityScanner);
         VrmlUnsupportedNodePtr skipUnsupportedNode(const std::string& nodeTypeName);
         VrmlUnsupportedNodePtr skipScriptNode();
         VrmlUnsupportedNodePtr skipExternProto();
@@ -378,7 +973,7 @@ namespace hrp {
         VrmlTextureTransformPtr readTextureTransformNode();
         VrmlNormalPtr readNormalNode();
   
-        VrmlVariantField& readProtoField(VrmlFieldTypeId fieldTypeId);
+        VrmlVariantField& readProtoField(VrmlFieldTypeId fieldTypeId, void* out_value = 0);
   
         void readSFInt32(SFInt32& out_value);
         void readSFFloat(SFFloat& out_value);
@@ -462,6 +1057,8 @@ void VrmlParser::setProtoInstanceActualNodeExtractionMode(bool isOn)
 */
 void VrmlParser::load(const string& filename)
 {
+    impl->inlineNodeMap.clear();
+    impl->inlineFileGraph.clear();
     impl->load(filename);
 }
 
@@ -473,9 +1070,11 @@ void VrmlParserImpl::load(const string& filename)
 
 #if (BOOST_VERSION < 104600)
     ancestorPathsList.push_back(localPath.file_string());
+    scanner->setMemoryMappedFileMode(true);
     scanner->loadFile(localPath.file_string());
 #else
     ancestorPathsList.push_back(localPath.string());
+    scanner->setMemoryMappedFileMode(true);
     scanner->loadFile(localPath.string());
 #endif
     
@@ -495,7 +1094,9 @@ void VrmlParserImpl::load(const string& filename)
 
 VrmlNodePtr VrmlParser::readNode()
 {
-    return impl->readNode(TOP_NODE);
+    VrmlNodePtr node = impl->readNode(TOP_NODE);
+    impl->loadPendingInlines();
+    return node;
 }
 
 
@@ -753,7 +1354,7 @@ VrmlNodePtr VrmlParserImpl::readInlineNode(VrmlNodeCategory nodeCategory)
 
         VrmlInlinePtr inlineNode = new VrmlInline();
         for( MFString::iterator ite = inlineUrls.begin(); ite != inlineUrls.end(); ++ite ){
-            inlineNode->children.push_back( newInlineSource( *ite ) );
+            addInlineSource( inlineNode, *ite );
             inlineNode->urls.push_back(*ite);
         }
         return inlineNode;
@@ -762,7 +1363,12 @@ VrmlNodePtr VrmlParserImpl::readInlineNode(VrmlNodeCategory nodeCategory)
 }
 
 
-VrmlNodePtr VrmlParserImpl::newInlineSource(string& io_filename)
+/**
+   Adds the node tree of an inline file to the children of inlineNode.
+   The file is not parsed here. The child is set by loadPendingInlines() of
+   the parser of the top file so that the inline files can be parsed in parallel.
+*/
+void VrmlParserImpl::addInlineSource(VrmlInlinePtr inlineNode, string& io_filename)
 {
     filesystem::path localPath;
     string chkFile("");
@@ -793,11 +1399,41 @@ VrmlNodePtr VrmlParserImpl::newInlineSource(string& io_filename)
             scanner->throwException("Infinity loop ! " + chkFile + " is included ancestor list");
         }
     }
+    io_filename = chkFile;
 
-    VrmlParserImpl  inlineParser( *this, ancestorPathsList );
+    string key(chkFile);
+    try {
+        filesystem::path path(chkFile);
+        if(exists(path)){
+            key += "\n" + lexical_cast<string>(last_write_time(path));
+        }
+    } catch(const filesystem::filesystem_error& ex){
+    }
 
-    inlineParser.load( chkFile );
-    io_filename = chkFile;
+    PendingInline pending;
+    pending.inlineNode = inlineNode;
+    pending.childIndex = inlineNode->children.size();
+    pending.filename = chkFile;
+    pending.key = key;
+    pending.ancestorPaths = ancestorPathsList;
+    pendingInlines.push_back(pending);
+
+    inlineNode->children.push_back(0);
+}
+
+
+/**
+   Parses an inline file with a parser of its own.
+   The inline files referred from the file are not parsed but returned as
+   out_pendingInlines, so the node tree does not share any node with the
+   other trees yet and the function can be called on any thread.
+*/
+VrmlNodePtr VrmlParserImpl::loadInlineFile
+(const string& filename, const list<string>& ancestorPaths, vector<PendingInline>& out_pendingInlines)
+{
+    VrmlParserImpl  inlineParser( *this, ancestorPaths );
+
+    inlineParser.load( filename );
 
     VrmlGroupPtr group = new VrmlGroup();
     while(VrmlNodePtr node = inlineParser.readNode(TOP_NODE)){
@@ -805,6 +1441,7 @@ VrmlNodePtr VrmlParserImpl::newInlineSource(string& io_filename)
             group->children.push_back(node);
         }
     }
+    out_pendingInlines.swap(inlineParser.pendingInlines);
 
     if(group->children.size() == 1){
         return group->children.front();
@@ -814,6 +1451,118 @@ VrmlNodePtr VrmlParserImpl::newInlineSource(string& io_filename)
 }
 
 
+/**
+   Parses the inline files added by addInlineSource() and the inline files
+   nested in them, level by level. The files of a level which have not been
+   loaded yet are parsed concurrently when OpenMP is enabled. Each thread
+   builds a separate node tree, and the trees are connected to each other
+   and registered in the inline node map after the parallel region, so the
+   reference counts of the shared nodes are only updated by this thread and
+   each file is parsed once.
+*/
+void VrmlParserImpl::loadPendingInlines()
+{
+    while(!pendingInlines.empty()){
+
+        vector<string> filenames;
+        vector<string> keys;
+        vector<const list<string>*> ancestorPaths;
+        set<string> newKeys;
+        for(size_t i=0; i < pendingInlines.size(); ++i){
+            const PendingInline& pending = pendingInlines[i];
+            if(inlineNodeMap.find(pending.key) == inlineNodeMap.end() &&
+               newKeys.insert(pending.key).second){
+                filenames.push_back(pending.filename);
+                keys.push_back(pending.key);
+                ancestorPaths.push_back(&pending.ancestorPaths);
+            }
+        }
+
+        const int numFiles = filenames.size();
+        vector<VrmlNodePtr> nodes(numFiles);
+        vector< vector<PendingInline> > nestedInlines(numFiles);
+        vector<EasyScanner::Exception> exceptions(numFiles);
+        vector<char> failed(numFiles, false);
+
+#pragma omp parallel for schedule(dynamic) if(numFiles > 1)
+        for(int i=0; i < numFiles; ++i){
+            try {
+                nodes[i] = loadInlineFile(filenames[i], *ancestorPaths[i], nestedInlines[i]);
+            } catch(const EasyScanner::Exception& ex){
+                exceptions[i] = ex;
+                failed[i] = true;
+            } catch(const std::exception& ex){
+                // an exception must not leave a parallel region
+                exceptions[i].message = ex.what();
+                exceptions[i].filename = filenames[i];
+                exceptions[i].lineNumber = -1;
+                failed[i] = true;
+            }
+        }
+
+        for(int i=0; i < numFiles; ++i){
+            if(failed[i]){
+                pendingInlines.clear();
+                throw exceptions[i];
+            }
+        }
+
+        vector<PendingInline> nextInlines;
+        for(int i=0; i < numFiles; ++i){
+            inlineNodeMap.insert(make_pair(keys[i], nodes[i]));
+            vector<string>& referredKeys = inlineFileGraph[keys[i]];
+            for(size_t j=0; j < nestedInlines[i].size(); ++j){
+                referredKeys.push_back(nestedInlines[i][j].key);
+                nextInlines.push_back(nestedInlines[i][j]);
+            }
+        }
+        for(size_t i=0; i < pendingInlines.size(); ++i){
+            PendingInline& pending = pendingInlines[i];
+            pending.inlineNode->children[pending.childIndex] = inlineNodeMap[pending.key];
+        }
+        pendingInlines.swap(nextInlines);
+    }
+
+    checkInlineFileLoop();
+}
+
+
+/**
+   Throws an exception if an inline file includes itself.
+   A loop which is made by sharing the tree of a file loaded for another
+   path is not detected by the ancestor paths of a parser.
+*/
+void VrmlParserImpl::checkInlineFileLoop()
+{
+    // 0: unvisited, 1: on the current path, 2: done
+    map<string, int> states;
+    for(InlineFileGraph::iterator p = inlineFileGraph.begin(); p != inlineFileGraph.end(); ++p){
+        if(states[p->first] != 0){
+            continue;
+        }
+        vector< pair<string, size_t> > path;
+        path.push_back(make_pair(p->first, (size_t)0));
+        states[p->first] = 1;
+        while(!path.empty()){
+            const vector<string>& referredKeys = inlineFileGraph[path.back().first];
+            if(path.back().second == referredKeys.size()){
+                states[path.back().first] = 2;
+                path.pop_back();
+                continue;
+            }
+            const string& key = referredKeys[path.back().second++];
+            int& state = states[key];
+            if(state == 1){
+                scanner->throwException("Infinity loop ! " + key.substr(0, key.find('\n')) + " is included ancestor list");
+            } else if(state == 0){
+                state = 1;
+                path.push_back(make_pair(key, (size_t)0));
+            }
+        }
+    }
+}
+
+
 VrmlProtoPtr VrmlParserImpl::defineProto()
 {
     string proto_name = scanner->readWordEx("illegal PROTO name");
@@ -927,6 +1676,11 @@ VrmlProtoInstancePtr VrmlParserImpl::readProtoInstanceNode(const string& proto_n
     VrmlProtoPtr proto = p->second;
     VrmlProtoInstancePtr protoInstance(new VrmlProtoInstance(proto));
 
+    if(compilingProtoTemplate){
+        // a nested proto instance is not copied from the template
+        compilingProtoTemplate->isCompilable = false;
+    }
+
     while(scanner->readWord()){
         TProtoFieldMap::iterator p = protoInstance->fields.find(scanner->stringValue);
         if(p == protoInstance->fields.end())
@@ -975,6 +1729,20 @@ VrmlNodePtr VrmlParserImpl::evalProtoInstance(VrmlProtoInstancePtr protoInstance
     if(p == protoToEntityScannerMap.end()){
         scanner->throwException("Undefined proto node instance");
     }
+
+    ProtoTemplatePtr protoTemplate = getProtoTemplate(protoInstance->proto, p->second);
+    if(protoTemplate){
+        VrmlNodePtr node = protoTemplate->instantiate(protoInstance.get());
+        if(!node){
+            return node;
+        }
+        if(node->isCategoryOf(nodeCategory)){
+            node->defName = protoInstance->defName;
+            return node;
+        }
+        // the entity is parsed again to report the error
+    }
+
     scanner = p->second;
     scanner->moveToHead();
 
@@ -993,6 +1761,101 @@ VrmlNodePtr VrmlParserImpl::evalProtoInstance(VrmlProtoInstancePtr protoInstance
 }
 
 
+/**
+   Returns the compiled template of a PROTO entity.
+   The entity is compiled when the first instance is evaluated.
+   A null pointer is returned if the entity cannot be compiled.
+*/
+ProtoTemplatePtr VrmlParserImpl::getProtoTemplate(VrmlProtoPtr proto, EasyScannerPtr entityScanner)
+{
+    ProtoToTemplateMap::iterator p = protoToTemplateMap.find(proto);
+    if(p != protoToTemplateMap.end()){
+        return p->second;
+    }
+
+    ProtoTemplatePtr protoTemplate;
+
+    if(isCompilableProtoEntity(entityScanner)){
+
+        protoTemplate.reset(new ProtoTemplate());
+
+        EasyScannerPtr orgScanner = scanner;
+        VrmlProtoInstancePtr orgProtoInstance = currentProtoInstance;
+        ProtoTemplate* orgProtoTemplate = compilingProtoTemplate;
+
+        scanner = entityScanner;
+        scanner->moveToHead();
+        currentProtoInstance = new VrmlProtoInstance(proto);
+        compilingProtoTemplate = protoTemplate.get();
+
+        try {
+            protoTemplate->node = readNode(ANY_NODE);
+        } catch(const EasyScanner::Exception& ex){
+            // the error is reported when the entity is parsed for the instance
+            protoTemplate->isCompilable = false;
+        }
+
+        scanner = orgScanner;
+        currentProtoInstance = orgProtoInstance;
+        compilingProtoTemplate = orgProtoTemplate;
+
+        if(!protoTemplate->isCompilable || !protoTemplate->resolveBindings()){
+            protoTemplate.reset();
+        }
+    }
+
+    protoToTemplateMap.insert(make_pair(proto, protoTemplate));
+
+    return protoTemplate;
+}
+
+
+/**
+   Checks whether a PROTO entity can be compiled without any side effect.
+   An entity which contains DEF, USE, ROUTE, Inline, Script or
+   another proto instance is parsed for each instance as before.
+*/
+bool VrmlParserImpl::isCompilableProtoEntity(EasyScannerPtr entityScanner)
+{
+    entityScanner->moveToHead();
+
+    bool isUndefinedWord = false;
+
+    while(true){
+        int token = entityScanner->readToken();
+        if(token == EasyScanner::T_EOF){
+            break;
+        }
+        if(token == EasyScanner::T_WORD || token == EasyScanner::T_ALPHABET){
+            int symbol = entityScanner->getSymbolID(entityScanner->stringValue);
+            switch(symbol){
+            case D_DEF:
+            case D_USE:
+            case D_ROUTE:
+            case N_INLINE:
+            case N_PROTO:
+            case U_SCRIPT:
+            case U_EXTERNPROTO:
+                return false;
+            default:
+                break;
+            }
+            isUndefinedWord = (symbol == NO_SYMBOL);
+        } else if(token == EasyScanner::T_NONE){
+            return false;
+        } else {
+            if(token == EasyScanner::T_SIGLUM && entityScanner->charValue == '{' && isUndefinedWord){
+                // a proto instance node
+                return false;
+            }
+            isUndefinedWord = false;
+        }
+    }
+
+    return true;
+}
+
+
 VrmlViewpointPtr VrmlParserImpl::readViewpointNode()
 {
     VrmlViewpointPtr node(new VrmlViewpoint);
@@ -1081,6 +1944,10 @@ VrmlGroupPtr VrmlParserImpl::readGroupNode()
         {
             MFNode dummy;
             readMFNode(dummy, CHILD_NODE);
+            if(compilingProtoTemplate){
+                // the events are not bound to the instance
+                compilingProtoTemplate->removeFieldReferences(&dummy);
+            }
         }
         break;
 
@@ -2115,7 +2982,7 @@ VrmlTextureTransformPtr VrmlParserImpl::readTextureTransformNode()
 }
 
 
-VrmlVariantField& VrmlParserImpl::readProtoField(VrmlFieldTypeId fieldTypeId)
+VrmlVariantField& VrmlParserImpl::readProtoField(VrmlFieldTypeId fieldTypeId, void* out_value)
 {
     if(!currentProtoInstance){
         scanner->throwException("cannot use proto field value here");
@@ -2132,6 +2999,17 @@ VrmlVariantField& VrmlParserImpl::readProtoField(VrmlFieldTypeId fieldTypeId)
         scanner->throwException("Unmatched field type");
     }
 
+    if(compilingProtoTemplate){
+        if(out_value){
+            ProtoTemplate::FieldReference ref;
+            ref.address = out_value;
+            ref.fieldName = p->first;
+            compilingProtoTemplate->fieldReferences.push_back(ref);
+        } else {
+            compilingProtoTemplate->isCompilable = false;
+        }
+    }
+
     return p->second;
 }
 
@@ -2139,7 +3017,7 @@ VrmlVariantField& VrmlParserImpl::readProtoField(VrmlFieldTypeId fieldTypeId)
 void VrmlParserImpl::readSFInt32(SFInt32& out_value)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(SFINT32);
+        VrmlVariantField& field = readProtoField(SFINT32, &out_value);
         out_value = field.sfInt32();
     } else {
         out_value = scanner->readIntEx("illegal int value");
@@ -2150,7 +3028,7 @@ void VrmlParserImpl::readSFInt32(SFInt32& out_value)
 void VrmlParserImpl::readMFInt32(MFInt32& out_value)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(MFINT32);
+        VrmlVariantField& field = readProtoField(MFINT32, &out_value);
         out_value = field.mfInt32();
     } else {
         int v;
@@ -2159,9 +3037,18 @@ void VrmlParserImpl::readMFInt32(MFInt32& out_value)
             readSFInt32(v);
             out_value.push_back(v);
         } else {
-            while(!scanner->readChar(']')){
-                readSFInt32(v);
-                out_value.push_back(v);
+            int n = scanner->countNumberTokens(']');
+            if(n > 0){
+                // bulk reading without the check of IS for each value
+                out_value.reserve(n);
+                while(!scanner->readChar(']')){
+                    out_value.push_back(scanner->readIntEx("illegal int value"));
+                }
+            } else {
+                while(!scanner->readChar(']')){
+                    readSFInt32(v);
+                    out_value.push_back(v);
+                }
             }
         }
     }
@@ -2171,7 +3058,7 @@ void VrmlParserImpl::readMFInt32(MFInt32& out_value)
 void VrmlParserImpl::readSFFloat(SFFloat& out_value)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(SFFLOAT);
+        VrmlVariantField& field = readProtoField(SFFLOAT, &out_value);
         out_value = field.sfFloat();
     } else {
         out_value = scanner->readDoubleEx("illegal float value");
@@ -2182,7 +3069,7 @@ void VrmlParserImpl::readSFFloat(SFFloat& out_value)
 void VrmlParserImpl::readMFFloat(MFFloat& out_value)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(MFFLOAT);
+        VrmlVariantField& field = readProtoField(MFFLOAT, &out_value);
         out_value = field.mfFloat();
     } else {
         SFFloat v;
@@ -2191,9 +3078,17 @@ void VrmlParserImpl::readMFFloat(MFFloat& out_value)
             readSFFloat(v);
             out_value.push_back(v);
         } else {
-            while(!scanner->readChar(']')){
-                readSFFloat(v);
-                out_value.push_back(v);
+            int n = scanner->countNumberTokens(']');
+            if(n > 0){
+                out_value.reserve(n);
+                while(!scanner->readChar(']')){
+                    out_value.push_back(scanner->readDoubleEx("illegal float value"));
+                }
+            } else {
+                while(!scanner->readChar(']')){
+                    readSFFloat(v);
+                    out_value.push_back(v);
+                }
             }
         }
     }
@@ -2203,7 +3098,7 @@ void VrmlParserImpl::readMFFloat(MFFloat& out_value)
 void VrmlParserImpl::readSFString(SFString& out_value)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(SFSTRING);
+        VrmlVariantField& field = readProtoField(SFSTRING, &out_value);
         out_value = field.sfString();
     } else {
         out_value = scanner->readQuotedStringEx("illegal string");
@@ -2214,7 +3109,7 @@ void VrmlParserImpl::readSFString(SFString& out_value)
 void VrmlParserImpl::readMFString(MFString& out_value)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(MFSTRING);
+        VrmlVariantField& field = readProtoField(MFSTRING, &out_value);
         out_value = field.mfString();
     } else {
         string s;
@@ -2235,7 +3130,7 @@ void VrmlParserImpl::readMFString(MFString& out_value)
 void VrmlParserImpl::readSFVec2f(SFVec2f& out_value)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(SFVEC2F);
+        VrmlVariantField& field = readProtoField(SFVEC2F, &out_value);
         out_value = field.sfVec2f();
     } else {
         readSFFloat(out_value[0]);
@@ -2247,7 +3142,7 @@ void VrmlParserImpl::readSFVec2f(SFVec2f& out_value)
 void VrmlParserImpl::readMFVec2f(MFVec2f& out_value)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(MFVEC2F);
+        VrmlVariantField& field = readProtoField(MFVEC2F, &out_value);
         out_value = field.mfVec2f();
     } else {
         SFVec2f v;
@@ -2256,9 +3151,19 @@ void VrmlParserImpl::readMFVec2f(MFVec2f& out_value)
             readSFVec2f(v);
             out_value.push_back(v);
         } else {
-            while(!scanner->readChar(']')){
-                readSFVec2f(v);
-                out_value.push_back(v);
+            int n = scanner->countNumberTokens(']');
+            if(n > 0){
+                out_value.reserve(n / 2);
+                while(!scanner->readChar(']')){
+                    v[0] = scanner->readDoubleEx("illegal float value");
+                    v[1] = scanner->readDoubleEx("illegal float value");
+                    out_value.push_back(v);
+                }
+            } else {
+                while(!scanner->readChar(']')){
+                    readSFVec2f(v);
+                    out_value.push_back(v);
+                }
             }
         }
     }
@@ -2268,7 +3173,7 @@ void VrmlParserImpl::readMFVec2f(MFVec2f& out_value)
 void VrmlParserImpl::readSFVec3f(SFVec3f& out_value)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(SFVEC3F);
+        VrmlVariantField& field = readProtoField(SFVEC3F, &out_value);
         out_value = field.sfVec3f();
     } else {
         readSFFloat(out_value[0]);
@@ -2281,7 +3186,7 @@ void VrmlParserImpl::readSFVec3f(SFVec3f& out_value)
 void VrmlParserImpl::readMFVec3f(MFVec3f& out_value)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(MFVEC3F);
+        VrmlVariantField& field = readProtoField(MFVEC3F, &out_value);
         out_value = field.mfVec3f();
     } else {
         SFVec3f v;
@@ -2290,9 +3195,20 @@ void VrmlParserImpl::readMFVec3f(MFVec3f& out_value)
             readSFVec3f(v);
             out_value.push_back(v);
         } else {
-            while(!scanner->readChar(']')){
-                readSFVec3f(v);
-                out_value.push_back(v);
+            int n = scanner->countNumberTokens(']');
+            if(n > 0){
+                out_value.reserve(n / 3);
+                while(!scanner->readChar(']')){
+                    v[0] = scanner->readDoubleEx("illegal float value");
+                    v[1] = scanner->readDoubleEx("illegal float value");
+                    v[2] = scanner->readDoubleEx("illegal float value");
+                    out_value.push_back(v);
+                }
+            } else {
+                while(!scanner->readChar(']')){
+                    readSFVec3f(v);
+                    out_value.push_back(v);
+                }
             }
         }
     }
@@ -2302,7 +3218,7 @@ void VrmlParserImpl::readMFVec3f(MFVec3f& out_value)
 void VrmlParserImpl::readSFColor(SFColor& out_value)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(SFCOLOR);
+        VrmlVariantField& field = readProtoField(SFCOLOR, &out_value);
         out_value = field.sfColor();
     } else {
         readSFVec3f(out_value);
@@ -2314,7 +3230,7 @@ void VrmlParserImpl::readSFColor(SFColor& out_value)
 void VrmlParserImpl::readMFColor(MFColor& out_value)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(MFCOLOR);
+        VrmlVariantField& field = readProtoField(MFCOLOR, &out_value);
         out_value = field.mfColor();
     } else {
         readMFVec3f(out_value);
@@ -2325,7 +3241,7 @@ void VrmlParserImpl::readMFColor(MFColor& out_value)
 void VrmlParserImpl::readSFRotation(SFRotation& out_value)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(SFROTATION);
+        VrmlVariantField& field = readProtoField(SFROTATION, &out_value);
         out_value = field.sfRotation();
     } else {
         double len2 = 0.0;
@@ -2353,7 +3269,7 @@ void VrmlParserImpl::readSFRotation(SFRotation& out_value)
 void VrmlParserImpl::readMFRotation(MFRotation& out_value)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(MFROTATION);
+        VrmlVariantField& field = readProtoField(MFROTATION, &out_value);
         out_value = field.mfRotation();
     } else {
         SFRotation r;
@@ -2374,7 +3290,7 @@ void VrmlParserImpl::readMFRotation(MFRotation& out_value)
 void VrmlParserImpl::readSFBool(SFBool& out_value)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(SFBOOL);
+        VrmlVariantField& field = readProtoField(SFBOOL, &out_value);
         out_value = field.sfBool();
     } else {
         switch(scanner->readSymbolEx("no bool value")){
@@ -2405,7 +3321,7 @@ void VrmlParserImpl::readSFImage(
 {
     if( scanner->readSymbol( F_IS ) )
 	{
-            VrmlVariantField& field = readProtoField( SFIMAGE );
+            VrmlVariantField& field = readProtoField( SFIMAGE, &out_image );
             out_image = field.sfImage();	//##### 要チェック
 	}
     else
@@ -2445,7 +3361,7 @@ void VrmlParserImpl::readSFImage(
 void VrmlParserImpl::readSFTime(SFTime& out_value)
 {
     if(scanner->readSymbol( F_IS )){
-        VrmlVariantField& field = readProtoField( SFTIME );
+        VrmlVariantField& field = readProtoField( SFTIME, &out_value );
         out_value = field.sfFloat();
     } else {
         out_value = scanner->readDoubleEx( "illegal time value" );
@@ -2456,7 +3372,7 @@ void VrmlParserImpl::readSFTime(SFTime& out_value)
 void VrmlParserImpl::readMFTime(MFTime& out_value)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField( MFTIME );
+        VrmlVariantField& field = readProtoField( MFTIME, &out_value );
         out_value = field.mfFloat();
     } else {
         SFFloat v;
@@ -2478,7 +3394,7 @@ void VrmlParserImpl::readMFTime(MFTime& out_value)
 void VrmlParserImpl::readSFNode(SFNode& out_node, VrmlNodeCategory nodeCategory)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(SFNODE);
+        VrmlVariantField& field = readProtoField(SFNODE, &out_node);
         out_node = field.sfNode();
     } else if(scanner->readSymbol(V_NULL)){
         out_node = 0;
@@ -2504,7 +3420,7 @@ SFNode VrmlParserImpl::readSFNode(VrmlNodeCategory nodeCategory)
 void VrmlParserImpl::readMFNode(MFNode& out_nodes, VrmlNodeCategory nodeCategory)
 {
     if(scanner->readSymbol(F_IS)){
-        VrmlVariantField& field = readProtoField(MFNODE);
+        VrmlVariantField& field = readProtoField(MFNODE, &out_nodes);
         out_nodes = field.mfNode();
     } else {
         SFNode sfnode;
@@ -2533,6 +3449,7 @@ void VrmlParserImpl::readMFNode(MFNode& out_nodes, VrmlNodeCategory nodeCategory
 void VrmlParserImpl::init()
 {
     currentProtoInstance = 0;
+    compilingProtoTemplate = 0;
     protoInstanceActualNodeExtractionMode = true;
 
     scanner = boost::shared_ptr<EasyScanner>( new EasyScanner() );
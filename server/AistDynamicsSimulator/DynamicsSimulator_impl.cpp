@@ -338,6 +338,62 @@ void DynamicsSimulator_impl::registerCollisionCheckPair
 }
 
 
+void DynamicsSimulator_impl::setCollisionCheckPairContactReduction
+(
+    const char *charName1,
+    const char *linkName1,
+    const char *charName2,
+    const char *linkName2,
+    CORBA::Short maxNumContactPoints
+    )
+{
+    if(debugMode){
+        cout << "DynamicsSimulator_impl::setCollisionCheckPairContactReduction("
+             << charName1 << ", " << linkName1 << ", "
+             << charName2 << ", " << linkName2 << ", "
+             << maxNumContactPoints << ")" << endl;
+    }
+
+    int bodyIndex1 = world.bodyIndex(charName1);
+    int bodyIndex2 = world.bodyIndex(charName2);
+
+    if(bodyIndex1 >= 0 && bodyIndex2 >= 0){
+
+        BodyPtr body1 = world.body(bodyIndex1);
+        BodyPtr body2 = world.body(bodyIndex2);
+
+        std::string emptyString = "";
+        vector<Link*> links1;
+        if(emptyString == linkName1){
+            const LinkTraverse& traverse = body1->linkTraverse();
+            links1.resize(traverse.numLinks());
+            std::copy(traverse.begin(), traverse.end(), links1.begin());
+        } else {
+            links1.push_back(body1->link(linkName1));
+        }
+
+        vector<Link*> links2;
+        if(emptyString == linkName2){
+            const LinkTraverse& traverse = body2->linkTraverse();
+            links2.resize(traverse.numLinks());
+            std::copy(traverse.begin(), traverse.end(), links2.begin());
+        } else {
+            links2.push_back(body2->link(linkName2));
+        }
+
+        for(size_t i=0; i < links1.size(); ++i){
+            for(size_t j=0; j < links2.size(); ++j){
+                Link* link1 = links1[i];
+                Link* link2 = links2[j];
+                if(link1 && link2 && link1 != link2){
+                    world.constraintForceSolver.setContactReduction(link1, link2, maxNumContactPoints);
+                }
+            }
+        }
+    }
+}
+
+
 void DynamicsSimulator_impl::registerIntersectionCheckPair
 (
     const char *charName1,
@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2008, AIST, the University of Tokyo and General Robotix Inc.
+ * All rights reserved. This program is made available under the terms of the
+ * Eclipse Public License v1.0 which accompanies this distribution, and is
+ * available at http://www.eclipse.org/legal/epl-v10.html
+ * Contributors:
+ * National Institute of Advanced Industrial Science and Technology (AIST)
+ */
+
+/*!
+  @file BodyInfoCache.cpp
+*/
+
+#include "BodyInfoCache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#include <boost/format.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <hrpUtil/Fnv1aHash.h>
+
+#include "BodyInfo_impl.h"
+#include "VrmlUtil.h"
+
+using namespace std;
+using namespace boost;
+
+namespace {
+
+    const char cacheMagic[8] = { 'H', 'R', 'P', 'B', 'I', 'C', '\0', '\0' };
+    const CORBA::ULong cacheVersion = 1;
+
+    /**
+       The CDR payload follows this header. Its size is a multiple of eight
+       so that the payload stays aligned in a memory-mapped region.
+    */
+    struct CacheHeader
+    {
+        char magic[8];
+        CORBA::ULong version;
+        CORBA::ULong byteOrder;
+    };
+
+    /**
+       cdrMemoryStream marshals the payload in the byte order of the host.
+       The value follows the CDR convention, that is, 1 for little endian and
+       0 for big endian. The header is also written in the host order, so an
+       entry written by a host of the other order never matches this value.
+    */
+    CORBA::ULong hostByteOrder()
+    {
+        const CORBA::ULong one = 1;
+        return *reinterpret_cast<const unsigned char*>(&one);
+    }
+
+    time_t getFileModificationTime(const string& filename)
+    {
+        struct stat statbuff;
+        if( stat( filename.c_str(), &statbuff ) == 0 ){
+            return statbuff.st_mtime;
+        }
+        return 0;
+    }
+
+    struct Dependency
+    {
+        string filename;
+        boost::uint64_t hash;
+    };
+}
+
+
+BodyInfoCache::BodyInfoCache()
+{
+    const char* dir = getenv("OPENHRP_MODEL_CACHE_DIR");
+    if(dir){
+        setDirectory(dir);
+    }
+}
+
+
+void BodyInfoCache::setDirectory(const std::string& directory)
+{
+    directory_ = directory;
+    if(!directory_.empty()){
+        char last = directory_[directory_.size() - 1];
+        if(last != '/' && last != '\\'){
+            directory_ += '/';
+        }
+    }
+}
+
+
+/**
+   @if jp
+   ファイル内容の 64bit FNV-1a ハッシュ値を計算する。
+   @endif
+*/
+bool BodyInfoCache::hashFile(const std::string& filename, boost::uint64_t& out_hash)
+{
+    using namespace boost::interprocess;
+
+    out_hash = hrp::Fnv1aHash().value();
+
+    struct stat statbuff;
+    if( stat( filename.c_str(), &statbuff ) != 0 ){
+        return false;
+    }
+    if(statbuff.st_size == 0){
+        return true;
+    }
+
+    try {
+        file_mapping file(filename.c_str(), read_only);
+        mapped_region region(file, read_only);
+        hrp::Fnv1aHash hash;
+        hash.add(region.get_address(), region.get_size());
+        out_hash = hash.value();
+    }
+    catch(const interprocess_exception& ex){
+        return false;
+    }
+    return true;
+}
+
+
+std::string BodyInfoCache::cacheFilePath(const std::string& url, bool readImage) const
+{
+    hrp::Fnv1aHash hash;
+    hash.add(url.data(), url.size());
+    return str(format("%1%%2$016x%3%.bic")
+               % directory_ % hash.value() % (readImage ? "-img" : ""));
+}
+
+
+/**
+   @if jp
+   キャッシュが有効であれば bodyInfo にその内容を設定して true を返す。
+   @else
+   Restores bodyInfo from the cache entry of url.
+   @return false if there is no entry or if one of the recorded files has
+   been modified since the entry was written.
+   @endif
+*/
+bool BodyInfoCache::load(const std::string& url, BodyInfo_impl* bodyInfo)
+{
+    using namespace boost::interprocess;
+
+    if(!isEnabled()){
+        return false;
+    }
+
+    string path(cacheFilePath(url, bodyInfo->getParam("readImage")));
+
+    struct stat statbuff;
+    if( stat( path.c_str(), &statbuff ) != 0 || statbuff.st_size <= (off_t)sizeof(CacheHeader) ){
+        return false;
+    }
+
+    try {
+        file_mapping file(path.c_str(), read_only);
+        mapped_region region(file, read_only);
+        char* data = static_cast<char*>(region.get_address());
+        size_t size = region.get_size();
+
+        const CacheHeader* header = reinterpret_cast<const CacheHeader*>(data);
+        if(memcmp(header->magic, cacheMagic, sizeof(cacheMagic)) != 0 ||
+           header->version != cacheVersion || header->byteOrder != hostByteOrder()){
+            return false;
+        }
+
+        cdrMemoryStream stream(data + sizeof(CacheHeader), size - sizeof(CacheHeader));
+
+        CORBA::ULong numDependencies;
+        numDependencies <<= stream;
+        vector<Dependency> dependencies(numDependencies);
+        for(CORBA::ULong i=0; i < numDependencies; ++i){
+            CORBA::String_var filename = stream.unmarshalString();
+            CORBA::ULongLong hash;
+            hash <<= stream;
+            boost::uint64_t currentHash;
+            if(!hashFile(filename.in(), currentHash) || currentHash != hash){
+                return false;
+            }
+            dependencies[i].filename = filename.in();
+            dependencies[i].hash = hash;
+        }
+
+        CORBA::String_var name = stream.unmarshalString();
+        CORBA::String_var url2 = stream.unmarshalString();
+        bodyInfo->name_ = name.in();
+        bodyInfo->url_ = url2.in();
+        bodyInfo->info_ <<= stream;
+        bodyInfo->links_ <<= stream;
+        bodyInfo->linkShapeIndices_ <<= stream;
+        bodyInfo->extraJoints_ <<= stream;
+        bodyInfo->shapes_ <<= stream;
+        bodyInfo->appearances_ <<= stream;
+        bodyInfo->materials_ <<= stream;
+        bodyInfo->textures_ <<= stream;
+
+        // the first dependency is the main file itself
+        for(size_t i=1; i < dependencies.size(); ++i){
+            const string& filename = dependencies[i].filename;
+            bodyInfo->fileTimeMap.insert(make_pair(filename, getFileModificationTime(filename)));
+        }
+    }
+    catch(const interprocess_exception& ex){
+        return false;
+    }
+    catch(const CORBA::SystemException& ex){
+        cout << "broken model cache " << path << endl;
+        bodyInfo->info_.length(0);
+        bodyInfo->links_.length(0);
+        bodyInfo->linkShapeIndices_.length(0);
+        bodyInfo->extraJoints_.length(0);
+        bodyInfo->shapes_.length(0);
+        bodyInfo->appearances_.length(0);
+        bodyInfo->materials_.length(0);
+        bodyInfo->textures_.length(0);
+        return false;
+    }
+
+    // a plain VRML file loaded as a single fixed link has no coldet models
+    if(bodyInfo->linkShapeIndices_.length() == bodyInfo->links_.length()){
+        bodyInfo->buildColdetModels();
+    }
+
+    return true;
+}
+
+
+/**
+   @if jp
+   ロードし終えた bodyInfo の内容をキャッシュファイルに書き出す。
+   @endif
+*/
+bool BodyInfoCache::save(const std::string& url, BodyInfo_impl* bodyInfo)
+{
+    if(!isEnabled()){
+        return false;
+    }
+
+    bool readImage = bodyInfo->getParam("readImage");
+
+    vector<string> filenames;
+    filenames.push_back(deleteURLScheme(url));
+    for(map<string, time_t>::iterator it = bodyInfo->fileTimeMap.begin(); it != bodyInfo->fileTimeMap.end(); ++it){
+        filenames.push_back(it->first);
+    }
+    if(readImage){
+        const TextureInfoSequence& textures = bodyInfo->textures_;
+        for(CORBA::ULong i=0; i < textures.length(); ++i){
+            string textureUrl(textures[i].url);
+            if(!textureUrl.empty()){
+                filenames.push_back(deleteURLScheme(textureUrl));
+            }
+        }
+    }
+
+    cdrMemoryStream stream;
+
+    CORBA::ULong numDependencies = filenames.size();
+    numDependencies >>= stream;
+    for(size_t i=0; i < filenames.size(); ++i){
+        boost::uint64_t hash;
+        if(!hashFile(filenames[i], hash)){
+            return false;
+        }
+        stream.marshalString(filenames[i].c_str());
+        CORBA::ULongLong h = hash;
+        h >>= stream;
+    }
+
+    stream.marshalString(bodyInfo->name_.c_str());
+    stream.marshalString(bodyInfo->url_.c_str());
+    bodyInfo->info_ >>= stream;
+    bodyInfo->links_ >>= stream;
+    bodyInfo->linkShapeIndices_ >>= stream;
+    bodyInfo->extraJoints_ >>= stream;
+    bodyInfo->shapes_ >>= stream;
+    bodyInfo->appearances_ >>= stream;
+    bodyInfo->materials_ >>= stream;
+    bodyInfo->textures_ >>= stream;
+
+    CacheHeader header;
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.byteOrder = hostByteOrder();
+
+    string path(cacheFilePath(url, readImage));
+#ifdef _WIN32
+    string tmpPath(str(format("%1%.%2%.tmp") % path % _getpid()));
+#else
+    string tmpPath(str(format("%1%.%2%.tmp") % path % getpid()));
+#endif
+    {
+        ofstream ofs(tmpPath.c_str(), ios::out | ios::binary | ios::trunc);
+        if(!ofs){
+            cout << "cannot write the model cache " << tmpPath << endl;
+            return false;
+        }
+        ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        ofs.write(static_cast<const char*>(stream.bufPtr()), stream.bufSize());
+        if(!ofs){
+            ofs.close();
+            remove(tmpPath.c_str());
+            return false;
+        }
+    }
+
+    // rename() is atomic on POSIX, so concurrent loaders never see a partial file
+    if(rename(tmpPath.c_str(), path.c_str()) != 0){
+        remove(path.c_str());
+        if(rename(tmpPath.c_str(), path.c_str()) != 0){
+            remove(tmpPath.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2008, AIST, the University of Tokyo and General Robotix Inc.
+ * All rights reserved. This program is made available under the terms of the
+ * Eclipse Public License v1.0 which accompanies this distribution, and is
+ * available at http://www.eclipse.org/legal/epl-v10.html
+ * Contributors:
+ * National Institute of Advanced Industrial Science and Technology (AIST)
+ */
+
+/*!
+  @file BodyInfoCache.h
+*/
+
+#ifndef OPENHRP_MODEL_LOADER_BODYINFO_CACHE_H_INCLUDED
+#define OPENHRP_MODEL_LOADER_BODYINFO_CACHE_H_INCLUDED
+
+#include <string>
+#include <boost/cstdint.hpp>
+
+class BodyInfo_impl;
+
+/**
+   @if jp
+   BodyInfo_impl の構築結果をバイナリ形式でディスクに保存し、
+   次回以降のロードでは VRML の解析と三角形メッシュ化を省略するためのキャッシュ。
+   @else
+   On-disk binary cache of fully built BodyInfo_impl objects.
+
+   A cache entry stores the LinkInfo, shape, appearance, material and texture
+   sequences in the CDR encoding together with the content hashes of the main
+   model file and of every inlined file. An entry is reused only when all the
+   hashes still match, and it is memory-mapped when it is read.
+
+   The cache is enabled by setting the directory to a non-empty path.
+   The initial directory is taken from the OPENHRP_MODEL_CACHE_DIR
+   environment variable.
+   @endif
+*/
+class BodyInfoCache
+{
+  public:
+
+    BodyInfoCache();
+
+    void setDirectory(const std::string& directory);
+    const std::string& directory() const { return directory_; }
+    bool isEnabled() const { return !directory_.empty(); }
+
+    bool load(const std::string& url, BodyInfo_impl* bodyInfo);
+    bool save(const std::string& url, BodyInfo_impl* bodyInfo);
+
+    static bool hashFile(const std::string& filename, boost::uint64_t& out_hash);
+
+  private:
+
+    std::string directory_;
+
+    std::string cacheFilePath(const std::string& url, bool readImage) const;
+};
+
+#endif
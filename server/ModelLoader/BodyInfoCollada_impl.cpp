@@ -3319,6 +3319,28 @@ ExtraJointInfoSequence* BodyInfoCollada_impl::extraJoints()
 	return new ExtraJointInfoSequence(extraJoints_);
 }
 
+
+LinkCollisionGeometry* BodyInfoCollada_impl::linkCollisionGeometry(CORBA::Short linkIndex, CORBA::Double decimationTolerance)
+{
+    if(linkIndex < 0 || linkIndex >= (CORBA::Short)links_.length()){
+        throw CORBA::BAD_PARAM();
+    }
+    LinkCollisionGeometry_var geometry(new LinkCollisionGeometry());
+    setLinkCollisionGeometry(geometry.inout(), links_[linkIndex], decimationTolerance);
+    return geometry._retn();
+}
+
+
+LinkCollisionGeometrySequence* BodyInfoCollada_impl::collisionGeometries(CORBA::Double decimationTolerance)
+{
+    LinkCollisionGeometrySequence_var geometries(new LinkCollisionGeometrySequence());
+    geometries->length(links_.length());
+    for(CORBA::ULong i=0; i < links_.length(); ++i){
+        setLinkCollisionGeometry(geometries[i], links_[i], decimationTolerance);
+    }
+    return geometries._retn();
+}
+
 boost::mutex BodyInfoCollada_impl::lock_;
 void BodyInfoCollada_impl::loadModelFile(const std::string& url)
 {
@@ -3352,6 +3374,22 @@ void BodyInfoCollada_impl::setParam(std::string param, int value)
     if(param == "AABBType") {
         AABBdataType_ = (OpenHRP::ModelLoader::AABBdataType)value;
     }
+    else if(param == "AABBTreeLayout") {
+        changeAABBTreeLayout((ColdetModel::AABBTreeLayout)value);
+    }
+}
+
+void BodyInfoCollada_impl::changeAABBTreeLayout(ColdetModel::AABBTreeLayout layout)
+{
+    for(size_t i = 0; i < linkColdetModels.size(); ++i) {
+        ColdetModelPtr& coldetModel = linkColdetModels[i];
+        if( coldetModel->getAABBTreeLayout() != layout ) {
+            coldetModel->setAABBTreeLayout(layout);
+            if( coldetModel->getNumTriangles() > 0 ) {
+                coldetModel->build();
+            }
+        }
+    }
 }
 
 void BodyInfoCollada_impl::setColdetModel(ColdetModelPtr& coldetModel, TransformedShapeIndexSequence shapeIndices, const Matrix44& Tparent, int& vertexIndex, int& triangleIndex){
@@ -48,6 +48,8 @@ class BodyInfoCollada_impl :
     virtual LinkInfoSequence* links();
     virtual AllLinkShapeIndexSequence* linkShapeIndices();
 	virtual ExtraJointInfoSequence* extraJoints();
+    virtual LinkCollisionGeometry* linkCollisionGeometry(CORBA::Short linkIndex, CORBA::Double decimationTolerance);
+    virtual LinkCollisionGeometrySequence* collisionGeometries(CORBA::Double decimationTolerance);
 
     void loadModelFile(const std::string& filename);
     void setLastUpdateTime(time_t time) { lastUpdate_ = time;};
@@ -58,6 +60,7 @@ class BodyInfoCollada_impl :
     void setParam(std::string param, bool value);
     void setParam(std::string param, int value);
     void changetoBoundingBox(unsigned int* depth) ; 
+    void changeAABBTreeLayout(ColdetModel::AABBTreeLayout layout);
 
 protected:
 
@@ -36,7 +36,23 @@ using namespace boost;
 
 namespace {
     typedef map<string, string> SensorTypeMap;
-    SensorTypeMap sensorTypeMap;
+
+    SensorTypeMap createSensorTypeMap()
+    {
+        SensorTypeMap typeMap;
+        typeMap["ForceSensor"]        = "Force";
+        typeMap["Gyro"]               = "RateGyro";
+        typeMap["AccelerationSensor"] = "Acceleration";
+        typeMap["PressureSensor"]     = "";
+        typeMap["PhotoInterrupter"]   = "";
+        typeMap["VisionSensor"]       = "Vision";
+        typeMap["TorqueSensor"]       = "";
+        typeMap["RangeSensor"]        = "Range";
+        return typeMap;
+    }
+
+    // initialized before main() so that concurrent loads only read it
+    const SensorTypeMap sensorTypeMap = createSensorTypeMap();
 }
     
 
@@ -93,6 +109,28 @@ ExtraJointInfoSequence* BodyInfo_impl::extraJoints()
 	return new ExtraJointInfoSequence(extraJoints_);
 }
 
+
+LinkCollisionGeometry* BodyInfo_impl::linkCollisionGeometry(CORBA::Short linkIndex, CORBA::Double decimationTolerance)
+{
+    if(linkIndex < 0 || linkIndex >= (CORBA::Short)links_.length()){
+        throw CORBA::BAD_PARAM();
+    }
+    LinkCollisionGeometry_var geometry(new LinkCollisionGeometry());
+    setLinkCollisionGeometry(geometry.inout(), links_[linkIndex], decimationTolerance);
+    return geometry._retn();
+}
+
+
+LinkCollisionGeometrySequence* BodyInfo_impl::collisionGeometries(CORBA::Double decimationTolerance)
+{
+    LinkCollisionGeometrySequence_var geometries(new LinkCollisionGeometrySequence());
+    geometries->length(links_.length());
+    for(CORBA::ULong i=0; i < links_.length(); ++i){
+        setLinkCollisionGeometry(geometries[i], links_[i], decimationTolerance);
+    }
+    return geometries._retn();
+}
+
 /*!
   @if jp
   @brief モデルファイルをロードし、BodyInfoを構築する。
@@ -189,38 +227,8 @@ void BodyInfo_impl::loadModelFile(const std::string& url)
         linkShapeIndices_[i] = links_[i].shapeIndices;
     }
     
-    // build coldetModels 
-    linkColdetModels.resize(numJointNodes);    
-    for(int linkIndex = 0; linkIndex < numJointNodes ; ++linkIndex){
-        ColdetModelPtr coldetModel(new ColdetModel());
-        coldetModel->setName(std::string(links_[linkIndex].name));
-        int vertexIndex = 0;
-        int triangleIndex = 0;
-        
-        Matrix44 E(Matrix44::Identity());
-        const TransformedShapeIndexSequence& shapeIndices = linkShapeIndices_[linkIndex];
-        setColdetModel(coldetModel, shapeIndices, E, vertexIndex, triangleIndex);
+    buildColdetModels();
 
-        Matrix44 T(Matrix44::Identity());
-        const SensorInfoSequence& sensors = links_[linkIndex].sensors;
-        for (unsigned int i=0; i<sensors.length(); i++){
-            const SensorInfo& sensor = sensors[i];
-            calcRodrigues(T, Vector3(sensor.rotation[0], sensor.rotation[1], 
-                                 sensor.rotation[2]), sensor.rotation[3]);
-            T(0,3) = sensor.translation[0];
-            T(1,3) = sensor.translation[1];
-            T(2,3) = sensor.translation[2];
-            const TransformedShapeIndexSequence& sensorShapeIndices = sensor.shapeIndices;
-            setColdetModel(coldetModel, sensorShapeIndices, T, vertexIndex, triangleIndex);
-        }
-                       
-        if(triangleIndex>0)    
-            coldetModel->build();
-
-        linkColdetModels[linkIndex] = coldetModel;
-        links_[linkIndex].AABBmaxDepth = coldetModel->getAABBTreeDepth();
-        links_[linkIndex].AABBmaxNum = coldetModel->getAABBmaxNum();
-    }
     //saveOriginalData();
     //originlinkShapeIndices_ = linkShapeIndices_;
 
@@ -258,6 +266,48 @@ void BodyInfo_impl::loadModelFile(const std::string& url)
 }
 
 
+/*!
+  @if jp
+  @brief 各リンクの形状から衝突検出用の ColdetModel を構築する。
+  @endif
+*/
+void BodyInfo_impl::buildColdetModels()
+{
+    int numJointNodes = links_.length();
+    linkColdetModels.resize(numJointNodes);    
+    for(int linkIndex = 0; linkIndex < numJointNodes ; ++linkIndex){
+        ColdetModelPtr coldetModel(new ColdetModel());
+        coldetModel->setName(std::string(links_[linkIndex].name));
+        int vertexIndex = 0;
+        int triangleIndex = 0;
+        
+        Matrix44 E(Matrix44::Identity());
+        const TransformedShapeIndexSequence& shapeIndices = linkShapeIndices_[linkIndex];
+        setColdetModel(coldetModel, shapeIndices, E, vertexIndex, triangleIndex);
+
+        Matrix44 T(Matrix44::Identity());
+        const SensorInfoSequence& sensors = links_[linkIndex].sensors;
+        for (unsigned int i=0; i<sensors.length(); i++){
+            const SensorInfo& sensor = sensors[i];
+            calcRodrigues(T, Vector3(sensor.rotation[0], sensor.rotation[1], 
+                                 sensor.rotation[2]), sensor.rotation[3]);
+            T(0,3) = sensor.translation[0];
+            T(1,3) = sensor.translation[1];
+            T(2,3) = sensor.translation[2];
+            const TransformedShapeIndexSequence& sensorShapeIndices = sensor.shapeIndices;
+            setColdetModel(coldetModel, sensorShapeIndices, T, vertexIndex, triangleIndex);
+        }
+                       
+        if(triangleIndex>0)    
+            coldetModel->build();
+
+        linkColdetModels[linkIndex] = coldetModel;
+        links_[linkIndex].AABBmaxDepth = coldetModel->getAABBTreeDepth();
+        links_[linkIndex].AABBmaxNum = coldetModel->getAABBmaxNum();
+    }
+}
+
+
 int BodyInfo_impl::readJointNodeSet(JointNodeSetPtr jointNodeSet, int& currentIndex, int parentIndex)
 {
     int index = currentIndex;
@@ -513,17 +563,6 @@ void BodyInfo_impl::setLights(int linkInfoIndex, JointNodeSetPtr jointNodeSet)
 
 void BodyInfo_impl::readSensorNode(int linkInfoIndex, SensorInfo& sensorInfo, VrmlProtoInstancePtr sensorNode)
 {
-    if(sensorTypeMap.empty()) {
-        sensorTypeMap["ForceSensor"]        = "Force";
-        sensorTypeMap["Gyro"]               = "RateGyro";
-        sensorTypeMap["AccelerationSensor"] = "Acceleration";
-        sensorTypeMap["PressureSensor"]     = "";
-        sensorTypeMap["PhotoInterrupter"]   = "";
-        sensorTypeMap["VisionSensor"]       = "Vision";
-        sensorTypeMap["TorqueSensor"]       = "";
-        sensorTypeMap["RangeSensor"]	    = "Range";
-    }
-
     try	{
         sensorInfo.name = CORBA::string_dup( sensorNode->defName.c_str() );
 
@@ -533,7 +572,7 @@ void BodyInfo_impl::readSensorNode(int linkInfoIndex, SensorInfo& sensorInfo, Vr
         copyVrmlField(fmap, "translation", sensorInfo.translation );
         copyVrmlRotationFieldToDblArray4( fmap, "rotation", sensorInfo.rotation );
         
-        SensorTypeMap::iterator p = sensorTypeMap.find( sensorNode->proto->protoName );
+        SensorTypeMap::const_iterator p = sensorTypeMap.find( sensorNode->proto->protoName );
         std::string sensorType;
         if(p != sensorTypeMap.end()){
             sensorType = p->second;
@@ -751,10 +790,32 @@ bool BodyInfo_impl::getParam(std::string param){
 void BodyInfo_impl::setParam(std::string param, int value){
     if(param == "AABBType")
         AABBdataType_ = (OpenHRP::ModelLoader::AABBdataType)value;
+    else if(param == "AABBTreeLayout")
+        changeAABBTreeLayout((ColdetModel::AABBTreeLayout)value);
     else
         ;
 }
 
+/*!
+  @if jp
+  @brief 衝突検出用モデルの AABB 木の配置を変え、配置が変わったモデルを構築し直す。
+
+  OpenHRP::ModelLoader::AABBTreeLayout と ColdetModel::AABBTreeLayout の値は同じ順に並んでいる。
+  ModelLoader は配置ごとに BodyInfo をキャッシュするので、他のクライアントと共有する前にだけ呼ばれる。
+  @endif
+*/
+void BodyInfo_impl::changeAABBTreeLayout(ColdetModel::AABBTreeLayout layout)
+{
+    for(size_t i=0; i < linkColdetModels.size(); ++i){
+        ColdetModelPtr& coldetModel = linkColdetModels[i];
+        if(coldetModel->getAABBTreeLayout() != layout){
+            coldetModel->setAABBTreeLayout(layout);
+            if(coldetModel->getNumTriangles() > 0)
+                coldetModel->build();
+        }
+    }
+}
+
 void BodyInfo_impl::changetoBoundingBox(unsigned int* inputData){
     const double EPS = 1.0e-6;
     createAppearanceInfo();
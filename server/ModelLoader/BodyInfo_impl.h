@@ -41,6 +41,8 @@ class BodyInfo_impl :
     virtual LinkInfoSequence* links();
     virtual AllLinkShapeIndexSequence* linkShapeIndices();
 	virtual ExtraJointInfoSequence* extraJoints();
+    virtual LinkCollisionGeometry* linkCollisionGeometry(CORBA::Short linkIndex, CORBA::Double decimationTolerance);
+    virtual LinkCollisionGeometrySequence* collisionGeometries(CORBA::Double decimationTolerance);
 
     void loadModelFile(const std::string& filename);
 
@@ -52,6 +54,7 @@ class BodyInfo_impl :
     void setParam(std::string param, bool value);
     void setParam(std::string param, int value);
     void changetoBoundingBox(unsigned int* depth) ; 
+    void changeAABBTreeLayout(ColdetModel::AABBTreeLayout layout);
     void changetoOriginData();
 
 protected:
@@ -74,6 +77,7 @@ private:
 
     std::vector<ColdetModelPtr> linkColdetModels;
 
+    void buildColdetModels();
     int readJointNodeSet(JointNodeSetPtr jointNodeSet, int& currentIndex, int motherIndex);
     void setJointParameters(int linkInfoIndex, VrmlProtoInstancePtr jointNode );
     void setSegmentParameters(int linkInfoIndex, JointNodeSetPtr jointNodeSet);
@@ -84,6 +88,8 @@ private:
     void readHwcNode(int linkInfoIndex, HwcInfo& hwcInfo, VrmlProtoInstancePtr hwcNode);
     void readLightNode(int linkInfoIndex, LightInfo& LightInfo, 
                        std::pair<Matrix44, VrmlNodePtr> &transformedLight);
+
+    friend class BodyInfoCache;
 };
 
 #endif
@@ -15,8 +15,15 @@
 #include "ModelLoader_impl.h"
 
 #include <iostream>
+#include <sstream>
+#include <vector>
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 
 #include "VrmlUtil.h"
 
@@ -48,7 +55,8 @@ static bool IsColladaFile(const std::string& filename)
 ModelLoader_impl::ModelLoader_impl(CORBA::ORB_ptr orb, PortableServer::POA_ptr poa)
     :
     orb(CORBA::ORB::_duplicate(orb)),
-    poa(PortableServer::POA::_duplicate(poa))
+    poa(PortableServer::POA::_duplicate(poa)),
+    loadFinishedCondition(&bodyInfoMutex)
 {
 
 }
@@ -178,21 +186,29 @@ static void changetoBoundingBox(POA_OpenHRP::BodyInfo* bodyInfo, unsigned int* d
     throw ModelLoader::ModelLoaderException("changetoBoundingBox(depth) invalid pointer");
 }
 
-BodyInfo_ptr ModelLoader_impl::loadBodyInfo(const char* url)
-    throw (CORBA::SystemException, OpenHRP::ModelLoader::ModelLoaderException)
+/**
+   @return the key of a cached BodyInfo. The options which change the contents of a BodyInfo
+   are a part of the key so that a cached BodyInfo is never modified for another request.
+*/
+static string makeCacheKey(const string& url, const OpenHRP::ModelLoader::ModelLoadOption& option)
 {
-    OpenHRP::ModelLoader::ModelLoadOption option;
-    option.readImage = false;
-    option.AABBdata.length(0);
-    option.AABBtype = OpenHRP::ModelLoader::AABB_NUM;
-    POA_OpenHRP::BodyInfo* bodyInfo = loadBodyInfoFromModelFile(url, option);
-    return bodyInfo->_this();
+    ostringstream key;
+    key << url << '\n' << (option.readImage ? 1 : 0) << ' ' << (int)option.AABBtreeLayout;
+    if(option.AABBdata.length()){
+        key << ' ' << (int)option.AABBtype << ':';
+        for(CORBA::ULong i=0; i < option.AABBdata.length(); ++i){
+            key << ' ' << option.AABBdata[i];
+        }
+    }
+    return key.str();
 }
 
-BodyInfo_ptr ModelLoader_impl::loadBodyInfoEx(const char* url, const OpenHRP::ModelLoader::ModelLoadOption& option)
-    throw (CORBA::SystemException, OpenHRP::ModelLoader::ModelLoaderException)
+/**
+   Applies the options to a BodyInfo which has just been loaded and is not shared yet.
+*/
+void ModelLoader_impl::applyModelLoadOption(POA_OpenHRP::BodyInfo* bodyInfo, const OpenHRP::ModelLoader::ModelLoadOption& option)
 {
-    POA_OpenHRP::BodyInfo* bodyInfo = loadBodyInfoFromModelFile(url, option);
+    setParam(bodyInfo,"AABBTreeLayout", (int)option.AABBtreeLayout);
     if(option.AABBdata.length()){
         setParam(bodyInfo,"AABBType", (int)option.AABBtype);
         int length=option.AABBdata.length();
@@ -202,15 +218,19 @@ BodyInfo_ptr ModelLoader_impl::loadBodyInfoEx(const char* url, const OpenHRP::Mo
         changetoBoundingBox(bodyInfo,_AABBdata);
         delete[] _AABBdata;
     }
-    return bodyInfo->_this();
 }
 
-BodyInfo_ptr ModelLoader_impl::getBodyInfoEx(const char* url0, const OpenHRP::ModelLoader::ModelLoadOption& option)
-    throw (CORBA::SystemException, OpenHRP::ModelLoader::ModelLoaderException)
+/**
+   @return the cached BodyInfo of key if the model files of url have not been modified since it was loaded, otherwise 0.
+   bodyInfoMutex must be locked by the caller.
+*/
+POA_OpenHRP::BodyInfo* ModelLoader_impl::findValidBodyInfo(const std::string& url, const std::string& key)
 {
-    string url(url0);
+    CacheKeyToBodyInfoMap::iterator p = cacheKeyToBodyInfoMap.find(key);
+    if(p == cacheKeyToBodyInfoMap.end()){
+        return 0;
+    }
 
-    BodyInfo_ptr bodyInfo = 0;
     string filename(deleteURLScheme(url));
     struct stat statbuff;
     time_t mtime = 0;
@@ -220,22 +240,81 @@ BodyInfo_ptr ModelLoader_impl::getBodyInfoEx(const char* url0, const OpenHRP::Mo
         mtime = statbuff.st_mtime;
     }
 
-    UrlToBodyInfoMap::iterator p = urlToBodyInfoMap.find(url);
-    if(p != urlToBodyInfoMap.end() && mtime == getLastUpdateTime(p->second) && checkInlineFileUpdateTime(p->second)){
-        bodyInfo = p->second->_this();
-        cout << string("cache found for ") + url << endl;
-        if(option.AABBdata.length()){
-            setParam(p->second,"AABBType", (int)option.AABBtype);
-            int length=option.AABBdata.length();
-            unsigned int* _AABBdata = new unsigned int[length];
-            for(int i=0; i<length; i++)
-                _AABBdata[i] = option.AABBdata[i];
-            changetoBoundingBox(p->second,_AABBdata);
-            delete[] _AABBdata;
+    if(mtime == getLastUpdateTime(p->second) && checkInlineFileUpdateTime(p->second)){
+        return p->second;
+    }
+    return 0;
+}
+
+/**
+   Loads the model file of url. When another thread is already loading the same url with the same options,
+   this function waits for it and shares its result instead of parsing the file again.
+   @param useCache If true, an up-to-date BodyInfo which has been loaded before is returned without loading the file.
+*/
+POA_OpenHRP::BodyInfo* ModelLoader_impl::getOrLoadBodyInfo
+(const std::string& url, const OpenHRP::ModelLoader::ModelLoadOption& option, bool useCache)
+{
+    string key(makeCacheKey(url, option));
+    {
+        omni_mutex_lock lock(bodyInfoMutex);
+        bool loadedByOtherThread = false;
+        while(loadingKeys.find(key) != loadingKeys.end()){
+            loadFinishedCondition.wait();
+            loadedByOtherThread = true;
+        }
+        if(useCache || loadedByOtherThread){
+            POA_OpenHRP::BodyInfo* bodyInfo = findValidBodyInfo(url, key);
+            if(bodyInfo){
+                cout << string("cache found for ") + url << endl;
+                return bodyInfo;
+            }
         }
-        return bodyInfo;
-    } 
-    return loadBodyInfoEx(url0, option);
+        loadingKeys.insert(key);
+    }
+
+    POA_OpenHRP::BodyInfo* bodyInfo;
+    try {
+        bodyInfo = loadBodyInfoFromModelFile(url, option);
+        applyModelLoadOption(bodyInfo, option);
+    }
+    catch(...){
+        omni_mutex_lock lock(bodyInfoMutex);
+        loadingKeys.erase(key);
+        loadFinishedCondition.broadcast();
+        throw;
+    }
+
+    omni_mutex_lock lock(bodyInfoMutex);
+    cacheKeyToBodyInfoMap[key] = bodyInfo;
+    loadingKeys.erase(key);
+    loadFinishedCondition.broadcast();
+
+    return bodyInfo;
+}
+
+BodyInfo_ptr ModelLoader_impl::loadBodyInfo(const char* url)
+    throw (CORBA::SystemException, OpenHRP::ModelLoader::ModelLoaderException)
+{
+    OpenHRP::ModelLoader::ModelLoadOption option;
+    option.readImage = false;
+    option.AABBdata.length(0);
+    option.AABBtype = OpenHRP::ModelLoader::AABB_NUM;
+    option.AABBtreeLayout = OpenHRP::ModelLoader::AABB_TREE_NORMAL;
+    return loadBodyInfoEx(url, option);
+}
+
+BodyInfo_ptr ModelLoader_impl::loadBodyInfoEx(const char* url, const OpenHRP::ModelLoader::ModelLoadOption& option)
+    throw (CORBA::SystemException, OpenHRP::ModelLoader::ModelLoaderException)
+{
+    POA_OpenHRP::BodyInfo* bodyInfo = getOrLoadBodyInfo(url, option, false);
+    return bodyInfo->_this();
+}
+
+BodyInfo_ptr ModelLoader_impl::getBodyInfoEx(const char* url, const OpenHRP::ModelLoader::ModelLoadOption& option)
+    throw (CORBA::SystemException, OpenHRP::ModelLoader::ModelLoaderException)
+{
+    POA_OpenHRP::BodyInfo* bodyInfo = getOrLoadBodyInfo(url, option, true);
+    return bodyInfo->_this();
 }
 
 BodyInfo_ptr ModelLoader_impl::getBodyInfo(const char* url)
@@ -245,9 +324,117 @@ BodyInfo_ptr ModelLoader_impl::getBodyInfo(const char* url)
     option.readImage = false;
     option.AABBdata.length(0);
     option.AABBtype = OpenHRP::ModelLoader::AABB_NUM;
+    option.AABBtreeLayout = OpenHRP::ModelLoader::AABB_TREE_NORMAL;
     return getBodyInfoEx(url, option);
 }
 
+
+namespace {
+
+    int getNumProcessors()
+    {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwNumberOfProcessors;
+#else
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        return n > 0 ? n : 1;
+#endif
+    }
+
+    struct BatchLoadState
+    {
+        ModelLoader_impl* modelLoader;
+        const StringSequence* urls;
+        BodyInfoSequence* bodyInfos;
+        omni_mutex mutex;
+        CORBA::ULong nextIndex;
+        bool failed;
+        string errorMessage;
+    };
+
+    /**
+       A worker of loadBodyInfos(). Each thread takes the next url which has not been loaded yet.
+    */
+    class BodyInfoLoadThread : public omni_thread
+    {
+    public:
+        BodyInfoLoadThread(BatchLoadState* state) : state(state) {
+            start_undetached();
+        }
+
+    private:
+        BatchLoadState* state;
+
+        virtual void* run_undetached(void* arg) {
+            while(true){
+                CORBA::ULong index;
+                {
+                    omni_mutex_lock lock(state->mutex);
+                    if(state->failed || state->nextIndex >= state->urls->length()){
+                        break;
+                    }
+                    index = state->nextIndex++;
+                }
+                const char* url = (*state->urls)[index];
+                try {
+                    BodyInfo_var bodyInfo = state->modelLoader->loadBodyInfo(url);
+                    (*state->bodyInfos)[index] = bodyInfo._retn();
+                }
+                catch(OpenHRP::ModelLoader::ModelLoaderException& ex){
+                    setError(string(url) + ": " + string(ex.description));
+                }
+                catch(CORBA::SystemException& ex){
+                    setError(string(url) + ": " + ex._name());
+                }
+            }
+            return 0;
+        }
+
+        void setError(const string& message) {
+            omni_mutex_lock lock(state->mutex);
+            if(!state->failed){
+                state->failed = true;
+                state->errorMessage = message;
+            }
+        }
+    };
+}
+
+
+BodyInfoSequence* ModelLoader_impl::loadBodyInfos(const StringSequence& urls)
+    throw (CORBA::SystemException, OpenHRP::ModelLoader::ModelLoaderException)
+{
+    BodyInfoSequence_var bodyInfos = new BodyInfoSequence;
+    bodyInfos->length(urls.length());
+
+    BatchLoadState state;
+    state.modelLoader = this;
+    state.urls = &urls;
+    state.bodyInfos = &bodyInfos.inout();
+    state.nextIndex = 0;
+    state.failed = false;
+
+    int numThreads = getNumProcessors();
+    if(numThreads > (int)urls.length()){
+        numThreads = urls.length();
+    }
+    std::vector<BodyInfoLoadThread*> threads;
+    for(int i=0; i < numThreads; ++i){
+        threads.push_back(new BodyInfoLoadThread(&state));
+    }
+    for(size_t i=0; i < threads.size(); ++i){
+        threads[i]->join(0);
+    }
+
+    if(state.failed){
+        throw ModelLoader::ModelLoaderException(state.errorMessage.c_str());
+    }
+
+    return bodyInfos._retn();
+}
+
 POA_OpenHRP::BodyInfo* ModelLoader_impl::loadBodyInfoFromModelFile(const string url, const OpenHRP::ModelLoader::ModelLoadOption option)
 {
     cout << "loading " << url << endl;
@@ -255,6 +442,8 @@ POA_OpenHRP::BodyInfo* ModelLoader_impl::loadBodyInfoFromModelFile(const string
     try {
 #ifdef OPENHRP_COLLADA_FOUND
         if( IsColladaFile(url) ) {
+            // the COLLADA DOM is not thread-safe
+            omni_mutex_lock lock(colladaMutex);
             BodyInfoCollada_impl* p = new BodyInfoCollada_impl(poa);
             p->setParam("readImage", option.readImage);
             p->loadModelFile(url);
@@ -265,7 +454,12 @@ POA_OpenHRP::BodyInfo* ModelLoader_impl::loadBodyInfoFromModelFile(const string
         {
             BodyInfo_impl* p = new BodyInfo_impl(poa);
             p->setParam("readImage", option.readImage);
-            p->loadModelFile(url);
+            if(bodyInfoCache.load(url, p)){
+                cout << "model cache found for " << url << endl;
+            } else {
+                p->loadModelFile(url);
+                bodyInfoCache.save(url, p);
+            }
             bodyInfo = p;
         }
     }
@@ -286,7 +480,6 @@ POA_OpenHRP::BodyInfo* ModelLoader_impl::loadBodyInfoFromModelFile(const string
 #endif
 
     //poa->activate_object(bodyInfo);
-    urlToBodyInfoMap[url] = bodyInfo;
 
     string filename(deleteURLScheme(url));
     struct stat statbuff;
@@ -312,6 +505,7 @@ SceneInfo_ptr ModelLoader_impl::loadSceneInfo(const char* url)
     try {
 #ifdef OPENHRP_COLLADA_FOUND
         if( IsColladaFile(url) ) {
+            omni_mutex_lock lock(colladaMutex);
             SceneInfoCollada_impl* p = new SceneInfoCollada_impl(poa);
 	    p->load(url);
 	    sceneInfo = p;
@@ -340,14 +534,16 @@ SceneInfo_ptr ModelLoader_impl::loadSceneInfo(const char* url)
 
 void ModelLoader_impl::clearData()
 {
-    //UrlToBodyInfoMap::iterator p;
-    //for(p = urlToBodyInfoMap.begin(); p != urlToBodyInfoMap.end(); ++p){
+    omni_mutex_lock lock(bodyInfoMutex);
+
+    //CacheKeyToBodyInfoMap::iterator p;
+    //for(p = cacheKeyToBodyInfoMap.begin(); p != cacheKeyToBodyInfoMap.end(); ++p){
     //	BodyInfo_impl* bodyInfo = p->second;
     //	PortableServer::ObjectId_var objectId = poa->servant_to_id(bodyInfo);
     //	poa->deactivate_object(objectId);
     //	bodyInfo->_remove_ref();
     //}
-    urlToBodyInfoMap.clear();
+    cacheKeyToBodyInfoMap.clear();
 }
 
 
@@ -16,6 +16,7 @@
 #define OPENHRP_MODELLOADER_IMPL_H_INCLUDED
 
 #include <map>
+#include <set>
 #include <string>
 #include <hrpCorba/ORBwrap.h>
 #include <hrpCorba/ModelLoader.hh>
@@ -23,6 +24,7 @@
 #include "BodyInfo_impl.h"
 #include "BodyInfoCollada_impl.h"
 #include "SceneInfo_impl.h"
+#include "BodyInfoCache.h"
 
 using namespace OpenHRP;
 
@@ -32,10 +34,27 @@ class ModelLoader_impl : public POA_OpenHRP::ModelLoader
     CORBA::ORB_var orb;
     PortableServer::POA_var poa;
 		
-    typedef std::map<std::string, POA_OpenHRP::BodyInfo*> UrlToBodyInfoMap;
-    UrlToBodyInfoMap urlToBodyInfoMap;
+    // a BodyInfo is cached for each url and set of load options
+    typedef std::map<std::string, POA_OpenHRP::BodyInfo*> CacheKeyToBodyInfoMap;
+    CacheKeyToBodyInfoMap cacheKeyToBodyInfoMap;
+
+    // cache keys whose model files are being loaded by some thread
+    std::set<std::string> loadingKeys;
+
+    // protects cacheKeyToBodyInfoMap and loadingKeys
+    omni_mutex bodyInfoMutex;
+    omni_condition loadFinishedCondition;
+
+#ifdef OPENHRP_COLLADA_FOUND
+    omni_mutex colladaMutex;
+#endif
+
+    BodyInfoCache bodyInfoCache;
 
     POA_OpenHRP::BodyInfo* loadBodyInfoFromModelFile(const std::string url, const OpenHRP::ModelLoader::ModelLoadOption option );
+    POA_OpenHRP::BodyInfo* getOrLoadBodyInfo(const std::string& url, const OpenHRP::ModelLoader::ModelLoadOption& option, bool useCache);
+    POA_OpenHRP::BodyInfo* findValidBodyInfo(const std::string& url, const std::string& key);
+    void applyModelLoadOption(POA_OpenHRP::BodyInfo* bodyInfo, const OpenHRP::ModelLoader::ModelLoadOption& option);
 		
   public:
 		
@@ -56,6 +75,9 @@ class ModelLoader_impl : public POA_OpenHRP::ModelLoader
     virtual BodyInfo_ptr loadBodyInfoEx(const char* url, const OpenHRP::ModelLoader::ModelLoadOption& option)
         throw (CORBA::SystemException, OpenHRP::ModelLoader::ModelLoaderException);
 
+    virtual BodyInfoSequence* loadBodyInfos(const StringSequence& urls)
+        throw (CORBA::SystemException, OpenHRP::ModelLoader::ModelLoaderException);
+
     virtual SceneInfo_ptr loadSceneInfo(const char* url)
         throw (CORBA::SystemException, OpenHRP::ModelLoader::ModelLoaderException);
 		
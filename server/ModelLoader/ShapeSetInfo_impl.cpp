@@ -15,28 +15,124 @@
 #include "ShapeSetInfo_impl.h"
 
 #include <map>
+#include <set>
 #include <vector>
+#include <cmath>
 #include <iostream>
 #include <boost/bind.hpp>
 #include <sys/stat.h>
 
 #include <hrpCorba/ViewSimulator.hh>
 #include <hrpUtil/VrmlNodes.h>
-#include <hrpUtil/ImageConverter.h>
 
 #include "VrmlUtil.h"
+#include "TextureImageCache.h"
 
 
 
 using namespace std;
 using namespace boost;
 
+
+namespace {
+
+    struct IndexTriple
+    {
+        int i[3];
+        bool operator<(const IndexTriple& rhs) const {
+            if(i[0] != rhs.i[0]) return i[0] < rhs.i[0];
+            if(i[1] != rhs.i[1]) return i[1] < rhs.i[1];
+            return i[2] < rhs.i[2];
+        }
+    };
+
+    /**
+       Vertex clustering. The vertices in each cubic cell of the given size are
+       merged into their centroid, and the triangles which have become degenerate
+       or duplicated are removed.
+    */
+    void decimateMesh(FloatSequence& vertices, LongSequence& triangles, double cellSize)
+    {
+        const int numVertices = vertices.length() / 3;
+        if(numVertices == 0){
+            return;
+        }
+
+        float minv[3] = { vertices[0], vertices[1], vertices[2] };
+        for(int j=1; j < numVertices; ++j){
+            for(int k=0; k < 3; ++k){
+                if(vertices[j*3+k] < minv[k]) minv[k] = vertices[j*3+k];
+            }
+        }
+
+        typedef map<IndexTriple, int> CellMap;
+        CellMap cells;
+        vector<int> newIndices(numVertices);
+        vector<double> sums;
+        vector<int> counts;
+
+        for(int j=0; j < numVertices; ++j){
+            IndexTriple cell;
+            for(int k=0; k < 3; ++k){
+                cell.i[k] = (int)floor((vertices[j*3+k] - minv[k]) / cellSize);
+            }
+            pair<CellMap::iterator, bool> inserted = cells.insert(make_pair(cell, (int)counts.size()));
+            int index = inserted.first->second;
+            if(inserted.second){
+                sums.resize(sums.size() + 3, 0.0);
+                counts.push_back(0);
+            }
+            for(int k=0; k < 3; ++k){
+                sums[index*3+k] += vertices[j*3+k];
+            }
+            counts[index]++;
+            newIndices[j] = index;
+        }
+
+        const int numNewVertices = counts.size();
+        vertices.length(numNewVertices * 3);
+        for(int j=0; j < numNewVertices; ++j){
+            for(int k=0; k < 3; ++k){
+                vertices[j*3+k] = sums[j*3+k] / counts[j];
+            }
+        }
+
+        const int numTriangles = triangles.length() / 3;
+        set<IndexTriple> existingTriangles;
+        int n = 0;
+        for(int j=0; j < numTriangles; ++j){
+            int v0 = newIndices[triangles[j*3]];
+            int v1 = newIndices[triangles[j*3+1]];
+            int v2 = newIndices[triangles[j*3+2]];
+            if(v0 == v1 || v1 == v2 || v2 == v0){
+                continue;
+            }
+            // the same face with the reversed orientation is kept
+            IndexTriple key;
+            int m = (v0 < v1) ? ((v0 < v2) ? 0 : 2) : ((v1 < v2) ? 1 : 2);
+            int v[3] = { v0, v1, v2 };
+            for(int k=0; k < 3; ++k){
+                key.i[k] = v[(m + k) % 3];
+            }
+            if(!existingTriangles.insert(key).second){
+                continue;
+            }
+            triangles[n++] = v0;
+            triangles[n++] = v1;
+            triangles[n++] = v2;
+        }
+        triangles.length(n);
+    }
+}
+
     
 
 ShapeSetInfo_impl::ShapeSetInfo_impl(PortableServer::POA_ptr poa) :
-    poa(PortableServer::POA::_duplicate(poa))
+    poa(PortableServer::POA::_duplicate(poa)),
+    inlineCount(0)
 {
     triangleMeshShaper.setNormalGenerationMode(true);
+    triangleMeshShaper.setParallelConversionMode(true);
     triangleMeshShaper.sigMessage.connect(boost::bind(&putMessage, _1));
 }
 
@@ -108,6 +204,29 @@ TextureInfoSequence* ShapeSetInfo_impl::textures()
 }
 
 
+/*!
+  @if jp
+  textureIndex 番目の TextureInfo を画像データ付きで返す。
+  readImage が偽でロードされたモデルでは、画像はこの時点でデコードされる。
+  @endif
+*/
+TextureInfo* ShapeSetInfo_impl::textureImage(CORBA::Long textureIndex)
+{
+    if(textureIndex < 0 || textureIndex >= (CORBA::Long)textures_.length()){
+        throw CORBA::BAD_PARAM();
+    }
+
+    TextureInfo_var texture(new TextureInfo(textures_[textureIndex]));
+
+    string url(texture->url);
+    if(texture->image.length() == 0 && !url.empty()){
+        TextureImageCache::setImage(texture.inout(), *TextureImageCache::instance().image(url));
+    }
+
+    return texture._retn();
+}
+
+
 /*!
   @if jp
   Shape ノード探索のための再帰関数
@@ -123,7 +242,6 @@ TextureInfoSequence* ShapeSetInfo_impl::textures()
 void ShapeSetInfo_impl::traverseShapeNodes
 (VrmlNode* node, const Matrix44& T, TransformedShapeIndexSequence& io_shapeIndices, DblArray12Sequence& inlinedShapeM, const SFString* url)
 {
-    static int inline_count=0;   
     SFString url_ = *url;
     if(node->isCategoryOf(PROTO_INSTANCE_NODE)){
         VrmlProtoInstance* protoInstance = static_cast<VrmlProtoInstance*>(node);
@@ -139,7 +257,7 @@ void ShapeSetInfo_impl::traverseShapeNodes
         inlineNode = dynamic_cast<VrmlInline*>(groupNode);
         const Matrix44* pT;
         if(inlineNode){
-            if(!inline_count){
+            if(!inlineCount){
                 int inlinedShapeMIndex = inlinedShapeM.length();
                 inlinedShapeM.length(inlinedShapeMIndex+1);
                 int p = 0;
@@ -150,7 +268,7 @@ void ShapeSetInfo_impl::traverseShapeNodes
                 }  
                 url_ = inlineNode->urls[0];
             }
-            inline_count++;
+            inlineCount++;
             for( MFString::iterator ite = inlineNode->urls.begin(); ite != inlineNode->urls.end(); ++ite ){
                 string filename(deleteURLScheme(*ite));
                 struct stat statbuff;
@@ -182,7 +300,7 @@ void ShapeSetInfo_impl::traverseShapeNodes
             }
         }
         if(inlineNode)
-            inline_count--;
+            inlineCount--;
 
         
     } else if(node->isCategoryOf(SHAPE_NODE)) {
@@ -208,7 +326,7 @@ void ShapeSetInfo_impl::traverseShapeNodes
                     tsi.transformMatrix[p++] = T(row, col);
                 }
             }
-            if(inline_count)
+            if(inlineCount)
                 tsi.inlinedShapeTransformMatrixIndex=inlinedShapeM.length()-1;
             else
                 tsi.inlinedShapeTransformMatrixIndex=-1;
@@ -544,6 +662,7 @@ int ShapeSetInfo_impl::createMaterialInfo(VrmlMaterialPtr& materialNode)
   @if jp
   textureノードが存在すれば，TextureInfoを生成，textures_ に追加する。
   なお，ImageTextureノードの場合は，画像のurlと、readImageフラグが真ならimageデータと両方を持つ。
+  同じ画像ファイルを参照するImageTextureノードは，一つのTextureInfoを共有する。
 　いまのところ、movieTextureノードには対応しいない。
 
   @return long TextureInfo(textures_)のインデックス，textureノードが存在しない場合は -1
@@ -556,6 +675,7 @@ int ShapeSetInfo_impl::createTextureInfo(VrmlTexturePtr& textureNode, const SFSt
     if(textureNode){
 
         TextureInfo_var texture(new TextureInfo());
+        string textureKey;
        
         VrmlPixelTexturePtr pixelTextureNode = dynamic_pointer_cast<VrmlPixelTexture>(textureNode);
         
@@ -563,20 +683,20 @@ int ShapeSetInfo_impl::createTextureInfo(VrmlTexturePtr& textureNode, const SFSt
             VrmlImageTexturePtr imageTextureNode = dynamic_pointer_cast<VrmlImageTexture>(textureNode);
             if(imageTextureNode){
                 string url = setTexturefileUrl(getModelFileDirPath(*currentUrl), imageTextureNode->url);
+
+                textureKey = url;
+                textureKey += imageTextureNode->repeatS ? "\n1" : "\n0";
+                textureKey += imageTextureNode->repeatT ? "1" : "0";
+                TextureKeyToTextureInfoIndexMap::iterator p = textureInfoIndexMap.find(textureKey);
+                if(p != textureInfoIndexMap.end()){
+                    return p->second;
+                }
+
                 texture->url = CORBA::string_dup(url.c_str());
                 texture->repeatS = imageTextureNode->repeatS;
                 texture->repeatT = imageTextureNode->repeatT;
                 if(readImage && !url.empty()){
-                    ImageConverter  converter;
-                    SFImage* image = converter.convert(url);          
-                    texture->height = image->height;
-                    texture->width = image->width;
-                    texture->numComponents = image->numComponents;
-                    unsigned long pixelsLength = image->pixels.size();
-                    texture->image.length( pixelsLength );
-                    for(unsigned long j = 0 ; j < pixelsLength ; j++ ){
-                        texture->image[j] = image->pixels[j];
-                    }
+                    TextureImageCache::setImage(texture.inout(), *TextureImageCache::instance().image(url));
                 }else{
                     texture->height = 0;
                     texture->width = 0;
@@ -584,15 +704,7 @@ int ShapeSetInfo_impl::createTextureInfo(VrmlTexturePtr& textureNode, const SFSt
                 }
             }
         }else if(pixelTextureNode){
-            texture->height = pixelTextureNode->image.height;
-            texture->width = pixelTextureNode->image.width;
-            texture->numComponents = pixelTextureNode->image.numComponents;
-		
-            size_t pixelsLength =  pixelTextureNode->image.pixels.size();
-            texture->image.length( pixelsLength );
-            for(size_t j = 0 ; j < pixelsLength ; j++ ){
-                texture->image[j] = pixelTextureNode->image.pixels[j];
-            }
+            TextureImageCache::setImage(texture.inout(), pixelTextureNode->image);
             texture->repeatS = pixelTextureNode->repeatS;
             texture->repeatT = pixelTextureNode->repeatT;
         }
@@ -600,6 +712,10 @@ int ShapeSetInfo_impl::createTextureInfo(VrmlTexturePtr& textureNode, const SFSt
         textureInfoIndex = textures_.length();
         textures_.length(textureInfoIndex + 1);
         textures_[textureInfoIndex] = texture;
+
+        if(!textureKey.empty()){
+            textureInfoIndexMap.insert(make_pair(textureKey, textureInfoIndex));
+        }
     }
 
     return textureInfoIndex;
@@ -672,6 +788,106 @@ void ShapeSetInfo_impl::setColdetModelTriangles
 
 }
 
+/*!
+  @if jp
+  @brief リンクの形状とセンサの形状を合わせた衝突検出用の形状を out_geometry に設定する。
+  @param decimationTolerance 0 より大きい場合、この大きさの格子で頂点を間引く。
+  @endif
+*/
+void ShapeSetInfo_impl::setLinkCollisionGeometry
+(LinkCollisionGeometry& out_geometry, const LinkInfo& linkInfo, double decimationTolerance)
+{
+    out_geometry.linkName = linkInfo.name;
+
+    // shapes of the link and of its sensors with the index of the sensor (-1 for the link)
+    std::vector<const TransformedShapeIndex*> tsis;
+    std::vector<int> sensorIndices;
+
+    const TransformedShapeIndexSequence& shapeIndices = linkInfo.shapeIndices;
+    for(CORBA::ULong i=0; i < shapeIndices.length(); ++i){
+        tsis.push_back(&shapeIndices[i]);
+        sensorIndices.push_back(-1);
+    }
+    const SensorInfoSequence& sensors = linkInfo.sensors;
+    for(CORBA::ULong i=0; i < sensors.length(); ++i){
+        for(CORBA::ULong j=0; j < sensors[i].shapeIndices.length(); ++j){
+            tsis.push_back(&sensors[i].shapeIndices[j]);
+            sensorIndices.push_back(i);
+        }
+    }
+
+    int totalNumVertices = 0;
+    int totalNumTriangles = 0;
+    for(size_t i=0; i < tsis.size(); ++i){
+        const ShapeInfo& shapeInfo = shapes_[tsis[i]->shapeIndex];
+        totalNumVertices += shapeInfo.vertices.length() / 3;
+        totalNumTriangles += shapeInfo.triangles.length() / 3;
+    }
+
+    FloatSequence& vertices = out_geometry.vertices;
+    LongSequence& triangles = out_geometry.triangles;
+    vertices.length(totalNumVertices * 3);
+    triangles.length(totalNumTriangles * 3);
+
+    out_geometry.primitiveType = SP_MESH;
+    out_geometry.primitiveParameters.length(0);
+    for(int i=0; i < 12; ++i){
+        out_geometry.primitiveTransformMatrix[i] = (i % 5 == 0) ? 1.0 : 0.0;
+    }
+
+    int vertexIndex = 0;
+    int triangleIndex = 0;
+    for(size_t i=0; i < tsis.size(); ++i){
+        const DblArray12& M = tsis[i]->transformMatrix;
+        Matrix44 Tlocal;
+        Tlocal << M[0], M[1], M[2],  M[3],
+                  M[4], M[5], M[6],  M[7],
+                  M[8], M[9], M[10], M[11],
+                  0.0,  0.0,  0.0,   1.0;
+        Matrix44 Tparent(Matrix44::Identity());
+        if(sensorIndices[i] >= 0){
+            const SensorInfo& sensor = sensors[sensorIndices[i]];
+            calcRodrigues(Tparent, Vector3(sensor.rotation[0], sensor.rotation[1],
+                                           sensor.rotation[2]), sensor.rotation[3]);
+            Tparent(0,3) = sensor.translation[0];
+            Tparent(1,3) = sensor.translation[1];
+            Tparent(2,3) = sensor.translation[2];
+        }
+        Matrix44 T(Tparent * Tlocal);
+
+        const ShapeInfo& shapeInfo = shapes_[tsis[i]->shapeIndex];
+        const FloatSequence& shapeVertices = shapeInfo.vertices;
+        const int numVertices = shapeVertices.length() / 3;
+        const int vertexIndexBase = vertexIndex;
+        for(int j=0; j < numVertices; ++j){
+            Vector4 v(T * Vector4(shapeVertices[j*3], shapeVertices[j*3+1], shapeVertices[j*3+2], 1.0));
+            vertices[vertexIndex*3]   = v[0];
+            vertices[vertexIndex*3+1] = v[1];
+            vertices[vertexIndex*3+2] = v[2];
+            ++vertexIndex;
+        }
+        const LongSequence& shapeTriangles = shapeInfo.triangles;
+        const int numTriangles = shapeTriangles.length();
+        for(int j=0; j < numTriangles; ++j){
+            triangles[triangleIndex++] = shapeTriangles[j] + vertexIndexBase;
+        }
+
+        if(tsis.size() == 1){
+            out_geometry.primitiveType = shapeInfo.primitiveType;
+            out_geometry.primitiveParameters = shapeInfo.primitiveParameters;
+            for(int row=0, p=0; row < 3; ++row){
+                for(int col=0; col < 4; ++col){
+                    out_geometry.primitiveTransformMatrix[p++] = T(row, col);
+                }
+            }
+        }
+    }
+
+    if(decimationTolerance > 0.0){
+        decimateMesh(vertices, triangles, decimationTolerance);
+    }
+}
+
 void ShapeSetInfo_impl::saveOriginalData(){
     originShapes_ = shapes_;
     originAppearances_ = appearances_;
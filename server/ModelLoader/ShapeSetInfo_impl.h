@@ -40,6 +40,7 @@ public:
     virtual AppearanceInfoSequence* appearances();
     virtual MaterialInfoSequence* materials();
     virtual TextureInfoSequence* textures();
+    virtual TextureInfo* textureImage(CORBA::Long textureIndex);
 
 protected:
 
@@ -49,6 +50,7 @@ protected:
     void traverseShapeNodes(VrmlNode* node, const Matrix44& T, TransformedShapeIndexSequence& io_shapeIndices, DblArray12Sequence& inlinedShapeM, const SFString* url = NULL);
     virtual const std::string& topUrl() = 0;
     void setColdetModel(ColdetModelPtr& coldetModel, TransformedShapeIndexSequence shapeIndices, const Matrix44& Tparent, int& vertexIndex, int& triangleIndex);
+    void setLinkCollisionGeometry(LinkCollisionGeometry& out_geometry, const LinkInfo& linkInfo, double decimationTolerance);
     void saveOriginalData();
     void restoreOriginalData();
     void createAppearanceInfo();
@@ -74,8 +76,15 @@ private:
     typedef std::map<VrmlShapePtr, int> ShapeNodeToShapeInfoIndexMap;
     ShapeNodeToShapeInfoIndexMap shapeInfoIndexMap;
 
+    // ImageTexture nodes which refer to the same file share one TextureInfo
+    typedef std::map<std::string, int> TextureKeyToTextureInfoIndexMap;
+    TextureKeyToTextureInfoIndexMap textureInfoIndexMap;
+
     std::map<std::string, time_t> fileTimeMap;
 
+    // nesting level of Inline nodes in traverseShapeNodes()
+    int inlineCount;
+
     int createShapeInfo(VrmlShape* shapeNode, const SFString* url);
     void setTriangleMesh(ShapeInfo& shapeInfo, VrmlIndexedFaceSet* triangleMesh);
     void setPrimitiveProperties(ShapeInfo& shapeInfo, VrmlShape* shapeNode);
@@ -91,6 +100,7 @@ private:
 
     friend class BodyInfo_impl;
     friend class SceneInfo_impl;
+    friend class BodyInfoCache;
 #ifdef OPENHRP_COLLADA_FOUND
     friend class ColladaReader;
     friend class BodyInfoCollada_impl;
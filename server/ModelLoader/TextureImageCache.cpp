@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2008, AIST, the University of Tokyo and General Robotix Inc.
+ * All rights reserved. This program is made available under the terms of the
+ * Eclipse Public License v1.0 which accompanies this distribution, and is
+ * available at http://www.eclipse.org/legal/epl-v10.html
+ * Contributors:
+ * National Institute of Advanced Industrial Science and Technology (AIST)
+ */
+
+/*!
+  @file TextureImageCache.cpp
+*/
+
+#include "TextureImageCache.h"
+
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <hrpUtil/ImageConverter.h>
+
+using namespace std;
+using namespace hrp;
+
+
+namespace {
+    const size_t DEFAULT_CAPACITY = 256 * 1024 * 1024;
+}
+
+
+TextureImageCache& TextureImageCache::instance()
+{
+    static TextureImageCache cache;
+    return cache;
+}
+
+
+TextureImageCache::TextureImageCache()
+    : capacity(DEFAULT_CAPACITY),
+      cachedBytes(0)
+{
+
+}
+
+
+/**
+   @if jp
+   キャッシュする画素データの合計サイズの上限を設定する。
+   上限を超えた分は最も長く使われていない画像から破棄される。
+   @endif
+*/
+void TextureImageCache::setCapacity(size_t bytes)
+{
+    omni_mutex_lock lock(mutex);
+    capacity = bytes;
+    removeLeastRecentlyUsedEntries();
+}
+
+
+size_t TextureImageCache::totalBytes()
+{
+    omni_mutex_lock lock(mutex);
+    return cachedBytes;
+}
+
+
+/**
+   @if jp
+   url の画像ファイルをデコードした結果を返す。
+   ファイルが前回のデコード以降に更新されていなければ、キャッシュされた画像を返す。
+   @endif
+*/
+boost::shared_ptr<const SFImage> TextureImageCache::image(const std::string& url)
+{
+    time_t modificationTime = 0;
+    struct stat statbuff;
+    if( stat( url.c_str(), &statbuff ) == 0 ){
+        modificationTime = statbuff.st_mtime;
+    }
+
+    {
+        omni_mutex_lock lock(mutex);
+        UrlToEntryMap::iterator p = entries.find(url);
+        if(p != entries.end() && p->second.modificationTime == modificationTime){
+            lruUrls.splice(lruUrls.begin(), lruUrls, p->second.lruPosition);
+            return p->second.image;
+        }
+    }
+
+    // the decoding is done without the lock so that other models can be loaded concurrently
+    ImageConverter converter;
+    boost::shared_ptr<SFImage> decoded(new SFImage(*converter.convert(url)));
+
+    omni_mutex_lock lock(mutex);
+    UrlToEntryMap::iterator p = entries.find(url);
+    if(p != entries.end()){
+        cachedBytes -= p->second.bytes;
+        lruUrls.erase(p->second.lruPosition);
+        entries.erase(p);
+    }
+    lruUrls.push_front(url);
+    Entry& entry = entries[url];
+    entry.modificationTime = modificationTime;
+    entry.image = decoded;
+    entry.bytes = decoded->pixels.size();
+    entry.lruPosition = lruUrls.begin();
+    cachedBytes += entry.bytes;
+
+    removeLeastRecentlyUsedEntries();
+
+    return decoded;
+}
+
+
+/**
+   @if jp
+   合計サイズが上限以下になるまで、最も長く使われていない画像を破棄する。
+   mutex をロックした状態で呼ぶこと。
+   @endif
+*/
+void TextureImageCache::removeLeastRecentlyUsedEntries()
+{
+    while(cachedBytes > capacity && !lruUrls.empty()){
+        UrlToEntryMap::iterator p = entries.find(lruUrls.back());
+        cachedBytes -= p->second.bytes;
+        entries.erase(p);
+        lruUrls.pop_back();
+    }
+}
+
+
+/**
+   @if jp
+   画像の大きさと画素データを TextureInfo に設定する。
+   @endif
+*/
+void TextureImageCache::setImage(OpenHRP::TextureInfo& out_texture, const SFImage& image)
+{
+    out_texture.height = image.height;
+    out_texture.width = image.width;
+    out_texture.numComponents = image.numComponents;
+
+    CORBA::ULong pixelsLength = image.pixels.size();
+    out_texture.image.length(pixelsLength);
+    if(pixelsLength > 0){
+        memcpy(out_texture.image.get_buffer(), &image.pixels[0], pixelsLength);
+    }
+}
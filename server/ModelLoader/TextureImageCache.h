@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2008, AIST, the University of Tokyo and General Robotix Inc.
+ * All rights reserved. This program is made available under the terms of the
+ * Eclipse Public License v1.0 which accompanies this distribution, and is
+ * available at http://www.eclipse.org/legal/epl-v10.html
+ * Contributors:
+ * National Institute of Advanced Industrial Science and Technology (AIST)
+ */
+
+/*!
+  @file TextureImageCache.h
+*/
+
+#ifndef OPENHRP_MODEL_LOADER_TEXTURE_IMAGE_CACHE_H_INCLUDED
+#define OPENHRP_MODEL_LOADER_TEXTURE_IMAGE_CACHE_H_INCLUDED
+
+#include <map>
+#include <list>
+#include <string>
+#include <ctime>
+#include <boost/shared_ptr.hpp>
+#include <hrpCorba/ORBwrap.h>
+#include <hrpCorba/ModelLoader.hh>
+#include <hrpUtil/VrmlNodes.h>
+
+/**
+   @if jp
+   デコード済みのテクスチャ画像をプロセス内で共有するためのキャッシュ。
+   @else
+   Process-wide cache of decoded texture images.
+
+   An entry is keyed by the path of the image file and is reused while the
+   modification time of the file is unchanged. The cache is shared by all
+   the models loaded by the server, so a texture file used by many shapes
+   or many models is decoded only once.
+
+   The total size of the cached pixels is bounded by the capacity and the
+   least recently used images are dropped when it is exceeded. An image
+   still referenced by a caller is not freed until the caller releases it.
+   @endif
+*/
+class TextureImageCache
+{
+  public:
+
+    static TextureImageCache& instance();
+
+    boost::shared_ptr<const hrp::SFImage> image(const std::string& url);
+
+    void setCapacity(size_t bytes);
+
+    size_t totalBytes();
+
+    static void setImage(OpenHRP::TextureInfo& out_texture, const hrp::SFImage& image);
+
+  private:
+
+    TextureImageCache();
+
+    void removeLeastRecentlyUsedEntries();
+
+    struct Entry
+    {
+        time_t modificationTime;
+        boost::shared_ptr<const hrp::SFImage> image;
+        size_t bytes;
+        std::list<std::string>::iterator lruPosition;
+    };
+    typedef std::map<std::string, Entry> UrlToEntryMap;
+    UrlToEntryMap entries;
+
+    //! urls of the entries ordered from the most recently used one
+    std::list<std::string> lruUrls;
+    size_t capacity;
+    size_t cachedBytes;
+
+    omni_mutex mutex;
+};
+
+#endif
@@ -19,7 +19,15 @@ int main(int argc, char* argv[])
   
     try {
 
-	orb = CORBA::ORB_init(argc, argv);
+	// Serve requests by a thread pool so that the models requested by
+	// several clients (or by loadBodyInfos) are loaded concurrently.
+	// These defaults can be overridden by -ORB options.
+	const char* options[][2] = {
+	    { "threadPerConnectionPolicy", "0" },
+	    { "maxServerThreadPoolSize", "64" },
+	    { 0, 0 }
+	};
+	orb = CORBA::ORB_init(argc, argv, "omniORB4", options);
 	
 	CORBA::Object_var obj;
 	
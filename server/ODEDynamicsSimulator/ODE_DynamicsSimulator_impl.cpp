@@ -326,6 +326,19 @@ void ODE_DynamicsSimulator_impl::registerCollisionCheckPair
 }
 
 
+//! \todo implement this method
+void ODE_DynamicsSimulator_impl::setCollisionCheckPairContactReduction
+(
+    const char *charName1,
+    const char *linkName1,
+    const char *charName2,
+    const char *linkName2,
+    CORBA::Short maxNumContactPoints
+    )
+{
+}
+
+
 void ODE_DynamicsSimulator_impl::registerIntersectionCheckPair
 (
     const char *charName1,
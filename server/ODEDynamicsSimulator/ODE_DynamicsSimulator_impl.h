@@ -95,6 +95,14 @@ class ODE_DynamicsSimulator_impl : virtual public POA_OpenHRP::DynamicsSimulator
             const double culling_thresh,
             const double restitution);
 
+    virtual void setCollisionCheckPairContactReduction
+        (
+            const char* char1, 
+            const char* name1, 
+            const char* char2,
+            const char* name2,
+            CORBA::Short maxNumContactPoints);
+
     virtual void registerIntersectionCheckPair
         (
             const char* char1, 
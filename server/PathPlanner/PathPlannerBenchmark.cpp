@@ -0,0 +1,410 @@
+// -*- C++ -*-
+/*!
+ * @file  PathPlannerBenchmark.cpp
+ * @brief Benchmark of the path planner on fixed scenarios
+ *
+ * The sample models are loaded directly with BodyInfo_impl, so neither
+ * the naming service nor the model loader server is needed. Every
+ * combination of a scenario, an algorithm and a seed is planned with a
+ * new planner and the results are written to CSV files.
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <hrpModel/Config.h>
+#include <hrpPlanner/PathPlanner.h>
+#include <hrpPlanner/Mobility.h>
+#include <hrpPlanner/ParallelShortcutOptimizer.h>
+#include <hrpPlanner/Roadmap.h>
+#include <hrpPlanner/RRT.h>
+#include <hrpPlanner/TimeUtil.h>
+#include "BodyInfo_impl.h"
+
+using namespace PathEngine;
+
+namespace {
+
+    const char* ROBOT_NAME = "robot";
+    const char* ROBOT_MODEL = "sample.wrl";
+    // height of the waist of sample.wrl standing on the floor
+    const double ROBOT_HEIGHT = 0.7135;
+
+    struct Obstacle
+    {
+        const char* name;
+        const char* model;
+        double x, y, theta;
+    };
+
+    struct Scenario
+    {
+        const char* name;
+        const char* mobility;
+        double start[3];
+        double goal[3];
+        double bounds[4]; // min-x, max-x, min-y, max-y
+        const Obstacle* obstacles;
+        int numObstacles;
+    };
+
+    // the same setting as sample/project/PathPlanner.xml
+    const Obstacle boxObstacles[] = {
+        { "box", "box.wrl", 1.0, 0.0, 0.0 },
+    };
+
+    // two walls of boxes with openings at the opposite ends
+    const Obstacle slalomObstacles[] = {
+        { "box0", "box.wrl", 0.5, -1.6, 0.0 },
+        { "box1", "box.wrl", 0.5, -0.8, 0.0 },
+        { "box2", "box.wrl", 0.5,  0.0, 0.0 },
+        { "box3", "box.wrl", 0.5,  0.8, 0.0 },
+        { "box4", "box.wrl", 1.3, -0.8, 0.0 },
+        { "box5", "box.wrl", 1.3,  0.0, 0.0 },
+        { "box6", "box.wrl", 1.3,  0.8, 0.0 },
+        { "box7", "box.wrl", 1.3,  1.6, 0.0 },
+    };
+
+    const Scenario scenarios[] = {
+        { "box", "TurnGoTurn", { 0.0, 0.0, 0.0 }, { 1.5, 0.0, 0.0 }, { -2, 2, -2, 2 },
+          boxObstacles, sizeof(boxObstacles)/sizeof(Obstacle) },
+        { "slalom", "OmniWheel", { 0.0, 0.0, 0.0 }, { 1.8, 0.0, 0.0 }, { -2, 2, -2, 2 },
+          slalomObstacles, sizeof(slalomObstacles)/sizeof(Obstacle) },
+    };
+    const int numScenarios = sizeof(scenarios)/sizeof(Scenario);
+
+    const char* algorithms[] = { "RRT", "PRM" };
+    const int numAlgorithms = sizeof(algorithms)/sizeof(const char*);
+
+    const char* optimizers[] = { "Shortcut", "RandomShortcut", "ParallelShortcut" };
+    const int numOptimizers = sizeof(optimizers)/sizeof(const char*);
+
+    struct Result
+    {
+        Result() : success(false), time(0), countCollisionCheck(0), timeCollisionCheck(0),
+                   timeNearestNode(0), length(0), numWayPoints(0) {}
+
+        bool success;
+        double time;
+        unsigned int countCollisionCheck;
+        double timeCollisionCheck;
+        double timeNearestNode;
+        double length;
+        unsigned int numWayPoints;
+    };
+
+    /**
+       The results of a scenario, an algorithm and an optimizer over all the seeds
+    */
+    struct Summary
+    {
+        Summary() : numRuns(0), numSuccesses(0), time(0), countCollisionCheck(0),
+                    timeNearestNode(0), length(0) {}
+
+        void add(const Result& result) {
+            numRuns++;
+            time += result.time;
+            countCollisionCheck += result.countCollisionCheck;
+            timeNearestNode += result.timeNearestNode;
+            if (result.success) {
+                numSuccesses++;
+                length += result.length;
+            }
+        }
+
+        int numRuns, numSuccesses;
+        double time;
+        double countCollisionCheck;
+        double timeNearestNode;
+        double length;
+    };
+
+    class BodyInfoSet
+    {
+    public:
+        BodyInfoSet(PortableServer::POA_ptr poa, const std::string& modelDir)
+            : poa_(PortableServer::POA::_duplicate(poa)), modelDir_(modelDir) {}
+
+        /**
+           @return the body info loaded from a file in the model directory.
+           Each file is loaded only once.
+        */
+        OpenHRP::BodyInfo_ptr get(const std::string& model) {
+            std::map<std::string, OpenHRP::BodyInfo_var>::iterator it = bodyInfos_.find(model);
+            if (it != bodyInfos_.end()) return it->second.in();
+
+            BodyInfo_impl* bodyInfo = new BodyInfo_impl(poa_);
+            bodyInfo->loadModelFile(modelDir_ + "/" + model);
+            OpenHRP::BodyInfo_var ref = bodyInfo->_this();
+            bodyInfo->_remove_ref();
+            bodyInfos_[model] = ref;
+            return bodyInfos_[model].in();
+        }
+
+    private:
+        PortableServer::POA_var poa_;
+        std::string modelDir_;
+        std::map<std::string, OpenHRP::BodyInfo_var> bodyInfos_;
+    };
+
+    void setPosition(PathPlanner& planner, const char* name, double x, double y, double z, double theta)
+    {
+        double c = cos(theta), s = sin(theta);
+        OpenHRP::DblSequence pos;
+        pos.length(12);
+        pos[0] = x; pos[1] = y; pos[2] = z;
+        pos[3] = c; pos[4] = -s; pos[5] = 0;
+        pos[6] = s; pos[7] =  c; pos[8] = 0;
+        pos[9] = 0; pos[10] = 0; pos[11] = 1;
+        planner.setCharacterPosition(name, pos);
+    }
+
+    void setup(PathPlanner& planner, BodyInfoSet& bodyInfos, const Scenario& scenario,
+               const char* algorithm, int numThreads)
+    {
+        ConfigurationSpace* cspace = planner.getConfigurationSpace();
+        cspace->unboundedRotation(2, true);
+        cspace->bounds(0, scenario.bounds[0], scenario.bounds[1]);
+        cspace->bounds(1, scenario.bounds[2], scenario.bounds[3]);
+
+        planner.registerCharacter(ROBOT_NAME, bodyInfos.get(ROBOT_MODEL));
+        setPosition(planner, ROBOT_NAME, 0, 0, ROBOT_HEIGHT, 0);
+        for (int i=0; i<scenario.numObstacles; i++) {
+            const Obstacle& obstacle = scenario.obstacles[i];
+            planner.registerCharacter(obstacle.name, bodyInfos.get(obstacle.model));
+            setPosition(planner, obstacle.name, obstacle.x, obstacle.y, 0, obstacle.theta);
+            planner.registerIntersectionCheckPair(obstacle.name, "", ROBOT_NAME, "", 0);
+        }
+        planner.setRobotName(ROBOT_NAME);
+        planner.setAlgorithmName(algorithm);
+        planner.setMobilityName(scenario.mobility);
+
+        std::map<std::string, std::string> properties;
+        char buf[16];
+        sprintf(buf, "%d", numThreads);
+        properties["num-threads"] = buf;
+        planner.setProperties(properties);
+        // the optimizer does not read the properties of the planner
+        ParallelShortcutOptimizer::numThreads(numThreads);
+
+        Configuration start(cspace->size()), goal(cspace->size());
+        for (int i=0; i<3; i++) {
+            start.value(i) = scenario.start[i];
+            goal.value(i) = scenario.goal[i];
+        }
+        planner.setStartConfiguration(start);
+        planner.setGoalConfiguration(goal);
+    }
+
+    void seedRandom(unsigned int seed)
+    {
+        srand(seed);
+#ifndef WIN32
+        srandom(seed);
+#endif
+    }
+
+    double pathLength(PathPlanner& planner)
+    {
+        Mobility* mobility = planner.getMobility();
+        const std::vector<Configuration>& path = planner.getWayPoints();
+        double length = 0;
+        for (unsigned int i=1; i<path.size(); i++) {
+            length += mobility->distance(path[i-1], path[i]);
+        }
+        return length;
+    }
+
+    double timeNearestNode(PathPlanner& planner)
+    {
+        RRT* rrt = dynamic_cast<RRT*>(planner.getAlgorithm());
+        if (!rrt) return 0;
+        double time = 0;
+        if (rrt->getForwardTree()) time += rrt->getForwardTree()->timeFindNearestNode();
+        if (rrt->getBackwardTree()) time += rrt->getBackwardTree()->timeFindNearestNode();
+        return time;
+    }
+
+    void writeHeader(std::ostream& os)
+    {
+        os << "scenario,algorithm,optimizer,seed,success,time,collision_checks,"
+           << "collision_checks_per_sec,collision_check_time,nearest_node_time,"
+           << "path_length,waypoints" << std::endl;
+    }
+
+    void writeResult(std::ostream& os, const Scenario& scenario, const char* algorithm,
+                     const char* optimizer, unsigned int seed, const Result& result)
+    {
+        os << scenario.name << "," << algorithm << "," << optimizer << "," << seed << ","
+           << (result.success ? 1 : 0) << "," << result.time << ","
+           << result.countCollisionCheck << ","
+           << (result.time > 0 ? result.countCollisionCheck/result.time : 0) << ","
+           << result.timeCollisionCheck << "," << result.timeNearestNode << ","
+           << result.length << "," << result.numWayPoints << std::endl;
+    }
+
+    void writeSummaryHeader(std::ostream& os)
+    {
+        os << "scenario,algorithm,optimizer,runs,success_rate,mean_time,"
+           << "collision_checks_per_sec,mean_nearest_node_time,mean_path_length" << std::endl;
+    }
+
+    void writeSummary(std::ostream& os, const Scenario& scenario, const char* algorithm,
+                      const char* optimizer, const Summary& summary)
+    {
+        os << scenario.name << "," << algorithm << "," << optimizer << ","
+           << summary.numRuns << ","
+           << (summary.numRuns ? (double)summary.numSuccesses/summary.numRuns : 0) << ","
+           << (summary.numRuns ? summary.time/summary.numRuns : 0) << ","
+           << (summary.time > 0 ? summary.countCollisionCheck/summary.time : 0) << ","
+           << (summary.numRuns ? summary.timeNearestNode/summary.numRuns : 0) << ","
+           << (summary.numSuccesses ? summary.length/summary.numSuccesses : 0) << std::endl;
+    }
+
+    std::string usage(const char* program)
+    {
+        return std::string("Usage: ") + program
+            + " [-modelDir <dir>] [-output <file>] [-summary <file>] [-seeds <n>]"
+            + " [-threads <n>] [-scenario <name>] [-algorithm <name>]";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    CORBA::ORB_var orb = CORBA::ORB::_nil();
+    int status = 1;
+
+    try {
+        orb = CORBA::ORB_init(argc, argv);
+
+        std::string modelDir = OPENHRP_SHARE_DIR "/sample/model";
+        std::string outputFile = "planner-benchmark.csv";
+        std::string summaryFile = "planner-benchmark-summary.csv";
+        std::string scenarioName, algorithmName;
+        unsigned int numSeeds = 10;
+        int numThreads = 1;
+
+        for (int i=1; i<argc; i++) {
+            std::string arg(argv[i]);
+            if (i+1 >= argc) {
+                throw usage(argv[0]);
+            }
+            if (arg == "-modelDir") {
+                modelDir = argv[++i];
+            } else if (arg == "-output") {
+                outputFile = argv[++i];
+            } else if (arg == "-summary") {
+                summaryFile = argv[++i];
+            } else if (arg == "-seeds") {
+                numSeeds = atoi(argv[++i]);
+            } else if (arg == "-threads") {
+                numThreads = atoi(argv[++i]);
+            } else if (arg == "-scenario") {
+                scenarioName = argv[++i];
+            } else if (arg == "-algorithm") {
+                algorithmName = argv[++i];
+            } else {
+                throw usage(argv[0]);
+            }
+        }
+
+        CORBA::Object_var obj = orb->resolve_initial_references("RootPOA");
+        PortableServer::POA_var poa = PortableServer::POA::_narrow(obj);
+        if (CORBA::is_nil(poa)) {
+            throw std::string("error: failed to narrow root POA.");
+        }
+        PortableServer::POAManager_var poaManager = poa->the_POAManager();
+        poaManager->activate();
+
+        std::ofstream output(outputFile.c_str());
+        std::ofstream summaryOutput(summaryFile.c_str());
+        if (!output || !summaryOutput) {
+            throw std::string("error: failed to open the output files.");
+        }
+        writeHeader(output);
+        writeSummaryHeader(summaryOutput);
+
+        BodyInfoSet bodyInfos(poa, modelDir);
+        for (int i=0; i<numScenarios; i++) {
+            const Scenario& scenario = scenarios[i];
+            if (!scenarioName.empty() && scenarioName != scenario.name) continue;
+
+            for (int j=0; j<numAlgorithms; j++) {
+                const char* algorithm = algorithms[j];
+                if (!algorithmName.empty() && algorithmName != algorithm) continue;
+
+                Summary summary;
+                std::vector<Summary> optimizerSummaries(numOptimizers);
+                for (unsigned int seed=1; seed<=numSeeds; seed++) {
+                    PathPlanner planner(3);
+                    setup(planner, bodyInfos, scenario, algorithm, numThreads);
+
+                    Result result;
+                    seedRandom(seed);
+                    tick_t t = get_tick();
+                    result.success = planner.calcPath();
+                    result.time = tick2sec(get_tick() - t);
+                    result.countCollisionCheck = planner.countCollisionCheck();
+                    result.timeCollisionCheck = planner.timeCollisionCheck();
+                    result.timeNearestNode = timeNearestNode(planner);
+                    result.length = pathLength(planner);
+                    result.numWayPoints = planner.getWayPoints().size();
+                    writeResult(output, scenario, algorithm, "-", seed, result);
+                    summary.add(result);
+                    if (!result.success) continue;
+
+                    // every optimizer starts from the path found by the algorithm
+                    std::vector<Configuration> path = planner.getWayPoints();
+                    for (int k=0; k<numOptimizers; k++) {
+                        planner.getWayPoints() = path;
+                        unsigned int count = planner.countCollisionCheck();
+                        double time = planner.timeCollisionCheck();
+
+                        Result optimized;
+                        seedRandom(seed);
+                        t = get_tick();
+                        planner.optimize(optimizers[k]);
+                        optimized.time = tick2sec(get_tick() - t);
+                        optimized.success = !planner.getWayPoints().empty();
+                        optimized.countCollisionCheck = planner.countCollisionCheck() - count;
+                        optimized.timeCollisionCheck = planner.timeCollisionCheck() - time;
+                        optimized.length = pathLength(planner);
+                        optimized.numWayPoints = planner.getWayPoints().size();
+                        writeResult(output, scenario, algorithm, optimizers[k], seed, optimized);
+                        optimizerSummaries[k].add(optimized);
+                    }
+                }
+
+                writeSummary(summaryOutput, scenario, algorithm, "-", summary);
+                writeSummary(std::cout, scenario, algorithm, "-", summary);
+                for (int k=0; k<numOptimizers; k++) {
+                    writeSummary(summaryOutput, scenario, algorithm, optimizers[k], optimizerSummaries[k]);
+                    writeSummary(std::cout, scenario, algorithm, optimizers[k], optimizerSummaries[k]);
+                }
+            }
+        }
+        status = 0;
+    }
+    catch (OpenHRP::ModelLoader::ModelLoaderException& ex) {
+        std::cerr << "error: failed to load a model: " << ex.description << std::endl;
+    }
+    catch (CORBA::SystemException& ex) {
+        std::cerr << ex._rep_id() << std::endl;
+    }
+    catch (const std::string& error) {
+        std::cerr << error << std::endl;
+    }
+
+    try {
+        orb->destroy();
+    }
+    catch (...) {
+
+    }
+
+    return status;
+}
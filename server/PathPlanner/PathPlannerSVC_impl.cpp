@@ -68,6 +68,16 @@ void OpenHRP_PathPlannerSVC_impl::clearRoadmap()
     rm->clear();
 }
 
+CORBA::Boolean OpenHRP_PathPlannerSVC_impl::saveRoadmap(const char* filename)
+{
+    return path_->saveRoadmap(filename);
+}
+
+CORBA::Boolean OpenHRP_PathPlannerSVC_impl::loadRoadmap(const char* filename, CORBA::Boolean incremental)
+{
+    return path_->loadRoadmap(filename, incremental);
+}
+
 void OpenHRP_PathPlannerSVC_impl::getMobilityNames(OpenHRP::StringSequence_out mobilities)
 {
     mobilities = new OpenHRP::StringSequence;
@@ -43,6 +43,8 @@ public:
     void stopPlanning();
     void getRoadmap(OpenHRP::PathPlanner::Roadmap_out graph);
     void clearRoadmap();
+    CORBA::Boolean saveRoadmap(const char* filename);
+    CORBA::Boolean loadRoadmap(const char* filename, CORBA::Boolean incremental);
     void getMobilityNames(OpenHRP::StringSequence_out mobilities);
     void getOptimizerNames(OpenHRP::StringSequence_out optimizers);
     void setRobotName(const char* model);
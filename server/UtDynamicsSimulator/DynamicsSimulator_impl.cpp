@@ -273,6 +273,15 @@ void DynamicsSimulator_impl::registerCollisionCheckPair(
 	}
 }
 
+void DynamicsSimulator_impl::setCollisionCheckPairContactReduction(
+		const char *charName1,
+		const char *linkName1,
+		const char *charName2,
+		const char *linkName2,
+		CORBA::Short maxNumContactPoints)
+{
+}
+
 void DynamicsSimulator_impl::registerIntersectionCheckPair(
 		const char *charName1,
 		const char *linkName1,